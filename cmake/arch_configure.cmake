@@ -5,6 +5,8 @@ if(ARCHITECTURE STREQUAL "i386" OR ARCHITECTURE STREQUAL "x86_64")
     OPTION(X86_MMX "Enable MMX optimizations" OFF)
     OPTION(X86_SSE2 "Enable SSE2 optimizations" OFF)
     OPTION(X86_SSSE3 "Enable SSSE3 optimizations" OFF)
+    OPTION(X86_AVX2 "Enable AVX2 optimizations" OFF)
+    OPTION(X86_AVX512 "Enable AVX-512 optimizations" OFF)
 elseif(ARCHITECTURE STREQUAL "arm")
     SET(ARM 1)
     OPTION(ARM_IWMMXT "Enable IWMMXT compiler intrinsics" OFF)
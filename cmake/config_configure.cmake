@@ -91,6 +91,15 @@ if (X86_SSSE3)
         set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} -msse3 -mssse3")
     endif(CMAKE_COMPILER_IS_GNUCC)
 endif(X86_SSSE3)
+# AVX2 is only enabled for pixman-avx2.c, see pixman/CMakeLists.txt,
+# since the rest of the library must run on CPUs without it
+if (X86_AVX2)
+    set(USE_AVX2 1)
+endif(X86_AVX2)
+# Likewise for pixman-avx512.c
+if (X86_AVX512)
+    set(USE_AVX512 1)
+endif(X86_AVX512)
 
 configure_file( ${CMAKE_CURRENT_SOURCE_DIR}/cmake/config_source.cmake ${CMAKE_CURRENT_BINARY_DIR}/pixman/config.h )
 configure_file( ${CMAKE_CURRENT_SOURCE_DIR}/pixman/pixman-version.h.in ${CMAKE_CURRENT_BINARY_DIR}/pixman/pixman-version.h)
\ No newline at end of file
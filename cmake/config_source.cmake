@@ -148,6 +148,12 @@
 /* use SSSE3 compiler intrinsics */
 #cmakedefine USE_SSSE3 @USE_SSSE3@
 
+/* use AVX2 compiler intrinsics */
+#cmakedefine USE_AVX2 @USE_AVX2@
+
+/* use AVX-512 compiler intrinsics */
+#cmakedefine USE_AVX512 @USE_AVX512@
+
 /* use VMX compiler intrinsics */
 #cmakedefine USE_VMX @USE_VMX@
 
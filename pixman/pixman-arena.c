@@ -0,0 +1,219 @@
+/*
+ * Copyright © 2026 The pixman authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Per-thread scanline buffers
+ *
+ * Each thread has an arena that scanline buffers are taken from, in
+ * stack order. The arena only grows, and only when no buffers are in
+ * use, so a buffer that doesn't fit while others are in use comes from
+ * the heap instead, and the arena grows enough to hold it next time.
+ *
+ * Wide buffers must not contain NaNs. The arena remembers how much of
+ * its start is known to hold floats only, so wide buffers only need to
+ * be cleared the first time that memory is used for them.
+ *
+ * The arena is freed when the thread exits where threads have
+ * destructors for their data, and by pixman_trim_scanline_arena().
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include "pixman-private.h"
+
+#define ARENA_ALIGN(n)		(((n) + 15) & ~(size_t)15)
+#define ARENA_MIN_SIZE		(64 * 1024)
+
+typedef struct
+{
+    void *	allocation;
+    uint8_t *	data;
+    size_t	size;
+    size_t	used;
+    size_t	clean;
+    size_t	wanted;
+    int		n_blocks;
+} scanline_arena_t;
+
+PIXMAN_DEFINE_THREAD_LOCAL (scanline_arena_t, scanline_arena);
+
+#if defined(HAVE_PTHREADS) && !defined(PIXMAN_NO_TLS) && !defined(_WIN32)
+
+#include <pthread.h>
+
+#define ARENA_THREAD_EXIT
+
+/* The key only holds the allocation, so that it is freed on thread exit
+ * no matter how the arena itself is stored.
+ */
+static pthread_once_t arena_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t arena_key;
+static pixman_bool_t arena_key_valid;
+
+static void
+arena_make_key (void)
+{
+    arena_key_valid = pthread_key_create (&arena_key, free) == 0;
+}
+
+static void
+arena_set_allocation (void *allocation)
+{
+    if (pthread_once (&arena_key_once, arena_make_key) == 0 && arena_key_valid)
+	pthread_setspecific (arena_key, allocation);
+}
+
+#else
+
+static void
+arena_set_allocation (void *allocation)
+{
+}
+
+#endif
+
+static pixman_bool_t
+arena_grow (scanline_arena_t *arena, size_t size)
+{
+    void *allocation;
+
+    if (size < ARENA_MIN_SIZE)
+	size = ARENA_MIN_SIZE;
+
+    if (size > INT32_MAX)
+	return FALSE;
+
+    if (!(allocation = malloc (size + 15)))
+	return FALSE;
+
+    free (arena->allocation);
+
+    arena->allocation = allocation;
+    arena->data = (uint8_t *)ARENA_ALIGN ((uintptr_t)allocation);
+    arena->size = size;
+    arena->clean = 0;
+
+    arena_set_allocation (allocation);
+
+    return TRUE;
+}
+
+void *
+_pixman_scanline_arena_alloc (size_t size, uint32_t flags)
+{
+    scanline_arena_t *arena = PIXMAN_GET_THREAD_LOCAL (scanline_arena);
+    uint8_t *block;
+
+    size = ARENA_ALIGN (size);
+
+    if (!arena)
+	goto heap;
+
+    if (arena->n_blocks == 0)
+    {
+	size_t needed = arena->wanted > size ? arena->wanted : size;
+
+	if (needed > arena->size && !arena_grow (arena, needed))
+	    goto heap;
+    }
+    else if (arena->used + size > arena->size)
+    {
+	if (arena->wanted < arena->used + size)
+	    arena->wanted = arena->used + size;
+
+	goto heap;
+    }
+
+    block = arena->data + arena->used;
+
+    if (flags & SCANLINE_ARENA_FLOATS)
+    {
+	if (arena->used <= arena->clean)
+	{
+	    if (arena->used + size > arena->clean)
+	    {
+		memset (arena->data + arena->clean, 0,
+			arena->used + size - arena->clean);
+		arena->clean = arena->used + size;
+	    }
+	}
+	else
+	{
+	    memset (block, 0, size);
+	}
+    }
+    else if (arena->clean > arena->used)
+    {
+	arena->clean = arena->used;
+    }
+
+    arena->used += size;
+    arena->n_blocks++;
+
+    return block;
+
+heap:
+    if (flags & SCANLINE_ARENA_FLOATS)
+	return calloc (1, size);
+    else
+	return malloc (size);
+}
+
+void
+_pixman_scanline_arena_free (void *block)
+{
+    scanline_arena_t *arena = PIXMAN_GET_THREAD_LOCAL (scanline_arena);
+
+    if (!arena || !arena->n_blocks ||
+	(uint8_t *)block < arena->data ||
+	(uint8_t *)block >= arena->data + arena->size)
+    {
+	free (block);
+	return;
+    }
+
+    if (--arena->n_blocks == 0)
+	arena->used = 0;
+}
+
+PIXMAN_EXPORT void
+pixman_trim_scanline_arena (void)
+{
+    scanline_arena_t *arena = PIXMAN_GET_THREAD_LOCAL (scanline_arena);
+
+    if (!arena || arena->n_blocks)
+	return;
+
+    free (arena->allocation);
+
+    arena->allocation = NULL;
+    arena->data = NULL;
+    arena->size = 0;
+    arena->used = 0;
+    arena->clean = 0;
+    arena->wanted = 0;
+
+    arena_set_allocation (NULL);
+}
@@ -0,0 +1,951 @@
+/*
+ * Copyright © 2008 Rodrigo Kumpera
+ * Copyright © 2008 André Tupinambá
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of Red Hat not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  Red Hat makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as is"
+ * without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+ * SOFTWARE.
+ *
+ * Based on the SSE2 implementation in pixman-sse2.c. The arithmetic
+ * is identical, it just operates on eight pixels at a time.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <immintrin.h> /* for AVX2 intrinsics */
+#include "pixman-private.h"
+#include "pixman-combine32.h"
+
+static __m256i mask_0080;
+static __m256i mask_00ff;
+static __m256i mask_0101;
+static __m256i mask_ff000000;
+static __m256i mask_expand_a8;
+
+/* Note that the 256 bit unpack and pack instructions operate on
+ * each 128 bit lane separately, so the "lo" half of an unpacked
+ * vector holds pixels 0, 1, 4, 5 and the "hi" half holds 2, 3, 6, 7.
+ * Packing them back with _mm256_packus_epi16() restores the
+ * original order, so as long as all operands are unpacked the same
+ * way, the pixel order never matters.
+ */
+static force_inline void
+unpack_256_2x256 (__m256i data, __m256i *data_lo, __m256i *data_hi)
+{
+    *data_lo = _mm256_unpacklo_epi8 (data, _mm256_setzero_si256 ());
+    *data_hi = _mm256_unpackhi_epi8 (data, _mm256_setzero_si256 ());
+}
+
+static force_inline __m256i
+pack_2x256_256 (__m256i lo, __m256i hi)
+{
+    return _mm256_packus_epi16 (lo, hi);
+}
+
+static force_inline __m256i
+load_256_aligned (const __m256i *src)
+{
+    return _mm256_load_si256 (src);
+}
+
+static force_inline __m256i
+load_256_unaligned (const __m256i *src)
+{
+    return _mm256_loadu_si256 (src);
+}
+
+static force_inline void
+save_256_aligned (__m256i *dst, __m256i data)
+{
+    _mm256_store_si256 (dst, data);
+}
+
+static force_inline int
+is_opaque_256 (__m256i x)
+{
+    __m256i ffs = _mm256_cmpeq_epi8 (x, x);
+
+    return ((uint32_t)_mm256_movemask_epi8 (
+		_mm256_cmpeq_epi8 (x, ffs)) & 0x88888888) == 0x88888888;
+}
+
+static force_inline int
+is_zero_256 (__m256i x)
+{
+    return _mm256_testz_si256 (x, x);
+}
+
+static force_inline int
+is_transparent_256 (__m256i x)
+{
+    return ((uint32_t)_mm256_movemask_epi8 (
+		_mm256_cmpeq_epi8 (x, _mm256_setzero_si256 ())) & 0x88888888) == 0x88888888;
+}
+
+static force_inline __m256i
+expand_alpha_1x256 (__m256i data)
+{
+    return _mm256_shufflehi_epi16 (
+	_mm256_shufflelo_epi16 (data, _MM_SHUFFLE (3, 3, 3, 3)),
+	_MM_SHUFFLE (3, 3, 3, 3));
+}
+
+static force_inline __m256i
+negate_1x256 (__m256i data)
+{
+    return _mm256_xor_si256 (data, mask_00ff);
+}
+
+static force_inline __m256i
+pix_multiply_1x256 (__m256i data, __m256i alpha)
+{
+    return _mm256_mulhi_epu16 (
+	_mm256_adds_epu16 (_mm256_mullo_epi16 (data, alpha), mask_0080),
+	mask_0101);
+}
+
+static force_inline __m256i
+pix_add_multiply_1x256 (__m256i src, __m256i alpha_dst,
+			__m256i dst, __m256i alpha_src)
+{
+    return _mm256_adds_epu8 (pix_multiply_1x256 (src, alpha_dst),
+			     pix_multiply_1x256 (dst, alpha_src));
+}
+
+static force_inline __m256i
+over_1x256 (__m256i src, __m256i alpha, __m256i dst)
+{
+    return _mm256_adds_epu8 (
+	src, pix_multiply_1x256 (dst, negate_1x256 (alpha)));
+}
+
+static force_inline __m256i
+in_over_1x256 (__m256i src, __m256i alpha, __m256i mask, __m256i dst)
+{
+    return over_1x256 (pix_multiply_1x256 (src, mask),
+		       pix_multiply_1x256 (alpha, mask),
+		       dst);
+}
+
+/* Load eight source pixels and multiply them by the alpha
+ * channel of the corresponding mask pixels, if any.
+ */
+static force_inline __m256i
+combine8 (const uint32_t *ps, const uint32_t *pm)
+{
+    __m256i s, m;
+    __m256i s_lo, s_hi, m_lo, m_hi;
+
+    if (pm)
+    {
+	m = load_256_unaligned ((const __m256i *)pm);
+
+	if (is_transparent_256 (m))
+	    return _mm256_setzero_si256 ();
+    }
+
+    s = load_256_unaligned ((const __m256i *)ps);
+
+    if (pm)
+    {
+	unpack_256_2x256 (s, &s_lo, &s_hi);
+	unpack_256_2x256 (m, &m_lo, &m_hi);
+
+	s_lo = pix_multiply_1x256 (s_lo, expand_alpha_1x256 (m_lo));
+	s_hi = pix_multiply_1x256 (s_hi, expand_alpha_1x256 (m_hi));
+
+	s = pack_2x256_256 (s_lo, s_hi);
+    }
+
+    return s;
+}
+
+/* The single pixel versions used for the unaligned heads and tails
+ * of a scanline. They use the same rounding as the vector code, so
+ * results do not depend on alignment.
+ */
+static force_inline uint32_t
+combine1 (const uint32_t *ps, const uint32_t *pm)
+{
+    uint32_t s = *ps;
+
+    if (pm)
+    {
+	uint32_t m = ALPHA_8 (*pm);
+
+	UN8x4_MUL_UN8 (s, m);
+    }
+
+    return s;
+}
+
+static force_inline uint32_t
+over_1x32 (uint32_t s, uint32_t d)
+{
+    uint32_t a = ALPHA_8 (s);
+
+    if (a == 0xff)
+	return s;
+
+    if (s)
+	UN8x4_MUL_UN8_ADD_UN8x4 (d, a ^ 0xff, s);
+
+    return d;
+}
+
+static force_inline uint32_t
+over_reverse_1x32 (uint32_t s, uint32_t d)
+{
+    UN8x4_MUL_UN8_ADD_UN8x4 (s, ALPHA_8 (~d), d);
+
+    return s;
+}
+
+static force_inline uint32_t
+in_1x32 (uint32_t s, uint32_t d)
+{
+    UN8x4_MUL_UN8 (s, ALPHA_8 (d));
+
+    return s;
+}
+
+static force_inline uint32_t
+in_reverse_1x32 (uint32_t s, uint32_t d)
+{
+    UN8x4_MUL_UN8 (d, ALPHA_8 (s));
+
+    return d;
+}
+
+static force_inline uint32_t
+out_1x32 (uint32_t s, uint32_t d)
+{
+    UN8x4_MUL_UN8 (s, ALPHA_8 (~d));
+
+    return s;
+}
+
+static force_inline uint32_t
+out_reverse_1x32 (uint32_t s, uint32_t d)
+{
+    UN8x4_MUL_UN8 (d, ALPHA_8 (~s));
+
+    return d;
+}
+
+static force_inline uint32_t
+atop_1x32 (uint32_t s, uint32_t d)
+{
+    uint32_t dest_a = ALPHA_8 (d);
+    uint32_t src_ia = ALPHA_8 (~s);
+
+    UN8x4_MUL_UN8_ADD_UN8x4_MUL_UN8 (s, dest_a, d, src_ia);
+
+    return s;
+}
+
+static force_inline uint32_t
+atop_reverse_1x32 (uint32_t s, uint32_t d)
+{
+    uint32_t src_a = ALPHA_8 (s);
+    uint32_t dest_ia = ALPHA_8 (~d);
+
+    UN8x4_MUL_UN8_ADD_UN8x4_MUL_UN8 (s, dest_ia, d, src_a);
+
+    return s;
+}
+
+static force_inline uint32_t
+xor_1x32 (uint32_t s, uint32_t d)
+{
+    uint32_t src_ia = ALPHA_8 (~s);
+    uint32_t dest_ia = ALPHA_8 (~d);
+
+    UN8x4_MUL_UN8_ADD_UN8x4_MUL_UN8 (s, dest_ia, d, src_ia);
+
+    return s;
+}
+
+static force_inline uint32_t
+add_1x32 (uint32_t s, uint32_t d)
+{
+    UN8x4_ADD_UN8x4 (d, s);
+
+    return d;
+}
+
+/* The vector versions of the above, operating on unpacked pixels */
+static force_inline __m256i
+over_reverse_1x256 (__m256i s, __m256i d)
+{
+    return over_1x256 (d, expand_alpha_1x256 (d), s);
+}
+
+static force_inline __m256i
+in_1x256 (__m256i s, __m256i d)
+{
+    return pix_multiply_1x256 (s, expand_alpha_1x256 (d));
+}
+
+static force_inline __m256i
+in_reverse_1x256 (__m256i s, __m256i d)
+{
+    return pix_multiply_1x256 (d, expand_alpha_1x256 (s));
+}
+
+static force_inline __m256i
+out_1x256 (__m256i s, __m256i d)
+{
+    return pix_multiply_1x256 (s, negate_1x256 (expand_alpha_1x256 (d)));
+}
+
+static force_inline __m256i
+out_reverse_1x256 (__m256i s, __m256i d)
+{
+    return pix_multiply_1x256 (d, negate_1x256 (expand_alpha_1x256 (s)));
+}
+
+static force_inline __m256i
+atop_1x256 (__m256i s, __m256i d)
+{
+    return pix_add_multiply_1x256 (
+	s, expand_alpha_1x256 (d),
+	d, negate_1x256 (expand_alpha_1x256 (s)));
+}
+
+static force_inline __m256i
+atop_reverse_1x256 (__m256i s, __m256i d)
+{
+    return pix_add_multiply_1x256 (
+	s, negate_1x256 (expand_alpha_1x256 (d)),
+	d, expand_alpha_1x256 (s));
+}
+
+static force_inline __m256i
+xor_1x256 (__m256i s, __m256i d)
+{
+    return pix_add_multiply_1x256 (
+	s, negate_1x256 (expand_alpha_1x256 (d)),
+	d, negate_1x256 (expand_alpha_1x256 (s)));
+}
+
+static void
+avx2_combine_over_u (pixman_implementation_t *imp,
+		     pixman_op_t              op,
+		     uint32_t *               pd,
+		     const uint32_t *         ps,
+		     const uint32_t *         pm,
+		     int                      w)
+{
+    /* Align dst on a 32-byte boundary */
+    while (w && ((uintptr_t)pd & 31))
+    {
+	*pd = over_1x32 (combine1 (ps, pm), *pd);
+	pd++;
+	ps++;
+	if (pm)
+	    pm++;
+	w--;
+    }
+
+    while (w >= 8)
+    {
+	__m256i src = combine8 (ps, pm);
+
+	if (is_opaque_256 (src))
+	{
+	    save_256_aligned ((__m256i *)pd, src);
+	}
+	else if (!is_zero_256 (src))
+	{
+	    __m256i src_lo, src_hi, dst_lo, dst_hi;
+
+	    unpack_256_2x256 (src, &src_lo, &src_hi);
+	    unpack_256_2x256 (load_256_aligned ((__m256i *)pd),
+			      &dst_lo, &dst_hi);
+
+	    dst_lo = over_1x256 (src_lo, expand_alpha_1x256 (src_lo), dst_lo);
+	    dst_hi = over_1x256 (src_hi, expand_alpha_1x256 (src_hi), dst_hi);
+
+	    save_256_aligned ((__m256i *)pd, pack_2x256_256 (dst_lo, dst_hi));
+	}
+
+	pd += 8;
+	ps += 8;
+	if (pm)
+	    pm += 8;
+	w -= 8;
+    }
+
+    while (w)
+    {
+	*pd = over_1x32 (combine1 (ps, pm), *pd);
+	pd++;
+	ps++;
+	if (pm)
+	    pm++;
+	w--;
+    }
+}
+
+static void
+avx2_combine_add_u (pixman_implementation_t *imp,
+		    pixman_op_t              op,
+		    uint32_t *               pd,
+		    const uint32_t *         ps,
+		    const uint32_t *         pm,
+		    int                      w)
+{
+    while (w && ((uintptr_t)pd & 31))
+    {
+	*pd = add_1x32 (combine1 (ps, pm), *pd);
+	pd++;
+	ps++;
+	if (pm)
+	    pm++;
+	w--;
+    }
+
+    while (w >= 8)
+    {
+	save_256_aligned (
+	    (__m256i *)pd, _mm256_adds_epu8 (
+		combine8 (ps, pm), load_256_aligned ((__m256i *)pd)));
+
+	pd += 8;
+	ps += 8;
+	if (pm)
+	    pm += 8;
+	w -= 8;
+    }
+
+    while (w)
+    {
+	*pd = add_1x32 (combine1 (ps, pm), *pd);
+	pd++;
+	ps++;
+	if (pm)
+	    pm++;
+	w--;
+    }
+}
+
+/* The remaining unified alpha combiners all have the same shape:
+ * a scalar head until the destination is aligned, an eight pixel
+ * vector loop and a scalar tail.
+ */
+#define AVX2_COMBINE_U(name)						\
+    static void								\
+    avx2_combine_ ## name ## _u (pixman_implementation_t *imp,		\
+				 pixman_op_t              op,		\
+				 uint32_t *               pd,		\
+				 const uint32_t *         ps,		\
+				 const uint32_t *         pm,		\
+				 int                      w)		\
+    {									\
+	while (w && ((uintptr_t)pd & 31))				\
+	{								\
+	    *pd = name ## _1x32 (combine1 (ps, pm), *pd);		\
+	    pd++;							\
+	    ps++;							\
+	    if (pm)							\
+		pm++;							\
+	    w--;							\
+	}								\
+									\
+	while (w >= 8)							\
+	{								\
+	    __m256i src_lo, src_hi, dst_lo, dst_hi;			\
+									\
+	    unpack_256_2x256 (combine8 (ps, pm), &src_lo, &src_hi);	\
+	    unpack_256_2x256 (load_256_aligned ((__m256i *)pd),		\
+			      &dst_lo, &dst_hi);			\
+									\
+	    save_256_aligned (						\
+		(__m256i *)pd,						\
+		pack_2x256_256 (name ## _1x256 (src_lo, dst_lo),	\
+				name ## _1x256 (src_hi, dst_hi)));	\
+									\
+	    pd += 8;							\
+	    ps += 8;							\
+	    if (pm)							\
+		pm += 8;						\
+	    w -= 8;							\
+	}								\
+									\
+	while (w)							\
+	{								\
+	    *pd = name ## _1x32 (combine1 (ps, pm), *pd);		\
+	    pd++;							\
+	    ps++;							\
+	    if (pm)							\
+		pm++;							\
+	    w--;							\
+	}								\
+    }
+
+AVX2_COMBINE_U (over_reverse)
+AVX2_COMBINE_U (in)
+AVX2_COMBINE_U (in_reverse)
+AVX2_COMBINE_U (out)
+AVX2_COMBINE_U (out_reverse)
+AVX2_COMBINE_U (atop)
+AVX2_COMBINE_U (atop_reverse)
+AVX2_COMBINE_U (xor)
+
+static void
+avx2_composite_over_8888_8888 (pixman_implementation_t *imp,
+			       pixman_composite_info_t *info)
+{
+    PIXMAN_COMPOSITE_ARGS (info);
+    int dst_stride, src_stride;
+    uint32_t *dst_line;
+    uint32_t *src_line;
+
+    PIXMAN_IMAGE_GET_LINE (
+	dest_image, dest_x, dest_y, uint32_t, dst_stride, dst_line, 1);
+    PIXMAN_IMAGE_GET_LINE (
+	src_image, src_x, src_y, uint32_t, src_stride, src_line, 1);
+
+    while (height--)
+    {
+	avx2_combine_over_u (imp, op, dst_line, src_line, NULL, width);
+
+	dst_line += dst_stride;
+	src_line += src_stride;
+    }
+}
+
+static void
+avx2_composite_add_8888_8888 (pixman_implementation_t *imp,
+			      pixman_composite_info_t *info)
+{
+    PIXMAN_COMPOSITE_ARGS (info);
+    int dst_stride, src_stride;
+    uint32_t *dst_line;
+    uint32_t *src_line;
+
+    PIXMAN_IMAGE_GET_LINE (
+	src_image, src_x, src_y, uint32_t, src_stride, src_line, 1);
+    PIXMAN_IMAGE_GET_LINE (
+	dest_image, dest_x, dest_y, uint32_t, dst_stride, dst_line, 1);
+
+    while (height--)
+    {
+	avx2_combine_add_u (imp, op, dst_line, src_line, NULL, width);
+
+	dst_line += dst_stride;
+	src_line += src_stride;
+    }
+}
+
+static void
+avx2_composite_src_x888_8888 (pixman_implementation_t *imp,
+			      pixman_composite_info_t *info)
+{
+    PIXMAN_COMPOSITE_ARGS (info);
+    uint32_t *dst_line, *dst;
+    uint32_t *src_line, *src;
+    int dst_stride, src_stride;
+    int32_t w;
+
+    PIXMAN_IMAGE_GET_LINE (
+	dest_image, dest_x, dest_y, uint32_t, dst_stride, dst_line, 1);
+    PIXMAN_IMAGE_GET_LINE (
+	src_image, src_x, src_y, uint32_t, src_stride, src_line, 1);
+
+    while (height--)
+    {
+	dst = dst_line;
+	dst_line += dst_stride;
+	src = src_line;
+	src_line += src_stride;
+	w = width;
+
+	while (w && (uintptr_t)dst & 31)
+	{
+	    *dst++ = *src++ | 0xff000000;
+	    w--;
+	}
+
+	while (w >= 32)
+	{
+	    __m256i s0, s1, s2, s3;
+
+	    s0 = load_256_unaligned ((__m256i *)src + 0);
+	    s1 = load_256_unaligned ((__m256i *)src + 1);
+	    s2 = load_256_unaligned ((__m256i *)src + 2);
+	    s3 = load_256_unaligned ((__m256i *)src + 3);
+
+	    save_256_aligned ((__m256i *)dst + 0, _mm256_or_si256 (s0, mask_ff000000));
+	    save_256_aligned ((__m256i *)dst + 1, _mm256_or_si256 (s1, mask_ff000000));
+	    save_256_aligned ((__m256i *)dst + 2, _mm256_or_si256 (s2, mask_ff000000));
+	    save_256_aligned ((__m256i *)dst + 3, _mm256_or_si256 (s3, mask_ff000000));
+
+	    dst += 32;
+	    src += 32;
+	    w -= 32;
+	}
+
+	while (w >= 8)
+	{
+	    save_256_aligned (
+		(__m256i *)dst, _mm256_or_si256 (
+		    load_256_unaligned ((__m256i *)src), mask_ff000000));
+
+	    dst += 8;
+	    src += 8;
+	    w -= 8;
+	}
+
+	while (w)
+	{
+	    *dst++ = *src++ | 0xff000000;
+	    w--;
+	}
+    }
+}
+
+static force_inline uint32_t
+in_over_1x32 (uint32_t src, uint32_t m, uint32_t dst)
+{
+    UN8x4_MUL_UN8 (src, m);
+    UN8x4_MUL_UN8_ADD_UN8x4 (dst, ALPHA_8 (~src), src);
+
+    return dst;
+}
+
+static void
+avx2_composite_over_n_8_8888 (pixman_implementation_t *imp,
+			      pixman_composite_info_t *info)
+{
+    PIXMAN_COMPOSITE_ARGS (info);
+    uint32_t src, srca;
+    uint32_t *dst_line, *dst;
+    uint8_t *mask_line, *mask;
+    int dst_stride, mask_stride;
+    int32_t w;
+    uint64_t m;
+
+    __m256i vsrc, valpha, vdef;
+
+    src = _pixman_image_get_solid (imp, src_image, dest_image->bits.format);
+
+    srca = src >> 24;
+    if (src == 0)
+	return;
+
+    PIXMAN_IMAGE_GET_LINE (
+	dest_image, dest_x, dest_y, uint32_t, dst_stride, dst_line, 1);
+    PIXMAN_IMAGE_GET_LINE (
+	mask_image, mask_x, mask_y, uint8_t, mask_stride, mask_line, 1);
+
+    vdef = _mm256_set1_epi32 (src);
+    vsrc = _mm256_unpacklo_epi8 (vdef, _mm256_setzero_si256 ());
+    valpha = expand_alpha_1x256 (vsrc);
+
+    while (height--)
+    {
+	dst = dst_line;
+	dst_line += dst_stride;
+	mask = mask_line;
+	mask_line += mask_stride;
+	w = width;
+
+	while (w && (uintptr_t)dst & 31)
+	{
+	    uint8_t a = *mask++;
+
+	    if (a)
+		*dst = in_over_1x32 (src, a, *dst);
+
+	    w--;
+	    dst++;
+	}
+
+	while (w >= 8)
+	{
+	    memcpy (&m, mask, sizeof (m));
+
+	    if (srca == 0xff && m == ~(uint64_t)0)
+	    {
+		save_256_aligned ((__m256i *)dst, vdef);
+	    }
+	    else if (m)
+	    {
+		__m256i vmask, vmask_lo, vmask_hi, vdst_lo, vdst_hi;
+
+		/* Widen the eight mask bytes to one byte per channel */
+		vmask = _mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((__m128i *)mask));
+		vmask = _mm256_shuffle_epi8 (vmask, mask_expand_a8);
+
+		unpack_256_2x256 (vmask, &vmask_lo, &vmask_hi);
+		unpack_256_2x256 (load_256_aligned ((__m256i *)dst),
+				  &vdst_lo, &vdst_hi);
+
+		vdst_lo = in_over_1x256 (vsrc, valpha, vmask_lo, vdst_lo);
+		vdst_hi = in_over_1x256 (vsrc, valpha, vmask_hi, vdst_hi);
+
+		save_256_aligned ((__m256i *)dst, pack_2x256_256 (vdst_lo, vdst_hi));
+	    }
+
+	    w -= 8;
+	    dst += 8;
+	    mask += 8;
+	}
+
+	while (w)
+	{
+	    uint8_t a = *mask++;
+
+	    if (a)
+		*dst = in_over_1x32 (src, a, *dst);
+
+	    w--;
+	    dst++;
+	}
+    }
+}
+
+static const pixman_fast_path_t avx2_fast_paths[] =
+{
+    /* PIXMAN_OP_OVER */
+    PIXMAN_STD_FAST_PATH (OVER, solid, a8, a8r8g8b8, avx2_composite_over_n_8_8888),
+    PIXMAN_STD_FAST_PATH (OVER, solid, a8, x8r8g8b8, avx2_composite_over_n_8_8888),
+    PIXMAN_STD_FAST_PATH (OVER, solid, a8, a8b8g8r8, avx2_composite_over_n_8_8888),
+    PIXMAN_STD_FAST_PATH (OVER, solid, a8, x8b8g8r8, avx2_composite_over_n_8_8888),
+    PIXMAN_STD_FAST_PATH (OVER, a8r8g8b8, null, a8r8g8b8, avx2_composite_over_8888_8888),
+    PIXMAN_STD_FAST_PATH (OVER, a8r8g8b8, null, x8r8g8b8, avx2_composite_over_8888_8888),
+    PIXMAN_STD_FAST_PATH (OVER, a8b8g8r8, null, a8b8g8r8, avx2_composite_over_8888_8888),
+    PIXMAN_STD_FAST_PATH (OVER, a8b8g8r8, null, x8b8g8r8, avx2_composite_over_8888_8888),
+
+    /* PIXMAN_OP_ADD */
+    PIXMAN_STD_FAST_PATH (ADD, a8r8g8b8, null, a8r8g8b8, avx2_composite_add_8888_8888),
+    PIXMAN_STD_FAST_PATH (ADD, a8b8g8r8, null, a8b8g8r8, avx2_composite_add_8888_8888),
+
+    /* PIXMAN_OP_SRC */
+    PIXMAN_STD_FAST_PATH (SRC, x8r8g8b8, null, a8r8g8b8, avx2_composite_src_x888_8888),
+    PIXMAN_STD_FAST_PATH (SRC, x8b8g8r8, null, a8b8g8r8, avx2_composite_src_x888_8888),
+
+    { PIXMAN_OP_NONE },
+};
+
+static uint32_t *
+avx2_fetch_x8r8g8b8 (pixman_iter_t *iter, const uint32_t *mask)
+{
+    int w = iter->width;
+    uint32_t *dst = iter->buffer;
+    uint32_t *src = (uint32_t *)iter->bits;
+
+    iter->bits += iter->stride;
+
+    while (w && ((uintptr_t)dst) & 31)
+    {
+	*dst++ = (*src++) | 0xff000000;
+	w--;
+    }
+
+    while (w >= 8)
+    {
+	save_256_aligned (
+	    (__m256i *)dst, _mm256_or_si256 (
+		load_256_unaligned ((__m256i *)src), mask_ff000000));
+
+	dst += 8;
+	src += 8;
+	w -= 8;
+    }
+
+    while (w)
+    {
+	*dst++ = (*src++) | 0xff000000;
+	w--;
+    }
+
+    return iter->buffer;
+}
+
+static uint32_t *
+avx2_fetch_a8 (pixman_iter_t *iter, const uint32_t *mask)
+{
+    int w = iter->width;
+    uint32_t *dst = iter->buffer;
+    uint8_t *src = iter->bits;
+
+    iter->bits += iter->stride;
+
+    while (w && ((uintptr_t)dst) & 31)
+    {
+	*dst++ = *(src++) << 24;
+	w--;
+    }
+
+    while (w >= 16)
+    {
+	__m128i s = _mm_loadu_si128 ((__m128i *)src);
+
+	save_256_aligned ((__m256i *)(dst + 0),
+			  _mm256_slli_epi32 (_mm256_cvtepu8_epi32 (s), 24));
+	save_256_aligned ((__m256i *)(dst + 8),
+			  _mm256_slli_epi32 (_mm256_cvtepu8_epi32 (
+						 _mm_srli_si128 (s, 8)), 24));
+
+	dst += 16;
+	src += 16;
+	w -= 16;
+    }
+
+    while (w)
+    {
+	*dst++ = *(src++) << 24;
+	w--;
+    }
+
+    return iter->buffer;
+}
+
+static force_inline void
+avx2_add_row (uint8_t *dst, const uint8_t *src, int w)
+{
+    while (w >= 32)
+    {
+	_mm256_storeu_si256 ((__m256i *)dst,
+			     _mm256_adds_epu8 (_mm256_loadu_si256 ((__m256i *)src),
+					       _mm256_loadu_si256 ((__m256i *)dst)));
+	src += 32;
+	dst += 32;
+	w -= 32;
+    }
+
+    if (w >= 16)
+    {
+	_mm_storeu_si128 ((__m128i *)dst,
+			  _mm_adds_epu8 (_mm_loadu_si128 ((__m128i *)src),
+					 _mm_loadu_si128 ((__m128i *)dst)));
+	src += 16;
+	dst += 16;
+	w -= 16;
+    }
+
+    if (w >= 8)
+    {
+	_mm_storel_epi64 ((__m128i *)dst,
+			  _mm_adds_epu8 (_mm_loadl_epi64 ((__m128i *)src),
+					 _mm_loadl_epi64 ((__m128i *)dst)));
+	src += 8;
+	dst += 8;
+	w -= 8;
+    }
+
+    if (w >= 4)
+    {
+	*(uint32_t *)dst = _mm_cvtsi128_si32 (
+	    _mm_adds_epu8 (_mm_cvtsi32_si128 (*(uint32_t *)src),
+			   _mm_cvtsi32_si128 (*(uint32_t *)dst)));
+	src += 4;
+	dst += 4;
+	w -= 4;
+    }
+
+    while (w--)
+    {
+	uint16_t t = *dst + *src++;
+
+	*dst++ = t | (0 - (t >> 8));
+    }
+}
+
+static pixman_bool_t
+avx2_add_glyphs (pixman_implementation_t   *imp,
+		 int                        dest_stride,
+		 int                        n_blits,
+		 const pixman_glyph_blit_t *blits)
+{
+    int i;
+
+    for (i = 0; i < n_blits; ++i)
+    {
+	const uint8_t *src = blits[i].src;
+	uint8_t *dst = blits[i].dest;
+	int height = blits[i].height;
+
+	while (height--)
+	{
+	    avx2_add_row (dst, src, blits[i].width);
+
+	    src += blits[i].src_stride;
+	    dst += dest_stride;
+	}
+    }
+
+    return TRUE;
+}
+
+#define IMAGE_FLAGS							\
+    (FAST_PATH_STANDARD_FLAGS | FAST_PATH_ID_TRANSFORM |		\
+     FAST_PATH_BITS_IMAGE | FAST_PATH_SAMPLES_COVER_CLIP_NEAREST)
+
+static const pixman_iter_info_t avx2_iters[] =
+{
+    { PIXMAN_x8r8g8b8, IMAGE_FLAGS, ITER_NARROW,
+      _pixman_iter_init_bits_stride, avx2_fetch_x8r8g8b8, NULL
+    },
+    { PIXMAN_a8, IMAGE_FLAGS, ITER_NARROW,
+      _pixman_iter_init_bits_stride, avx2_fetch_a8, NULL
+    },
+    { PIXMAN_null },
+};
+
+#if defined(__GNUC__) && !defined(__x86_64__) && !defined(__amd64__)
+__attribute__((__force_align_arg_pointer__))
+#endif
+pixman_implementation_t *
+_pixman_implementation_create_avx2 (pixman_implementation_t *fallback)
+{
+    pixman_implementation_t *imp = _pixman_implementation_create (fallback, avx2_fast_paths);
+
+    imp->name = "avx2";
+
+    /* AVX2 constants */
+    mask_0080 = _mm256_set1_epi16 (0x0080);
+    mask_00ff = _mm256_set1_epi16 (0x00ff);
+    mask_0101 = _mm256_set1_epi16 (0x0101);
+    mask_ff000000 = _mm256_set1_epi32 (0xff000000);
+    mask_expand_a8 = _mm256_set_epi8 (12, 12, 12, 12, 8, 8, 8, 8,
+				      4, 4, 4, 4, 0, 0, 0, 0,
+				      12, 12, 12, 12, 8, 8, 8, 8,
+				      4, 4, 4, 4, 0, 0, 0, 0);
+
+    /* Set up function pointers */
+    imp->combine_32[PIXMAN_OP_OVER] = avx2_combine_over_u;
+    imp->combine_32[PIXMAN_OP_OVER_REVERSE] = avx2_combine_over_reverse_u;
+    imp->combine_32[PIXMAN_OP_IN] = avx2_combine_in_u;
+    imp->combine_32[PIXMAN_OP_IN_REVERSE] = avx2_combine_in_reverse_u;
+    imp->combine_32[PIXMAN_OP_OUT] = avx2_combine_out_u;
+    imp->combine_32[PIXMAN_OP_OUT_REVERSE] = avx2_combine_out_reverse_u;
+    imp->combine_32[PIXMAN_OP_ATOP] = avx2_combine_atop_u;
+    imp->combine_32[PIXMAN_OP_ATOP_REVERSE] = avx2_combine_atop_reverse_u;
+    imp->combine_32[PIXMAN_OP_XOR] = avx2_combine_xor_u;
+    imp->combine_32[PIXMAN_OP_ADD] = avx2_combine_add_u;
+
+    imp->iter_info = avx2_iters;
+    imp->add_glyphs = avx2_add_glyphs;
+
+    return imp;
+}
@@ -0,0 +1,754 @@
+/*
+ * Copyright © 2008 Rodrigo Kumpera
+ * Copyright © 2008 André Tupinambá
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of Red Hat not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  Red Hat makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as is"
+ * without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+ * SOFTWARE.
+ *
+ *
+ * Based on the SSE2 implementation in pixman-sse2.c. The arithmetic
+ * is identical, but it operates on sixteen pixels at a time and uses
+ * AVX-512 mask registers for the ends of a scanline, so there are no
+ * scalar head and tail loops.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <immintrin.h> /* for AVX-512 intrinsics */
+#include "pixman-private.h"
+#include "pixman-combine32.h"
+
+static __m512i mask_0080;
+static __m512i mask_0101;
+static __m512i mask_00ff;
+static __m512i mask_ff000000;
+static __m512i mask_expand_a8;
+
+/* Masks selecting the first @n elements of a vector. @n must be
+ * smaller than the number of elements.
+ */
+static force_inline __mmask16
+first_n_16 (int n)
+{
+    return (__mmask16)((1u << n) - 1);
+}
+
+static force_inline __mmask64
+first_n_64 (int n)
+{
+    return (__mmask64)((((uint64_t)1) << n) - 1);
+}
+
+/* Number of bytes before @p reaches a 64 byte boundary */
+static force_inline int
+bytes_to_align_64 (const void *p)
+{
+    return (64 - ((uintptr_t)p & 63)) & 63;
+}
+
+/* Like with AVX2, unpacking and packing work on each 128 bit lane
+ * separately. The order of the pixels in the unpacked halves is
+ * irrelevant as long as everything is unpacked the same way.
+ */
+static force_inline void
+unpack_512_2x512 (__m512i data, __m512i *data_lo, __m512i *data_hi)
+{
+    *data_lo = _mm512_unpacklo_epi8 (data, _mm512_setzero_si512 ());
+    *data_hi = _mm512_unpackhi_epi8 (data, _mm512_setzero_si512 ());
+}
+
+static force_inline __m512i
+pack_2x512_512 (__m512i lo, __m512i hi)
+{
+    return _mm512_packus_epi16 (lo, hi);
+}
+
+static force_inline __m512i
+expand_alpha_1x512 (__m512i data)
+{
+    return _mm512_shufflehi_epi16 (
+	_mm512_shufflelo_epi16 (data, _MM_SHUFFLE (3, 3, 3, 3)),
+	_MM_SHUFFLE (3, 3, 3, 3));
+}
+
+static force_inline __m512i
+negate_1x512 (__m512i data)
+{
+    return _mm512_xor_si512 (data, mask_00ff);
+}
+
+static force_inline __m512i
+pix_multiply_1x512 (__m512i data, __m512i alpha)
+{
+    return _mm512_mulhi_epu16 (
+	_mm512_adds_epu16 (_mm512_mullo_epi16 (data, alpha), mask_0080),
+	mask_0101);
+}
+
+static force_inline __m512i
+over_1x512 (__m512i src, __m512i alpha, __m512i dst)
+{
+    return _mm512_adds_epu8 (
+	src, pix_multiply_1x512 (dst, negate_1x512 (alpha)));
+}
+
+static force_inline __m512i
+in_over_1x512 (__m512i src, __m512i alpha, __m512i mask, __m512i dst)
+{
+    return over_1x512 (pix_multiply_1x512 (src, mask),
+		       pix_multiply_1x512 (alpha, mask),
+		       dst);
+}
+
+/* Load the pixels of @ps selected by @k and multiply them by the
+ * alpha channel of the corresponding mask pixels, if any. Pixels
+ * that are not selected are zero.
+ */
+static force_inline __m512i
+combine16 (const uint32_t *ps, const uint32_t *pm, __mmask16 k)
+{
+    __m512i s, m;
+    __m512i s_lo, s_hi, m_lo, m_hi;
+
+    if (pm)
+    {
+	m = _mm512_maskz_loadu_epi32 (k, pm);
+
+	if (!_mm512_test_epi32_mask (m, mask_ff000000))
+	    return _mm512_setzero_si512 ();
+    }
+
+    s = _mm512_maskz_loadu_epi32 (k, ps);
+
+    if (pm)
+    {
+	unpack_512_2x512 (s, &s_lo, &s_hi);
+	unpack_512_2x512 (m, &m_lo, &m_hi);
+
+	s_lo = pix_multiply_1x512 (s_lo, expand_alpha_1x512 (m_lo));
+	s_hi = pix_multiply_1x512 (s_hi, expand_alpha_1x512 (m_hi));
+
+	s = pack_2x512_512 (s_lo, s_hi);
+    }
+
+    return s;
+}
+
+static force_inline void
+over_16 (uint32_t *pd, const uint32_t *ps, const uint32_t *pm, __mmask16 k)
+{
+    __m512i src = combine16 (ps, pm, k);
+    __mmask16 opaque;
+
+    opaque = _mm512_mask_cmpeq_epi32_mask (
+	k, _mm512_and_si512 (src, mask_ff000000), mask_ff000000);
+
+    if (opaque == k)
+    {
+	_mm512_mask_storeu_epi32 (pd, k, src);
+    }
+    else if (_mm512_test_epi32_mask (src, src))
+    {
+	__m512i src_lo, src_hi, dst_lo, dst_hi;
+
+	unpack_512_2x512 (src, &src_lo, &src_hi);
+	unpack_512_2x512 (_mm512_maskz_loadu_epi32 (k, pd), &dst_lo, &dst_hi);
+
+	dst_lo = over_1x512 (src_lo, expand_alpha_1x512 (src_lo), dst_lo);
+	dst_hi = over_1x512 (src_hi, expand_alpha_1x512 (src_hi), dst_hi);
+
+	_mm512_mask_storeu_epi32 (pd, k, pack_2x512_512 (dst_lo, dst_hi));
+    }
+}
+
+static force_inline void
+add_16 (uint32_t *pd, const uint32_t *ps, const uint32_t *pm, __mmask16 k)
+{
+    _mm512_mask_storeu_epi32 (
+	pd, k, _mm512_adds_epu8 (combine16 (ps, pm, k),
+				 _mm512_maskz_loadu_epi32 (k, pd)));
+}
+
+/* Run @op over a scanline of 32 bpp pixels: a masked head to get the
+ * destination 64 byte aligned when the scanline is long enough for
+ * that to pay off, full vectors, and a masked tail.
+ */
+#define AVX512_COMBINE_U(name, op)					\
+    static void								\
+    avx512_combine_ ## name ## _u (pixman_implementation_t *imp,	\
+				   pixman_op_t              pop,	\
+				   uint32_t *               pd,		\
+				   const uint32_t *         ps,		\
+				   const uint32_t *         pm,		\
+				   int                      w)		\
+    {									\
+	int n;								\
+									\
+	if (w > 16 && (n = bytes_to_align_64 (pd) >> 2))		\
+	{								\
+	    op (pd, ps, pm, first_n_16 (n));				\
+	    pd += n;							\
+	    ps += n;							\
+	    if (pm)							\
+		pm += n;						\
+	    w -= n;							\
+	}								\
+									\
+	while (w >= 16)							\
+	{								\
+	    op (pd, ps, pm, 0xffff);					\
+	    pd += 16;							\
+	    ps += 16;							\
+	    if (pm)							\
+		pm += 16;						\
+	    w -= 16;							\
+	}								\
+									\
+	if (w)								\
+	    op (pd, ps, pm, first_n_16 (w));				\
+    }
+
+AVX512_COMBINE_U (over, over_16)
+AVX512_COMBINE_U (add, add_16)
+
+static void
+avx512_composite_over_8888_8888 (pixman_implementation_t *imp,
+				 pixman_composite_info_t *info)
+{
+    PIXMAN_COMPOSITE_ARGS (info);
+    int dst_stride, src_stride;
+    uint32_t *dst_line;
+    uint32_t *src_line;
+
+    PIXMAN_IMAGE_GET_LINE (
+	dest_image, dest_x, dest_y, uint32_t, dst_stride, dst_line, 1);
+    PIXMAN_IMAGE_GET_LINE (
+	src_image, src_x, src_y, uint32_t, src_stride, src_line, 1);
+
+    while (height--)
+    {
+	avx512_combine_over_u (imp, op, dst_line, src_line, NULL, width);
+
+	dst_line += dst_stride;
+	src_line += src_stride;
+    }
+}
+
+static force_inline void
+over_n_8_16 (uint32_t *dst, const uint8_t *mask, __mmask16 k, uint32_t srca,
+	     __m512i vsrc, __m512i valpha, __m512i vdef)
+{
+    __m128i m = _mm_maskz_loadu_epi8 (k, mask);
+    __m512i vmask, vmask_lo, vmask_hi, vdst_lo, vdst_hi;
+
+    if (!_mm_test_epi8_mask (m, m))
+	return;
+
+    if (srca == 0xff && _mm_cmpeq_epi8_mask (m, _mm_set1_epi8 (-1)) == k)
+    {
+	_mm512_mask_storeu_epi32 (dst, k, vdef);
+	return;
+    }
+
+    /* Widen the sixteen mask bytes to one byte per channel */
+    vmask = _mm512_shuffle_epi8 (_mm512_cvtepu8_epi32 (m), mask_expand_a8);
+
+    unpack_512_2x512 (vmask, &vmask_lo, &vmask_hi);
+    unpack_512_2x512 (_mm512_maskz_loadu_epi32 (k, dst), &vdst_lo, &vdst_hi);
+
+    vdst_lo = in_over_1x512 (vsrc, valpha, vmask_lo, vdst_lo);
+    vdst_hi = in_over_1x512 (vsrc, valpha, vmask_hi, vdst_hi);
+
+    _mm512_mask_storeu_epi32 (dst, k, pack_2x512_512 (vdst_lo, vdst_hi));
+}
+
+static void
+avx512_composite_over_n_8_8888 (pixman_implementation_t *imp,
+				pixman_composite_info_t *info)
+{
+    PIXMAN_COMPOSITE_ARGS (info);
+    uint32_t src, srca;
+    uint32_t *dst_line, *dst;
+    uint8_t *mask_line, *mask;
+    int dst_stride, mask_stride;
+    int32_t w;
+    __m512i vsrc, valpha, vdef;
+
+    src = _pixman_image_get_solid (imp, src_image, dest_image->bits.format);
+
+    srca = src >> 24;
+    if (src == 0)
+	return;
+
+    PIXMAN_IMAGE_GET_LINE (
+	dest_image, dest_x, dest_y, uint32_t, dst_stride, dst_line, 1);
+    PIXMAN_IMAGE_GET_LINE (
+	mask_image, mask_x, mask_y, uint8_t, mask_stride, mask_line, 1);
+
+    vdef = _mm512_set1_epi32 (src);
+    unpack_512_2x512 (vdef, &vsrc, &valpha);
+    valpha = expand_alpha_1x512 (vsrc);
+
+    while (height--)
+    {
+	int n;
+
+	dst = dst_line;
+	dst_line += dst_stride;
+	mask = mask_line;
+	mask_line += mask_stride;
+	w = width;
+
+	if (w > 16 && (n = bytes_to_align_64 (dst) >> 2))
+	{
+	    over_n_8_16 (dst, mask, first_n_16 (n), srca, vsrc, valpha, vdef);
+	    dst += n;
+	    mask += n;
+	    w -= n;
+	}
+
+	while (w >= 16)
+	{
+	    over_n_8_16 (dst, mask, 0xffff, srca, vsrc, valpha, vdef);
+	    dst += 16;
+	    mask += 16;
+	    w -= 16;
+	}
+
+	if (w)
+	    over_n_8_16 (dst, mask, first_n_16 (w), srca, vsrc, valpha, vdef);
+    }
+}
+
+static force_inline void
+add_8_8_64 (uint8_t *dst, const uint8_t *src, __mmask64 k)
+{
+    _mm512_mask_storeu_epi8 (
+	dst, k, _mm512_adds_epu8 (_mm512_maskz_loadu_epi8 (k, src),
+				  _mm512_maskz_loadu_epi8 (k, dst)));
+}
+
+static void
+avx512_composite_add_8_8 (pixman_implementation_t *imp,
+			  pixman_composite_info_t *info)
+{
+    PIXMAN_COMPOSITE_ARGS (info);
+    uint8_t *dst_line, *dst;
+    uint8_t *src_line, *src;
+    int dst_stride, src_stride;
+    int32_t w;
+
+    PIXMAN_IMAGE_GET_LINE (
+	src_image, src_x, src_y, uint8_t, src_stride, src_line, 1);
+    PIXMAN_IMAGE_GET_LINE (
+	dest_image, dest_x, dest_y, uint8_t, dst_stride, dst_line, 1);
+
+    while (height--)
+    {
+	int n;
+
+	dst = dst_line;
+	dst_line += dst_stride;
+	src = src_line;
+	src_line += src_stride;
+	w = width;
+
+	if (w > 64 && (n = bytes_to_align_64 (dst)))
+	{
+	    add_8_8_64 (dst, src, first_n_64 (n));
+	    dst += n;
+	    src += n;
+	    w -= n;
+	}
+
+	while (w >= 64)
+	{
+	    add_8_8_64 (dst, src, ~(__mmask64)0);
+	    dst += 64;
+	    src += 64;
+	    w -= 64;
+	}
+
+	if (w)
+	    add_8_8_64 (dst, src, first_n_64 (w));
+    }
+}
+
+static force_inline void
+add_n_8_8_64 (uint8_t *dst, const uint8_t *mask, __mmask64 k, __m512i valpha)
+{
+    __m512i m, m_lo, m_hi;
+
+    m = _mm512_maskz_loadu_epi8 (k, mask);
+    if (!_mm512_test_epi8_mask (m, m))
+	return;
+
+    unpack_512_2x512 (m, &m_lo, &m_hi);
+
+    m_lo = pix_multiply_1x512 (valpha, m_lo);
+    m_hi = pix_multiply_1x512 (valpha, m_hi);
+
+    _mm512_mask_storeu_epi8 (
+	dst, k, _mm512_adds_epu8 (pack_2x512_512 (m_lo, m_hi),
+				  _mm512_maskz_loadu_epi8 (k, dst)));
+}
+
+static void
+avx512_composite_add_n_8_8 (pixman_implementation_t *imp,
+			    pixman_composite_info_t *info)
+{
+    PIXMAN_COMPOSITE_ARGS (info);
+    uint8_t *dst_line, *dst;
+    uint8_t *mask_line, *mask;
+    int dst_stride, mask_stride;
+    int32_t w;
+    uint32_t src;
+    __m512i valpha;
+
+    PIXMAN_IMAGE_GET_LINE (
+	dest_image, dest_x, dest_y, uint8_t, dst_stride, dst_line, 1);
+    PIXMAN_IMAGE_GET_LINE (
+	mask_image, mask_x, mask_y, uint8_t, mask_stride, mask_line, 1);
+
+    src = _pixman_image_get_solid (imp, src_image, dest_image->bits.format);
+
+    if ((src >> 24) == 0)
+	return;
+
+    valpha = _mm512_set1_epi16 (src >> 24);
+
+    while (height--)
+    {
+	int n;
+
+	dst = dst_line;
+	dst_line += dst_stride;
+	mask = mask_line;
+	mask_line += mask_stride;
+	w = width;
+
+	if (w > 64 && (n = bytes_to_align_64 (dst)))
+	{
+	    add_n_8_8_64 (dst, mask, first_n_64 (n), valpha);
+	    dst += n;
+	    mask += n;
+	    w -= n;
+	}
+
+	while (w >= 64)
+	{
+	    add_n_8_8_64 (dst, mask, ~(__mmask64)0, valpha);
+	    dst += 64;
+	    mask += 64;
+	    w -= 64;
+	}
+
+	if (w)
+	    add_n_8_8_64 (dst, mask, first_n_64 (w), valpha);
+    }
+}
+
+static void
+avx512_composite_add_n_8 (pixman_implementation_t *imp,
+			  pixman_composite_info_t *info)
+{
+    PIXMAN_COMPOSITE_ARGS (info);
+    uint8_t *dst_line, *dst;
+    int dst_stride;
+    int32_t w;
+    uint32_t src;
+    __m512i vsrc;
+
+    PIXMAN_IMAGE_GET_LINE (
+	dest_image, dest_x, dest_y, uint8_t, dst_stride, dst_line, 1);
+
+    src = _pixman_image_get_solid (imp, src_image, dest_image->bits.format);
+
+    src >>= 24;
+
+    if (src == 0x00)
+	return;
+
+    if (src == 0xff)
+    {
+	pixman_fill (dest_image->bits.bits, dest_image->bits.rowstride,
+		     8, dest_x, dest_y, width, height, 0xff);
+
+	return;
+    }
+
+    vsrc = _mm512_set1_epi8 (src);
+
+    while (height--)
+    {
+	__mmask64 k;
+
+	dst = dst_line;
+	dst_line += dst_stride;
+	w = width;
+
+	while (w > 0)
+	{
+	    k = w >= 64 ? ~(__mmask64)0 : first_n_64 (w);
+
+	    _mm512_mask_storeu_epi8 (
+		dst, k, _mm512_adds_epu8 (vsrc, _mm512_maskz_loadu_epi8 (k, dst)));
+
+	    dst += 64;
+	    w -= 64;
+	}
+    }
+}
+
+static pixman_bool_t
+avx512_blt (pixman_implementation_t *imp,
+	    uint32_t *               src_bits,
+	    uint32_t *               dst_bits,
+	    int                      src_stride,
+	    int                      dst_stride,
+	    int                      src_bpp,
+	    int                      dst_bpp,
+	    int                      src_x,
+	    int                      src_y,
+	    int                      dest_x,
+	    int                      dest_y,
+	    int                      width,
+	    int                      height)
+{
+    uint8_t *src_bytes;
+    uint8_t *dst_bytes;
+    int byte_width;
+    int bpp = src_bpp / 8;
+
+    if (src_bpp != dst_bpp)
+	return FALSE;
+
+    if (src_bpp != 8 && src_bpp != 16 && src_bpp != 32)
+	return FALSE;
+
+    src_stride = src_stride * (int) sizeof (uint32_t);
+    dst_stride = dst_stride * (int) sizeof (uint32_t);
+    src_bytes = (uint8_t *)src_bits + src_stride * src_y + src_x * bpp;
+    dst_bytes = (uint8_t *)dst_bits + dst_stride * dest_y + dest_x * bpp;
+    byte_width = width * bpp;
+
+    while (height--)
+    {
+	int w, n;
+	uint8_t *s = src_bytes;
+	uint8_t *d = dst_bytes;
+	src_bytes += src_stride;
+	dst_bytes += dst_stride;
+	w = byte_width;
+
+	if (w > 64 && (n = bytes_to_align_64 (d)))
+	{
+	    __mmask64 k = first_n_64 (n);
+
+	    _mm512_mask_storeu_epi8 (d, k, _mm512_maskz_loadu_epi8 (k, s));
+	    s += n;
+	    d += n;
+	    w -= n;
+	}
+
+	while (w >= 256)
+	{
+	    __m512i z0, z1, z2, z3;
+
+	    z0 = _mm512_loadu_si512 (s);
+	    z1 = _mm512_loadu_si512 (s + 64);
+	    z2 = _mm512_loadu_si512 (s + 128);
+	    z3 = _mm512_loadu_si512 (s + 192);
+
+	    _mm512_store_si512 (d, z0);
+	    _mm512_store_si512 (d + 64, z1);
+	    _mm512_store_si512 (d + 128, z2);
+	    _mm512_store_si512 (d + 192, z3);
+
+	    s += 256;
+	    d += 256;
+	    w -= 256;
+	}
+
+	while (w >= 64)
+	{
+	    _mm512_storeu_si512 (d, _mm512_loadu_si512 (s));
+
+	    s += 64;
+	    d += 64;
+	    w -= 64;
+	}
+
+	if (w)
+	{
+	    __mmask64 k = first_n_64 (w);
+
+	    _mm512_mask_storeu_epi8 (d, k, _mm512_maskz_loadu_epi8 (k, s));
+	}
+    }
+
+    return TRUE;
+}
+
+static void
+avx512_composite_copy_area (pixman_implementation_t *imp,
+			    pixman_composite_info_t *info)
+{
+    PIXMAN_COMPOSITE_ARGS (info);
+    avx512_blt (imp, src_image->bits.bits,
+		dest_image->bits.bits,
+		src_image->bits.rowstride,
+		dest_image->bits.rowstride,
+		PIXMAN_FORMAT_BPP (src_image->bits.format),
+		PIXMAN_FORMAT_BPP (dest_image->bits.format),
+		src_x, src_y, dest_x, dest_y, width, height);
+}
+
+static pixman_bool_t
+avx512_fill (pixman_implementation_t *imp,
+	     uint32_t *               bits,
+	     int                      stride,
+	     int                      bpp,
+	     int                      x,
+	     int                      y,
+	     int                      width,
+	     int                      height,
+	     uint32_t                 filler)
+{
+    uint8_t *byte_line;
+    int byte_width;
+    __m512i vdef;
+
+    if (bpp == 8)
+	filler = (filler & 0xff) * 0x01010101;
+    else if (bpp == 16)
+	filler = (filler & 0xffff) * 0x00010001;
+    else if (bpp != 32)
+	return FALSE;
+
+    stride = stride * (int) sizeof (uint32_t);
+    byte_line = (uint8_t *)bits + stride * y + x * (bpp / 8);
+    byte_width = width * (bpp / 8);
+
+    vdef = _mm512_set1_epi32 (filler);
+
+    while (height--)
+    {
+	int w, n;
+	uint8_t *d = byte_line;
+	byte_line += stride;
+	w = byte_width;
+
+	/* The destination is always aligned to the pixel size, so
+	 * the pattern in vdef stays in phase after the head.
+	 */
+	if (w > 64 && (n = bytes_to_align_64 (d)))
+	{
+	    _mm512_mask_storeu_epi8 (d, first_n_64 (n), vdef);
+	    d += n;
+	    w -= n;
+	}
+
+	while (w >= 256)
+	{
+	    _mm512_store_si512 (d, vdef);
+	    _mm512_store_si512 (d + 64, vdef);
+	    _mm512_store_si512 (d + 128, vdef);
+	    _mm512_store_si512 (d + 192, vdef);
+
+	    d += 256;
+	    w -= 256;
+	}
+
+	while (w >= 64)
+	{
+	    _mm512_storeu_si512 (d, vdef);
+
+	    d += 64;
+	    w -= 64;
+	}
+
+	if (w)
+	    _mm512_mask_storeu_epi8 (d, first_n_64 (w), vdef);
+    }
+
+    return TRUE;
+}
+
+static const pixman_fast_path_t avx512_fast_paths[] =
+{
+    /* PIXMAN_OP_OVER */
+    PIXMAN_STD_FAST_PATH (OVER, solid, a8, a8r8g8b8, avx512_composite_over_n_8_8888),
+    PIXMAN_STD_FAST_PATH (OVER, solid, a8, x8r8g8b8, avx512_composite_over_n_8_8888),
+    PIXMAN_STD_FAST_PATH (OVER, solid, a8, a8b8g8r8, avx512_composite_over_n_8_8888),
+    PIXMAN_STD_FAST_PATH (OVER, solid, a8, x8b8g8r8, avx512_composite_over_n_8_8888),
+    PIXMAN_STD_FAST_PATH (OVER, a8r8g8b8, null, a8r8g8b8, avx512_composite_over_8888_8888),
+    PIXMAN_STD_FAST_PATH (OVER, a8r8g8b8, null, x8r8g8b8, avx512_composite_over_8888_8888),
+    PIXMAN_STD_FAST_PATH (OVER, a8b8g8r8, null, a8b8g8r8, avx512_composite_over_8888_8888),
+    PIXMAN_STD_FAST_PATH (OVER, a8b8g8r8, null, x8b8g8r8, avx512_composite_over_8888_8888),
+    PIXMAN_STD_FAST_PATH (OVER, x8r8g8b8, null, x8r8g8b8, avx512_composite_copy_area),
+    PIXMAN_STD_FAST_PATH (OVER, x8b8g8r8, null, x8b8g8r8, avx512_composite_copy_area),
+
+    /* PIXMAN_OP_ADD */
+    PIXMAN_STD_FAST_PATH (ADD, a8, null, a8, avx512_composite_add_8_8),
+    PIXMAN_STD_FAST_PATH (ADD, solid, a8, a8, avx512_composite_add_n_8_8),
+    PIXMAN_STD_FAST_PATH (ADD, solid, null, a8, avx512_composite_add_n_8),
+
+    /* PIXMAN_OP_SRC */
+    PIXMAN_STD_FAST_PATH (SRC, a8r8g8b8, null, a8r8g8b8, avx512_composite_copy_area),
+    PIXMAN_STD_FAST_PATH (SRC, a8b8g8r8, null, a8b8g8r8, avx512_composite_copy_area),
+    PIXMAN_STD_FAST_PATH (SRC, a8r8g8b8, null, x8r8g8b8, avx512_composite_copy_area),
+    PIXMAN_STD_FAST_PATH (SRC, a8b8g8r8, null, x8b8g8r8, avx512_composite_copy_area),
+    PIXMAN_STD_FAST_PATH (SRC, x8r8g8b8, null, x8r8g8b8, avx512_composite_copy_area),
+    PIXMAN_STD_FAST_PATH (SRC, x8b8g8r8, null, x8b8g8r8, avx512_composite_copy_area),
+    PIXMAN_STD_FAST_PATH (SRC, r5g6b5, null, r5g6b5, avx512_composite_copy_area),
+    PIXMAN_STD_FAST_PATH (SRC, b5g6r5, null, b5g6r5, avx512_composite_copy_area),
+    PIXMAN_STD_FAST_PATH (SRC, a8, null, a8, avx512_composite_copy_area),
+
+    { PIXMAN_OP_NONE },
+};
+
+#if defined(__GNUC__) && !defined(__x86_64__) && !defined(__amd64__)
+__attribute__((__force_align_arg_pointer__))
+#endif
+pixman_implementation_t *
+_pixman_implementation_create_avx512 (pixman_implementation_t *fallback)
+{
+    pixman_implementation_t *imp = _pixman_implementation_create (fallback, avx512_fast_paths);
+
+    imp->name = "avx512";
+
+    /* AVX-512 constants */
+    mask_0080 = _mm512_set1_epi16 (0x0080);
+    mask_00ff = _mm512_set1_epi16 (0x00ff);
+    mask_0101 = _mm512_set1_epi16 (0x0101);
+    mask_ff000000 = _mm512_set1_epi32 (0xff000000);
+    mask_expand_a8 = _mm512_set4_epi32 (0x0c0c0c0c, 0x08080808,
+					0x04040404, 0x00000000);
+
+    /* Set up function pointers */
+    imp->combine_32[PIXMAN_OP_OVER] = avx512_combine_over_u;
+    imp->combine_32[PIXMAN_OP_ADD] = avx512_combine_add_u;
+
+    imp->blt = avx512_blt;
+    imp->fill = avx512_fill;
+
+    return imp;
+}
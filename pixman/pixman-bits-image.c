@@ -766,7 +766,8 @@ dest_get_scanline_narrow (pixman_iter_t *iter, const uint32_t *mask)
     {
 	uint32_t *alpha;
 
-	if ((alpha = malloc (width * sizeof (uint32_t))))
+	if ((alpha = _pixman_scanline_arena_alloc (
+		 width * sizeof (uint32_t), 0)))
 	{
 	    int i;
 
@@ -782,7 +783,7 @@ dest_get_scanline_narrow (pixman_iter_t *iter, const uint32_t *mask)
 		buffer[i] |= (alpha[i] & 0xff000000);
 	    }
 
-	    free (alpha);
+	    _pixman_scanline_arena_free (alpha);
 	}
     }
 
@@ -804,7 +805,8 @@ dest_get_scanline_wide (pixman_iter_t *iter, const uint32_t *mask)
     {
 	argb_t *alpha;
 
-	if ((alpha = malloc (width * sizeof (argb_t))))
+	if ((alpha = _pixman_scanline_arena_alloc (
+		 width * sizeof (argb_t), 0)))
 	{
 	    int i;
 
@@ -817,7 +819,7 @@ dest_get_scanline_wide (pixman_iter_t *iter, const uint32_t *mask)
 	    for (i = 0; i < width; ++i)
 		buffer[i].a = alpha[i].a;
 
-	    free (alpha);
+	    _pixman_scanline_arena_free (alpha);
 	}
     }
 
@@ -99,6 +99,127 @@
 #   define PIXMAN_EXPORT
 #endif
 
+/* Atomic addition for statistics counters shared by all threads.
+ * Evaluates to the value before the addition.
+ */
+#if defined(PIXMAN_NO_TLS)
+#   define PIXMAN_ATOMIC_FETCH_ADD_64(ptr, value)			\
+    pixman_fetch_add_64 ((ptr), (value))
+#elif defined(__GNUC__)
+#   define PIXMAN_ATOMIC_FETCH_ADD_64(ptr, value)			\
+    __sync_fetch_and_add ((ptr), (value))
+#elif defined(_MSC_VER)
+#   include <windows.h>
+#   define PIXMAN_ATOMIC_FETCH_ADD_64(ptr, value)			\
+    ((uint64_t)InterlockedExchangeAdd64 ((volatile LONG64 *)(ptr), (value)))
+#else
+#   define PIXMAN_ATOMIC_FETCH_ADD_64(ptr, value)			\
+    pixman_fetch_add_64 ((ptr), (value))
+#endif
+
+static inline uint64_t
+pixman_fetch_add_64 (volatile uint64_t *ptr, uint64_t value)
+{
+    uint64_t old = *ptr;
+
+    *ptr = old + value;
+
+    return old;
+}
+
+/* The same for reference counts of data that may be shared between
+ * threads.
+ */
+#if defined(PIXMAN_NO_TLS)
+#   define PIXMAN_ATOMIC_FETCH_ADD_32(ptr, value)			\
+    pixman_fetch_add_32 ((ptr), (value))
+#elif defined(__GNUC__)
+#   define PIXMAN_ATOMIC_FETCH_ADD_32(ptr, value)			\
+    __sync_fetch_and_add ((ptr), (value))
+#elif defined(_MSC_VER)
+#   include <windows.h>
+#   define PIXMAN_ATOMIC_FETCH_ADD_32(ptr, value)			\
+    ((int32_t)InterlockedExchangeAdd ((volatile LONG *)(ptr), (value)))
+#else
+#   define PIXMAN_ATOMIC_FETCH_ADD_32(ptr, value)			\
+    pixman_fetch_add_32 ((ptr), (value))
+#endif
+
+static inline int32_t
+pixman_fetch_add_32 (volatile int32_t *ptr, int32_t value)
+{
+    int32_t old = *ptr;
+
+    *ptr = old + value;
+
+    return old;
+}
+
+/* A lock that is only ever tried, never waited for. PIXMAN_TRY_LOCK()
+ * evaluates to TRUE if the lock was taken, and both imply a full
+ * memory barrier.
+ */
+#if defined(PIXMAN_NO_TLS)
+#   define PIXMAN_TRY_LOCK(ptr)						\
+    pixman_try_lock ((ptr))
+#   define PIXMAN_UNLOCK(ptr)						\
+    (*(ptr) = 0)
+#elif defined(__GNUC__)
+#   define PIXMAN_TRY_LOCK(ptr)						\
+    __sync_bool_compare_and_swap ((ptr), 0, 1)
+#   define PIXMAN_UNLOCK(ptr)						\
+    __sync_lock_release ((ptr))
+#elif defined(_MSC_VER)
+#   include <windows.h>
+#   define PIXMAN_TRY_LOCK(ptr)						\
+    (InterlockedCompareExchange ((volatile LONG *)(ptr), 1, 0) == 0)
+#   define PIXMAN_UNLOCK(ptr)						\
+    InterlockedExchange ((volatile LONG *)(ptr), 0)
+#else
+#   define PIXMAN_TRY_LOCK(ptr)						\
+    pixman_try_lock ((ptr))
+#   define PIXMAN_UNLOCK(ptr)						\
+    (*(ptr) = 0)
+#endif
+
+static inline int
+pixman_try_lock (volatile int32_t *ptr)
+{
+    if (*ptr)
+	return 0;
+
+    *ptr = 1;
+
+    return 1;
+}
+
+/* Memory ordering for data that is read without taking a lock.
+ * PIXMAN_READ_BARRIER() keeps the loads before it from being moved past
+ * the loads after it, and PIXMAN_WRITE_BARRIER() does the same for
+ * stores. On x86 both only need to stop the compiler.
+ */
+#if defined(PIXMAN_NO_TLS)
+#   define PIXMAN_READ_BARRIER()	do { } while (0)
+#   define PIXMAN_WRITE_BARRIER()	do { } while (0)
+#elif defined(__ATOMIC_ACQUIRE)
+#   define PIXMAN_READ_BARRIER()	__atomic_thread_fence (__ATOMIC_ACQUIRE)
+#   define PIXMAN_WRITE_BARRIER()	__atomic_thread_fence (__ATOMIC_RELEASE)
+#elif defined(__GNUC__)
+#   define PIXMAN_READ_BARRIER()	__sync_synchronize ()
+#   define PIXMAN_WRITE_BARRIER()	__sync_synchronize ()
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_AMD64))
+#   include <intrin.h>
+#   define PIXMAN_READ_BARRIER()	_ReadWriteBarrier ()
+#   define PIXMAN_WRITE_BARRIER()	_ReadWriteBarrier ()
+#elif defined(_MSC_VER)
+#   include <windows.h>
+#   define PIXMAN_READ_BARRIER()	MemoryBarrier ()
+#   define PIXMAN_WRITE_BARRIER()	MemoryBarrier ()
+#else
+#   define PIXMAN_READ_BARRIER()	do { } while (0)
+#   define PIXMAN_WRITE_BARRIER()	do { } while (0)
+#endif
+
 /* member offsets */
 #define CONTAINER_OF(type, member, data)				\
     ((type *)(((uint8_t *)data) - offsetof (type, member)))
@@ -0,0 +1,406 @@
+/*
+ * Copyright © 2026 The pixman authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Exact coverage of trapezoids
+ *
+ * Each trapezoid is turned into its left and right edges, which are
+ * line segments going down with a direction of +1 and -1. Adding up the
+ * directions of the segments to the left of a point gives the number of
+ * trapezoids that cover it.
+ *
+ * The segments are swept from the top down, one pixel row at a time. In
+ * each row, the part of a segment that is in the row adds to a row of
+ * cells, such that the sum of the cells up to and including a pixel is
+ * the area of that pixel to the right of the segment, times the
+ * direction. The sum of all segments in the row is then the covered
+ * area of each pixel, which is added to the mask once.
+ *
+ * Segments are clipped to the image. Parts to the left of it are moved
+ * onto its left edge, since they cover all of the row to the right,
+ * and parts to the right are moved onto its right edge, where they
+ * don't affect any pixels.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pixman-private.h"
+
+/* Each trapezoid has two edges that can be split in three at the sides
+ * of the image.
+ */
+#define MAX_SEGMENTS_PER_TRAP	6
+
+typedef struct
+{
+    double	x;	/* at y1 */
+    double	y1, y2;
+    double	dxdy;
+    double	dir;
+} segment_t;
+
+static void
+add_segment (segment_t **segs, int width,
+	     double x1, double y1, double x2, double y2, double dir)
+{
+    segment_t *s;
+
+    if (y1 >= y2)
+	return;
+
+    /* Split at the sides of the image */
+    if ((x1 < 0 && x2 > 0) || (x1 > 0 && x2 < 0))
+    {
+	double y = y1 + (y2 - y1) * (0 - x1) / (x2 - x1);
+
+	add_segment (segs, width, x1, y1, 0, y, dir);
+	add_segment (segs, width, 0, y, x2, y2, dir);
+	return;
+    }
+
+    if ((x1 < width && x2 > width) || (x1 > width && x2 < width))
+    {
+	double y = y1 + (y2 - y1) * (width - x1) / (x2 - x1);
+
+	add_segment (segs, width, x1, y1, width, y, dir);
+	add_segment (segs, width, width, y, x2, y2, dir);
+	return;
+    }
+
+    x1 = CLIP (x1, 0, width);
+    x2 = CLIP (x2, 0, width);
+
+    s = (*segs)++;
+    s->x = x1;
+    s->y1 = y1;
+    s->y2 = y2;
+    s->dxdy = (x2 - x1) / (y2 - y1);
+    s->dir = dir;
+}
+
+static double
+line_x (const pixman_line_fixed_t *line, double x_off, double y)
+{
+    double x1 = pixman_fixed_to_double (line->p1.x);
+    double y1 = pixman_fixed_to_double (line->p1.y);
+    double x2 = pixman_fixed_to_double (line->p2.x);
+    double y2 = pixman_fixed_to_double (line->p2.y);
+
+    return x1 + (x2 - x1) * (y - y1) / (y2 - y1) + x_off;
+}
+
+/* Adds the edges of the part of @trap where the left edge is to the
+ * left of the right edge, as that is the only part that is rasterized
+ * when sampling.
+ */
+static void
+add_trapezoid (segment_t **segs, int width, int height,
+	       const pixman_trapezoid_t *trap, int x_off, int y_off)
+{
+    double top = pixman_fixed_to_double (trap->top);
+    double bottom = pixman_fixed_to_double (trap->bottom);
+    double lt, rt, lb, rb, wt, wb;
+
+    lt = line_x (&trap->left, x_off, top);
+    rt = line_x (&trap->right, x_off, top);
+    lb = line_x (&trap->left, x_off, bottom);
+    rb = line_x (&trap->right, x_off, bottom);
+
+    top += y_off;
+    bottom += y_off;
+
+    wt = rt - lt;
+    wb = rb - lb;
+
+    if (wt <= 0 && wb <= 0)
+	return;
+
+    if (wt < 0 || wb < 0)
+    {
+	/* The edges cross */
+	double f = wt / (wt - wb);
+	double y = top + (bottom - top) * f;
+	double x = lt + (lb - lt) * f;
+
+	if (wt < 0)
+	{
+	    top = y;
+	    lt = rt = x;
+	}
+	else
+	{
+	    bottom = y;
+	    lb = rb = x;
+	}
+    }
+
+    /* Clip to the image vertically */
+    if (top < 0)
+    {
+	double f = (0 - top) / (bottom - top);
+
+	lt += (lb - lt) * f;
+	rt += (rb - rt) * f;
+	top = 0;
+    }
+
+    if (bottom > height)
+    {
+	double f = (bottom - height) / (bottom - top);
+
+	lb -= (lb - lt) * f;
+	rb -= (rb - rt) * f;
+	bottom = height;
+    }
+
+    if (top >= bottom)
+	return;
+
+    add_segment (segs, width, lt, top, lb, bottom, 1);
+    add_segment (segs, width, rt, top, rb, bottom, -1);
+}
+
+static int
+compare_segments (const void *a, const void *b)
+{
+    double ya = ((const segment_t *)a)->y1;
+    double yb = ((const segment_t *)b)->y1;
+
+    return (ya > yb) - (ya < yb);
+}
+
+/* Adds the part of @seg in pixel row @y to @cells */
+static void
+add_segment_row (const segment_t *seg, int y, int width,
+		 double *cells, int *x1, int *x2)
+{
+    double ya = seg->y1 > y ? seg->y1 : y;
+    double yb = seg->y2 < y + 1 ? seg->y2 : y + 1;
+    double d = (yb - ya) * seg->dir;
+    double xa, xb, x0, x1f, x0f;
+    int x0i, x1i;
+
+    if (yb <= ya)
+	return;
+
+    /* Rounding must not take the ends outside the image */
+    xa = CLIP (seg->x + (ya - seg->y1) * seg->dxdy, 0, width);
+    xb = CLIP (seg->x + (yb - seg->y1) * seg->dxdy, 0, width);
+
+    if (xa < xb)
+    {
+	x0 = xa;
+	x1f = xb;
+    }
+    else
+    {
+	x0 = xb;
+	x1f = xa;
+    }
+
+    x0i = (int)floor (x0);
+    x1i = (int)ceil (x1f);
+    x0f = x0 - x0i;
+
+    if (x1i <= x0i + 1)
+    {
+	/* Within one pixel; the part of it that is covered is to the
+	 * right of the middle of the segment.
+	 */
+	double xm = 0.5 * (xa + xb) - x0i;
+
+	cells[x0i] += d - d * xm;
+	cells[x0i + 1] += d * xm;
+
+	x1i = x0i + 1;
+    }
+    else
+    {
+	/* Across several pixels; the area to the right of the segment
+	 * grows quadratically in the first and last pixels, and by the
+	 * same amount in each pixel in between.
+	 */
+	double s = 1 / (x1f - x0);
+	double a0 = 0.5 * s * (1 - x0f) * (1 - x0f);
+	double xl = x1f - x1i + 1;
+	double am = 0.5 * s * xl * xl;
+
+	cells[x0i] += d * a0;
+
+	if (x1i == x0i + 2)
+	{
+	    cells[x0i + 1] += d * (1 - a0 - am);
+	}
+	else
+	{
+	    double a1 = s * (1.5 - x0f);
+	    double a2 = a1 + (x1i - x0i - 3) * s;
+	    int x;
+
+	    cells[x0i + 1] += d * (a1 - a0);
+	    for (x = x0i + 2; x < x1i - 1; ++x)
+		cells[x] += d * s;
+	    cells[x1i - 1] += d * (1 - a2 - am);
+	}
+
+	cells[x1i] += d * am;
+    }
+
+    if (x0i < *x1)
+	*x1 = x0i;
+    if (x1i + 1 > *x2)
+	*x2 = x1i + 1;
+}
+
+/* Adds the coverage in cells[x1, x2) to @line and clears the cells */
+static void
+write_row (uint8_t *line, int width, double *cells, int x1, int x2)
+{
+    int end = x2 < width ? x2 : width;
+    double c = 0;
+    int x;
+
+    for (x = x1; x < end; ++x)
+    {
+	int a;
+
+	c += cells[x];
+
+	a = (int)(CLIP (c, 0, 1) * 255 + 0.5);
+	if (a)
+	{
+	    a += line[x];
+	    line[x] = a > 0xff ? 0xff : a;
+	}
+    }
+
+    memset (cells + x1, 0, (x2 - x1) * sizeof (double));
+}
+
+static void
+sweep_segments (pixman_image_t *image, int n_segs, segment_t *segs,
+		segment_t **active, double *cells)
+{
+    uint8_t *bits = (uint8_t *)image->bits.bits;
+    int stride = image->bits.rowstride * 4;
+    int width = image->bits.width;
+    int n_active = 0;
+    int next = 0;
+    int y = 0;
+
+    while (next < n_segs || n_active)
+    {
+	int x1 = width + 2, x2 = 0;
+	int i;
+
+	if (!n_active)
+	    y = (int)floor (segs[next].y1);
+
+	while (next < n_segs && segs[next].y1 < y + 1)
+	    active[n_active++] = &segs[next++];
+
+	i = 0;
+	while (i < n_active)
+	{
+	    add_segment_row (active[i], y, width, cells, &x1, &x2);
+
+	    if (active[i]->y2 <= y + 1)
+		active[i] = active[--n_active];
+	    else
+		i++;
+	}
+
+	if (x1 < x2)
+	    write_row (bits + y * stride, width, cells, x1, x2);
+
+	y++;
+    }
+}
+
+/*
+ * Adds the exact coverage of @traps, offset by (@x_off, @y_off), to an
+ * a8 image with saturation.
+ */
+void
+_pixman_rasterize_trapezoids_exact (pixman_image_t           *image,
+				    int                       x_off,
+				    int                       y_off,
+				    int                       n_traps,
+				    const pixman_trapezoid_t *traps)
+{
+    segment_t *segs, *end;
+    segment_t **active = NULL;
+    double *cells = NULL;
+    int i;
+
+    return_if_fail (image->type == BITS);
+    return_if_fail (image->bits.format == PIXMAN_a8);
+    return_if_fail (!image->bits.read_func && !image->bits.write_func);
+
+    if (n_traps <= 0)
+	return;
+
+    segs = pixman_malloc_abc (
+	n_traps, MAX_SEGMENTS_PER_TRAP, sizeof (segment_t));
+    if (segs)
+    {
+	active = pixman_malloc_abc (
+	    n_traps, MAX_SEGMENTS_PER_TRAP, sizeof (segment_t *));
+	cells = calloc (image->bits.width + 2, sizeof (double));
+    }
+
+    if (!segs || !active || !cells)
+    {
+	/* Sampled coverage is better than none */
+	for (i = 0; i < n_traps; ++i)
+	{
+	    if (pixman_trapezoid_valid (&traps[i]))
+		pixman_rasterize_trapezoid (image, &traps[i], x_off, y_off);
+	}
+    }
+    else
+    {
+	end = segs;
+	for (i = 0; i < n_traps; ++i)
+	{
+	    if (pixman_trapezoid_valid (&traps[i]))
+	    {
+		add_trapezoid (&end, image->bits.width, image->bits.height,
+			       &traps[i], x_off, y_off);
+	    }
+	}
+
+	qsort (segs, end - segs, sizeof (segment_t), compare_segments);
+
+	sweep_segments (image, end - segs, segs, active, cells);
+    }
+
+    free (segs);
+    free (active);
+    free (cells);
+}
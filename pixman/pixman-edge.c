@@ -24,6 +24,7 @@
 #include <config.h>
 #endif
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "pixman-private.h"
@@ -382,4 +383,383 @@ pixman_rasterize_edges (pixman_image_t *image,
 	pixman_rasterize_edges_no_accessors (image, l, r, t, b);
 }
 
+/*
+ * Many trapezoids at once
+ *
+ * The trapezoids are sorted by their first sample row and swept from the
+ * top down one pixel row at a time. The coverage of every trapezoid that
+ * crosses the row is accumulated in a row of cells, and then the row is
+ * written once. Coverage is only ever added with saturation, so this
+ * gives the same result as rasterizing the trapezoids one by one.
+ *
+ * Each cell has the coverage of the edge pixels of spans, and the change
+ * in coverage of the pixels in between from the previous cell, so that
+ * a span takes at most four additions no matter how long it is.
+ */
+typedef struct
+{
+    int32_t	cover;
+    int32_t	delta;
+} cell_t;
+
+static int
+compare_trap_edges (const void *a, const void *b)
+{
+    pixman_fixed_t ta = ((const pixman_trap_edges_t *)a)->t;
+    pixman_fixed_t tb = ((const pixman_trap_edges_t *)b)->t;
+
+    return (ta > tb) - (ta < tb);
+}
+
+/* Same rounding and clipping as RASTERIZE_EDGES () */
+static force_inline void
+add_span (cell_t        *cells,
+	  int            bpp,
+	  int            width,
+	  pixman_fixed_t lx,
+	  pixman_fixed_t rx,
+	  int           *x1,
+	  int           *x2)
+{
+    int lxi, rxi;
+
+    if (bpp == 1)
+    {
+	lx += X_FRAC_FIRST (1) - pixman_fixed_e;
+	rx += X_FRAC_FIRST (1) - pixman_fixed_e;
+    }
+
+    /* clip X */
+    if (lx < 0)
+	lx = 0;
+    if (pixman_fixed_to_int (rx) >= width)
+    {
+	if (bpp == 1)
+	    rx = pixman_int_to_fixed (width);
+	else
+	    rx = pixman_int_to_fixed (width) - 1;
+    }
+
+    /* Skip empty (or backwards) sections */
+    if (rx <= lx)
+	return;
+
+    lxi = pixman_fixed_to_int (lx);
+    rxi = pixman_fixed_to_int (rx);
+
+    if (bpp == 1)
+    {
+	cells[lxi].delta += 1;
+	cells[rxi].delta -= 1;
+    }
+    else
+    {
+	int lxs = RENDER_SAMPLES_X (lx, bpp);
+	int rxs = RENDER_SAMPLES_X (rx, bpp);
+
+	/* Add coverage across row */
+	if (lxi == rxi)
+	{
+	    cells[lxi].cover += rxs - lxs;
+	}
+	else
+	{
+	    cells[lxi].cover += N_X_FRAC (bpp) - lxs;
+	    cells[lxi + 1].delta += N_X_FRAC (bpp);
+	    cells[rxi].delta -= N_X_FRAC (bpp);
+	    cells[rxi].cover += rxs;
+	}
+    }
+
+    if (lxi < *x1)
+	*x1 = lxi;
+    if (rxi + 1 > *x2)
+	*x2 = rxi + 1;
+}
+
+/* Adds the sample rows of @trap that are in the current pixel row, and
+ * returns TRUE if it was the last one. The edges are stepped in local
+ * copies, since the stores to @cells could otherwise alias them.
+ */
+static force_inline pixman_bool_t
+add_trap_row (pixman_trap_edges_t *trap,
+	      int                  bpp,
+	      int                  width,
+	      cell_t              *cells,
+	      int                 *x1,
+	      int                 *x2)
+{
+    pixman_edge_t l = trap->l;
+    pixman_edge_t r = trap->r;
+    pixman_fixed_t y = trap->t;
+    pixman_fixed_t b = trap->b;
+    int lo = *x1, hi = *x2;
+    pixman_bool_t done;
+
+    for (;;)
+    {
+	add_span (cells, bpp, width, l.x, r.x, &lo, &hi);
+
+	if (y == b)
+	{
+	    done = TRUE;
+	    break;
+	}
+
+	if (bpp > 1 && pixman_fixed_frac (y) != Y_FRAC_LAST (bpp))
+	{
+	    RENDER_EDGE_STEP_SMALL ((&l));
+	    RENDER_EDGE_STEP_SMALL ((&r));
+	    y += STEP_Y_SMALL (bpp);
+	}
+	else
+	{
+	    RENDER_EDGE_STEP_BIG ((&l));
+	    RENDER_EDGE_STEP_BIG ((&r));
+	    y += STEP_Y_BIG (bpp);
+
+	    done = FALSE;
+	    break;
+	}
+    }
+
+    trap->l = l;
+    trap->r = r;
+    trap->t = y;
+    *x1 = lo;
+    *x2 = hi;
+
+    return done;
+}
+
+static void
+fill_bits (uint32_t *line, int x, int width)
+{
+    uint32_t *a = line + (x >> 5);
+    uint32_t startmask;
+    uint32_t endmask;
+    int nmiddle;
+
+    x &= 0x1f;
+
+    MASK_BITS (x, width, startmask, nmiddle, endmask);
+
+    if (startmask)
+	*a++ |= startmask;
+    while (nmiddle--)
+	*a++ = 0xffffffff;
+    if (endmask)
+	*a |= endmask;
+}
+
+/* Adds the coverage in cells[x1, x2) to @line and clears the cells */
+static force_inline void
+write_row (uint32_t *line,
+	   int       bpp,
+	   int       width,
+	   cell_t   *cells,
+	   int       x1,
+	   int       x2)
+{
+    int end = x2 < width ? x2 : width;
+    int32_t c = 0;
+    int x;
+
+    if (bpp == 8)
+    {
+	uint8_t *ap = (uint8_t *)line;
+
+	x = x1;
+	while (x < end)
+	{
+	    int start = x;
+
+	    /* Pixels inside spans have the same coverage until the next
+	     * cell that is not empty.
+	     */
+	    while (x < end && !(cells[x].delta | cells[x].cover))
+		x++;
+
+	    if (c >= 255)
+		memset (ap + start, 0xff, x - start);
+	    else if (c)
+		ADD_SATURATE_8 (ap + start, c, x - start);
+
+	    if (x < end)
+	    {
+		int32_t a;
+
+		c += cells[x].delta;
+		a = c + cells[x].cover;
+		if (a)
+		    ap[x] = clip255 (ap[x] + a);
+
+		x++;
+	    }
+	}
+    }
+    else if (bpp == 4)
+    {
+	for (x = x1; x < end; ++x)
+	{
+	    int32_t a;
+
+	    c += cells[x].delta;
+	    a = c + cells[x].cover;
+	    if (a)
+	    {
+		uint8_t *ap = (uint8_t *)line + (x >> 1);
+
+		a += GET_4 (*ap, x & 1);
+		*ap = PUT_4 (*ap, x & 1, a > 0xf ? 0xf : a);
+	    }
+	}
+    }
+    else
+    {
+	x = x1;
+	while (x < end)
+	{
+	    int start;
+
+	    c += cells[x++].delta;
+	    if (!c)
+		continue;
+
+	    start = x - 1;
+	    while (x < end && c + cells[x].delta > 0)
+		c += cells[x++].delta;
+
+	    fill_bits (line, start, x - start);
+	}
+    }
+
+    memset (cells + x1, 0, (x2 - x1) * sizeof (cell_t));
+}
+
+static force_inline void
+sweep_traps (pixman_image_t       *image,
+	     int                   bpp,
+	     int                   n_traps,
+	     pixman_trap_edges_t  *traps,
+	     pixman_trap_edges_t **active,
+	     cell_t               *cells)
+{
+    uint32_t *bits = image->bits.bits;
+    int stride = image->bits.rowstride;
+    int width = image->bits.width;
+    int n_active = 0;
+    int next = 0;
+    int y = 0;
+
+    while (next < n_traps || n_active)
+    {
+	int x1 = width + 1, x2 = 0;
+	int i;
+
+	if (!n_active)
+	    y = pixman_fixed_to_int (traps[next].t);
+
+	while (next < n_traps && pixman_fixed_to_int (traps[next].t) == y)
+	    active[n_active++] = &traps[next++];
+
+	i = 0;
+	while (i < n_active)
+	{
+	    if (add_trap_row (active[i], bpp, width, cells, &x1, &x2))
+		active[i] = active[--n_active];
+	    else
+		i++;
+	}
+
+	if (x1 < x2)
+	    write_row (bits + y * stride, bpp, width, cells, x1, x2);
+
+	y++;
+    }
+}
+
+/* Sweeping only pays for itself when the trapezoids share pixel rows;
+ * otherwise writing each trapezoid directly touches the same memory.
+ */
+static pixman_bool_t
+traps_share_rows (int n_traps, const pixman_trap_edges_t *traps)
+{
+    int y1 = INT32_MAX, y2 = INT32_MIN;
+    int64_t rows = 0;
+    int i;
+
+    for (i = 0; i < n_traps; ++i)
+    {
+	int t = pixman_fixed_to_int (traps[i].t);
+	int b = pixman_fixed_to_int (traps[i].b);
+
+	rows += b - t + 1;
+	if (t < y1)
+	    y1 = t;
+	if (b > y2)
+	    y2 = b;
+    }
+
+    return rows >= 2 * ((int64_t)y2 - y1 + 1);
+}
+
+/*
+ * Rasterizes each of @traps into @image as pixman_rasterize_edges ()
+ * would. The edges and first sample rows are changed.
+ */
+void
+_pixman_rasterize_trap_edges (pixman_image_t      *image,
+			      int                  n_traps,
+			      pixman_trap_edges_t *traps)
+{
+    int bpp = PIXMAN_FORMAT_BPP (image->bits.format);
+    pixman_trap_edges_t **active = NULL;
+    cell_t *cells = NULL;
+    int i;
+
+    return_if_fail (image->type == BITS);
+    return_if_fail (PIXMAN_FORMAT_TYPE (image->bits.format) == PIXMAN_TYPE_A);
+
+    if (n_traps > 1						&&
+	!image->bits.read_func && !image->bits.write_func	&&
+	(bpp == 1 || bpp == 4 || bpp == 8)			&&
+	traps_share_rows (n_traps, traps))
+    {
+	active = pixman_malloc_ab (n_traps, sizeof (pixman_trap_edges_t *));
+	cells = calloc (image->bits.width + 1, sizeof (cell_t));
+    }
+
+    if (!active || !cells)
+    {
+	for (i = 0; i < n_traps; ++i)
+	{
+	    pixman_rasterize_edges (
+		image, &traps[i].l, &traps[i].r, traps[i].t, traps[i].b);
+	}
+    }
+    else
+    {
+	qsort (traps, n_traps, sizeof (pixman_trap_edges_t), compare_trap_edges);
+
+	switch (bpp)
+	{
+	case 1:
+	    sweep_traps (image, 1, n_traps, traps, active, cells);
+	    break;
+
+	case 4:
+	    sweep_traps (image, 4, n_traps, traps, active, cells);
+	    break;
+
+	case 8:
+	    sweep_traps (image, 8, n_traps, traps, active, cells);
+	    break;
+	}
+    }
+
+    free (active);
+    free (cells);
+}
+
 #endif
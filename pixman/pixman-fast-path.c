@@ -2432,7 +2432,7 @@ fast_fetch_bilinear_cover (pixman_iter_t *iter, const uint32_t *mask)
 static void
 bilinear_cover_iter_fini (pixman_iter_t *iter)
 {
-    free (iter->data);
+    _pixman_scanline_arena_free (iter->data);
 }
 
 static void
@@ -2450,7 +2450,8 @@ fast_bilinear_cover_iter_init (pixman_iter_t *iter, const pixman_iter_info_t *it
     if (!pixman_transform_point_3d (iter->image->common.transform, &v))
 	goto fail;
 
-    info = malloc (sizeof (*info) + (2 * width - 1) * sizeof (uint64_t));
+    info = _pixman_scanline_arena_alloc (
+	sizeof (*info) + (2 * width - 1) * sizeof (uint64_t), 0);
     if (!info)
 	goto fail;
 
@@ -3287,6 +3288,8 @@ _pixman_implementation_create_fast_path (pixman_implementation_t *fallback)
 {
     pixman_implementation_t *imp = _pixman_implementation_create (fallback, c_fast_paths);
 
+    imp->name = "fast";
+
     imp->fill = fast_path_fill;
     imp->iter_info = fast_iters;
 
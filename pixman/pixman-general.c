@@ -35,6 +35,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 #include "pixman-private.h"
 
 static void
@@ -107,8 +110,6 @@ static const op_info_t op_flags[PIXMAN_N_OPERATORS] =
     { 0,                     0                     }, /* SATURATE */
 };
 
-#define SCANLINE_BUFFER_LENGTH 8192
-
 static pixman_bool_t
 operator_needs_division (pixman_op_t op)
 {
@@ -123,18 +124,79 @@ operator_needs_division (pixman_op_t op)
     return needs_division[op];
 }
 
+/* Wide rectangles are composited in columns, so that the scanline
+ * buffers of a column stay in the cache while it is fetched, combined
+ * and written back. The block size is the amount of cache they should
+ * fit in: 0 means half the L2 cache, and a negative size turns this off.
+ */
+#define DEFAULT_CACHE_SIZE	(256 * 1024)
+#define MIN_TILE_WIDTH		64
+
+static volatile int cache_block_size;
+static volatile int detected_block_size;
+
+static int
+detect_block_size (void)
+{
+    int size = DEFAULT_CACHE_SIZE;
+
+#if defined(HAVE_UNISTD_H) && defined(_SC_LEVEL2_CACHE_SIZE)
+    long l2 = sysconf (_SC_LEVEL2_CACHE_SIZE);
+
+    if (l2 > 0 && l2 <= INT32_MAX)
+	size = l2;
+#endif
+
+    return size / 2;
+}
+
+PIXMAN_EXPORT void
+pixman_set_cache_block_size (int n_bytes)
+{
+    cache_block_size = n_bytes;
+}
+
+static int
+get_tile_width (int width, int Bpp)
+{
+    int block_size = cache_block_size;
+    int tile_width, n_tiles;
+
+    if (block_size < 0)
+	return width;
+
+    if (block_size == 0)
+    {
+	if (!(block_size = detected_block_size))
+	    detected_block_size = block_size = detect_block_size ();
+    }
+
+    tile_width = block_size / (3 * Bpp);
+    tile_width &= ~(MIN_TILE_WIDTH - 1);
+    if (tile_width < MIN_TILE_WIDTH)
+	tile_width = MIN_TILE_WIDTH;
+
+    if (width <= tile_width)
+	return width;
+
+    /* Spread the width evenly, so the last column isn't tiny */
+    n_tiles = (width + tile_width - 1) / tile_width;
+
+    return (width + n_tiles - 1) / n_tiles;
+}
+
 static void
 general_composite_rect  (pixman_implementation_t *imp,
                          pixman_composite_info_t *info)
 {
     PIXMAN_COMPOSITE_ARGS (info);
-    uint8_t stack_scanline_buffer[3 * SCANLINE_BUFFER_LENGTH];
-    uint8_t *scanline_buffer = (uint8_t *) stack_scanline_buffer;
+    uint8_t *scanline_buffer;
     uint8_t *src_buffer, *mask_buffer, *dest_buffer;
     pixman_iter_t src_iter, mask_iter, dest_iter;
     pixman_combine_32_func_t compose;
     pixman_bool_t component_alpha;
-    iter_flags_t width_flag, src_iter_flags;
+    iter_flags_t width_flag, src_iter_flags, mask_iter_flags, dest_iter_flags;
+    int tile_width, x, w;
     int Bpp;
     int i;
 
@@ -158,35 +220,38 @@ general_composite_rect  (pixman_implementation_t *imp,
     if (width <= 0 || _pixman_multiply_overflows_int (width, Bpp * 3))
 	return;
 
-    if (width * Bpp * 3 > sizeof (stack_scanline_buffer) - 15 * 3)
-    {
-	scanline_buffer = pixman_malloc_ab_plus_c (width, Bpp * 3, 15 * 3);
+    if (_pixman_addition_overflows_int (width * Bpp * 3, 15 * 3))
+	return;
 
-	if (!scanline_buffer)
-	    return;
-    }
+    /* Where a linear gradient starts affects its rounding, so it must be
+     * fetched one scanline at a time. So must images that share their
+     * bits with the destination, because otherwise the columns on the
+     * left would be written before those on the right are fetched.
+     */
+    if (src_image->type == LINEAR || (mask_image && mask_image->type == LINEAR))
+	tile_width = width;
+    else if ((src_image->type == BITS &&
+	      src_image->bits.bits == dest_image->bits.bits) ||
+	     (mask_image && mask_image->type == BITS &&
+	      mask_image->bits.bits == dest_image->bits.bits))
+	tile_width = width;
+    else
+	tile_width = get_tile_width (width, Bpp);
+
+    /* Wide buffers must not contain NaNs, which the arena takes care of */
+    scanline_buffer = _pixman_scanline_arena_alloc (
+	tile_width * Bpp * 3 + 15 * 3,
+	width_flag == ITER_WIDE ? SCANLINE_ARENA_FLOATS : 0);
+
+    if (!scanline_buffer)
+	return;
 
     src_buffer = ALIGN (scanline_buffer);
-    mask_buffer = ALIGN (src_buffer + width * Bpp);
-    dest_buffer = ALIGN (mask_buffer + width * Bpp);
+    mask_buffer = ALIGN (src_buffer + tile_width * Bpp);
+    dest_buffer = ALIGN (mask_buffer + tile_width * Bpp);
 
-    if (width_flag == ITER_WIDE)
-    {
-	/* To make sure there aren't any NANs in the buffers */
-	memset (src_buffer, 0, width * Bpp);
-	memset (mask_buffer, 0, width * Bpp);
-	memset (dest_buffer, 0, width * Bpp);
-    }
-    
-    /* src iter */
     src_iter_flags = width_flag | op_flags[op].src | ITER_SRC;
 
-    _pixman_implementation_iter_init (imp->toplevel, &src_iter, src_image,
-                                      src_x, src_y, width, height,
-                                      src_buffer, src_iter_flags,
-                                      info->src_flags);
-
-    /* mask iter */
     if ((src_iter_flags & (ITER_IGNORE_ALPHA | ITER_IGNORE_RGB)) ==
 	(ITER_IGNORE_ALPHA | ITER_IGNORE_RGB))
     {
@@ -198,42 +263,90 @@ general_composite_rect  (pixman_implementation_t *imp,
 
     component_alpha = mask_image && mask_image->common.component_alpha;
 
-    _pixman_implementation_iter_init (
-	imp->toplevel, &mask_iter,
-	mask_image, mask_x, mask_y, width, height, mask_buffer,
-	ITER_SRC | width_flag | (component_alpha? 0 : ITER_IGNORE_RGB),
-	info->mask_flags);
-
-    /* dest iter */
-    _pixman_implementation_iter_init (
-	imp->toplevel, &dest_iter, dest_image, dest_x, dest_y, width, height,
-	dest_buffer, ITER_DEST | width_flag | op_flags[op].dst, info->dest_flags);
+    mask_iter_flags =
+	ITER_SRC | width_flag | (component_alpha? 0 : ITER_IGNORE_RGB);
+    dest_iter_flags = ITER_DEST | width_flag | op_flags[op].dst;
 
     compose = _pixman_implementation_lookup_combiner (
 	imp->toplevel, op, component_alpha, width_flag != ITER_WIDE);
 
-    for (i = 0; i < height; ++i)
+    for (x = 0; x < width; x += w)
+    {
+	w = width - x < tile_width ? width - x : tile_width;
+
+	/* src iter */
+	_pixman_implementation_iter_init (
+	    imp->toplevel, &src_iter, src_image,
+	    src_x + x, src_y, w, height,
+	    src_buffer, src_iter_flags, info->src_flags);
+
+	/* mask iter */
+	_pixman_implementation_iter_init (
+	    imp->toplevel, &mask_iter, mask_image,
+	    mask_x + x, mask_y, w, height,
+	    mask_buffer, mask_iter_flags, info->mask_flags);
+
+	/* dest iter */
+	_pixman_implementation_iter_init (
+	    imp->toplevel, &dest_iter, dest_image,
+	    dest_x + x, dest_y, w, height,
+	    dest_buffer, dest_iter_flags, info->dest_flags);
+
+	for (i = 0; i < height; ++i)
+	{
+	    uint32_t *s, *m, *d;
+
+	    m = mask_iter.get_scanline (&mask_iter, NULL);
+	    s = src_iter.get_scanline (&src_iter, m);
+	    d = dest_iter.get_scanline (&dest_iter, NULL);
+
+	    compose (imp->toplevel, op, d, s, m, w);
+
+	    dest_iter.write_back (&dest_iter);
+	}
+
+	if (src_iter.fini)
+	    src_iter.fini (&src_iter);
+	if (mask_iter.fini)
+	    mask_iter.fini (&mask_iter);
+	if (dest_iter.fini)
+	    dest_iter.fini (&dest_iter);
+    }
+
+    _pixman_scanline_arena_free (scanline_buffer);
+}
+
+static pixman_bool_t
+general_add_glyphs (pixman_implementation_t   *imp,
+		    int                        dest_stride,
+		    int                        n_blits,
+		    const pixman_glyph_blit_t *blits)
+{
+    int i;
+
+    for (i = 0; i < n_blits; ++i)
     {
-	uint32_t *s, *m, *d;
+	const uint8_t *src = blits[i].src;
+	uint8_t *dst = blits[i].dest;
+	int height = blits[i].height;
+
+	while (height--)
+	{
+	    int w;
 
-	m = mask_iter.get_scanline (&mask_iter, NULL);
-	s = src_iter.get_scanline (&src_iter, m);
-	d = dest_iter.get_scanline (&dest_iter, NULL);
+	    for (w = 0; w < blits[i].width; ++w)
+	    {
+		uint16_t t = dst[w] + src[w];
 
-	compose (imp->toplevel, op, d, s, m, width);
+		dst[w] = t | (0 - (t >> 8));
+	    }
 
-	dest_iter.write_back (&dest_iter);
+	    src += blits[i].src_stride;
+	    dst += dest_stride;
+	}
     }
 
-    if (src_iter.fini)
-	src_iter.fini (&src_iter);
-    if (mask_iter.fini)
-	mask_iter.fini (&mask_iter);
-    if (dest_iter.fini)
-	dest_iter.fini (&dest_iter);
-    
-    if (scanline_buffer != (uint8_t *) stack_scanline_buffer)
-	free (scanline_buffer);
+    return TRUE;
 }
 
 static const pixman_fast_path_t general_fast_path[] =
@@ -247,10 +360,13 @@ _pixman_implementation_create_general (void)
 {
     pixman_implementation_t *imp = _pixman_implementation_create (NULL, general_fast_path);
 
+    imp->name = "general";
+
     _pixman_setup_combiner_functions_32 (imp);
     _pixman_setup_combiner_functions_float (imp);
 
     imp->iter_info = general_iters;
+    imp->add_glyphs = general_add_glyphs;
 
     return imp;
 }
@@ -36,12 +36,81 @@ typedef struct glyph_t glyph_t;
 
 #define TOMBSTONE ((glyph_t *)0x1)
 
-/* XXX: These numbers are arbitrary---we've never done any measurements.
+/* The default limit of pixman_glyph_cache_create(). When a cache is
+ * thawed with more glyphs or bytes than its limits, the least recently
+ * used glyphs are evicted until it is down to half of them.
  */
 #define N_GLYPHS_HIGH_WATER  (16384)
-#define N_GLYPHS_LOW_WATER   (8192)
-#define HASH_SIZE (2 * N_GLYPHS_HIGH_WATER)
-#define HASH_MASK (HASH_SIZE - 1)
+
+/* The hash table grows when it is half full, counting tombstones, and
+ * is rebuilt to be at most a quarter full.
+ */
+#define MIN_HASH_SIZE	     (64)
+
+/* Shared caches are split into shards by the top bits of the hash, each
+ * with its own lock, table, MRU list and pages.
+ *
+ * Lookups don't take any lock. They may run concurrently with inserts
+ * and removals in the same shard, so a glyph is fully initialized before
+ * it is stored in the table, and the table is replaced rather than
+ * rebuilt in place. Removed glyphs and replaced tables are only freed
+ * once no thread has the cache frozen, which is also when glyphs are
+ * evicted. Compositing doesn't move glyphs in the MRU lists of shared
+ * caches; it marks them as used, and the marked glyphs are moved to the
+ * front right before evicting.
+ */
+#define SHARD_BITS	     (4)
+#define N_SHARDS	     (1 << SHARD_BITS)
+
+/* Lookups in a shared cache count hits and misses in one of several sets
+ * of counters, picked by thread, each on a cache line of its own. The
+ * counters are not atomic, so a count can get lost when two threads that
+ * run at the same time use the same set.
+ */
+#define N_COUNTERS	     (16)
+
+/* Glyphs can have variants that are shifted to the right by a multiple
+ * of 1/MAX_PHASES pixel. They are made from the glyph when they are
+ * first asked for, are one pixel wider, and go away with the glyph.
+ */
+#define MAX_PHASES	     (16)
+
+/* Small a8 and a8r8g8b8 glyphs are packed into shared pages. Each page
+ * is split into shelves, horizontal strips that are filled from left to
+ * right with glyphs of about the same height. The space of a shelf is
+ * reused once all its glyphs are gone, and a page is freed once it is
+ * empty. Other glyphs get an image of their own.
+ */
+#define PAGE_BYTES		(256 * 1024)
+#define MAX_SHELVES		128
+#define SHELF_ALIGN		4
+
+/* Masks of up to this many bytes are taken from the scanline arena, which
+ * starts out bigger than that. Bigger masks come from the heap, so that
+ * they don't keep the arena of every thread that drew them that big.
+ */
+#define MAX_ARENA_MASK_BYTES	(32 * 1024)
+
+typedef struct
+{
+    int			y;
+    int			height;
+    int			x;
+    int			n_glyphs;
+} glyph_shelf_t;
+
+typedef struct
+{
+    pixman_link_t	link;
+    pixman_image_t *	image;
+    pixman_format_code_t format;
+    int			width;
+    int			height;
+    int			top;
+    int			n_glyphs;
+    int			n_shelves;
+    glyph_shelf_t	shelves[MAX_SHELVES];
+} glyph_page_t;
 
 struct glyph_t
 {
@@ -50,26 +119,302 @@ struct glyph_t
     int			origin_x;
     int			origin_y;
     pixman_image_t *	image;
+    int			x;
+    int			y;
+    int			width;
+    int			height;
+    glyph_page_t *	page;
+    int			shelf;
+    pixman_bool_t	used;
+    glyph_t *		base;
+    glyph_t * volatile * volatile variants;
     pixman_link_t	mru_link;
 };
 
-struct pixman_glyph_cache_t
+typedef struct
+{
+    pixman_link_t	link;
+    unsigned int	mask;
+    glyph_t *		slots[1];
+} glyph_table_t;
+
+typedef struct
 {
+    volatile int32_t	lock;
+    glyph_table_t * volatile table;
     int			n_glyphs;
     int			n_tombstones;
-    int			freeze_count;
+    uint64_t		n_bytes;
+    uint64_t		insertions;
     pixman_list_t	mru;
-    glyph_t *		glyphs[HASH_SIZE];
+    pixman_list_t	pages;
+    pixman_list_t	retired_glyphs;
+    pixman_list_t	retired_tables;
+} glyph_shard_t;
+
+typedef struct
+{
+    uint64_t		hits;
+    uint64_t		misses;
+    uint8_t		padding[64 - 2 * sizeof (uint64_t)];
+} glyph_counters_t;
+
+struct pixman_glyph_cache_t
+{
+    pixman_bool_t	shared;
+    volatile int32_t	freeze_lock;
+    int			freeze_count;
+    int			max_glyphs;
+    uint64_t		max_bytes;
+    uint64_t		evictions;
+    int			n_shards;
+    glyph_shard_t	shards[N_SHARDS];
+    glyph_counters_t	counters[N_COUNTERS];
 };
 
+static void
+free_page (glyph_page_t *page)
+{
+    pixman_list_unlink (&page->link);
+    pixman_image_unref (page->image);
+    free (page);
+}
+
+static glyph_page_t *
+create_page (glyph_shard_t *shard, pixman_format_code_t format)
+{
+    int bpp = PIXMAN_FORMAT_BPP (format);
+    glyph_page_t *page;
+
+    if (!(page = malloc (sizeof *page)))
+	return NULL;
+
+    /* Square pages of PAGE_BYTES: 512x512 for a8, 256x256 for 32 bpp */
+    page->width = page->height = bpp == 8 ? 512 : 256;
+    page->format = format;
+    page->top = 0;
+    page->n_glyphs = 0;
+    page->n_shelves = 0;
+
+    if (!(page->image = pixman_image_create_bits (
+	      format, page->width, page->height, NULL, -1)))
+    {
+	free (page);
+	return NULL;
+    }
+
+    if (PIXMAN_FORMAT_A (format) != 0 && PIXMAN_FORMAT_RGB (format) != 0)
+	pixman_image_set_component_alpha (page->image, TRUE);
+
+    _pixman_image_validate (page->image);
+
+    pixman_list_prepend (&shard->pages, &page->link);
+
+    return page;
+}
+
+/* The space may have been used by an earlier glyph, and compositing the
+ * new one into it doesn't necessarily write every pixel.
+ */
+static void
+clear_glyph (glyph_t *glyph)
+{
+    bits_image_t *bits = &glyph->image->bits;
+    int Bpp = PIXMAN_FORMAT_BPP (bits->format) / 8;
+    uint8_t *line = (uint8_t *)(bits->bits + glyph->y * bits->rowstride);
+    int y;
+
+    line += glyph->x * Bpp;
+
+    for (y = 0; y < glyph->height; ++y)
+    {
+	memset (line, 0, glyph->width * Bpp);
+	line += bits->rowstride * 4;
+    }
+}
+
+/* Finds room for a glyph in @page, preferring the lowest shelf that is
+ * not much taller than the glyph.
+ */
+static pixman_bool_t
+page_alloc (glyph_page_t *page, glyph_t *glyph)
+{
+    int height = (glyph->height + SHELF_ALIGN - 1) & ~(SHELF_ALIGN - 1);
+    glyph_shelf_t *shelf = NULL;
+    int i;
+
+    for (i = 0; i < page->n_shelves; ++i)
+    {
+	glyph_shelf_t *s = &page->shelves[i];
+
+	if (s->height < height || page->width - s->x < glyph->width)
+	    continue;
+
+	if (s->n_glyphs && s->height > height + height / 2)
+	    continue;
+
+	if (!shelf || s->height < shelf->height)
+	    shelf = s;
+    }
+
+    if (!shelf)
+    {
+	if (page->n_shelves == MAX_SHELVES		||
+	    page->top + height > page->height)
+	{
+	    return FALSE;
+	}
+
+	shelf = &page->shelves[page->n_shelves++];
+	shelf->y = page->top;
+	shelf->height = height;
+	shelf->x = 0;
+	shelf->n_glyphs = 0;
+
+	page->top += height;
+    }
+
+    glyph->page = page;
+    glyph->shelf = shelf - page->shelves;
+    glyph->image = page->image;
+    glyph->x = shelf->x;
+    glyph->y = shelf->y;
+
+    shelf->x += glyph->width;
+    shelf->n_glyphs++;
+    page->n_glyphs++;
+
+    clear_glyph (glyph);
+
+    return TRUE;
+}
+
+static void
+page_free (glyph_page_t *page, glyph_t *glyph)
+{
+    glyph_shelf_t *shelf = &page->shelves[glyph->shelf];
+
+    if (--shelf->n_glyphs == 0)
+    {
+	shelf->x = 0;
+
+	/* Give empty shelves at the top back to the page */
+	while (page->n_shelves &&
+	       page->shelves[page->n_shelves - 1].n_glyphs == 0)
+	{
+	    page->n_shelves--;
+	    page->top = page->shelves[page->n_shelves].y;
+	}
+    }
+
+    if (--page->n_glyphs == 0)
+	free_page (page);
+}
+
+static pixman_bool_t
+alloc_glyph_image (glyph_shard_t        *shard,
+		   glyph_t              *glyph,
+		   pixman_format_code_t  format)
+{
+    pixman_link_t *link;
+    glyph_page_t *page;
+
+    if ((format == PIXMAN_a8 || format == PIXMAN_a8r8g8b8) &&
+	glyph->width > 0 && glyph->height > 0			&&
+	glyph->width <= (PIXMAN_FORMAT_BPP (format) == 8 ? 128 : 64) &&
+	glyph->height <= (PIXMAN_FORMAT_BPP (format) == 8 ? 128 : 64))
+    {
+	for (link = shard->pages.head;
+	     link != (pixman_link_t *)&shard->pages;
+	     link = link->next)
+	{
+	    page = CONTAINER_OF (glyph_page_t, link, link);
+
+	    if (page->format == format && page_alloc (page, glyph))
+		return TRUE;
+	}
+
+	if ((page = create_page (shard, format)) && page_alloc (page, glyph))
+	    return TRUE;
+    }
+
+    glyph->page = NULL;
+    glyph->x = 0;
+    glyph->y = 0;
+
+    if (!(glyph->image = pixman_image_create_bits (
+	      format, glyph->width, glyph->height, NULL, -1)))
+    {
+	return FALSE;
+    }
+
+    if (PIXMAN_FORMAT_A (format) != 0 && PIXMAN_FORMAT_RGB (format) != 0)
+	pixman_image_set_component_alpha (glyph->image, TRUE);
+
+    return TRUE;
+}
+
+static void
+free_glyph_image (glyph_t *glyph)
+{
+    if (glyph->page)
+	page_free (glyph->page, glyph);
+    else
+	pixman_image_unref (glyph->image);
+}
+
 static void
 free_glyph (glyph_t *glyph)
 {
     pixman_list_unlink (&glyph->mru_link);
-    pixman_image_unref (glyph->image);
+
+    if (glyph->variants)
+    {
+	int i;
+
+	for (i = 0; i < MAX_PHASES; ++i)
+	{
+	    if (glyph->variants[i])
+	    {
+		free_glyph_image (glyph->variants[i]);
+		free (glyph->variants[i]);
+	    }
+	}
+
+	free ((void *)glyph->variants);
+    }
+
+    free_glyph_image (glyph);
     free (glyph);
 }
 
+static uint64_t
+image_bytes (const glyph_t *glyph)
+{
+    int bpp = PIXMAN_FORMAT_BPP (glyph->image->bits.format);
+
+    return (uint64_t)((glyph->width * bpp + 7) / 8) * glyph->height;
+}
+
+/* The bytes of a glyph and its variants */
+static uint64_t
+glyph_bytes (const glyph_t *glyph)
+{
+    uint64_t n_bytes = image_bytes (glyph);
+    int i;
+
+    if (glyph->variants)
+    {
+	for (i = 0; i < MAX_PHASES; ++i)
+	{
+	    if (glyph->variants[i])
+		n_bytes += image_bytes (glyph->variants[i]);
+	}
+    }
+
+    return n_bytes;
+}
+
 static unsigned int
 hash (const void *font_key, const void *glyph_key)
 {
@@ -91,16 +436,64 @@ hash (const void *font_key, const void *glyph_key)
     return key;
 }
 
+static glyph_shard_t *
+get_shard (pixman_glyph_cache_t *cache, unsigned int h)
+{
+    if (!cache->shared)
+	return &cache->shards[0];
+
+    return &cache->shards[(h >> (32 - SHARD_BITS)) & (N_SHARDS - 1)];
+}
+
+static void
+take_lock (pixman_glyph_cache_t *cache, volatile int32_t *lock)
+{
+    if (cache->shared)
+    {
+	while (!PIXMAN_TRY_LOCK (lock))
+	    ;
+    }
+}
+
+static void
+drop_lock (pixman_glyph_cache_t *cache, volatile int32_t *lock)
+{
+    if (cache->shared)
+	PIXMAN_UNLOCK (lock);
+}
+
+PIXMAN_DEFINE_THREAD_LOCAL (int, counters_index);
+
+static volatile int32_t next_counters_index;
+
+static glyph_counters_t *
+get_counters (pixman_glyph_cache_t *cache)
+{
+    int *index;
+
+    if (!cache->shared || !(index = PIXMAN_GET_THREAD_LOCAL (counters_index)))
+	return &cache->counters[0];
+
+    /* 0 means that the thread doesn't have an index yet */
+    if (!*index)
+	*index = PIXMAN_ATOMIC_FETCH_ADD_32 (&next_counters_index, 1) + 1;
+
+    return &cache->counters[*index & (N_COUNTERS - 1)];
+}
+
 static glyph_t *
-lookup_glyph (pixman_glyph_cache_t *cache,
-	      void                 *font_key,
-	      void                 *glyph_key)
+lookup_glyph (glyph_shard_t *shard,
+	      unsigned int   h,
+	      void          *font_key,
+	      void          *glyph_key)
 {
-    unsigned idx;
+    glyph_table_t *table = shard->table;
+    unsigned idx = h;
     glyph_t *g;
 
-    idx = hash (font_key, glyph_key);
-    while ((g = cache->glyphs[idx++ & HASH_MASK]))
+    PIXMAN_READ_BARRIER ();
+
+    while ((g = table->slots[idx++ & table->mask]))
     {
 	if (g != TOMBSTONE			&&
 	    g->font_key == font_key		&&
@@ -113,12 +506,13 @@ lookup_glyph (pixman_glyph_cache_t *cache,
     return NULL;
 }
 
-static void
-insert_glyph (pixman_glyph_cache_t *cache,
-	      glyph_t              *glyph)
+/* Returns TRUE if the glyph took the place of a tombstone */
+static pixman_bool_t
+table_insert (glyph_table_t *table, glyph_t *glyph)
 {
     unsigned idx;
     glyph_t **loc;
+    pixman_bool_t tombstone;
 
     idx = hash (glyph->font_key, glyph->glyph_key);
 
@@ -127,85 +521,271 @@ insert_glyph (pixman_glyph_cache_t *cache,
      */
     do
     {
-	loc = &cache->glyphs[idx++ & HASH_MASK];
+	loc = &table->slots[idx++ & table->mask];
     } while (*loc && *loc != TOMBSTONE);
 
-    if (*loc == TOMBSTONE)
-	cache->n_tombstones--;
-    cache->n_glyphs++;
+    tombstone = (*loc == TOMBSTONE);
+
+    /* Lookups in shared caches must not see the glyph before it is
+     * completely initialized.
+     */
+    PIXMAN_WRITE_BARRIER ();
 
     *loc = glyph;
+
+    return tombstone;
 }
 
 static void
-remove_glyph (pixman_glyph_cache_t *cache,
-	      glyph_t              *glyph)
+insert_glyph (glyph_shard_t *shard,
+	      glyph_t       *glyph)
+{
+    if (table_insert (shard->table, glyph))
+	shard->n_tombstones--;
+    shard->n_glyphs++;
+    shard->n_bytes += glyph_bytes (glyph);
+}
+
+static glyph_table_t *
+create_table (unsigned int size)
+{
+    glyph_table_t *table;
+
+    if (!(table = calloc (
+	      1, offsetof (glyph_table_t, slots) + size * sizeof (glyph_t *))))
+    {
+	return NULL;
+    }
+
+    table->mask = size - 1;
+
+    return table;
+}
+
+/* Replaces the table with one that has room for at least @n_glyphs
+ * glyphs and no tombstones. Lookups may still be using the old table,
+ * so in shared caches it is only freed later.
+ */
+static pixman_bool_t
+resize_table (pixman_glyph_cache_t *cache,
+	      glyph_shard_t        *shard,
+	      int                   n_glyphs)
+{
+    glyph_table_t *old_table = shard->table;
+    glyph_table_t *table;
+    unsigned int size = MIN_HASH_SIZE;
+    unsigned int i;
+
+    while (size / 4 < (unsigned int)n_glyphs)
+    {
+	if (size > INT32_MAX / 16)
+	    return FALSE;
+
+	size *= 2;
+    }
+
+    if (!(table = create_table (size)))
+	return FALSE;
+
+    for (i = 0; i <= old_table->mask; ++i)
+    {
+	glyph_t *glyph = old_table->slots[i];
+
+	if (glyph && glyph != TOMBSTONE)
+	    table_insert (table, glyph);
+    }
+
+    PIXMAN_WRITE_BARRIER ();
+
+    shard->table = table;
+    shard->n_tombstones = 0;
+
+    if (cache->shared)
+	pixman_list_prepend (&shard->retired_tables, &old_table->link);
+    else
+	free (old_table);
+
+    return TRUE;
+}
+
+static void
+remove_glyph (glyph_shard_t *shard,
+	      glyph_t       *glyph)
 {
+    glyph_table_t *table = shard->table;
     unsigned idx;
 
     idx = hash (glyph->font_key, glyph->glyph_key);
-    while (cache->glyphs[idx & HASH_MASK] != glyph)
+    while (table->slots[idx & table->mask] != glyph)
 	idx++;
 
-    cache->glyphs[idx & HASH_MASK] = TOMBSTONE;
-    cache->n_tombstones++;
-    cache->n_glyphs--;
+    table->slots[idx & table->mask] = TOMBSTONE;
+    shard->n_tombstones++;
+    shard->n_glyphs--;
+    shard->n_bytes -= glyph_bytes (glyph);
 
-    /* Eliminate tombstones if possible */
-    if (cache->glyphs[(idx + 1) & HASH_MASK] == NULL)
+    /* Eliminate tombstones if possible. This is safe with concurrent
+     * lookups, because no glyph can be found past the empty slot.
+     */
+    if (table->slots[(idx + 1) & table->mask] == NULL)
     {
-	while (cache->glyphs[idx & HASH_MASK] == TOMBSTONE)
+	while (table->slots[idx & table->mask] == TOMBSTONE)
 	{
-	    cache->glyphs[idx & HASH_MASK] = NULL;
-	    cache->n_tombstones--;
+	    table->slots[idx & table->mask] = NULL;
+	    shard->n_tombstones--;
 	    idx--;
 	}
     }
 }
 
+/* Frees a glyph that has been removed from the table, or in shared
+ * caches, keeps it until no thread has the cache frozen.
+ */
 static void
-clear_table (pixman_glyph_cache_t *cache)
+retire_glyph (pixman_glyph_cache_t *cache,
+	      glyph_shard_t        *shard,
+	      glyph_t              *glyph)
 {
-    int i;
+    if (cache->shared)
+    {
+	pixman_list_unlink (&glyph->mru_link);
+	pixman_list_prepend (&shard->retired_glyphs, &glyph->mru_link);
+    }
+    else
+    {
+	free_glyph (glyph);
+    }
+}
+
+static void
+free_retired (glyph_shard_t *shard)
+{
+    while (shard->retired_glyphs.head !=
+	   (pixman_link_t *)&shard->retired_glyphs)
+    {
+	free_glyph (CONTAINER_OF (
+			glyph_t, mru_link, shard->retired_glyphs.head));
+    }
 
-    for (i = 0; i < HASH_SIZE; ++i)
+    while (shard->retired_tables.head !=
+	   (pixman_link_t *)&shard->retired_tables)
     {
-	glyph_t *glyph = cache->glyphs[i];
+	pixman_link_t *link = shard->retired_tables.head;
+
+	pixman_list_unlink (link);
+	free (CONTAINER_OF (glyph_table_t, link, link));
+    }
+}
+
+static void
+clear_shard (glyph_shard_t *shard)
+{
+    glyph_table_t *table = shard->table;
+    unsigned int i;
+
+    for (i = 0; i <= table->mask; ++i)
+    {
+	glyph_t *glyph = table->slots[i];
 
 	if (glyph && glyph != TOMBSTONE)
 	    free_glyph (glyph);
 
-	cache->glyphs[i] = NULL;
+	table->slots[i] = NULL;
     }
 
-    cache->n_glyphs = 0;
-    cache->n_tombstones = 0;
+    free_retired (shard);
+
+    shard->n_glyphs = 0;
+    shard->n_tombstones = 0;
+    shard->n_bytes = 0;
 }
 
-PIXMAN_EXPORT pixman_glyph_cache_t *
-pixman_glyph_cache_create (void)
+static pixman_glyph_cache_t *
+create_cache (pixman_bool_t shared,
+	      int           max_glyphs,
+	      uint64_t      max_bytes)
 {
     pixman_glyph_cache_t *cache;
+    int i;
+
+    return_val_if_fail (max_glyphs >= 0, NULL);
 
     if (!(cache = malloc (sizeof *cache)))
 	return NULL;
 
-    memset (cache->glyphs, 0, sizeof (cache->glyphs));
-    cache->n_glyphs = 0;
-    cache->n_tombstones = 0;
+    cache->shared = shared;
+    cache->freeze_lock = 0;
     cache->freeze_count = 0;
+    cache->max_glyphs = max_glyphs;
+    cache->max_bytes = max_bytes;
+    cache->evictions = 0;
+    cache->n_shards = shared ? N_SHARDS : 1;
+
+    for (i = 0; i < N_COUNTERS; ++i)
+    {
+	cache->counters[i].hits = 0;
+	cache->counters[i].misses = 0;
+    }
+
+    for (i = 0; i < cache->n_shards; ++i)
+    {
+	glyph_shard_t *shard = &cache->shards[i];
 
-    pixman_list_init (&cache->mru);
+	if (!(shard->table = create_table (MIN_HASH_SIZE)))
+	{
+	    while (i--)
+		free (cache->shards[i].table);
+	    free (cache);
+	    return NULL;
+	}
+
+	shard->lock = 0;
+	shard->n_glyphs = 0;
+	shard->n_tombstones = 0;
+	shard->n_bytes = 0;
+	shard->insertions = 0;
+
+	pixman_list_init (&shard->mru);
+	pixman_list_init (&shard->pages);
+	pixman_list_init (&shard->retired_glyphs);
+	pixman_list_init (&shard->retired_tables);
+    }
 
     return cache;
 }
 
+PIXMAN_EXPORT pixman_glyph_cache_t *
+pixman_glyph_cache_create_with_limits (int      max_glyphs,
+				       uint64_t max_bytes)
+{
+    return create_cache (FALSE, max_glyphs, max_bytes);
+}
+
+PIXMAN_EXPORT pixman_glyph_cache_t *
+pixman_glyph_cache_create_shared (int      max_glyphs,
+				  uint64_t max_bytes)
+{
+    return create_cache (TRUE, max_glyphs, max_bytes);
+}
+
+PIXMAN_EXPORT pixman_glyph_cache_t *
+pixman_glyph_cache_create (void)
+{
+    return create_cache (FALSE, N_GLYPHS_HIGH_WATER, 0);
+}
+
 PIXMAN_EXPORT void
 pixman_glyph_cache_destroy (pixman_glyph_cache_t *cache)
 {
+    int i;
+
     return_if_fail (cache->freeze_count == 0);
 
-    clear_table (cache);
+    for (i = 0; i < cache->n_shards; ++i)
+    {
+	clear_shard (&cache->shards[i]);
+	free (cache->shards[i].table);
+    }
 
     free (cache);
 }
@@ -213,31 +793,116 @@ pixman_glyph_cache_destroy (pixman_glyph_cache_t *cache)
 PIXMAN_EXPORT void
 pixman_glyph_cache_freeze (pixman_glyph_cache_t  *cache)
 {
+    take_lock (cache, &cache->freeze_lock);
     cache->freeze_count++;
+    drop_lock (cache, &cache->freeze_lock);
 }
 
-PIXMAN_EXPORT void
-pixman_glyph_cache_thaw (pixman_glyph_cache_t  *cache)
+static pixman_bool_t
+over_limits (pixman_glyph_cache_t *cache,
+	     int n_glyphs, uint64_t n_bytes,
+	     int max_glyphs, uint64_t max_bytes)
+{
+    return (cache->max_glyphs && n_glyphs > max_glyphs)	||
+	   (cache->max_bytes && n_bytes > max_bytes);
+}
+
+/* Moves the glyphs that were marked as used to the front */
+static void
+promote_used (glyph_shard_t *shard)
+{
+    pixman_link_t *link = shard->mru.head;
+
+    while (link != (pixman_link_t *)&shard->mru)
+    {
+	glyph_t *glyph = CONTAINER_OF (glyph_t, mru_link, link);
+
+	link = link->next;
+
+	if (glyph->used)
+	{
+	    glyph->used = FALSE;
+	    pixman_list_move_to_front (&shard->mru, &glyph->mru_link);
+	}
+    }
+}
+
+/* Called when no thread has the cache frozen, so no other thread is
+ * using it.
+ */
+static void
+maintain_cache (pixman_glyph_cache_t *cache)
 {
-    if (--cache->freeze_count == 0					&&
-	cache->n_glyphs + cache->n_tombstones > N_GLYPHS_HIGH_WATER)
+    int n_glyphs = 0;
+    uint64_t n_bytes = 0;
+    int i;
+
+    for (i = 0; i < cache->n_shards; ++i)
     {
-	if (cache->n_tombstones > N_GLYPHS_HIGH_WATER)
+	n_glyphs += cache->shards[i].n_glyphs;
+	n_bytes += cache->shards[i].n_bytes;
+    }
+
+    if (over_limits (cache, n_glyphs, n_bytes,
+		     cache->max_glyphs, cache->max_bytes))
+    {
+	if (cache->shared)
 	{
-	    /* More than half the entries are
-	     * tombstones. Just dump the whole table.
-	     */
-	    clear_table (cache);
+	    for (i = 0; i < cache->n_shards; ++i)
+		promote_used (&cache->shards[i]);
 	}
 
-	while (cache->n_glyphs > N_GLYPHS_LOW_WATER)
+	/* Shards evict in turn, from the back of their MRU list */
+	i = 0;
+	while (n_glyphs && over_limits (cache, n_glyphs, n_bytes,
+					cache->max_glyphs / 2,
+					cache->max_bytes / 2))
 	{
-	    glyph_t *glyph = CONTAINER_OF (glyph_t, mru_link, cache->mru.tail);
+	    glyph_shard_t *shard = &cache->shards[i++ % cache->n_shards];
+	    glyph_t *glyph;
+
+	    if (!shard->n_glyphs)
+		continue;
 
-	    remove_glyph (cache, glyph);
+	    glyph = CONTAINER_OF (glyph_t, mru_link, shard->mru.tail);
+
+	    n_glyphs--;
+	    n_bytes -= glyph_bytes (glyph);
+
+	    remove_glyph (shard, glyph);
 	    free_glyph (glyph);
+
+	    cache->evictions++;
 	}
     }
+
+    for (i = 0; i < cache->n_shards; ++i)
+    {
+	glyph_shard_t *shard = &cache->shards[i];
+	unsigned int size = shard->table->mask + 1;
+
+	/* Shrink the table if it is mostly empty, or mostly tombstones.
+	 * If that fails, the old one is still fine.
+	 */
+	if ((size > MIN_HASH_SIZE && (unsigned int)shard->n_glyphs < size / 16) ||
+	    shard->n_tombstones > shard->n_glyphs)
+	{
+	    resize_table (cache, shard, shard->n_glyphs);
+	}
+
+	free_retired (shard);
+    }
+}
+
+PIXMAN_EXPORT void
+pixman_glyph_cache_thaw (pixman_glyph_cache_t  *cache)
+{
+    take_lock (cache, &cache->freeze_lock);
+
+    if (--cache->freeze_count == 0)
+	maintain_cache (cache);
+
+    drop_lock (cache, &cache->freeze_lock);
 }
 
 PIXMAN_EXPORT const void *
@@ -245,7 +910,18 @@ pixman_glyph_cache_lookup (pixman_glyph_cache_t  *cache,
 			   void                  *font_key,
 			   void                  *glyph_key)
 {
-    return lookup_glyph (cache, font_key, glyph_key);
+    unsigned int h = hash (font_key, glyph_key);
+    glyph_shard_t *shard = get_shard (cache, h);
+    glyph_t *glyph;
+
+    glyph = lookup_glyph (shard, h, font_key, glyph_key);
+
+    if (glyph)
+	get_counters (cache)->hits++;
+    else
+	get_counters (cache)->misses++;
+
+    return glyph;
 }
 
 PIXMAN_EXPORT const void *
@@ -256,47 +932,62 @@ pixman_glyph_cache_insert (pixman_glyph_cache_t  *cache,
 			   int                    origin_y,
 			   pixman_image_t        *image)
 {
+    unsigned int h = hash (font_key, glyph_key);
+    glyph_shard_t *shard = get_shard (cache, h);
     glyph_t *glyph;
-    int32_t width, height;
 
     return_val_if_fail (cache->freeze_count > 0, NULL);
     return_val_if_fail (image->type == BITS, NULL);
 
-    width = image->bits.width;
-    height = image->bits.height;
+    take_lock (cache, &shard->lock);
 
-    if (cache->n_glyphs >= HASH_SIZE)
-	return NULL;
+    /* Another thread may have inserted it after the caller looked */
+    if (cache->shared && (glyph = lookup_glyph (shard, h, font_key, glyph_key)))
+	goto out;
+
+    glyph = NULL;
+
+    /* Make sure there is room in the table, see table_insert() */
+    if ((unsigned int)(shard->n_glyphs + shard->n_tombstones + 1) >
+	(shard->table->mask + 1) / 2)
+    {
+	if (!resize_table (cache, shard, shard->n_glyphs + 1))
+	    goto out;
+    }
 
     if (!(glyph = malloc (sizeof *glyph)))
-	return NULL;
+	goto out;
 
     glyph->font_key = font_key;
     glyph->glyph_key = glyph_key;
     glyph->origin_x = origin_x;
     glyph->origin_y = origin_y;
+    glyph->width = image->bits.width;
+    glyph->height = image->bits.height;
+    glyph->used = FALSE;
+    glyph->base = glyph;
+    glyph->variants = NULL;
 
-    if (!(glyph->image = pixman_image_create_bits (
-	      image->bits.format, width, height, NULL, -1)))
+    if (!alloc_glyph_image (shard, glyph, image->bits.format))
     {
 	free (glyph);
-	return NULL;
+	glyph = NULL;
+	goto out;
     }
 
     pixman_image_composite32 (PIXMAN_OP_SRC,
-			      image, NULL, glyph->image, 0, 0, 0, 0, 0, 0,
-			      width, height);
-
-    if (PIXMAN_FORMAT_A   (glyph->image->bits.format) != 0	&&
-	PIXMAN_FORMAT_RGB (glyph->image->bits.format) != 0)
-    {
-	pixman_image_set_component_alpha (glyph->image, TRUE);
-    }
+			      image, NULL, glyph->image, 0, 0, 0, 0,
+			      glyph->x, glyph->y, glyph->width, glyph->height);
 
-    pixman_list_prepend (&cache->mru, &glyph->mru_link);
+    pixman_list_prepend (&shard->mru, &glyph->mru_link);
 
     _pixman_image_validate (glyph->image);
-    insert_glyph (cache, glyph);
+    insert_glyph (shard, glyph);
+
+    shard->insertions++;
+
+out:
+    drop_lock (cache, &shard->lock);
 
     return glyph;
 }
@@ -306,14 +997,194 @@ pixman_glyph_cache_remove (pixman_glyph_cache_t  *cache,
 			   void                  *font_key,
 			   void                  *glyph_key)
 {
+    unsigned int h = hash (font_key, glyph_key);
+    glyph_shard_t *shard = get_shard (cache, h);
     glyph_t *glyph;
 
-    if ((glyph = lookup_glyph (cache, font_key, glyph_key)))
+    take_lock (cache, &shard->lock);
+
+    if ((glyph = lookup_glyph (shard, h, font_key, glyph_key)))
     {
-	remove_glyph (cache, glyph);
+	remove_glyph (shard, glyph);
 
-	free_glyph (glyph);
+	retire_glyph (cache, shard, glyph);
+    }
+
+    drop_lock (cache, &shard->lock);
+}
+
+static pixman_bool_t
+has_variants (const glyph_t *glyph)
+{
+    pixman_format_code_t format = glyph->image->bits.format;
+
+    return (format == PIXMAN_a8 || format == PIXMAN_a8r8g8b8) &&
+	glyph->width > 0 && glyph->height > 0;
+}
+
+/* Each channel of the variant is interpolated between the pixel at the
+ * same position in the glyph and the one to the left of it.
+ */
+static void
+shift_glyph (const glyph_t *glyph, glyph_t *variant, int phase)
+{
+    const bits_image_t *src = &glyph->image->bits;
+    const bits_image_t *dst = &variant->image->bits;
+    int Bpp = PIXMAN_FORMAT_BPP (src->format) / 8;
+    int n_bytes = glyph->width * Bpp;
+    int w = phase * 256 / MAX_PHASES;
+    int x, y;
+
+    for (y = 0; y < glyph->height; ++y)
+    {
+	const uint8_t *s = (const uint8_t *)(
+	    src->bits + (glyph->y + y) * src->rowstride) + glyph->x * Bpp;
+	uint8_t *d = (uint8_t *)(
+	    dst->bits + (variant->y + y) * dst->rowstride) + variant->x * Bpp;
+
+	for (x = 0; x < n_bytes + Bpp; ++x)
+	{
+	    int cur = x < n_bytes ? s[x] : 0;
+	    int left = x >= Bpp ? s[x - Bpp] : 0;
+
+	    d[x] = (cur * (256 - w) + left * w + 128) >> 8;
+	}
+    }
+}
+
+static glyph_t *
+create_variant (glyph_shard_t *shard, glyph_t *glyph, int phase)
+{
+    glyph_t *variant;
+
+    if (!glyph->variants)
+    {
+	glyph_t **variants;
+
+	if (!(variants = calloc (MAX_PHASES, sizeof (glyph_t *))))
+	    return NULL;
+
+	PIXMAN_WRITE_BARRIER ();
+
+	glyph->variants = variants;
+    }
+
+    if (!(variant = malloc (sizeof *variant)))
+	return NULL;
+
+    *variant = *glyph;
+    variant->width = glyph->width + 1;
+    variant->base = glyph;
+    variant->variants = NULL;
+
+    if (!alloc_glyph_image (shard, variant, glyph->image->bits.format))
+    {
+	free (variant);
+	return NULL;
+    }
+
+    shift_glyph (glyph, variant, phase);
+
+    _pixman_image_validate (variant->image);
+
+    shard->n_bytes += image_bytes (variant);
+
+    /* As in table_insert(), lookups must not see it half done */
+    PIXMAN_WRITE_BARRIER ();
+
+    glyph->variants[phase] = variant;
+
+    return variant;
+}
+
+PIXMAN_EXPORT const void *
+pixman_glyph_cache_lookup_subpixel (pixman_glyph_cache_t  *cache,
+				    void                  *font_key,
+				    void                  *glyph_key,
+				    int                    phase,
+				    int                    n_phases)
+{
+    unsigned int h = hash (font_key, glyph_key);
+    glyph_shard_t *shard = get_shard (cache, h);
+    glyph_t *glyph, *variant;
+
+    return_val_if_fail (n_phases > 0 && n_phases <= MAX_PHASES &&
+			(n_phases & (n_phases - 1)) == 0, NULL);
+    return_val_if_fail (phase >= 0 && phase < n_phases, NULL);
+
+    if (!(glyph = lookup_glyph (shard, h, font_key, glyph_key)))
+    {
+	get_counters (cache)->misses++;
+	return NULL;
+    }
+
+    get_counters (cache)->hits++;
+
+    phase *= MAX_PHASES / n_phases;
+    if (phase == 0 || !has_variants (glyph))
+	return glyph;
+
+    if (glyph->variants && (variant = glyph->variants[phase]))
+	return variant;
+
+    return_val_if_fail (cache->freeze_count > 0, glyph);
+
+    take_lock (cache, &shard->lock);
+
+    if (!glyph->variants || !(variant = glyph->variants[phase]))
+	variant = create_variant (shard, glyph, phase);
+
+    drop_lock (cache, &shard->lock);
+
+    /* Without memory for the variant, the unshifted glyph will do */
+    return variant ? variant : glyph;
+}
+
+PIXMAN_EXPORT void
+pixman_glyph_cache_get_stats (pixman_glyph_cache_t       *cache,
+			      pixman_glyph_cache_stats_t *stats)
+{
+    int i;
+
+    stats->n_glyphs = 0;
+    stats->n_bytes = 0;
+    stats->hits = 0;
+    stats->misses = 0;
+    stats->insertions = 0;
+    stats->evictions = cache->evictions;
+
+    for (i = 0; i < cache->n_shards; ++i)
+    {
+	glyph_shard_t *shard = &cache->shards[i];
+
+	stats->n_glyphs += shard->n_glyphs;
+	stats->n_bytes += shard->n_bytes;
+	stats->insertions += shard->insertions;
+    }
+
+    for (i = 0; i < N_COUNTERS; ++i)
+    {
+	stats->hits += cache->counters[i].hits;
+	stats->misses += cache->counters[i].misses;
+    }
+}
+
+/* Compositing a glyph makes it the most recently used one */
+static force_inline void
+touch_glyph (pixman_glyph_cache_t *cache, glyph_t *glyph)
+{
+    glyph = glyph->base;
+
+    /* Only written when it changes, so that threads compositing the
+     * same glyphs don't keep taking its cache line from each other.
+     */
+    if (cache->shared)
+    {
+	if (!glyph->used)
+	    glyph->used = TRUE;
     }
+    else
+	pixman_list_move_to_front (&cache->shards[0].mru, &glyph->mru_link);
 }
 
 PIXMAN_EXPORT void
@@ -334,8 +1205,8 @@ pixman_glyph_get_extents (pixman_glyph_cache_t *cache,
 
 	x1 = glyphs[i].x - glyph->origin_x;
 	y1 = glyphs[i].y - glyph->origin_y;
-	x2 = glyphs[i].x - glyph->origin_x + glyph->image->bits.width;
-	y2 = glyphs[i].y - glyph->origin_y + glyph->image->bits.height;
+	x2 = glyphs[i].x - glyph->origin_x + glyph->width;
+	y2 = glyphs[i].y - glyph->origin_y + glyph->height;
 
 	if (x1 < extents->x1)
 	    extents->x1 = x1;
@@ -378,6 +1249,25 @@ pixman_glyph_get_mask_format (pixman_glyph_cache_t *cache,
     return format;
 }
 
+static pixman_bool_t
+op_ignores_clear_mask (pixman_op_t op)
+{
+    switch (op)
+    {
+    case PIXMAN_OP_DST:
+    case PIXMAN_OP_OVER:
+    case PIXMAN_OP_OVER_REVERSE:
+    case PIXMAN_OP_OUT_REVERSE:
+    case PIXMAN_OP_ATOP:
+    case PIXMAN_OP_XOR:
+    case PIXMAN_OP_ADD:
+	return TRUE;
+
+    default:
+	return FALSE;
+    }
+}
+
 static pixman_bool_t
 box32_intersect (pixman_box32_t *dest,
 		 const pixman_box32_t *box1,
@@ -391,20 +1281,21 @@ box32_intersect (pixman_box32_t *dest,
     return dest->x2 > dest->x1 && dest->y2 > dest->y1;
 }
 
-#if defined(__GNUC__) && !defined(__x86_64__) && !defined(__amd64__)
-__attribute__((__force_align_arg_pointer__))
-#endif
-PIXMAN_EXPORT void
-pixman_composite_glyphs_no_mask (pixman_op_t            op,
-				 pixman_image_t        *src,
-				 pixman_image_t        *dest,
-				 int32_t                src_x,
-				 int32_t                src_y,
-				 int32_t                dest_x,
-				 int32_t                dest_y,
-				 pixman_glyph_cache_t  *cache,
-				 int                    n_glyphs,
-				 const pixman_glyph_t  *glyphs)
+/* Composites each glyph with the glyph as the mask, within @bounds in
+ * destination coordinates.
+ */
+static void
+composite_glyphs_direct (pixman_op_t            op,
+			 pixman_image_t        *src,
+			 pixman_image_t        *dest,
+			 int32_t                src_x,
+			 int32_t                src_y,
+			 int32_t                dest_x,
+			 int32_t                dest_y,
+			 const pixman_box32_t  *bounds,
+			 pixman_glyph_cache_t  *cache,
+			 int                    n_glyphs,
+			 const pixman_glyph_t  *glyphs)
 {
     pixman_region32_t region;
     pixman_format_code_t glyph_format = PIXMAN_null;
@@ -414,6 +1305,8 @@ pixman_composite_glyphs_no_mask (pixman_op_t            op,
     pixman_composite_func_t func = NULL;
     pixman_implementation_t *implementation = NULL;
     pixman_composite_info_t info;
+    pixman_bool_t stats = _pixman_stats_enabled;
+    uint64_t start = 0;
     int i;
 
     _pixman_image_validate (src);
@@ -426,8 +1319,9 @@ pixman_composite_glyphs_no_mask (pixman_op_t            op,
     if (!_pixman_compute_composite_region32 (
 	    &region,
 	    src, NULL, dest,
-	    src_x - dest_x, src_y - dest_y, 0, 0, 0, 0,
-	    dest->bits.width, dest->bits.height))
+	    src_x - dest_x + bounds->x1, src_y - dest_y + bounds->y1, 0, 0,
+	    bounds->x1, bounds->y1,
+	    bounds->x2 - bounds->x1, bounds->y2 - bounds->y1))
     {
 	goto out;
     }
@@ -450,8 +1344,8 @@ pixman_composite_glyphs_no_mask (pixman_op_t            op,
 
 	glyph_box.x1 = dest_x + glyphs[i].x - glyph->origin_x;
 	glyph_box.y1 = dest_y + glyphs[i].y - glyph->origin_y;
-	glyph_box.x2 = glyph_box.x1 + glyph->image->bits.width;
-	glyph_box.y2 = glyph_box.y1 + glyph->image->bits.height;
+	glyph_box.x2 = glyph_box.x1 + glyph->width;
+	glyph_box.y2 = glyph_box.y1 + glyph->height;
 	
 	pbox = pixman_region32_rectangles (&region, &n);
 	
@@ -477,8 +1371,8 @@ pixman_composite_glyphs_no_mask (pixman_op_t            op,
 
 		info.src_x = src_x + composite_box.x1 - dest_x;
 		info.src_y = src_y + composite_box.y1 - dest_y;
-		info.mask_x = composite_box.x1 - (dest_x + glyphs[i].x - glyph->origin_x);
-		info.mask_y = composite_box.y1 - (dest_y + glyphs[i].y - glyph->origin_y);
+		info.mask_x = glyph->x + composite_box.x1 - glyph_box.x1;
+		info.mask_y = glyph->y + composite_box.y1 - glyph_box.y1;
 		info.dest_x = composite_box.x1;
 		info.dest_y = composite_box.y1;
 		info.width = composite_box.x2 - composite_box.x1;
@@ -486,24 +1380,93 @@ pixman_composite_glyphs_no_mask (pixman_op_t            op,
 
 		info.mask_flags = glyph_flags;
 
+		if (stats)
+		    start = _pixman_stats_timestamp ();
+
 		func (implementation, &info);
+
+		if (stats)
+		    _pixman_stats_record (implementation, func, &info, start);
 	    }
 
 	    pbox++;
 	}
-	pixman_list_move_to_front (&cache->mru, &glyph->mru_link);
+	touch_glyph (cache, glyph);
     }
 
 out:
     pixman_region32_fini (&region);
 }
 
+#if defined(__GNUC__) && !defined(__x86_64__) && !defined(__amd64__)
+__attribute__((__force_align_arg_pointer__))
+#endif
+PIXMAN_EXPORT void
+pixman_composite_glyphs_no_mask (pixman_op_t            op,
+				 pixman_image_t        *src,
+				 pixman_image_t        *dest,
+				 int32_t                src_x,
+				 int32_t                src_y,
+				 int32_t                dest_x,
+				 int32_t                dest_y,
+				 pixman_glyph_cache_t  *cache,
+				 int                    n_glyphs,
+				 const pixman_glyph_t  *glyphs)
+{
+    pixman_box32_t bounds;
+
+    bounds.x1 = 0;
+    bounds.y1 = 0;
+    bounds.x2 = dest->bits.width;
+    bounds.y2 = dest->bits.height;
+
+    composite_glyphs_direct (op, src, dest, src_x, src_y, dest_x, dest_y,
+			     &bounds, cache, n_glyphs, glyphs);
+}
+
+/* Glyphs in the same format as the mask are added to it by the
+ * implementation's add_glyphs() in batches of this many.
+ */
+#define N_BLITS 32
+
+/* Adds a batch of glyphs, and counts it when statistics are enabled */
+static void
+flush_blits (pixman_image_t *dest, int n_blits, const pixman_glyph_blit_t *blits)
+{
+    pixman_implementation_t *imp;
+    uint64_t start, pixels = 0;
+    int i;
+
+    if (!_pixman_stats_enabled)
+    {
+	_pixman_implementation_add_glyphs (
+	    get_implementation (), dest->bits.rowstride * 4, n_blits, blits);
+	return;
+    }
+
+    for (i = 0; i < n_blits; ++i)
+	pixels += (uint64_t)blits[i].width * blits[i].height;
+    pixels = pixels * 8 / PIXMAN_FORMAT_BPP (dest->bits.format);
+
+    start = _pixman_stats_timestamp ();
+
+    imp = _pixman_implementation_add_glyphs (
+	get_implementation (), dest->bits.rowstride * 4, n_blits, blits);
+
+    if (imp)
+	_pixman_stats_record_glyphs (imp, dest->bits.format, n_blits, pixels, start);
+}
+
 static void
 add_glyphs (pixman_glyph_cache_t *cache,
 	    pixman_image_t *dest,
 	    int off_x, int off_y,
 	    int n_glyphs, const pixman_glyph_t *glyphs)
 {
+    pixman_glyph_blit_t blits[N_BLITS];
+    pixman_bool_t batch;
+    int n_blits = 0;
+    int bpp;
     pixman_format_code_t glyph_format = PIXMAN_null;
     uint32_t glyph_flags = 0;
     pixman_composite_func_t func = NULL;
@@ -514,6 +1477,8 @@ add_glyphs (pixman_glyph_cache_t *cache,
     pixman_composite_info_t info;
     pixman_image_t *white_img = NULL;
     pixman_bool_t white_src = FALSE;
+    pixman_bool_t stats = _pixman_stats_enabled;
+    uint64_t start = 0;
     int i;
 
     _pixman_image_validate (dest);
@@ -532,6 +1497,12 @@ add_glyphs (pixman_glyph_cache_t *cache,
     dest_box.x2 = dest->bits.width;
     dest_box.y2 = dest->bits.height;
 
+    /* Saturating adds give the same result in any order, so glyphs that
+     * can be blitted may be added later than the ones that can't.
+     */
+    bpp = PIXMAN_FORMAT_BPP (dest->bits.format);
+    batch = dest->bits.format == PIXMAN_a8 || dest->bits.format == PIXMAN_a8r8g8b8;
+
     for (i = 0; i < n_glyphs; ++i)
     {
 	glyph_t *glyph = (glyph_t *)glyphs[i].glyph;
@@ -539,6 +1510,40 @@ add_glyphs (pixman_glyph_cache_t *cache,
 	pixman_box32_t glyph_box;
 	pixman_box32_t composite_box;
 
+	if (batch && glyph_img->bits.format == dest->bits.format)
+	{
+	    glyph_box.x1 = glyphs[i].x - glyph->origin_x + off_x;
+	    glyph_box.y1 = glyphs[i].y - glyph->origin_y + off_y;
+	    glyph_box.x2 = glyph_box.x1 + glyph->width;
+	    glyph_box.y2 = glyph_box.y1 + glyph->height;
+
+	    if (box32_intersect (&composite_box, &glyph_box, &dest_box))
+	    {
+		pixman_glyph_blit_t *blit = &blits[n_blits++];
+		int src_x = glyph->x + composite_box.x1 - glyph_box.x1;
+		int src_y = glyph->y + composite_box.y1 - glyph_box.y1;
+
+		blit->src_stride = glyph_img->bits.rowstride * 4;
+		blit->src = (uint8_t *)glyph_img->bits.bits +
+		    src_y * blit->src_stride + src_x * bpp / 8;
+		blit->dest = (uint8_t *)dest->bits.bits +
+		    composite_box.y1 * dest->bits.rowstride * 4 +
+		    composite_box.x1 * bpp / 8;
+		blit->width = (composite_box.x2 - composite_box.x1) * bpp / 8;
+		blit->height = composite_box.y2 - composite_box.y1;
+
+		if (n_blits == N_BLITS)
+		{
+		    flush_blits (dest, n_blits, blits);
+		    n_blits = 0;
+		}
+
+		touch_glyph (cache, glyph);
+	    }
+
+	    continue;
+	}
+
 	if (glyph_img->common.extended_format_code != glyph_format	||
 	    glyph_img->common.flags != glyph_flags)
 	{
@@ -586,13 +1591,13 @@ add_glyphs (pixman_glyph_cache_t *cache,
 
 	glyph_box.x1 = glyphs[i].x - glyph->origin_x + off_x;
 	glyph_box.y1 = glyphs[i].y - glyph->origin_y + off_y;
-	glyph_box.x2 = glyph_box.x1 + glyph->image->bits.width;
-	glyph_box.y2 = glyph_box.y1 + glyph->image->bits.height;
+	glyph_box.x2 = glyph_box.x1 + glyph->width;
+	glyph_box.y2 = glyph_box.y1 + glyph->height;
 	
 	if (box32_intersect (&composite_box, &glyph_box, &dest_box))
 	{
-	    int src_x = composite_box.x1 - glyph_box.x1;
-	    int src_y = composite_box.y1 - glyph_box.y1;
+	    int src_x = glyph->x + composite_box.x1 - glyph_box.x1;
+	    int src_y = glyph->y + composite_box.y1 - glyph_box.y1;
 
 	    if (white_src)
 		info.mask_image = glyph_img;
@@ -606,13 +1611,22 @@ add_glyphs (pixman_glyph_cache_t *cache,
 	    info.width = composite_box.x2 - composite_box.x1;
 	    info.height = composite_box.y2 - composite_box.y1;
 
+	    if (stats)
+		start = _pixman_stats_timestamp ();
+
 	    func (implementation, &info);
 
-	    pixman_list_move_to_front (&cache->mru, &glyph->mru_link);
+	    if (stats)
+		_pixman_stats_record (implementation, func, &info, start);
+
+	    touch_glyph (cache, glyph);
 	}
     }
 
 out:
+    if (n_blits)
+	flush_blits (dest, n_blits, blits);
+
     if (white_img)
 	pixman_image_unref (white_img);
 }
@@ -629,9 +1643,11 @@ out:
  *
  * rectangle.
  *
+ * When the operator leaves the destination alone where the mask is zero,
+ * only the part of the mask that has glyphs is composited.
+ *
  * TODO:
  *   - Trim the mask to the destination clip/image?
- *   - Trim composite region based on sources, when the op ignores 0s.
  */
 #if defined(__GNUC__) && !defined(__x86_64__) && !defined(__amd64__)
 __attribute__((__force_align_arg_pointer__))
@@ -653,24 +1669,113 @@ pixman_composite_glyphs (pixman_op_t            op,
 			 int			n_glyphs,
 			 const pixman_glyph_t  *glyphs)
 {
+    pixman_box32_t extents = { 0, 0, width, height };
+    pixman_bool_t direct = FALSE;
     pixman_image_t *mask;
+    uint32_t *bits = NULL;
+    int mask_width, mask_height, stride;
+    size_t size;
+
+    /* Where the mask is zero, these operators leave the destination
+     * alone, so only the part of the mask that has glyphs matters. If
+     * in addition no two glyphs overlap and they all have the format of
+     * the mask, the mask is the same as each glyph where that glyph is,
+     * and the glyphs can be used as the mask directly.
+     */
+    if (PIXMAN_FORMAT_A (mask_format) != 0 && op_ignores_clear_mask (op))
+    {
+	int32_t last_x2 = INT32_MIN;
+	int i;
+
+	direct = TRUE;
+	extents.x1 = extents.y1 = INT32_MAX;
+	extents.x2 = extents.y2 = INT32_MIN;
+
+	for (i = 0; i < n_glyphs; ++i)
+	{
+	    glyph_t *glyph = (glyph_t *)glyphs[i].glyph;
+	    int32_t x1 = glyphs[i].x - glyph->origin_x - mask_x;
+	    int32_t y1 = glyphs[i].y - glyph->origin_y - mask_y;
+
+	    if (glyph->width <= 0 || glyph->height <= 0)
+		continue;
+
+	    /* Only runs that go from left to right are checked */
+	    if (glyph->image->bits.format != mask_format || x1 < last_x2)
+		direct = FALSE;
+	    last_x2 = x1 + glyph->width;
+
+	    extents.x1 = MIN (extents.x1, x1);
+	    extents.y1 = MIN (extents.y1, y1);
+	    extents.x2 = MAX (extents.x2, x1 + glyph->width);
+	    extents.y2 = MAX (extents.y2, y1 + glyph->height);
+	}
+
+	extents.x1 = MAX (extents.x1, 0);
+	extents.y1 = MAX (extents.y1, 0);
+	extents.x2 = MIN (extents.x2, width);
+	extents.y2 = MIN (extents.y2, height);
+    }
+
+    mask_width = extents.x2 - extents.x1;
+    mask_height = extents.y2 - extents.y1;
 
-    if (!(mask = pixman_image_create_bits (mask_format, width, height, NULL, -1)))
+    if (mask_width <= 0 || mask_height <= 0)
 	return;
 
+    if (direct)
+    {
+	pixman_box32_t bounds;
+
+	bounds.x1 = dest_x + extents.x1;
+	bounds.y1 = dest_y + extents.y1;
+	bounds.x2 = dest_x + extents.x2;
+	bounds.y2 = dest_y + extents.y2;
+
+	composite_glyphs_direct (op, src, dest,
+				 src_x - mask_x, src_y - mask_y,
+				 dest_x - mask_x, dest_y - mask_y,
+				 &bounds, cache, n_glyphs, glyphs);
+	return;
+    }
+
+    /* The mask only lives for this call, so small ones are taken from
+     * the scanline arena rather than the heap.
+     */
+    stride = (mask_width * PIXMAN_FORMAT_BPP (mask_format) + 31) / 32 * 4;
+    size = (size_t)stride * mask_height;
+    if (size <= MAX_ARENA_MASK_BYTES)
+    {
+	if (!(bits = _pixman_scanline_arena_alloc (size, 0)))
+	    return;
+
+	memset (bits, 0, size);
+    }
+
+    if (!(mask = pixman_image_create_bits (
+	      mask_format, mask_width, mask_height, bits, bits ? stride : -1)))
+    {
+	if (bits)
+	    _pixman_scanline_arena_free (bits);
+	return;
+    }
+
     if (PIXMAN_FORMAT_A   (mask_format) != 0 &&
 	PIXMAN_FORMAT_RGB (mask_format) != 0)
     {
 	pixman_image_set_component_alpha (mask, TRUE);
     }
 
-    add_glyphs (cache, mask, - mask_x, - mask_y, n_glyphs, glyphs);
+    add_glyphs (cache, mask, - mask_x - extents.x1, - mask_y - extents.y1,
+		n_glyphs, glyphs);
 
     pixman_image_composite32 (op, src, mask, dest,
-			      src_x, src_y,
+			      src_x + extents.x1, src_y + extents.y1,
 			      0, 0,
-			      dest_x, dest_y,
-			      width, height);
+			      dest_x + extents.x1, dest_y + extents.y1,
+			      mask_width, mask_height);
 
     pixman_image_unref (mask);
+    if (bits)
+	_pixman_scanline_arena_free (bits);
 }
@@ -129,6 +129,12 @@ _pixman_image_init (pixman_image_t *image)
     common->destroy_func = NULL;
     common->destroy_data = NULL;
     common->dirty = TRUE;
+    common->generation = _pixman_image_next_generation ();
+    common->plans = NULL;
+    common->plans_lock = 0;
+    common->plan_hits = 0;
+    common->plan_misses = 0;
+    common->plans_sparse = FALSE;
 }
 
 pixman_bool_t
@@ -147,6 +153,7 @@ _pixman_image_fini (pixman_image_t *image)
 
 	free (common->transform);
 	free (common->filter_params);
+	free (common->plans);
 
 	if (common->alpha_map)
 	    pixman_image_unref ((pixman_image_t *)common->alpha_map);
@@ -189,10 +196,19 @@ _pixman_image_allocate (void)
     return image;
 }
 
+uint64_t
+_pixman_image_next_generation (void)
+{
+    static volatile uint64_t generation;
+
+    return PIXMAN_ATOMIC_FETCH_ADD_64 (&generation, 1) + 1;
+}
+
 static void
 image_property_changed (pixman_image_t *image)
 {
     image->common.dirty = TRUE;
+    image->common.generation = _pixman_image_next_generation ();
 }
 
 /* Ref Counting */
@@ -608,6 +624,8 @@ pixman_image_set_has_client_clip (pixman_image_t *image,
                                   pixman_bool_t   client_clip)
 {
     image->common.client_clip = client_clip;
+
+    image_property_changed (image);
 }
 
 PIXMAN_EXPORT pixman_bool_t
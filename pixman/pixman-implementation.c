@@ -54,6 +54,11 @@ _pixman_implementation_create (pixman_implementation_t *fallback,
 
 #define N_CACHED_FAST_PATHS 8
 
+/* Each thread accumulates its statistics locally and adds them to the
+ * global counters every STATS_FLUSH_INTERVAL lookups.
+ */
+#define STATS_FLUSH_INTERVAL 64
+
 typedef struct
 {
     struct
@@ -61,10 +66,336 @@ typedef struct
 	pixman_implementation_t *	imp;
 	pixman_fast_path_t		fast_path;
     } cache [N_CACHED_FAST_PATHS];
+
+    uint32_t	n_lookups;
+    uint32_t	n_hits;
+    uint32_t	n_misses;
+    uint32_t	n_candidates;
 } cache_t;
 
 PIXMAN_DEFINE_THREAD_LOCAL (cache_t, fast_path_cache);
 
+static volatile uint64_t stats_cache_hits;
+static volatile uint64_t stats_cache_misses;
+static volatile uint64_t stats_candidates;
+
+static void
+flush_stats (cache_t *cache)
+{
+    PIXMAN_ATOMIC_FETCH_ADD_64 (&stats_cache_hits, cache->n_hits);
+    PIXMAN_ATOMIC_FETCH_ADD_64 (&stats_cache_misses, cache->n_misses);
+    PIXMAN_ATOMIC_FETCH_ADD_64 (&stats_candidates, cache->n_candidates);
+
+    cache->n_lookups = 0;
+    cache->n_hits = 0;
+    cache->n_misses = 0;
+    cache->n_candidates = 0;
+}
+
+PIXMAN_EXPORT void
+pixman_get_dispatch_stats (pixman_dispatch_stats_t *stats)
+{
+    cache_t *cache = PIXMAN_GET_THREAD_LOCAL (fast_path_cache);
+
+    if (cache)
+	flush_stats (cache);
+
+    stats->cache_hits = PIXMAN_ATOMIC_FETCH_ADD_64 (&stats_cache_hits, 0);
+    stats->cache_misses = PIXMAN_ATOMIC_FETCH_ADD_64 (&stats_cache_misses, 0);
+    stats->candidates = PIXMAN_ATOMIC_FETCH_ADD_64 (&stats_candidates, 0);
+}
+
+PIXMAN_EXPORT void
+pixman_reset_dispatch_stats (void)
+{
+    pixman_dispatch_stats_t stats;
+
+    pixman_get_dispatch_stats (&stats);
+
+    PIXMAN_ATOMIC_FETCH_ADD_64 (&stats_cache_hits, -stats.cache_hits);
+    PIXMAN_ATOMIC_FETCH_ADD_64 (&stats_cache_misses, -stats.cache_misses);
+    PIXMAN_ATOMIC_FETCH_ADD_64 (&stats_candidates, -stats.candidates);
+}
+
+/* Fast path index
+ *
+ * Instead of scanning the fast path tables of every implementation in
+ * the chain on a cache miss, the candidates for an exact (op, src_format,
+ * mask_format, dest_format) key are found in a hash table built once
+ * the chain is complete. Fast paths using PIXMAN_OP_any or PIXMAN_any
+ * can't be hashed, so they are kept in a separate list. Both lists are
+ * sorted by their position in the linear scan, and the lookup merges
+ * them, so it finds the same fast path the scan would.
+ */
+typedef struct
+{
+    const pixman_fast_path_t *	fast_path;
+    pixman_implementation_t *	imp;
+    int				position;
+} index_entry_t;
+
+typedef struct
+{
+    pixman_op_t			op;
+    pixman_format_code_t	src_format;
+    pixman_format_code_t	mask_format;
+    pixman_format_code_t	dest_format;
+    int				first;
+    int				n_entries;
+} index_bucket_t;
+
+struct pixman_fast_path_index_t
+{
+    uint32_t		bucket_mask;
+    index_bucket_t *	buckets;
+    index_entry_t *	entries;
+    index_entry_t *	wildcards;
+    int			n_wildcards;
+};
+
+static force_inline uint32_t
+hash_key (pixman_op_t          op,
+	  pixman_format_code_t src_format,
+	  pixman_format_code_t mask_format,
+	  pixman_format_code_t dest_format)
+{
+    uint32_t h;
+
+    h = (uint32_t)op * 0x9e3779b1u;
+    h ^= (uint32_t)src_format * 0x85ebca6bu;
+    h ^= (uint32_t)mask_format * 0xc2b2ae35u;
+    h ^= (uint32_t)dest_format * 0x27d4eb2fu;
+
+    return h ^ (h >> 15);
+}
+
+static pixman_bool_t
+is_wildcard (const pixman_fast_path_t *fast_path)
+{
+    return fast_path->op == PIXMAN_OP_any		||
+	fast_path->src_format == PIXMAN_any	||
+	fast_path->mask_format == PIXMAN_any	||
+	fast_path->dest_format == PIXMAN_any;
+}
+
+static int
+compare_entries (const void *p1, const void *p2)
+{
+    const index_entry_t *e1 = p1;
+    const index_entry_t *e2 = p2;
+    const pixman_fast_path_t *f1 = e1->fast_path;
+    const pixman_fast_path_t *f2 = e2->fast_path;
+
+    if (f1->op != f2->op)
+	return f1->op < f2->op ? -1 : 1;
+    if (f1->src_format != f2->src_format)
+	return f1->src_format < f2->src_format ? -1 : 1;
+    if (f1->mask_format != f2->mask_format)
+	return f1->mask_format < f2->mask_format ? -1 : 1;
+    if (f1->dest_format != f2->dest_format)
+	return f1->dest_format < f2->dest_format ? -1 : 1;
+
+    return e1->position - e2->position;
+}
+
+static pixman_fast_path_index_t *
+build_fast_path_index (pixman_implementation_t *toplevel)
+{
+    pixman_fast_path_index_t *index;
+    pixman_implementation_t *imp;
+    const pixman_fast_path_t *info;
+    int n_exact, n_keys, n_buckets;
+    int n_total = 0;
+    int i, j;
+
+    for (imp = toplevel; imp != NULL; imp = imp->fallback)
+    {
+	for (info = imp->fast_paths; info->op != PIXMAN_OP_NONE; ++info)
+	    n_total++;
+    }
+
+    if (!(index = calloc (1, sizeof (pixman_fast_path_index_t))))
+	return NULL;
+
+    index->entries = pixman_malloc_ab (n_total + 1, sizeof (index_entry_t));
+    index->wildcards = pixman_malloc_ab (n_total + 1, sizeof (index_entry_t));
+    if (!index->entries || !index->wildcards)
+	goto fail;
+
+    n_exact = 0;
+    i = 0;
+    for (imp = toplevel; imp != NULL; imp = imp->fallback)
+    {
+	for (info = imp->fast_paths; info->op != PIXMAN_OP_NONE; ++info)
+	{
+	    index_entry_t *entry;
+
+	    if (is_wildcard (info))
+		entry = &index->wildcards[index->n_wildcards++];
+	    else
+		entry = &index->entries[n_exact++];
+
+	    entry->fast_path = info;
+	    entry->imp = imp;
+	    entry->position = i++;
+	}
+    }
+
+    qsort (index->entries, n_exact, sizeof (index_entry_t), compare_entries);
+
+    n_keys = 0;
+    for (i = 0; i < n_exact; ++i)
+    {
+	if (i == 0 || compare_entries (&index->entries[i - 1], &index->entries[i]) != 0)
+	    n_keys++;
+    }
+
+    /* At most half full, so probe sequences stay short */
+    n_buckets = 16;
+    while (n_buckets < 2 * n_keys)
+	n_buckets *= 2;
+
+    if (!(index->buckets = calloc (n_buckets, sizeof (index_bucket_t))))
+	goto fail;
+
+    index->bucket_mask = n_buckets - 1;
+
+    for (i = 0; i < n_exact; i = j)
+    {
+	const pixman_fast_path_t *f = index->entries[i].fast_path;
+	index_bucket_t *bucket;
+	uint32_t h;
+
+	for (j = i + 1; j < n_exact; ++j)
+	{
+	    const pixman_fast_path_t *g = index->entries[j].fast_path;
+
+	    if (g->op != f->op				||
+		g->src_format != f->src_format		||
+		g->mask_format != f->mask_format	||
+		g->dest_format != f->dest_format)
+	    {
+		break;
+	    }
+	}
+
+	h = hash_key (f->op, f->src_format, f->mask_format, f->dest_format);
+	while (index->buckets[h & index->bucket_mask].n_entries)
+	    h++;
+
+	bucket = &index->buckets[h & index->bucket_mask];
+	bucket->op = f->op;
+	bucket->src_format = f->src_format;
+	bucket->mask_format = f->mask_format;
+	bucket->dest_format = f->dest_format;
+	bucket->first = i;
+	bucket->n_entries = j - i;
+    }
+
+    return index;
+
+fail:
+    free (index->buckets);
+    free (index->entries);
+    free (index->wildcards);
+    free (index);
+
+    return NULL;
+}
+
+static force_inline pixman_bool_t
+fast_path_matches (const pixman_fast_path_t *info,
+		   pixman_op_t               op,
+		   pixman_format_code_t      src_format,
+		   uint32_t                  src_flags,
+		   pixman_format_code_t      mask_format,
+		   uint32_t                  mask_flags,
+		   pixman_format_code_t      dest_format,
+		   uint32_t                  dest_flags)
+{
+    return (info->op == op || info->op == PIXMAN_OP_any)	&&
+	/* Formats */
+	((info->src_format == src_format) ||
+	 (info->src_format == PIXMAN_any))			&&
+	((info->mask_format == mask_format) ||
+	 (info->mask_format == PIXMAN_any))			&&
+	((info->dest_format == dest_format) ||
+	 (info->dest_format == PIXMAN_any))			&&
+	/* Flags */
+	(info->src_flags & src_flags) == info->src_flags	&&
+	(info->mask_flags & mask_flags) == info->mask_flags	&&
+	(info->dest_flags & dest_flags) == info->dest_flags;
+}
+
+static pixman_bool_t
+lookup_in_index (const pixman_fast_path_index_t *index,
+		 cache_t *                       cache,
+		 pixman_op_t                     op,
+		 pixman_format_code_t            src_format,
+		 uint32_t                        src_flags,
+		 pixman_format_code_t            mask_format,
+		 uint32_t                        mask_flags,
+		 pixman_format_code_t            dest_format,
+		 uint32_t                        dest_flags,
+		 pixman_implementation_t **      out_imp,
+		 pixman_composite_func_t  *      out_func)
+{
+    const index_entry_t *exact = NULL;
+    int n_exact = 0;
+    int i, j;
+    uint32_t h;
+
+    h = hash_key (op, src_format, mask_format, dest_format);
+    for (;;)
+    {
+	const index_bucket_t *bucket = &index->buckets[h++ & index->bucket_mask];
+
+	if (!bucket->n_entries)
+	    break;
+
+	if (bucket->op == op				&&
+	    bucket->src_format == src_format		&&
+	    bucket->mask_format == mask_format		&&
+	    bucket->dest_format == dest_format)
+	{
+	    exact = &index->entries[bucket->first];
+	    n_exact = bucket->n_entries;
+	    break;
+	}
+    }
+
+    i = j = 0;
+    while (i < n_exact || j < index->n_wildcards)
+    {
+	const index_entry_t *entry;
+
+	if (j == index->n_wildcards ||
+	    (i < n_exact && exact[i].position < index->wildcards[j].position))
+	{
+	    entry = &exact[i++];
+	}
+	else
+	{
+	    entry = &index->wildcards[j++];
+	}
+
+	cache->n_candidates++;
+
+	if (fast_path_matches (entry->fast_path, op,
+			       src_format, src_flags,
+			       mask_format, mask_flags,
+			       dest_format, dest_flags))
+	{
+	    *out_imp = entry->imp;
+	    *out_func = entry->fast_path->func;
+
+	    return TRUE;
+	}
+    }
+
+    return FALSE;
+}
+
 static void
 dummy_composite_rect (pixman_implementation_t *imp,
 		      pixman_composite_info_t *info)
@@ -90,6 +421,9 @@ _pixman_implementation_lookup_composite (pixman_implementation_t  *toplevel,
     /* Check cache for fast paths */
     cache = PIXMAN_GET_THREAD_LOCAL (fast_path_cache);
 
+    if (++cache->n_lookups == STATS_FLUSH_INTERVAL)
+	flush_stats (cache);
+
     for (i = 0; i < N_CACHED_FAST_PATHS; ++i)
     {
 	const pixman_fast_path_t *info = &(cache->cache[i].fast_path);
@@ -111,41 +445,53 @@ _pixman_implementation_lookup_composite (pixman_implementation_t  *toplevel,
 	    *out_imp = cache->cache[i].imp;
 	    *out_func = cache->cache[i].fast_path.func;
 
+	    cache->n_hits++;
+
 	    goto update_cache;
 	}
     }
 
-    for (imp = toplevel; imp != NULL; imp = imp->fallback)
-    {
-	const pixman_fast_path_t *info = imp->fast_paths;
+    cache->n_misses++;
 
-	while (info->op != PIXMAN_OP_NONE)
+    /* Set i to the last spot in the cache so that the
+     * move-to-front code below will work
+     */
+    i = N_CACHED_FAST_PATHS - 1;
+
+    if (toplevel->fast_path_index)
+    {
+	if (lookup_in_index (toplevel->fast_path_index, cache, op,
+			     src_format, src_flags,
+			     mask_format, mask_flags,
+			     dest_format, dest_flags,
+			     out_imp, out_func))
+	{
+	    goto update_cache;
+	}
+    }
+    else
+    {
+	for (imp = toplevel; imp != NULL; imp = imp->fallback)
 	{
-	    if ((info->op == op || info->op == PIXMAN_OP_any)		&&
-		/* Formats */
-		((info->src_format == src_format) ||
-		 (info->src_format == PIXMAN_any))			&&
-		((info->mask_format == mask_format) ||
-		 (info->mask_format == PIXMAN_any))			&&
-		((info->dest_format == dest_format) ||
-		 (info->dest_format == PIXMAN_any))			&&
-		/* Flags */
-		(info->src_flags & src_flags) == info->src_flags	&&
-		(info->mask_flags & mask_flags) == info->mask_flags	&&
-		(info->dest_flags & dest_flags) == info->dest_flags)
+	    const pixman_fast_path_t *info = imp->fast_paths;
+
+	    while (info->op != PIXMAN_OP_NONE)
 	    {
-		*out_imp = imp;
-		*out_func = info->func;
+		cache->n_candidates++;
 
-		/* Set i to the last spot in the cache so that the
-		 * move-to-front code below will work
-		 */
-		i = N_CACHED_FAST_PATHS - 1;
+		if (fast_path_matches (info, op,
+				       src_format, src_flags,
+				       mask_format, mask_flags,
+				       dest_format, dest_flags))
+		{
+		    *out_imp = imp;
+		    *out_func = info->func;
 
-		goto update_cache;
-	    }
+		    goto update_cache;
+		}
 
-	    ++info;
+		++info;
+	    }
 	}
     }
 
@@ -285,6 +631,27 @@ _pixman_implementation_fill (pixman_implementation_t *imp,
     return FALSE;
 }
 
+/* Returns the implementation that added the glyphs, or NULL */
+pixman_implementation_t *
+_pixman_implementation_add_glyphs (pixman_implementation_t   *imp,
+				   int                        dest_stride,
+				   int                        n_blits,
+				   const pixman_glyph_blit_t *blits)
+{
+    while (imp)
+    {
+	if (imp->add_glyphs &&
+	    ((*imp->add_glyphs) (imp, dest_stride, n_blits, blits)))
+	{
+	    return imp;
+	}
+
+	imp = imp->fallback;
+    }
+
+    return NULL;
+}
+
 static uint32_t *
 get_scanline_null (pixman_iter_t *iter, const uint32_t *mask)
 {
@@ -413,5 +780,9 @@ _pixman_choose_implementation (void)
             cur->fast_paths = empty_fast_path;
     }
 
+    imp->fast_path_index = build_fast_path_index (imp);
+
+    _pixman_stats_init ();
+
     return imp;
 }
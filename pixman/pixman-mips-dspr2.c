@@ -450,6 +450,8 @@ _pixman_implementation_create_mips_dspr2 (pixman_implementation_t *fallback)
     pixman_implementation_t *imp =
         _pixman_implementation_create (fallback, mips_dspr2_fast_paths);
 
+    imp->name = "mips-dspr2";
+
     imp->combine_32[PIXMAN_OP_OVER] = mips_dspr2_combine_over_u;
 
     imp->blt = mips_dspr2_blt;
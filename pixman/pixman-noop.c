@@ -154,6 +154,8 @@ _pixman_implementation_create_noop (pixman_implementation_t *fallback)
 {
     pixman_implementation_t *imp =
 	_pixman_implementation_create (fallback, noop_fast_paths);
+
+    imp->name = "noop";
  
     imp->iter_info = noop_iters;
 
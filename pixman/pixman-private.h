@@ -46,6 +46,7 @@ typedef struct conical_gradient conical_gradient_t;
 typedef struct radial_gradient radial_gradient_t;
 typedef struct bits_image bits_image_t;
 typedef struct circle circle_t;
+typedef struct composite_plans composite_plans_t;
 
 typedef struct argb_t argb_t;
 
@@ -118,6 +119,19 @@ struct image_common
 
     uint32_t			flags;
     pixman_format_code_t	extended_format_code;
+
+    /* Changes whenever a property of the image changes. The values
+     * are unique across all images, so a generation also identifies
+     * the image it was taken from.
+     */
+    uint64_t			generation;
+
+    /* Recently used ways of compositing to this image, see pixman.c */
+    composite_plans_t * volatile plans;
+    volatile int32_t		plans_lock;
+    int32_t			plan_hits;
+    int32_t			plan_misses;
+    pixman_bool_t		plans_sparse;
 };
 
 struct solid_fill
@@ -322,6 +336,9 @@ _pixman_image_reset_clip_region (pixman_image_t *image);
 void
 _pixman_image_validate (pixman_image_t *image);
 
+uint64_t
+_pixman_image_next_generation (void);
+
 #define PIXMAN_IMAGE_GET_LINE(image, x, y, type, out_stride, line, mul)	\
     do									\
     {									\
@@ -399,6 +416,25 @@ pixman_rasterize_edges_accessors (pixman_image_t *image,
                                   pixman_fixed_t  t,
                                   pixman_fixed_t  b);
 
+/* The edges of a trapezoid and the first and last sample rows of it */
+typedef struct
+{
+    pixman_edge_t	l, r;
+    pixman_fixed_t	t, b;
+} pixman_trap_edges_t;
+
+void
+_pixman_rasterize_trap_edges (pixman_image_t      *image,
+			      int                  n_traps,
+			      pixman_trap_edges_t *traps);
+
+void
+_pixman_rasterize_trapezoids_exact (pixman_image_t           *image,
+				    int                       x_off,
+				    int                       y_off,
+				    int                       n_traps,
+				    const pixman_trapezoid_t *traps);
+
 /*
  * Implementations
  */
@@ -477,6 +513,24 @@ typedef pixman_bool_t (*pixman_fill_func_t) (pixman_implementation_t *imp,
 					     int                      height,
 					     uint32_t                 filler);
 
+/* A glyph to add to a mask of the same format. Pointers are to the first
+ * byte, and the width and strides are in bytes.
+ */
+typedef struct
+{
+    const uint8_t *	src;
+    uint8_t *		dest;
+    int			src_stride;
+    int			width;
+    int			height;
+} pixman_glyph_blit_t;
+
+/* Adds each glyph to the destination with saturation, byte by byte */
+typedef pixman_bool_t (*pixman_add_glyphs_func_t) (pixman_implementation_t   *imp,
+						   int                        dest_stride,
+						   int                        n_blits,
+						   const pixman_glyph_blit_t *blits);
+
 void _pixman_setup_combiner_functions_32 (pixman_implementation_t *imp);
 void _pixman_setup_combiner_functions_float (pixman_implementation_t *imp);
 
@@ -492,15 +546,20 @@ typedef struct
     pixman_composite_func_t func;
 } pixman_fast_path_t;
 
+typedef struct pixman_fast_path_index_t pixman_fast_path_index_t;
+
 struct pixman_implementation_t
 {
+    const char *		name;
     pixman_implementation_t *	toplevel;
     pixman_implementation_t *	fallback;
     const pixman_fast_path_t *	fast_paths;
+    pixman_fast_path_index_t *	fast_path_index;
     const pixman_iter_info_t *  iter_info;
 
     pixman_blt_func_t		blt;
     pixman_fill_func_t		fill;
+    pixman_add_glyphs_func_t	add_glyphs;
 
     pixman_combine_32_func_t	combine_32[PIXMAN_N_OPERATORS];
     pixman_combine_32_func_t	combine_32_ca[PIXMAN_N_OPERATORS];
@@ -561,6 +620,12 @@ _pixman_implementation_fill (pixman_implementation_t *imp,
                              int                      height,
                              uint32_t                 filler);
 
+pixman_implementation_t *
+_pixman_implementation_add_glyphs (pixman_implementation_t   *imp,
+				   int                        dest_stride,
+				   int                        n_blits,
+				   const pixman_glyph_blit_t *blits);
+
 void
 _pixman_implementation_iter_init (pixman_implementation_t       *imp,
                                   pixman_iter_t                 *iter,
@@ -598,6 +663,16 @@ pixman_implementation_t *
 _pixman_implementation_create_ssse3 (pixman_implementation_t *fallback);
 #endif
 
+#ifdef USE_AVX2
+pixman_implementation_t *
+_pixman_implementation_create_avx2 (pixman_implementation_t *fallback);
+#endif
+
+#ifdef USE_AVX512
+pixman_implementation_t *
+_pixman_implementation_create_avx512 (pixman_implementation_t *fallback);
+#endif
+
 #ifdef USE_ARM_SIMD
 pixman_implementation_t *
 _pixman_implementation_create_arm_simd (pixman_implementation_t *fallback);
@@ -870,6 +945,97 @@ pixman_list_move_to_front (pixman_list_t *list, pixman_link_t *link)
     pixman_list_prepend (list, link);
 }
 
+/* Worker threads, see pixman-threads.c */
+typedef void (* pixman_parallel_func_t) (void *data, int job);
+
+int
+_pixman_parallel_get_num_threads (void);
+
+/* Calls @func for each job in [0, @n_jobs), possibly concurrently,
+ * and returns once all of them have finished.
+ */
+void
+_pixman_parallel_run (int                    n_jobs,
+		      pixman_parallel_func_t func,
+		      void *                 data);
+
+/* Per-thread scanline buffers, see pixman-arena.c. Buffers must be freed
+ * on the thread that allocated them. With SCANLINE_ARENA_FLOATS the
+ * buffer contains no NaNs, and the caller must only store floats in it.
+ */
+#define SCANLINE_ARENA_FLOATS	(1 << 0)
+
+void *
+_pixman_scanline_arena_alloc (size_t size, uint32_t flags);
+
+void
+_pixman_scanline_arena_free (void *block);
+
+/* Runtime composite statistics, see pixman-stats.c */
+extern volatile pixman_bool_t _pixman_stats_enabled;
+
+void
+_pixman_stats_init (void);
+
+/* Records a call to @func, which was started at time @start */
+void
+_pixman_stats_record (pixman_implementation_t       *imp,
+		      pixman_composite_func_t        func,
+		      const pixman_composite_info_t *info,
+		      uint64_t                       start);
+
+/* Records one batch of @n_glyphs glyphs added by @imp to an image in
+ * @format, which was started at time @start
+ */
+void
+_pixman_stats_record_glyphs (pixman_implementation_t *imp,
+			     pixman_format_code_t     format,
+			     int                      n_glyphs,
+			     uint64_t                 pixels,
+			     uint64_t                 start);
+
+/* Counts a composite operation done by the general implementation */
+extern volatile pixman_bool_t _pixman_trace_fallbacks;
+
+void
+_pixman_trace_fallback (pixman_implementation_t *toplevel,
+			pixman_op_t              op,
+			pixman_format_code_t     src_format,
+			uint32_t                 src_flags,
+			pixman_format_code_t     mask_format,
+			uint32_t                 mask_flags,
+			pixman_format_code_t     dest_format,
+			uint32_t                 dest_flags);
+
+#if defined (_MSC_VER) && (defined (_M_IX86) || defined (_M_AMD64))
+#include <intrin.h>
+#endif
+
+/* A cheap timestamp in CPU cycles or timer ticks, or 0 if the
+ * platform has nothing suitable.
+ */
+static force_inline uint64_t
+_pixman_stats_timestamp (void)
+{
+#if defined (__GNUC__) && (defined (__i386__) || defined (__x86_64__))
+    uint32_t hi, lo;
+
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+
+    return lo | (((uint64_t)hi) << 32);
+#elif defined (_MSC_VER) && (defined (_M_IX86) || defined (_M_AMD64))
+    return __rdtsc ();
+#elif defined (__GNUC__) && defined (__aarch64__)
+    uint64_t ticks;
+
+    __asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r" (ticks));
+
+    return ticks;
+#else
+    return 0;
+#endif
+}
+
 /* Misc macros */
 
 #ifndef FALSE
@@ -69,6 +69,10 @@
 #include <stdio.h>
 #include "pixman-private.h"
 
+#if defined(USE_SSE2) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define PIXREGION_NIL(reg) ((reg)->data && !(reg)->data->numRects)
 /* not a region */
 #define PIXREGION_NAR(reg)      ((reg)->data == pixman_broken_data)
@@ -213,7 +217,49 @@ alloc_data (size_t n)
     return malloc (sz);
 }
 
-#define FREE_DATA(reg) if ((reg)->data && (reg)->data->size) free ((reg)->data)
+/* Resizes @data, which must not be shared, to hold @n boxes */
+static region_data_type_t *
+realloc_data (region_data_type_t *data, size_t n)
+{
+    size_t sz = PIXREGION_SZOF (n);
+
+    if (!sz)
+	return NULL;
+
+    return realloc (data, sz);
+}
+
+/* Boxes that PREFIX (_copy_shared) shares between regions are kept in a
+ * block of their own, preceded by a reference count. Shared data has a
+ * size of 0, like the static empty and broken data, so that it is never
+ * modified in place or resized. Unlike those it has boxes, which data
+ * allocated by anyone else can't have with a size of 0. Code that tests
+ * the size of data that may be shared has to keep this in mind.
+ */
+typedef union
+{
+    int32_t	ref_count;
+    long	align;
+} data_header_t;
+
+#define DATA_HEADER(data) ((data_header_t *)(data) - 1)
+
+#define DATA_IS_SHARED(data) ((data) && !(data)->size && (data)->numRects)
+
+static void
+free_data (region_data_type_t *data)
+{
+    if (!data)
+	return;
+
+    if (data->size)
+	free (data);
+    else if (data->numRects &&
+	     PIXMAN_ATOMIC_FETCH_ADD_32 (&DATA_HEADER (data)->ref_count, -1) == 1)
+	free (DATA_HEADER (data));
+}
+
+#define FREE_DATA(reg) free_data ((reg)->data)
 
 #define RECTALLOC_BAIL(region, n, bail)					\
     do									\
@@ -252,8 +298,9 @@ alloc_data (size_t n)
 #define NEWRECT(region, next_rect, nx1, ny1, nx2, ny2)			\
     do									\
     {									\
+	/* >= so that shared data, with its size of 0, is unshared */	\
 	if (!(region)->data ||						\
-	    ((region)->data->numRects == (region)->data->size))		\
+	    ((region)->data->numRects >= (region)->data->size))		\
 	{								\
 	    if (!pixman_rect_alloc (region, 1))				\
 		return FALSE;						\
@@ -264,6 +311,7 @@ alloc_data (size_t n)
 	critical_if_fail (region->data->numRects <= region->data->size);		\
     } while (0)
 
+/* Leaves static and shared data, with a size of 0, alone */
 #define DOWNSIZE(reg, numRects)						\
     do									\
     {									\
@@ -271,17 +319,8 @@ alloc_data (size_t n)
 	    ((reg)->data->size > 50))					\
 	{								\
 	    region_data_type_t * new_data;				\
-	    size_t data_size = PIXREGION_SZOF (numRects);		\
 									\
-	    if (!data_size)						\
-	    {								\
-		new_data = NULL;					\
-	    }								\
-	    else							\
-	    {								\
-		new_data = (region_data_type_t *)			\
-		    realloc ((reg)->data, data_size);			\
-	    }								\
+	    new_data = realloc_data ((reg)->data, numRects);		\
 									\
 	    if (new_data)						\
 	    {								\
@@ -443,12 +482,38 @@ pixman_break (region_type_t *region)
     return FALSE;
 }
 
+/* Gives @region boxes of its own, if they are shared with other regions,
+ * so that they can be modified in place.
+ */
+static pixman_bool_t
+pixman_region_unshare (region_type_t *region)
+{
+    region_data_type_t *data;
+
+    if (!DATA_IS_SHARED (region->data))
+	return TRUE;
+
+    if (!(data = alloc_data (region->data->numRects)))
+	return pixman_break (region);
+
+    memcpy (data, region->data, PIXREGION_SZOF (region->data->numRects));
+    data->size = data->numRects;
+
+    free_data (region->data);
+    region->data = data;
+
+    return TRUE;
+}
+
 static pixman_bool_t
 pixman_rect_alloc (region_type_t * region,
                    int             n)
 {
     region_data_type_t *data;
 
+    if (!pixman_region_unshare (region))
+	return FALSE;
+
     if (!region->data)
     {
 	n++;
@@ -462,6 +527,7 @@ pixman_rect_alloc (region_type_t * region,
     }
     else if (!region->data->size)
     {
+	/* Static data; shared data was unshared above */
 	region->data = alloc_data (n);
 
 	if (!region->data)
@@ -471,8 +537,6 @@ pixman_rect_alloc (region_type_t * region,
     }
     else
     {
-	size_t data_size;
-
 	if (n == 1)
 	{
 	    n = region->data->numRects;
@@ -481,18 +545,8 @@ pixman_rect_alloc (region_type_t * region,
 	}
 
 	n += region->data->numRects;
-	data_size = PIXREGION_SZOF (n);
+	data = realloc_data (region->data, n);
 
-	if (!data_size)
-	{
-	    data = NULL;
-	}
-	else
-	{
-	    data = (region_data_type_t *)
-		realloc (region->data, PIXREGION_SZOF (n));
-	}
-	
 	if (!data)
 	    return pixman_break (region);
 	
@@ -517,8 +571,17 @@ PREFIX (_copy) (region_type_t *dst, region_type_t *src)
 
     if (!src->data || !src->data->size)
     {
-	FREE_DATA (dst);
-	dst->data = src->data;
+	/* Boxes are only shared if the caller asked for that with
+	 * PREFIX (_copy_shared); @src itself is never modified.
+	 */
+	if (dst->data != src->data)
+	{
+	    if (DATA_IS_SHARED (src->data))
+		PIXMAN_ATOMIC_FETCH_ADD_32 (&DATA_HEADER (src->data)->ref_count, 1);
+
+	    FREE_DATA (dst);
+	    dst->data = src->data;
+	}
 	return TRUE;
     }
     
@@ -542,10 +605,119 @@ PREFIX (_copy) (region_type_t *dst, region_type_t *src)
     return TRUE;
 }
 
+/* Gives @dst a copy of the boxes of @src in a block that can be shared.
+ * @src is only read, and may be @dst.
+ */
+static pixman_bool_t
+pixman_region_copy_shareable (region_type_t *dst, region_type_t *src)
+{
+    size_t sz = PIXREGION_SZOF (src->data->numRects);
+    region_data_type_t *data;
+    data_header_t *header;
+
+    if (!sz || !(header = malloc (sizeof (data_header_t) + sz)))
+	return FALSE;
+
+    header->ref_count = 1;
+
+    data = (region_data_type_t *)(header + 1);
+    memcpy (data, src->data, sz);
+    data->size = 0;
+
+    FREE_DATA (dst);
+    dst->data = data;
+
+    return TRUE;
+}
+
+PIXMAN_EXPORT pixman_bool_t
+PREFIX (_copy_shared) (region_type_t *dst, region_type_t *src)
+{
+    GOOD (dst);
+    GOOD (src);
+
+    if (!src->data || !src->data->size || !src->data->numRects)
+	return PREFIX (_copy) (dst, src);
+
+    if (!pixman_region_copy_shareable (dst, src))
+	return pixman_break (dst);
+
+    dst->extents = src->extents;
+
+    return TRUE;
+}
+
 /*======================================================================
  *	    Generic Region Operator
  *====================================================================*/
 
+/*
+ * Returns whether two runs of @n boxes have the same x1 and x2. With
+ * SSE2, 64 bytes of boxes are compared at a time, which is four 32 bit
+ * or eight 16 bit boxes. In both box types x1 and x2 are the even
+ * fields, so the y fields are masked out.
+ */
+static force_inline pixman_bool_t
+pixman_band_x_equal (const box_type_t *a, const box_type_t *b, int n)
+{
+#if defined(USE_SSE2) && defined(__SSE2__)
+    const __m128i x_mask = sizeof (box_type_t) == 16 ?
+	_mm_set_epi32 (0, -1, 0, -1) : _mm_set1_epi32 (0xffff);
+    const char *pa = (const char *)a;
+    const char *pb = (const char *)b;
+    size_t bytes = n * sizeof (box_type_t);
+
+#define BOXES_DIFFER(offset)						\
+    _mm_xor_si128 (_mm_loadu_si128 ((const __m128i *)(pa + (offset))),	\
+		   _mm_loadu_si128 ((const __m128i *)(pb + (offset))))
+
+    while (bytes >= 64)
+    {
+	__m128i d = _mm_or_si128 (
+	    _mm_or_si128 (BOXES_DIFFER (0), BOXES_DIFFER (16)),
+	    _mm_or_si128 (BOXES_DIFFER (32), BOXES_DIFFER (48)));
+
+	d = _mm_cmpeq_epi32 (_mm_and_si128 (d, x_mask), _mm_setzero_si128 ());
+	if (_mm_movemask_epi8 (d) != 0xffff)
+	    return FALSE;
+
+	pa += 64;
+	pb += 64;
+	bytes -= 64;
+    }
+
+    while (bytes >= 16)
+    {
+	__m128i d = _mm_and_si128 (BOXES_DIFFER (0), x_mask);
+
+	d = _mm_cmpeq_epi32 (d, _mm_setzero_si128 ());
+	if (_mm_movemask_epi8 (d) != 0xffff)
+	    return FALSE;
+
+	pa += 16;
+	pb += 16;
+	bytes -= 16;
+    }
+
+#undef BOXES_DIFFER
+
+    a = (const box_type_t *)pa;
+    b = (const box_type_t *)pb;
+    n = bytes / sizeof (box_type_t);
+#endif
+
+    while (n--)
+    {
+	if (a->x1 != b->x1 || a->x2 != b->x2)
+	    return FALSE;
+
+	a++;
+	b++;
+    }
+
+    return TRUE;
+}
+
 /*-
  *-----------------------------------------------------------------------
  * pixman_coalesce --
@@ -596,30 +768,20 @@ pixman_coalesce (region_type_t * region,      /* Region to coalesce		 */
      * cover the most area possible. I.e. two boxes in a band must
      * have some horizontal space between them.
      */
-    y2 = cur_box->y2;
-
-    do
-    {
-	if ((prev_box->x1 != cur_box->x1) || (prev_box->x2 != cur_box->x2))
-	    return (cur_start);
-	
-	prev_box++;
-	cur_box++;
-	numRects--;
-    }
-    while (numRects);
+    if (!pixman_band_x_equal (prev_box, cur_box, numRects))
+	return (cur_start);
 
     /*
      * The bands may be merged, so set the bottom y of each box
      * in the previous band to the bottom y of the current band.
      */
-    numRects = cur_start - prev_start;
+    y2 = cur_box->y2;
     region->data->numRects -= numRects;
 
     do
     {
-	prev_box--;
 	prev_box->y2 = y2;
+	prev_box++;
 	numRects--;
     }
     while (numRects);
@@ -707,6 +869,60 @@ pixman_region_append_non_o (region_type_t * region,
 	}								\
     } while (0)
 
+/*
+ * Returns the first box in [r, r_end) that extends below y. Since
+ * bands don't overlap, the bottoms of the boxes of a region never
+ * decrease, so this can be a binary search.
+ */
+static box_type_t *
+pixman_find_box_below (box_type_t *r, box_type_t *r_end, int y)
+{
+    while (r != r_end)
+    {
+	box_type_t *mid = r + (r_end - r) / 2;
+
+	if (mid->y2 <= y)
+	    r = mid + 1;
+	else
+	    r_end = mid;
+    }
+
+    return r;
+}
+
+/*
+ * Once a band of one region has been handled and is completely above
+ * the next band of the other, so are the bands that follow it up to
+ * y. Those are either appended as they are or skipped together, without
+ * going through them one band at a time. The bands of a region can't
+ * be coalesced with each other, so only the previous band has to be
+ * found for coalescing with what comes next. Sets r_band_end to the
+ * first box that wasn't handled.
+ */
+#define SKIP_BANDS_ABOVE(r_band_end, r_end, y, append)			\
+    do									\
+    {									\
+	box_type_t *r_skip_end =					\
+	    pixman_find_box_below (r_band_end, r_end, y);		\
+									\
+	if (append && r_skip_end != r_band_end)				\
+	{								\
+	    box_type_t *last;						\
+									\
+	    APPEND_REGIONS (new_reg, r_band_end, r_skip_end);		\
+									\
+	    prev_band = new_reg->data->numRects - 1;			\
+	    last = PIXREGION_BOX (new_reg, prev_band);			\
+	    while (prev_band > 0 && (last - 1)->y1 == last->y1)		\
+	    {								\
+		prev_band--;						\
+		last--;							\
+	    }								\
+	}								\
+									\
+	r_band_end = r_skip_end;					\
+    } while (0)
+
 /*-
  *-----------------------------------------------------------------------
  * pixman_op --
@@ -819,15 +1035,24 @@ pixman_op (region_type_t *  new_reg,               /* Place to store result
     new_size <<= 1;
 
     if (!new_reg->data)
+    {
 	new_reg->data = pixman_region_empty_data;
+    }
+    else if (DATA_IS_SHARED (new_reg->data))
+    {
+	free_data (new_reg->data);
+	new_reg->data = pixman_region_empty_data;
+    }
     else if (new_reg->data->size)
+    {
 	new_reg->data->numRects = 0;
+    }
 
     if (new_size > new_reg->data->size)
     {
         if (!pixman_rect_alloc (new_reg, new_size))
         {
-            free (old_data);
+            free_data (old_data);
             return FALSE;
 	}
     }
@@ -896,6 +1121,14 @@ pixman_op (region_type_t *  new_reg,               /* Place to store result
                     COALESCE (new_reg, prev_band, cur_band);
 		}
 	    }
+
+	    if (r1->y2 <= r2y1)
+	    {
+		SKIP_BANDS_ABOVE (r1_band_end, r1_end, r2y1, append_non1);
+		r1 = r1_band_end;
+		continue;
+	    }
+
             ytop = r2y1;
 	}
         else if (r2y1 < r1y1)
@@ -915,6 +1148,14 @@ pixman_op (region_type_t *  new_reg,               /* Place to store result
                     COALESCE (new_reg, prev_band, cur_band);
 		}
 	    }
+
+	    if (r2->y2 <= r1y1)
+	    {
+		SKIP_BANDS_ABOVE (r2_band_end, r2_end, r1y1, append_non2);
+		r2 = r2_band_end;
+		continue;
+	    }
+
             ytop = r1y1;
 	}
         else
@@ -1002,7 +1243,7 @@ pixman_op (region_type_t *  new_reg,               /* Place to store result
         APPEND_REGIONS (new_reg, r2_band_end, r2_end);
     }
 
-    free (old_data);
+    free_data (old_data);
 
     if (!(numRects = new_reg->data->numRects))
     {
@@ -1023,7 +1264,7 @@ pixman_op (region_type_t *  new_reg,               /* Place to store result
     return TRUE;
 
 bail:
-    free (old_data);
+    free_data (old_data);
 
     return pixman_break (new_reg);
 }
@@ -1051,7 +1292,8 @@ pixman_set_extents (region_type_t *region)
     if (!region->data)
 	return;
 
-    if (!region->data->size)
+    /* Not the size, which is also 0 for shared data with boxes */
+    if (!region->data->numRects)
     {
         region->extents.x2 = region->extents.x1;
         region->extents.y2 = region->extents.y1;
@@ -1450,6 +1692,372 @@ PREFIX (_union) (region_type_t *new_reg,
     return TRUE;
 }
 
+/*======================================================================
+ *	    Multiple Region Union
+ *====================================================================*/
+
+/* The largest number of regions whose bands are merged at once */
+#define UNION_FAN_IN 16
+
+/* One of the regions in a multiple region union. The boxes from band
+ * to band_end are its current band, and r is the next box of that band
+ * to be merged in x. Sources are kept in heaps ordered by key, which is
+ * the top of the band or the left side of r.
+ */
+typedef struct
+{
+    box_type_t *band;
+    box_type_t *band_end;
+    box_type_t *end;
+    box_type_t *r;
+    int         key;
+} union_source_t;
+
+static void
+union_heap_down (union_source_t **heap, int n, int i)
+{
+    union_source_t *s = heap[i];
+
+    for (;;)
+    {
+	int child = 2 * i + 1;
+
+	if (child >= n)
+	    break;
+
+	if (child + 1 < n && heap[child + 1]->key < heap[child]->key)
+	    child++;
+
+	if (s->key <= heap[child]->key)
+	    break;
+
+	heap[i] = heap[child];
+	i = child;
+    }
+
+    heap[i] = s;
+}
+
+static void
+union_heap_push (union_source_t **heap, int *n, union_source_t *s)
+{
+    int i = (*n)++;
+
+    while (i > 0 && heap[(i - 1) / 2]->key > s->key)
+    {
+	heap[i] = heap[(i - 1) / 2];
+	i = (i - 1) / 2;
+    }
+
+    heap[i] = s;
+}
+
+static void
+union_source_find_band (union_source_t *s)
+{
+    int y1 = s->band->y1;
+
+    s->band_end = s->band + 1;
+    while (s->band_end != s->end && s->band_end->y1 == y1)
+	s->band_end++;
+
+    s->key = y1;
+}
+
+/* Adds the union of the bands in @heap, which is ordered by the left
+ * side of the next box of each band, from y1 to y2.
+ */
+static pixman_bool_t
+pixman_region_union_bands (region_type_t *  region,
+			   union_source_t **heap,
+			   int              n,
+			   int              y1,
+			   int              y2)
+{
+    box_type_t *next_rect;
+    int x1, x2;
+
+    critical_if_fail (y1 < y2);
+    critical_if_fail (n > 0);
+
+    next_rect = PIXREGION_TOP (region);
+
+    x1 = x2 = heap[0]->r->x1;
+
+    while (n)
+    {
+	union_source_t *s = heap[0];
+	box_type_t *r = s->r;
+
+	if (r->x1 <= x2)
+	{
+	    if (x2 < r->x2)
+		x2 = r->x2;
+	}
+	else
+	{
+	    NEWRECT (region, next_rect, x1, y1, x2, y2);
+	    x1 = r->x1;
+	    x2 = r->x2;
+	}
+
+	if (++s->r == s->band_end)
+	    heap[0] = heap[--n];
+	else
+	    s->key = s->r->x1;
+
+	if (n)
+	    union_heap_down (heap, n, 0);
+    }
+
+    NEWRECT (region, next_rect, x1, y1, x2, y2);
+
+    return TRUE;
+}
+
+/* Merges the bands of at most UNION_FAN_IN regions, none of which is
+ * broken, from the top down. Each band of the result lasts until one of
+ * the current bands ends or a new one starts, and its boxes are merged
+ * from the current bands in order of x.
+ */
+static pixman_bool_t
+pixman_region_union_merge (region_type_t * dest,
+			   region_type_t **regions,
+			   int             n_regions)
+{
+    union_source_t sources[UNION_FAN_IN];
+    union_source_t *y_heap[UNION_FAN_IN];
+    union_source_t *active[UNION_FAN_IN];
+    union_source_t *x_heap[UNION_FAN_IN];
+    region_type_t result;
+    region_type_t *new_reg = &result;
+    union_source_t *s;
+    int n_sources, n_y, n_active, n_x;
+    int prev_band, cur_band;
+    int y, ybot, i;
+    int numRects;
+
+    critical_if_fail (n_regions <= UNION_FAN_IN);
+
+    result.extents = *pixman_region_empty_box;
+
+    n_sources = 0;
+    numRects = 0;
+    for (i = 0; i < n_regions; ++i)
+    {
+	region_type_t *reg = regions[i];
+
+	if (PIXREGION_NIL (reg))
+	    continue;
+
+	if (n_sources++ == 0)
+	{
+	    result.extents = reg->extents;
+	}
+	else
+	{
+	    result.extents.x1 = MIN (result.extents.x1, reg->extents.x1);
+	    result.extents.y1 = MIN (result.extents.y1, reg->extents.y1);
+	    result.extents.x2 = MAX (result.extents.x2, reg->extents.x2);
+	    result.extents.y2 = MAX (result.extents.y2, reg->extents.y2);
+	}
+
+	s = &sources[n_sources - 1];
+	s->band = PIXREGION_RECTS (reg);
+	s->end = s->band + PIXREGION_NUMRECTS (reg);
+
+	numRects += PIXREGION_NUMRECTS (reg);
+    }
+
+    if (n_sources == 0)
+    {
+	FREE_DATA (dest);
+	PREFIX (_init) (dest);
+
+	return TRUE;
+    }
+
+    if (n_sources == 1)
+    {
+	for (i = 0; PIXREGION_NIL (regions[i]); ++i)
+	    ;
+
+	return PREFIX (_copy) (dest, regions[i]);
+    }
+
+    /* The result usually has fewer boxes than the regions together */
+    result.data = pixman_region_empty_data;
+    if (!pixman_rect_alloc (&result, numRects))
+	return pixman_break (dest);
+
+    n_y = 0;
+    for (i = 0; i < n_sources; ++i)
+    {
+	union_source_find_band (&sources[i]);
+	union_heap_push (y_heap, &n_y, &sources[i]);
+    }
+
+    prev_band = 0;
+    n_active = 0;
+    y = y_heap[0]->key;
+
+    while (n_y || n_active)
+    {
+	/* Activate the bands that start at y */
+	while (n_y && y_heap[0]->key <= y)
+	{
+	    active[n_active++] = y_heap[0];
+
+	    y_heap[0] = y_heap[--n_y];
+	    if (n_y)
+		union_heap_down (y_heap, n_y, 0);
+	}
+
+	/* The band of the result ends where an active band ends or
+	 * another one starts.
+	 */
+	ybot = n_y ? y_heap[0]->key : PIXMAN_REGION_MAX;
+	n_x = 0;
+	for (i = 0; i < n_active; ++i)
+	{
+	    s = active[i];
+
+	    if (s->band->y2 < ybot)
+		ybot = s->band->y2;
+
+	    s->r = s->band;
+	    s->key = s->r->x1;
+	    union_heap_push (x_heap, &n_x, s);
+	}
+
+	cur_band = new_reg->data->numRects;
+
+	if (!pixman_region_union_bands (new_reg, x_heap, n_x, y, ybot))
+	{
+	    FREE_DATA (new_reg);
+
+	    return pixman_break (dest);
+	}
+
+	COALESCE (new_reg, prev_band, cur_band);
+
+	/* Move on to the next band of those that end at ybot */
+	i = 0;
+	while (i < n_active)
+	{
+	    s = active[i];
+
+	    if (s->band->y2 == ybot)
+	    {
+		active[i] = active[--n_active];
+
+		s->band = s->band_end;
+		if (s->band != s->end)
+		{
+		    union_source_find_band (s);
+		    union_heap_push (y_heap, &n_y, s);
+		}
+	    }
+	    else
+	    {
+		i++;
+	    }
+	}
+
+	if (n_active)
+	    y = ybot;
+	else if (n_y)
+	    y = y_heap[0]->key;
+    }
+
+    numRects = new_reg->data->numRects;
+    if (numRects == 1)
+    {
+	FREE_DATA (new_reg);
+	new_reg->data = (region_data_type_t *)NULL;
+    }
+    else
+    {
+	DOWNSIZE (new_reg, numRects);
+    }
+
+    FREE_DATA (dest);
+    *dest = result;
+
+    return TRUE;
+}
+
+/*
+ * Computes the union of @n_regions regions without rebuilding the
+ * result once for each region. Up to UNION_FAN_IN regions are merged in
+ * one pass; more are merged in groups of that many, and the results of
+ * the groups are merged in turn, since merging the bands of too many
+ * regions at once is slower when they overlap.
+ *
+ * @dest may be one of the regions.
+ */
+PIXMAN_EXPORT pixman_bool_t
+PREFIX (_union_many) (region_type_t * dest,
+                      region_type_t **regions,
+                      int             n_regions)
+{
+    region_type_t *groups;
+    region_type_t **group_ptrs;
+    int n_groups, i;
+    pixman_bool_t ret;
+
+    GOOD (dest);
+
+    return_val_if_fail (n_regions >= 0, FALSE);
+
+    for (i = 0; i < n_regions; ++i)
+    {
+	GOOD (regions[i]);
+
+	if (PIXREGION_NAR (regions[i]))
+	    return pixman_break (dest);
+    }
+
+    if (n_regions <= UNION_FAN_IN)
+    {
+	ret = pixman_region_union_merge (dest, regions, n_regions);
+
+	GOOD (dest);
+
+	return ret;
+    }
+
+    n_groups = (n_regions + UNION_FAN_IN - 1) / UNION_FAN_IN;
+
+    groups = pixman_malloc_ab (
+	n_groups, sizeof (region_type_t) + sizeof (region_type_t *));
+    if (!groups)
+	return pixman_break (dest);
+
+    group_ptrs = (region_type_t **)(groups + n_groups);
+
+    for (i = 0; i < n_groups; ++i)
+    {
+	int first = i * UNION_FAN_IN;
+
+	PREFIX (_init) (&groups[i]);
+	pixman_region_union_merge (
+	    &groups[i], regions + first, MIN (n_regions - first, UNION_FAN_IN));
+
+	group_ptrs[i] = &groups[i];
+    }
+
+    /* A group that failed is broken, and so is the result */
+    ret = PREFIX (_union_many) (dest, group_ptrs, n_groups);
+
+    for (i = 0; i < n_groups; ++i)
+	FREE_DATA (&groups[i]);
+
+    free (groups);
+
+    return ret;
+}
+
 /*======================================================================
  *	    Batch Rectangle Union
  *====================================================================*/
@@ -2096,6 +2704,28 @@ find_box_for_y (box_type_t *begin, box_type_t *end, int y)
     }
 }
 
+/* Returns the first box from @begin that is not in the same band as
+ * @begin or that ends to the right of @x. The boxes in a band are sorted
+ * in x, so there is no need to walk wide bands.
+ */
+static box_type_t *
+find_box_for_x (box_type_t *begin, box_type_t *end, int x)
+{
+    int y1 = begin->y1;
+
+    while (begin != end)
+    {
+	box_type_t *mid = begin + (end - begin) / 2;
+
+	if (mid->y1 == y1 && mid->x2 <= x)
+	    begin = mid + 1;
+	else
+	    end = mid;
+    }
+
+    return begin;
+}
+
 /*
  *   rect_in(region, rect)
  *   This routine takes a pointer to a region and a pointer to a box
@@ -2167,7 +2797,11 @@ PREFIX (_contains_rectangle) (region_type_t *  region,
 	}
 
         if (pbox->x2 <= x)
-	    continue;           /* not far enough over yet */
+	{
+	    /* not far enough over yet */
+	    pbox = find_box_for_x (pbox, pbox_end, x) - 1;
+	    continue;
+	}
 
         if (pbox->x1 > x)
         {
@@ -2229,6 +2863,10 @@ PREFIX (_translate) (region_type_t *region, int x, int y)
     box_type_t * pbox;
 
     GOOD (region);
+
+    if (!pixman_region_unshare (region))
+	return;
+
     region->extents.x1 = x1 = region->extents.x1 + x;
     region->extents.y1 = y1 = region->extents.y1 + y;
     region->extents.x2 = x2 = region->extents.x2 + x;
@@ -2368,22 +3006,17 @@ PREFIX (_contains_point) (region_type_t * region,
     pbox_end = pbox + numRects;
 
     pbox = find_box_for_y (pbox, pbox_end, y);
+    if (pbox == pbox_end || y < pbox->y1)
+	return(FALSE);          /* missed it */
 
-    for (;pbox != pbox_end; pbox++)
-    {
-        if ((y < pbox->y1) || (x < pbox->x1))
-	    break;              /* missed it */
-
-        if (x >= pbox->x2)
-	    continue;           /* not there yet */
+    pbox = find_box_for_x (pbox, pbox_end, x);
+    if (pbox == pbox_end || y < pbox->y1 || x < pbox->x1)
+	return(FALSE);          /* missed it */
 
-        if (box)
-	    *box = *pbox;
-
-        return(TRUE);
-    }
+    if (box)
+	*box = *pbox;
 
-    return(FALSE);
+    return(TRUE);
 }
 
 PIXMAN_EXPORT int
@@ -2423,6 +3056,7 @@ PREFIX (_selfcheck) (region_type_t *reg)
     numRects = PIXREGION_NUMRECTS (reg);
     if (!numRects)
     {
+	/* Shared data always has boxes, so it isn't accepted here */
 	return ((reg->extents.x1 == reg->extents.x2) &&
 	        (reg->extents.y1 == reg->extents.y2) &&
 	        (reg->data->size || (reg->data == pixman_region_empty_data)));
@@ -2567,6 +3201,7 @@ bitmap_addrect (region_type_t *reg,
 	   ((r-1)->y1 == ry1) && ((r-1)->y2 == ry2) &&
 	   ((r-1)->x1 <= rx1) && ((r-1)->x2 >= rx2))))
     {
+	/* @reg is being built from an image, so it is never shared */
 	if (reg->data->numRects == reg->data->size)
 	{
 	    if (!pixman_rect_alloc (reg, 1))
@@ -2588,38 +3223,202 @@ bitmap_addrect (region_type_t *reg,
     return r;
 }
 
-/* Convert bitmap clip mask into clipping region.
- * First, goes through each line and makes boxes by noting the transitions
- * from 0 to 1 and 1 to 0.
- * Then it coalesces the current line with the previous if they have boxes
- * at the same X coordinates.
+/* The screen position of the first set bit of @w, which is not 0 */
+static force_inline int
+bitmap_first_bit (uint32_t w)
+{
+#if defined(HAVE_BUILTIN_CLZ) || defined(__GNUC__)
+#ifdef WORDS_BIGENDIAN
+    return __builtin_clz (w);
+#else
+    return 31 - __builtin_clz (w & -w);
+#endif
+#else
+    uint32_t mask0 = 0xffffffff & ~SCREEN_SHIFT_RIGHT (0xffffffff, 1);
+    int n = 0;
+
+    while (!(w & mask0))
+    {
+	w = SCREEN_SHIFT_LEFT (w, 1);
+	n++;
+    }
+
+    return n;
+#endif
+}
+
+/* Adds a box to row @y for each run of set bits in the first @width
+ * bits of @line. The runs are found with one bit scan per edge, and
+ * words that are all inside or all outside of a run are skipped.
+ */
+static box_type_t *
+bitmap_add_runs (region_type_t *  region,
+		 box_type_t *     rects,
+		 box_type_t **    first_rect,
+		 const uint32_t * line,
+		 int              width,
+		 int              y)
+{
+    int n_words = (width + 31) >> 5;
+    uint32_t last_mask = 0xffffffff;
+    pixman_bool_t in_box = FALSE;
+    int rx1 = 0;
+    int i;
+
+    /* Ignore the bits after the end of the line */
+    if (width & 31)
+	last_mask = ~SCREEN_SHIFT_RIGHT (0xffffffff, width & 31);
+
+    for (i = 0; i < n_words; ++i)
+    {
+	uint32_t w = READ (line + i);
+	uint32_t from = 0xffffffff;
+	uint32_t edges;
+
+	if (i == n_words - 1)
+	    w &= last_mask;
+
+	if (w == (in_box ? 0xffffffff : 0))
+	    continue;
+
+	/* Find the next edge at or after the bits in from */
+	while ((edges = (in_box ? ~w : w) & from))
+	{
+	    int b = bitmap_first_bit (edges);
+
+	    if (in_box)
+	    {
+		rects = bitmap_addrect (region, rects, first_rect,
+					rx1, y, (i << 5) + b, y + 1);
+		if (rects == NULL)
+		    return NULL;
+	    }
+	    else
+	    {
+		rx1 = (i << 5) + b;
+	    }
+
+	    in_box = !in_box;
+	    from = SCREEN_SHIFT_RIGHT (0xffffffff, b);
+	}
+    }
+
+    /* If the line ended with the last bit set, end the box */
+    if (in_box)
+	rects = bitmap_addrect (region, rects, first_rect, rx1, y, width, y + 1);
+
+    return rects;
+}
+
+/* Whether the first @width bits of two lines are the same */
+static pixman_bool_t
+bitmap_lines_equal (const uint32_t *a, const uint32_t *b, int width)
+{
+    int n = width >> 5;
+
+    if (memcmp (a, b, n * sizeof (uint32_t)) != 0)
+	return FALSE;
+
+    return !(width & 31) ||
+	!((READ (a + n) ^ READ (b + n)) & ~SCREEN_SHIFT_RIGHT (0xffffffff, width & 31));
+}
+
+/* Sets the bits of @line for the pixels of @row that are above
+ * @threshold.
+ */
+static void
+bitmap_line_from_a8 (uint32_t *      line,
+		     const uint8_t * row,
+		     int             width,
+		     uint8_t         threshold)
+{
+    int x = 0;
+
+#if defined(USE_SSE2) && defined(__SSE2__)
+    __m128i t = _mm_set1_epi8 ((char)threshold);
+    __m128i zero = _mm_setzero_si128 ();
+
+    /* Pixels that are not above the threshold saturate to 0. On x86 the
+     * screen order of the bits is the order of the mask bits.
+     */
+    for (; x + 32 <= width; x += 32)
+    {
+	__m128i lo = _mm_subs_epu8 (_mm_loadu_si128 ((const __m128i *)(row + x)), t);
+	__m128i hi = _mm_subs_epu8 (_mm_loadu_si128 ((const __m128i *)(row + x + 16)), t);
+	uint32_t out_lo = _mm_movemask_epi8 (_mm_cmpeq_epi8 (lo, zero));
+	uint32_t out_hi = _mm_movemask_epi8 (_mm_cmpeq_epi8 (hi, zero));
+
+	line[x >> 5] = ~(out_lo | (out_hi << 16));
+    }
+#endif
+
+    for (; x < width; x += 32)
+    {
+	uint32_t bit = 0xffffffff & ~SCREEN_SHIFT_RIGHT (0xffffffff, 1);
+	uint32_t w = 0;
+	int i, n = MIN (width - x, 32);
+
+	for (i = 0; i < n; ++i)
+	{
+	    if (row[x + i] > threshold)
+		w |= bit;
+
+	    bit = SCREEN_SHIFT_RIGHT (bit, 1);
+	}
+
+	line[x >> 5] = w;
+    }
+}
+
+/* Convert a bitmap clip mask into a clipping region.
+ * First, goes through each line and makes boxes from the runs of set
+ * bits. a8 lines are first turned into bits, by comparing each pixel
+ * to the threshold.
+ * A line that is the same as the previous one just makes the boxes of
+ * the previous line taller. Otherwise the current line is coalesced
+ * with the previous if they have boxes at the same X coordinates.
  * Stride is in number of uint32_t per line.
  */
 PIXMAN_EXPORT void
-PREFIX (_init_from_image) (region_type_t *region,
-                           pixman_image_t *image)
+PREFIX (_init_from_image_threshold) (region_type_t *region,
+                                     pixman_image_t *image,
+                                     uint8_t         threshold)
 {
-    uint32_t mask0 = 0xffffffff & ~SCREEN_SHIFT_RIGHT(0xffffffff, 1);
     box_type_t *first_rect, *rects, *prect_line_start;
     box_type_t *old_rect, *new_rect;
-    uint32_t *pw, w, *pw_line, *pw_line_end;
+    uint32_t *pw_line, *line, *prev_line;
+    uint32_t *a8_lines = NULL;
     int	irect_prev_start, irect_line_start;
-    int	h, base, rx1 = 0, crects;
-    int	ib;
-    pixman_bool_t in_box, same;
-    int width, height, stride;
+    int	h, crects;
+    pixman_bool_t same;
+    int width, height, stride, words;
 
     PREFIX(_init) (region);
 
     critical_if_fail (region->data);
 
     return_if_fail (image->type == BITS);
-    return_if_fail (image->bits.format == PIXMAN_a1);
+    return_if_fail (image->bits.format == PIXMAN_a1 ||
+		    image->bits.format == PIXMAN_a8);
 
     pw_line = pixman_image_get_data (image);
     width = pixman_image_get_width (image);
     height = pixman_image_get_height (image);
     stride = pixman_image_get_stride (image) / 4;
+    words = (width + 31) >> 5;
+
+    /* a8 lines are turned into bits in two buffers, one of which holds
+     * the previous line.
+     */
+    if (image->bits.format == PIXMAN_a8)
+    {
+	a8_lines = pixman_malloc_ab (2 * MAX (words, 1), sizeof (uint32_t));
+	if (!a8_lines)
+	{
+	    pixman_break (region);
+	    return;
+	}
+    }
 
     first_rect = PIXREGION_BOXPTR(region);
     rects = first_rect;
@@ -2627,110 +3426,36 @@ PREFIX (_init_from_image) (region_type_t *region,
     region->extents.x1 = width - 1;
     region->extents.x2 = 0;
     irect_prev_start = -1;
+    prev_line = NULL;
     for (h = 0; h < height; h++)
     {
-        pw = pw_line;
-        pw_line += stride;
-        irect_line_start = rects - first_rect;
-
-        /* If the Screen left most bit of the word is set, we're starting in
-         * a box */
-        if (READ(pw) & mask0)
+        if (a8_lines)
         {
-            in_box = TRUE;
-            rx1 = 0;
+            line = (prev_line == a8_lines) ? a8_lines + words : a8_lines;
+            bitmap_line_from_a8 (line, (uint8_t *)pw_line, width, threshold);
         }
         else
         {
-            in_box = FALSE;
+            line = pw_line;
         }
+        pw_line += stride;
 
-        /* Process all words which are fully in the pixmap */
-        pw_line_end = pw + (width >> 5);
-        for (base = 0; pw < pw_line_end; base += 32)
+        /* The boxes of the previous line, if any, end at this line */
+        if (prev_line && bitmap_lines_equal (line, prev_line, width))
         {
-            w = READ(pw++);
-            if (in_box)
-            {
-                if (!~w)
-                    continue;
-            }
-            else
-            {
-                if (!w)
-                    continue;
-            }
-            for (ib = 0; ib < 32; ib++)
-            {
-                /* If the Screen left most bit of the word is set, we're
-                 * starting a box */
-                if (w & mask0)
-                {
-                    if (!in_box)
-                    {
-                        rx1 = base + ib;
-                        /* start new box */
-                        in_box = TRUE;
-                    }
-                }
-                else
-                {
-                    if (in_box)
-                    {
-                        /* end box */
-                        rects = bitmap_addrect (region, rects, &first_rect,
-                                                rx1, h, base + ib, h + 1);
-                        if (rects == NULL)
-                            goto error;
-                        in_box = FALSE;
-                    }
-                }
-                /* Shift the word VISUALLY left one. */
-                w = SCREEN_SHIFT_LEFT(w, 1);
-            }
+            for (old_rect = first_rect + irect_prev_start; old_rect < rects; old_rect++)
+                old_rect->y2 += 1;
+            continue;
         }
 
-        if (width & 31)
-        {
-            /* Process final partial word on line */
-             w = READ(pw++);
-            for (ib = 0; ib < (width & 31); ib++)
-            {
-                /* If the Screen left most bit of the word is set, we're
-                 * starting a box */
-                if (w & mask0)
-                {
-                    if (!in_box)
-                    {
-                        rx1 = base + ib;
-                        /* start new box */
-                        in_box = TRUE;
-                    }
-                }
-                else
-                {
-                    if (in_box)
-                    {
-                        /* end box */
-                        rects = bitmap_addrect(region, rects, &first_rect,
-					       rx1, h, base + ib, h + 1);
-			if (rects == NULL)
-			    goto error;
-                        in_box = FALSE;
-                    }
-                }
-                /* Shift the word VISUALLY left one. */
-                w = SCREEN_SHIFT_LEFT(w, 1);
-            }
-        }
-        /* If scanline ended with last bit set, end the box */
-        if (in_box)
-        {
-            rects = bitmap_addrect(region, rects, &first_rect,
-				   rx1, h, base + (width & 31), h + 1);
-	    if (rects == NULL)
-		goto error;
-        }
+        irect_line_start = rects - first_rect;
+
+        rects = bitmap_add_runs (region, rects, &first_rect, line, width, h);
+        if (rects == NULL)
+            goto error;
+
+        prev_line = line;
+
         /* if all rectangles on this line have the same x-coords as
          * those on the previous line, then add 1 to all the previous  y2s and
          * throw away all the rectangles from this line
@@ -2782,11 +3507,18 @@ PREFIX (_init_from_image) (region_type_t *region,
         region->extents.y2 = PIXREGION_END(region)->y2;
         if (region->data->numRects == 1)
         {
-            free (region->data);
+            FREE_DATA (region);
             region->data = NULL;
         }
     }
 
  error:
-    return;
+    free (a8_lines);
+}
+
+PIXMAN_EXPORT void
+PREFIX (_init_from_image) (region_type_t *region,
+                           pixman_image_t *image)
+{
+    PREFIX (_init_from_image_threshold) (region, image, 0);
 }
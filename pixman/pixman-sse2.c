@@ -3312,6 +3312,79 @@ sse2_composite_over_n_8_8888 (pixman_implementation_t *imp,
 
 }
 
+/* Glyphs are mostly narrower than 16 bytes, so the end of each row is
+ * done with 8 and 4 byte adds before going byte by byte.
+ */
+static force_inline void
+sse2_add_row (uint8_t *dst, const uint8_t *src, int w)
+{
+    while (w >= 16)
+    {
+	_mm_storeu_si128 ((__m128i *)dst,
+			  _mm_adds_epu8 (_mm_loadu_si128 ((__m128i *)src),
+					 _mm_loadu_si128 ((__m128i *)dst)));
+	src += 16;
+	dst += 16;
+	w -= 16;
+    }
+
+    if (w >= 8)
+    {
+	_mm_storel_epi64 ((__m128i *)dst,
+			  _mm_adds_epu8 (_mm_loadl_epi64 ((__m128i *)src),
+					 _mm_loadl_epi64 ((__m128i *)dst)));
+	src += 8;
+	dst += 8;
+	w -= 8;
+    }
+
+    if (w >= 4)
+    {
+	*(uint32_t *)dst = _mm_cvtsi128_si32 (
+	    _mm_adds_epu8 (_mm_cvtsi32_si128 (*(uint32_t *)src),
+			   _mm_cvtsi32_si128 (*(uint32_t *)dst)));
+	src += 4;
+	dst += 4;
+	w -= 4;
+    }
+
+    while (w--)
+    {
+	uint16_t t = *dst + *src++;
+
+	*dst++ = t | (0 - (t >> 8));
+    }
+}
+
+#if defined(__GNUC__) && !defined(__x86_64__) && !defined(__amd64__)
+__attribute__((__force_align_arg_pointer__))
+#endif
+static pixman_bool_t
+sse2_add_glyphs (pixman_implementation_t   *imp,
+		 int                        dest_stride,
+		 int                        n_blits,
+		 const pixman_glyph_blit_t *blits)
+{
+    int i;
+
+    for (i = 0; i < n_blits; ++i)
+    {
+	const uint8_t *src = blits[i].src;
+	uint8_t *dst = blits[i].dest;
+	int height = blits[i].height;
+
+	while (height--)
+	{
+	    sse2_add_row (dst, src, blits[i].width);
+
+	    src += blits[i].src_stride;
+	    dst += dest_stride;
+	}
+    }
+
+    return TRUE;
+}
+
 #if defined(__GNUC__) && !defined(__x86_64__) && !defined(__amd64__)
 __attribute__((__force_align_arg_pointer__))
 #endif
@@ -6470,6 +6543,8 @@ _pixman_implementation_create_sse2 (pixman_implementation_t *fallback)
 {
     pixman_implementation_t *imp = _pixman_implementation_create (fallback, sse2_fast_paths);
 
+    imp->name = "sse2";
+
     /* SSE2 constants */
     mask_565_r  = create_mask_2x32_128 (0x00f80000, 0x00f80000);
     mask_565_g1 = create_mask_2x32_128 (0x00070000, 0x00070000);
@@ -6517,6 +6592,7 @@ _pixman_implementation_create_sse2 (pixman_implementation_t *fallback)
 
     imp->blt = sse2_blt;
     imp->fill = sse2_fill;
+    imp->add_glyphs = sse2_add_glyphs;
 
     imp->iter_info = sse2_iters;
 
@@ -0,0 +1,592 @@
+/*
+ * Copyright © 2026 The pixman authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Runtime composite statistics and fallback tracing
+ *
+ * Counts are kept in a fixed size open addressing hash table with one
+ * slot per combination of implementation, composite function, operator
+ * and formats. Glyphs added in batches by an implementation's
+ * add_glyphs() have slots of their own, without a composite function.
+ * Slots are never removed, so once a slot is in use its key doesn't
+ * change, and lookups don't need a lock. Adding a slot is done under a
+ * spin lock, and the counters are updated atomically.
+ *
+ * Fallbacks are rare and slow enough that their trace is simply a
+ * short array searched with a spin lock held.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include "pixman-private.h"
+
+#define N_STATS_SLOTS 512
+
+typedef struct
+{
+    volatile pixman_bool_t	used;
+    pixman_stats_kind_t		kind;
+    pixman_implementation_t *	imp;
+    pixman_composite_func_t	func;
+    pixman_op_t			op;
+    pixman_format_code_t	src_format;
+    pixman_format_code_t	mask_format;
+    pixman_format_code_t	dest_format;
+
+    volatile uint64_t		calls;
+    volatile uint64_t		pixels;
+    volatile uint64_t		cycles;
+    volatile uint64_t		glyphs;
+} stats_slot_t;
+
+volatile pixman_bool_t _pixman_stats_enabled;
+
+static stats_slot_t stats_slots[N_STATS_SLOTS];
+static volatile int32_t stats_lock;
+
+/* Only real formats are reported */
+static force_inline pixman_format_code_t
+public_format (pixman_image_t *image)
+{
+    pixman_format_code_t format;
+
+    if (!image)
+	return 0;
+
+    format = image->common.extended_format_code;
+
+    return PIXMAN_FORMAT_BPP (format) ? format : 0;
+}
+
+static force_inline uint32_t
+hash_slot (pixman_implementation_t *imp,
+	   pixman_composite_func_t  func,
+	   pixman_op_t              op,
+	   pixman_format_code_t     src_format,
+	   pixman_format_code_t     mask_format,
+	   pixman_format_code_t     dest_format)
+{
+    uint64_t h;
+
+    h = (uintptr_t)func * 0x9e3779b97f4a7c15ULL;
+    h ^= (uintptr_t)imp;
+    h ^= ((uint64_t)src_format << 32) ^ mask_format;
+    h *= 0xc2b2ae3d27d4eb4fULL;
+    h ^= ((uint64_t)dest_format << 32) ^ op;
+    h *= 0x9e3779b97f4a7c15ULL;
+
+    return (uint32_t)(h >> 32);
+}
+
+#define SLOT_MATCHES(slot)						\
+    ((slot)->kind == kind &&						\
+     (slot)->func == func && (slot)->imp == imp && (slot)->op == op &&	\
+     (slot)->src_format == src_format &&				\
+     (slot)->mask_format == mask_format &&				\
+     (slot)->dest_format == dest_format)
+
+static stats_slot_t *
+find_slot (pixman_stats_kind_t      kind,
+	   pixman_implementation_t *imp,
+	   pixman_composite_func_t  func,
+	   pixman_op_t              op,
+	   pixman_format_code_t     src_format,
+	   pixman_format_code_t     mask_format,
+	   pixman_format_code_t     dest_format)
+{
+    uint32_t i = hash_slot (imp, func, op, src_format, mask_format, dest_format);
+    stats_slot_t *slot = NULL;
+    int n;
+
+    for (n = 0; n < N_STATS_SLOTS; ++n, ++i)
+    {
+	slot = &stats_slots[i % N_STATS_SLOTS];
+
+	if (!slot->used)
+	    break;
+
+	PIXMAN_READ_BARRIER ();
+
+	if (SLOT_MATCHES (slot))
+	    return slot;
+    }
+
+    if (n == N_STATS_SLOTS)
+	return NULL;
+
+    /* Not there yet, so add it. Another thread may have done that in
+     * the meantime, so continue the search with the lock held.
+     */
+    while (!PIXMAN_TRY_LOCK (&stats_lock))
+	;
+
+    for (; n < N_STATS_SLOTS; ++n, ++i)
+    {
+	slot = &stats_slots[i % N_STATS_SLOTS];
+
+	if (!slot->used)
+	{
+	    slot->kind = kind;
+	    slot->imp = imp;
+	    slot->func = func;
+	    slot->op = op;
+	    slot->src_format = src_format;
+	    slot->mask_format = mask_format;
+	    slot->dest_format = dest_format;
+
+	    PIXMAN_WRITE_BARRIER ();
+	    slot->used = TRUE;
+	    break;
+	}
+
+	if (SLOT_MATCHES (slot))
+	    break;
+    }
+
+    PIXMAN_UNLOCK (&stats_lock);
+
+    return n < N_STATS_SLOTS ? slot : NULL;
+}
+
+void
+_pixman_stats_record (pixman_implementation_t       *imp,
+		      pixman_composite_func_t        func,
+		      const pixman_composite_info_t *info,
+		      uint64_t                       start)
+{
+    uint64_t cycles = _pixman_stats_timestamp () - start;
+    stats_slot_t *slot;
+
+    slot = find_slot (PIXMAN_STATS_COMPOSITE, imp, func, info->op,
+		      public_format (info->src_image),
+		      public_format (info->mask_image),
+		      public_format (info->dest_image));
+
+    if (!slot)
+	return;
+
+    PIXMAN_ATOMIC_FETCH_ADD_64 (&slot->calls, 1);
+    PIXMAN_ATOMIC_FETCH_ADD_64 (&slot->pixels, (uint64_t)info->width * info->height);
+    PIXMAN_ATOMIC_FETCH_ADD_64 (&slot->cycles, cycles);
+}
+
+void
+_pixman_stats_record_glyphs (pixman_implementation_t *imp,
+			     pixman_format_code_t     format,
+			     int                      n_glyphs,
+			     uint64_t                 pixels,
+			     uint64_t                 start)
+{
+    uint64_t cycles = _pixman_stats_timestamp () - start;
+    stats_slot_t *slot;
+
+    slot = find_slot (PIXMAN_STATS_ADD_GLYPHS, imp, NULL, PIXMAN_OP_ADD,
+		      format, 0, format);
+
+    if (!slot)
+	return;
+
+    PIXMAN_ATOMIC_FETCH_ADD_64 (&slot->calls, 1);
+    PIXMAN_ATOMIC_FETCH_ADD_64 (&slot->pixels, pixels);
+    PIXMAN_ATOMIC_FETCH_ADD_64 (&slot->cycles, cycles);
+    PIXMAN_ATOMIC_FETCH_ADD_64 (&slot->glyphs, n_glyphs);
+}
+
+static pixman_bool_t
+env_enabled (const char *name)
+{
+    const char *env = getenv (name);
+
+    return env && *env && strcmp (env, "0") != 0;
+}
+
+void
+_pixman_stats_init (void)
+{
+    if (env_enabled ("PIXMAN_STATS"))
+	_pixman_stats_enabled = TRUE;
+
+    if (env_enabled ("PIXMAN_TRACE_FALLBACKS"))
+	_pixman_trace_fallbacks = TRUE;
+}
+
+PIXMAN_EXPORT void
+pixman_enable_stats (pixman_bool_t enable)
+{
+    _pixman_stats_enabled = enable;
+}
+
+static void
+fill_stats (pixman_composite_stats_t *stats,
+	    pixman_stats_kind_t       kind,
+	    pixman_implementation_t  *imp)
+{
+    stats->kind = kind;
+    stats->implementation = imp->name;
+    stats->fallback = imp->fallback == NULL;
+    stats->op = PIXMAN_OP_NONE;
+    stats->src_format = 0;
+    stats->mask_format = 0;
+    stats->dest_format = 0;
+    stats->calls = 0;
+    stats->pixels = 0;
+    stats->cycles = 0;
+    stats->glyphs = 0;
+}
+
+PIXMAN_EXPORT int
+pixman_get_stats (pixman_composite_stats_t *stats, int n_stats)
+{
+    pixman_composite_stats_t entry;
+    pixman_implementation_t *imp;
+    stats_slot_t *slot;
+    int n = 0;
+    int i;
+
+    for (imp = get_implementation (); imp; imp = imp->fallback)
+    {
+	fill_stats (&entry, PIXMAN_STATS_IMPLEMENTATION, imp);
+
+	for (i = 0; i < N_STATS_SLOTS; ++i)
+	{
+	    slot = &stats_slots[i];
+
+	    if (!slot->used)
+		continue;
+
+	    PIXMAN_READ_BARRIER ();
+
+	    if (slot->imp == imp)
+	    {
+		entry.calls += slot->calls;
+		entry.pixels += slot->pixels;
+		entry.cycles += slot->cycles;
+		entry.glyphs += slot->glyphs;
+	    }
+	}
+
+	if (n < n_stats)
+	    stats[n] = entry;
+	n++;
+    }
+
+    for (i = 0; i < N_STATS_SLOTS; ++i)
+    {
+	slot = &stats_slots[i];
+
+	if (!slot->used)
+	    continue;
+
+	PIXMAN_READ_BARRIER ();
+
+	if (!slot->calls)
+	    continue;
+
+	fill_stats (&entry, slot->kind, slot->imp);
+
+	entry.op = slot->op;
+	entry.src_format = slot->src_format;
+	entry.mask_format = slot->mask_format;
+	entry.dest_format = slot->dest_format;
+	entry.calls = slot->calls;
+	entry.pixels = slot->pixels;
+	entry.cycles = slot->cycles;
+	entry.glyphs = slot->glyphs;
+
+	if (n < n_stats)
+	    stats[n] = entry;
+	n++;
+    }
+
+    return n;
+}
+
+PIXMAN_EXPORT void
+pixman_reset_stats (void)
+{
+    int i;
+
+    /* Subtract what is there rather than storing zeros, so that counts
+     * added concurrently are not lost.
+     */
+    for (i = 0; i < N_STATS_SLOTS; ++i)
+    {
+	stats_slot_t *slot = &stats_slots[i];
+
+	PIXMAN_ATOMIC_FETCH_ADD_64 (&slot->calls, -slot->calls);
+	PIXMAN_ATOMIC_FETCH_ADD_64 (&slot->pixels, -slot->pixels);
+	PIXMAN_ATOMIC_FETCH_ADD_64 (&slot->cycles, -slot->cycles);
+	PIXMAN_ATOMIC_FETCH_ADD_64 (&slot->glyphs, -slot->glyphs);
+    }
+}
+
+/* Fallback tracing */
+
+#define N_FALLBACK_TRACES 64
+
+typedef struct
+{
+    pixman_op_t			op;
+    pixman_format_code_t	src_format;
+    uint32_t			src_flags;
+    pixman_format_code_t	mask_format;
+    uint32_t			mask_flags;
+    pixman_format_code_t	dest_format;
+    uint32_t			dest_flags;
+
+    const char *		candidate;
+    uint32_t			missing_src_flags;
+    uint32_t			missing_mask_flags;
+    uint32_t			missing_dest_flags;
+
+    uint64_t			count;
+} fallback_trace_t;
+
+volatile pixman_bool_t _pixman_trace_fallbacks;
+
+static fallback_trace_t fallback_traces[N_FALLBACK_TRACES];
+static int n_fallback_traces;
+static volatile int32_t fallback_lock;
+
+static int
+count_bits (uint32_t bits)
+{
+    int n = 0;
+
+    while (bits)
+    {
+	bits &= bits - 1;
+	n++;
+    }
+
+    return n;
+}
+
+/* Finds the fast path for the operator and formats that is missing the
+ * fewest flags. The general implementation is left out, since that is
+ * where the operation ended up.
+ */
+static void
+find_candidate (pixman_implementation_t *toplevel,
+		fallback_trace_t *       trace)
+{
+    pixman_implementation_t *imp;
+    const pixman_fast_path_t *info;
+    int best = 0;
+
+    trace->candidate = NULL;
+    trace->missing_src_flags = 0;
+    trace->missing_mask_flags = 0;
+    trace->missing_dest_flags = 0;
+
+    for (imp = toplevel; imp && imp->fallback; imp = imp->fallback)
+    {
+	for (info = imp->fast_paths; info->op != PIXMAN_OP_NONE; ++info)
+	{
+	    uint32_t src, mask, dest;
+	    int missing;
+
+	    if ((info->op != trace->op && info->op != PIXMAN_OP_any)	||
+		(info->src_format != trace->src_format &&
+		 info->src_format != PIXMAN_any)			||
+		(info->mask_format != trace->mask_format &&
+		 info->mask_format != PIXMAN_any)			||
+		(info->dest_format != trace->dest_format &&
+		 info->dest_format != PIXMAN_any))
+	    {
+		continue;
+	    }
+
+	    src = info->src_flags & ~trace->src_flags;
+	    mask = info->mask_flags & ~trace->mask_flags;
+	    dest = info->dest_flags & ~trace->dest_flags;
+
+	    missing = count_bits (src) + count_bits (mask) + count_bits (dest);
+
+	    if (!trace->candidate || missing < best)
+	    {
+		trace->candidate = imp->name;
+		trace->missing_src_flags = src;
+		trace->missing_mask_flags = mask;
+		trace->missing_dest_flags = dest;
+
+		best = missing;
+	    }
+	}
+    }
+}
+
+void
+_pixman_trace_fallback (pixman_implementation_t *toplevel,
+			pixman_op_t              op,
+			pixman_format_code_t     src_format,
+			uint32_t                 src_flags,
+			pixman_format_code_t     mask_format,
+			uint32_t                 mask_flags,
+			pixman_format_code_t     dest_format,
+			uint32_t                 dest_flags)
+{
+    fallback_trace_t *trace;
+    int i;
+
+    while (!PIXMAN_TRY_LOCK (&fallback_lock))
+	;
+
+    for (i = 0; i < n_fallback_traces; ++i)
+    {
+	trace = &fallback_traces[i];
+
+	if (trace->op == op					&&
+	    trace->src_format == src_format			&&
+	    trace->src_flags == src_flags			&&
+	    trace->mask_format == mask_format			&&
+	    trace->mask_flags == mask_flags			&&
+	    trace->dest_format == dest_format			&&
+	    trace->dest_flags == dest_flags)
+	{
+	    trace->count++;
+	    goto out;
+	}
+    }
+
+    if (n_fallback_traces < N_FALLBACK_TRACES)
+    {
+	trace = &fallback_traces[n_fallback_traces++];
+
+	trace->op = op;
+	trace->src_format = src_format;
+	trace->src_flags = src_flags;
+	trace->mask_format = mask_format;
+	trace->mask_flags = mask_flags;
+	trace->dest_format = dest_format;
+	trace->dest_flags = dest_flags;
+	trace->count = 1;
+
+	find_candidate (toplevel, trace);
+    }
+
+out:
+    PIXMAN_UNLOCK (&fallback_lock);
+}
+
+PIXMAN_EXPORT void
+pixman_enable_fallback_trace (pixman_bool_t enable)
+{
+    _pixman_trace_fallbacks = enable;
+}
+
+static force_inline pixman_format_code_t
+public_format_code (pixman_format_code_t format)
+{
+    return PIXMAN_FORMAT_BPP (format) ? format : 0;
+}
+
+PIXMAN_EXPORT int
+pixman_get_fallback_trace (pixman_fallback_trace_t *traces, int n_traces)
+{
+    int i, n;
+
+    while (!PIXMAN_TRY_LOCK (&fallback_lock))
+	;
+
+    n = n_fallback_traces;
+
+    for (i = 0; i < n && i < n_traces; ++i)
+    {
+	const fallback_trace_t *trace = &fallback_traces[i];
+
+	traces[i].op = trace->op;
+	traces[i].src_format = public_format_code (trace->src_format);
+	traces[i].mask_format = public_format_code (trace->mask_format);
+	traces[i].dest_format = public_format_code (trace->dest_format);
+	traces[i].candidate = trace->candidate;
+	traces[i].missing_src_flags = trace->missing_src_flags;
+	traces[i].missing_mask_flags = trace->missing_mask_flags;
+	traces[i].missing_dest_flags = trace->missing_dest_flags;
+	traces[i].count = trace->count;
+    }
+
+    PIXMAN_UNLOCK (&fallback_lock);
+
+    return n;
+}
+
+PIXMAN_EXPORT void
+pixman_reset_fallback_trace (void)
+{
+    while (!PIXMAN_TRY_LOCK (&fallback_lock))
+	;
+
+    n_fallback_traces = 0;
+
+    PIXMAN_UNLOCK (&fallback_lock);
+}
+
+PIXMAN_EXPORT const char *
+pixman_fast_path_flag_name (uint32_t flag)
+{
+    static const char *const names[] =
+    {
+	"ID_TRANSFORM",
+	"NO_ALPHA_MAP",
+	"NO_CONVOLUTION_FILTER",
+	"NO_PAD_REPEAT",
+	"NO_REFLECT_REPEAT",
+	"NO_ACCESSORS",
+	"NARROW_FORMAT",
+	"SAMPLES_OPAQUE",
+	"COMPONENT_ALPHA",
+	"UNIFIED_ALPHA",
+	"SCALE_TRANSFORM",
+	"NEAREST_FILTER",
+	"HAS_TRANSFORM",
+	"IS_OPAQUE",
+	"NO_NORMAL_REPEAT",
+	"NO_NONE_REPEAT",
+	"X_UNIT_POSITIVE",
+	"AFFINE_TRANSFORM",
+	"Y_UNIT_ZERO",
+	"BILINEAR_FILTER",
+	"ROTATE_90_TRANSFORM",
+	"ROTATE_180_TRANSFORM",
+	"ROTATE_270_TRANSFORM",
+	"SAMPLES_COVER_CLIP_NEAREST",
+	"SAMPLES_COVER_CLIP_BILINEAR",
+	"BITS_IMAGE",
+	"SEPARABLE_CONVOLUTION_FILTER",
+    };
+    int i;
+
+    if (!flag || (flag & (flag - 1)))
+	return NULL;
+
+    for (i = 0; i < (int)(sizeof (names) / sizeof (names[0])); ++i)
+    {
+	if (flag == (1u << i))
+	    return names[i];
+    }
+
+    return NULL;
+}
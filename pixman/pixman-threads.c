@@ -0,0 +1,336 @@
+/*
+ * Copyright © 2026 The pixman authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* A small pool of worker threads used to split large operations into
+ * independent jobs. The pool is shared by all threads calling into
+ * pixman: each call to _pixman_parallel_run() queues a batch of jobs,
+ * and both the workers and the calling thread take jobs from it until
+ * it is done. Several batches from different threads can be in flight
+ * at the same time.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "pixman-private.h"
+
+#if defined(_WIN32) && !defined(PIXMAN_NO_TLS)
+
+#define PIXMAN_THREAD_POOL_WIN32
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <process.h>
+
+typedef SRWLOCK pool_mutex_t;
+typedef CONDITION_VARIABLE pool_cond_t;
+
+#define POOL_MUTEX_INIT SRWLOCK_INIT
+#define POOL_COND_INIT CONDITION_VARIABLE_INIT
+
+#define pool_lock(m)		AcquireSRWLockExclusive (m)
+#define pool_unlock(m)		ReleaseSRWLockExclusive (m)
+#define pool_wait(c, m)		SleepConditionVariableSRW (c, m, INFINITE, 0)
+#define pool_signal(c)		WakeConditionVariable (c)
+#define pool_broadcast(c)	WakeAllConditionVariable (c)
+
+#elif defined(HAVE_PTHREADS) && !defined(PIXMAN_NO_TLS)
+
+#define PIXMAN_THREAD_POOL_PTHREADS
+
+#include <pthread.h>
+
+typedef pthread_mutex_t pool_mutex_t;
+typedef pthread_cond_t pool_cond_t;
+
+#define POOL_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#define POOL_COND_INIT PTHREAD_COND_INITIALIZER
+
+#define pool_lock(m)		pthread_mutex_lock (m)
+#define pool_unlock(m)		pthread_mutex_unlock (m)
+#define pool_wait(c, m)		pthread_cond_wait (c, m)
+#define pool_signal(c)		pthread_cond_signal (c)
+#define pool_broadcast(c)	pthread_cond_broadcast (c)
+
+#endif
+
+#if defined(PIXMAN_THREAD_POOL_WIN32) || defined(PIXMAN_THREAD_POOL_PTHREADS)
+
+#define MAX_THREADS 64
+
+typedef struct
+{
+    pixman_link_t		link;
+    pixman_parallel_func_t	func;
+    void *			data;
+    int				n_jobs;
+    int				next_job;
+    int				n_done;
+} batch_t;
+
+static pool_mutex_t pool_mutex = POOL_MUTEX_INIT;
+static pool_cond_t work_cond = POOL_COND_INIT;
+static pool_cond_t done_cond = POOL_COND_INIT;
+
+/* All of these are protected by pool_mutex. n_threads counts the
+ * calling thread, so the number of workers wanted is n_threads - 1.
+ */
+static pixman_list_t queue = { (pixman_link_t *)&queue, (pixman_link_t *)&queue };
+static int n_threads = 1;
+static int n_workers;
+
+static force_inline pixman_bool_t
+queue_empty (void)
+{
+    return queue.head == (pixman_link_t *)&queue;
+}
+
+/* Hands out the next job of @batch. Once all jobs have been handed out,
+ * the batch is taken off the queue; it stays alive until the thread
+ * that queued it has seen all of them complete.
+ */
+static int
+take_job (batch_t *batch)
+{
+    int job = batch->next_job++;
+
+    if (batch->next_job == batch->n_jobs)
+	pixman_list_unlink (&batch->link);
+
+    return job;
+}
+
+static void
+run_job (batch_t *batch, int job)
+{
+    pool_unlock (&pool_mutex);
+
+    batch->func (batch->data, job);
+
+    pool_lock (&pool_mutex);
+
+    if (++batch->n_done == batch->n_jobs)
+	pool_broadcast (&done_cond);
+}
+
+/* See the comment above pixman_image_composite32() */
+#if defined (USE_SSE2) && defined(__GNUC__) && !defined(__x86_64__) && !defined(__amd64__)
+__attribute__((__force_align_arg_pointer__))
+#endif
+static void
+worker_main (void)
+{
+    pool_lock (&pool_mutex);
+
+    for (;;)
+    {
+	batch_t *batch;
+
+	while (queue_empty () && n_workers < n_threads)
+	    pool_wait (&work_cond, &pool_mutex);
+
+	if (n_workers >= n_threads)
+	    break;
+
+	/* Oldest batch first; new batches are added at the head */
+	batch = CONTAINER_OF (batch_t, link, queue.tail);
+
+	run_job (batch, take_job (batch));
+    }
+
+    n_workers--;
+
+    pool_unlock (&pool_mutex);
+}
+
+#ifdef PIXMAN_THREAD_POOL_WIN32
+
+static unsigned __stdcall
+worker_thread (void *closure)
+{
+    worker_main ();
+
+    return 0;
+}
+
+static pixman_bool_t
+start_worker (void)
+{
+    uintptr_t thread = _beginthreadex (NULL, 0, worker_thread, NULL, 0, NULL);
+
+    if (!thread)
+	return FALSE;
+
+    CloseHandle ((HANDLE)thread);
+
+    return TRUE;
+}
+
+#else
+
+static void *
+worker_thread (void *closure)
+{
+    worker_main ();
+
+    return NULL;
+}
+
+static pixman_bool_t
+start_worker (void)
+{
+    pthread_t thread;
+
+    if (pthread_create (&thread, NULL, worker_thread, NULL) != 0)
+	return FALSE;
+
+    pthread_detach (thread);
+
+    return TRUE;
+}
+
+#endif
+
+PIXMAN_EXPORT void
+pixman_set_num_threads (int threads)
+{
+    if (threads < 1)
+	threads = 1;
+    if (threads > MAX_THREADS)
+	threads = MAX_THREADS;
+
+    pool_lock (&pool_mutex);
+
+    n_threads = threads;
+
+    /* Surplus workers notice this when they wake up and exit */
+    while (n_workers < n_threads - 1)
+    {
+	if (!start_worker ())
+	{
+	    _pixman_log_error (FUNC, "Could not create worker thread");
+
+	    n_threads = n_workers + 1;
+	    break;
+	}
+
+	n_workers++;
+    }
+
+    pool_broadcast (&work_cond);
+
+    pool_unlock (&pool_mutex);
+}
+
+PIXMAN_EXPORT int
+pixman_get_num_threads (void)
+{
+    int threads;
+
+    pool_lock (&pool_mutex);
+    threads = n_threads;
+    pool_unlock (&pool_mutex);
+
+    return threads;
+}
+
+int
+_pixman_parallel_get_num_threads (void)
+{
+    /* An unlocked read is fine here; it is only used as a hint for
+     * how much to split up an operation.
+     */
+    return n_threads;
+}
+
+void
+_pixman_parallel_run (int n_jobs, pixman_parallel_func_t func, void *data)
+{
+    batch_t batch;
+
+    if (n_jobs <= 1 || _pixman_parallel_get_num_threads () <= 1)
+    {
+	int i;
+
+	for (i = 0; i < n_jobs; ++i)
+	    func (data, i);
+
+	return;
+    }
+
+    batch.func = func;
+    batch.data = data;
+    batch.n_jobs = n_jobs;
+    batch.next_job = 0;
+    batch.n_done = 0;
+
+    pool_lock (&pool_mutex);
+
+    pixman_list_prepend (&queue, &batch.link);
+
+    pool_broadcast (&work_cond);
+
+    /* Help out with our own batch, then wait for the stragglers */
+    while (batch.next_job < batch.n_jobs)
+	run_job (&batch, take_job (&batch));
+
+    while (batch.n_done < batch.n_jobs)
+	pool_wait (&done_cond, &pool_mutex);
+
+    pool_unlock (&pool_mutex);
+}
+
+#else
+
+/* No thread support; everything runs on the calling thread */
+
+PIXMAN_EXPORT void
+pixman_set_num_threads (int threads)
+{
+}
+
+PIXMAN_EXPORT int
+pixman_get_num_threads (void)
+{
+    return 1;
+}
+
+int
+_pixman_parallel_get_num_threads (void)
+{
+    return 1;
+}
+
+void
+_pixman_parallel_run (int n_jobs, pixman_parallel_func_t func, void *data)
+{
+    int i;
+
+    for (i = 0; i < n_jobs; ++i)
+	func (data, i);
+}
+
+#endif
@@ -27,6 +27,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "pixman-private.h"
 
 /*
@@ -229,6 +230,86 @@ pixman_line_fixed_edge_init (pixman_edge_t *            e,
                       bot->y + y_off_fixed);
 }
 
+/*
+ * Initialize the edges of a trap, and return FALSE if it doesn't cover
+ * any sample rows of an image with the given height
+ */
+static pixman_bool_t
+init_trap_edges (pixman_trap_edges_t *edges,
+		 int                  bpp,
+		 int                  height,
+		 const pixman_trap_t *trap,
+		 int                  x_off,
+		 int                  y_off)
+{
+    pixman_fixed_t x_off_fixed = pixman_int_to_fixed (x_off);
+    pixman_fixed_t y_off_fixed = pixman_int_to_fixed (y_off);
+
+    edges->t = trap->top.y + y_off_fixed;
+    if (edges->t < 0)
+	edges->t = 0;
+    edges->t = pixman_sample_ceil_y (edges->t, bpp);
+
+    edges->b = trap->bot.y + y_off_fixed;
+    if (pixman_fixed_to_int (edges->b) >= height)
+	edges->b = pixman_int_to_fixed (height) - 1;
+    edges->b = pixman_sample_floor_y (edges->b, bpp);
+
+    if (edges->b < edges->t)
+	return FALSE;
+
+    /* initialize edge walkers */
+    pixman_edge_init (&edges->l, bpp, edges->t,
+		      trap->top.l + x_off_fixed,
+		      trap->top.y + y_off_fixed,
+		      trap->bot.l + x_off_fixed,
+		      trap->bot.y + y_off_fixed);
+
+    pixman_edge_init (&edges->r, bpp, edges->t,
+		      trap->top.r + x_off_fixed,
+		      trap->top.y + y_off_fixed,
+		      trap->bot.r + x_off_fixed,
+		      trap->bot.y + y_off_fixed);
+
+    return TRUE;
+}
+
+/*
+ * Initialize the edges of a trapezoid, and return FALSE if it doesn't
+ * cover any sample rows of an image with the given height
+ */
+static pixman_bool_t
+init_trapezoid_edges (pixman_trap_edges_t      *edges,
+		      int                       bpp,
+		      int                       height,
+		      const pixman_trapezoid_t *trap,
+		      int                       x_off,
+		      int                       y_off)
+{
+    pixman_fixed_t y_off_fixed = pixman_int_to_fixed (y_off);
+
+    edges->t = trap->top + y_off_fixed;
+    if (edges->t < 0)
+	edges->t = 0;
+    edges->t = pixman_sample_ceil_y (edges->t, bpp);
+
+    edges->b = trap->bottom + y_off_fixed;
+    if (pixman_fixed_to_int (edges->b) >= height)
+	edges->b = pixman_int_to_fixed (height) - 1;
+    edges->b = pixman_sample_floor_y (edges->b, bpp);
+
+    if (edges->b < edges->t)
+	return FALSE;
+
+    /* initialize edge walkers */
+    pixman_line_fixed_edge_init (
+	&edges->l, bpp, edges->t, &trap->left, x_off, y_off);
+    pixman_line_fixed_edge_init (
+	&edges->r, bpp, edges->t, &trap->right, x_off, y_off);
+
+    return TRUE;
+}
+
 PIXMAN_EXPORT void
 pixman_add_traps (pixman_image_t *     image,
                   int16_t              x_off,
@@ -236,53 +317,42 @@ pixman_add_traps (pixman_image_t *     image,
                   int                  ntrap,
                   const pixman_trap_t *traps)
 {
+    pixman_trap_edges_t *edges, tmp;
     int bpp;
     int height;
+    int i, n;
 
-    pixman_fixed_t x_off_fixed;
-    pixman_fixed_t y_off_fixed;
-    pixman_edge_t l, r;
-    pixman_fixed_t t, b;
+    if (ntrap <= 0)
+	return;
 
     _pixman_image_validate (image);
     
     height = image->bits.height;
     bpp = PIXMAN_FORMAT_BPP (image->bits.format);
 
-    x_off_fixed = pixman_int_to_fixed (x_off);
-    y_off_fixed = pixman_int_to_fixed (y_off);
+    /* If there is no memory for all the edges, rasterize the traps
+     * one by one.
+     */
+    edges = pixman_malloc_ab (ntrap, sizeof (pixman_trap_edges_t));
 
-    while (ntrap--)
+    n = 0;
+    for (i = 0; i < ntrap; ++i)
     {
-	t = traps->top.y + y_off_fixed;
-	if (t < 0)
-	    t = 0;
-	t = pixman_sample_ceil_y (t, bpp);
+	pixman_trap_edges_t *e = edges ? &edges[n] : &tmp;
 
-	b = traps->bot.y + y_off_fixed;
-	if (pixman_fixed_to_int (b) >= height)
-	    b = pixman_int_to_fixed (height) - 1;
-	b = pixman_sample_floor_y (b, bpp);
-
-	if (b >= t)
+	if (init_trap_edges (e, bpp, height, &traps[i], x_off, y_off))
 	{
-	    /* initialize edge walkers */
-	    pixman_edge_init (&l, bpp, t,
-	                      traps->top.l + x_off_fixed,
-	                      traps->top.y + y_off_fixed,
-	                      traps->bot.l + x_off_fixed,
-	                      traps->bot.y + y_off_fixed);
-
-	    pixman_edge_init (&r, bpp, t,
-	                      traps->top.r + x_off_fixed,
-	                      traps->top.y + y_off_fixed,
-	                      traps->bot.r + x_off_fixed,
-	                      traps->bot.y + y_off_fixed);
-
-	    pixman_rasterize_edges (image, &l, &r, t, b);
+	    if (edges)
+		n++;
+	    else
+		pixman_rasterize_edges (image, &e->l, &e->r, e->t, e->b);
 	}
+    }
 
-	traps++;
+    if (edges)
+    {
+	_pixman_rasterize_trap_edges (image, n, edges);
+	free (edges);
     }
 }
 
@@ -314,6 +384,57 @@ dump_image (pixman_image_t *image,
 }
 #endif
 
+static void
+add_trapezoids (pixman_image_t *          image,
+		int                       x_off,
+		int                       y_off,
+		int                       n_traps,
+		const pixman_trapezoid_t *traps)
+{
+    pixman_trap_edges_t *edges, tmp;
+    int bpp;
+    int height;
+    int i, n;
+
+    return_if_fail (image->type == BITS);
+
+    if (n_traps <= 0)
+	return;
+
+    _pixman_image_validate (image);
+
+    height = image->bits.height;
+    bpp = PIXMAN_FORMAT_BPP (image->bits.format);
+
+    /* If there is no memory for all the edges, rasterize the trapezoids
+     * one by one.
+     */
+    edges = pixman_malloc_ab (n_traps, sizeof (pixman_trap_edges_t));
+
+    n = 0;
+    for (i = 0; i < n_traps; ++i)
+    {
+	pixman_trap_edges_t *e = edges ? &edges[n] : &tmp;
+
+	if (!pixman_trapezoid_valid (&traps[i]))
+	    continue;
+
+	if (init_trapezoid_edges (e, bpp, height, &traps[i], x_off, y_off))
+	{
+	    if (edges)
+		n++;
+	    else
+		pixman_rasterize_edges (image, &e->l, &e->r, e->t, e->b);
+	}
+    }
+
+    if (edges)
+    {
+	_pixman_rasterize_trap_edges (image, n, edges);
+	free (edges);
+    }
+}
+
 PIXMAN_EXPORT void
 pixman_add_trapezoids (pixman_image_t *          image,
                        int16_t                   x_off,
@@ -321,21 +442,11 @@ pixman_add_trapezoids (pixman_image_t *          image,
                        int                       ntraps,
                        const pixman_trapezoid_t *traps)
 {
-    int i;
-
 #if 0
     dump_image (image, "before");
 #endif
 
-    for (i = 0; i < ntraps; ++i)
-    {
-	const pixman_trapezoid_t *trap = &(traps[i]);
-
-	if (!pixman_trapezoid_valid (trap))
-	    continue;
-
-	pixman_rasterize_trapezoid (image, trap, x_off, y_off);
-    }
+    add_trapezoids (image, x_off, y_off, ntraps, traps);
 
 #if 0
     dump_image (image, "after");
@@ -348,12 +459,7 @@ pixman_rasterize_trapezoid (pixman_image_t *          image,
                             int                       x_off,
                             int                       y_off)
 {
-    int bpp;
-    int height;
-
-    pixman_fixed_t y_off_fixed;
-    pixman_edge_t l, r;
-    pixman_fixed_t t, b;
+    pixman_trap_edges_t edges;
 
     return_if_fail (image->type == BITS);
 
@@ -362,28 +468,11 @@ pixman_rasterize_trapezoid (pixman_image_t *          image,
     if (!pixman_trapezoid_valid (trap))
 	return;
 
-    height = image->bits.height;
-    bpp = PIXMAN_FORMAT_BPP (image->bits.format);
-
-    y_off_fixed = pixman_int_to_fixed (y_off);
-
-    t = trap->top + y_off_fixed;
-    if (t < 0)
-	t = 0;
-    t = pixman_sample_ceil_y (t, bpp);
-
-    b = trap->bottom + y_off_fixed;
-    if (pixman_fixed_to_int (b) >= height)
-	b = pixman_int_to_fixed (height) - 1;
-    b = pixman_sample_floor_y (b, bpp);
-    
-    if (b >= t)
+    if (init_trapezoid_edges (&edges,
+			      PIXMAN_FORMAT_BPP (image->bits.format),
+			      image->bits.height, trap, x_off, y_off))
     {
-	/* initialize edge walkers */
-	pixman_line_fixed_edge_init (&l, bpp, t, &trap->left, x_off, y_off);
-	pixman_line_fixed_edge_init (&r, bpp, t, &trap->right, x_off, y_off);
-
-	pixman_rasterize_edges (image, &l, &r, t, b);
+	pixman_rasterize_edges (image, &edges.l, &edges.r, edges.t, edges.b);
     }
 }
 
@@ -468,29 +557,406 @@ get_trap_extents (pixman_op_t op, pixman_image_t *dest,
     return TRUE;
 }
 
+static void
+rasterize_trapezoids (pixman_image_t *          image,
+		      int                       x_off,
+		      int                       y_off,
+		      int                       n_traps,
+		      const pixman_trapezoid_t *traps,
+		      pixman_bool_t             exact)
+{
+    if (exact)
+	_pixman_rasterize_trapezoids_exact (image, x_off, y_off, n_traps, traps);
+    else
+	add_trapezoids (image, x_off, y_off, n_traps, traps);
+}
+
 /*
- * pixman_composite_trapezoids()
+ * Rather than rasterizing all the trapezoids into a mask the size of
+ * their extents, the extents are processed in strips of STRIP_HEIGHT
+ * rows. Each strip is rasterized and composited while it is still in
+ * the cache, and then cleared for the next one. When a zero mask has
+ * no effect, only the part of a strip that the trapezoids in it touch
+ * is composited, and strips without trapezoids are skipped.
  *
- * All the trapezoids are conceptually rendered to an infinitely big image.
- * The (0, 0) coordinates of this image are then aligned with the (x, y)
- * coordinates of the source image, and then both images are aligned with
- * the (x, y) coordinates of the destination. Then these three images are
- * composited across the entire destination.
+ * With worker threads, several strips are rasterized at once, and when
+ * rasterizing straight into the destination, its rows are split into
+ * strips in the same way. The strips are disjoint and each is
+ * rasterized exactly as it would be on its own, so the result is the
+ * same as with a single thread.
  */
-PIXMAN_EXPORT void
-pixman_composite_trapezoids (pixman_op_t		op,
-			     pixman_image_t *		src,
-			     pixman_image_t *		dst,
-			     pixman_format_code_t	mask_format,
-			     int			x_src,
-			     int			y_src,
-			     int			x_dst,
-			     int			y_dst,
-			     int			n_traps,
-			     const pixman_trapezoid_t *	traps)
+#define STRIP_HEIGHT 64
+
+/* Fewer trapezoids than this are not worth handing out to threads */
+#define PARALLEL_MIN_TRAPS 128
+#define PARALLEL_STRIPS_PER_THREAD 2
+#define MAX_PARALLEL_STRIPS 32
+
+typedef struct
+{
+    int			y;
+    int			height;
+    int			strip_height;
+    int			n_strips;
+    /* The trapezoids of strip i are traps[start[i]] to traps[start[i + 1] - 1] */
+    int *		start;
+    pixman_trapezoid_t *traps;
+} trap_strips_t;
+
+typedef struct
+{
+    pixman_image_t *		image;
+    int				x_off;
+    int				y_off;
+    int				n_traps;
+    const pixman_trapezoid_t *	traps;
+    pixman_bool_t		exact;
+} strip_job_t;
+
+/* Finds the strips that @trap touches, if any */
+static pixman_bool_t
+get_trap_strips (const trap_strips_t *strips, const pixman_trapezoid_t *trap,
+		 int *s1, int *s2)
+{
+    int top, bottom;
+
+    if (!pixman_trapezoid_valid (trap))
+	return FALSE;
+
+    top = pixman_fixed_to_int (trap->top) - strips->y;
+    bottom = pixman_fixed_to_int (pixman_fixed_ceil (trap->bottom)) - strips->y;
+
+    if (bottom <= 0 || top >= strips->height)
+	return FALSE;
+
+    *s1 = top < 0 ? 0 : top / strips->strip_height;
+    *s2 = bottom > strips->height ?
+	strips->n_strips - 1 : (bottom - 1) / strips->strip_height;
+
+    return TRUE;
+}
+
+/* Sorts copies of the trapezoids into the strips of rows [y1, y2) they
+ * touch, so that each strip only needs to look at its own.
+ */
+static pixman_bool_t
+init_trap_strips (trap_strips_t *strips, int y1, int y2, int strip_height,
+		  int n_traps, const pixman_trapezoid_t *traps)
+{
+    int64_t total = 0;
+    int i, s, s1, s2;
+
+    strips->y = y1;
+    strips->height = y2 - y1;
+    strips->strip_height = strip_height;
+    strips->n_strips = (y2 - y1 + strip_height - 1) / strip_height;
+    strips->traps = NULL;
+
+    strips->start = calloc (strips->n_strips + 1, sizeof (int));
+    if (!strips->start)
+	return FALSE;
+
+    for (i = 0; i < n_traps; ++i)
+    {
+	if (get_trap_strips (strips, &traps[i], &s1, &s2))
+	{
+	    for (s = s1; s <= s2; ++s)
+		strips->start[s]++;
+
+	    total += s2 - s1 + 1;
+	}
+    }
+
+    if (total > INT32_MAX ||
+	!(strips->traps = pixman_malloc_ab (total, sizeof (pixman_trapezoid_t))))
+    {
+	free (strips->start);
+	return FALSE;
+    }
+
+    /* Turn the counts into the start of each strip, then fill in the
+     * strips, which moves each start to the start of the next strip.
+     */
+    total = 0;
+    for (s = 0; s < strips->n_strips; ++s)
+    {
+	int count = strips->start[s];
+
+	strips->start[s] = total;
+	total += count;
+    }
+
+    for (i = 0; i < n_traps; ++i)
+    {
+	if (get_trap_strips (strips, &traps[i], &s1, &s2))
+	{
+	    for (s = s1; s <= s2; ++s)
+		strips->traps[strips->start[s]++] = traps[i];
+	}
+    }
+
+    memmove (strips->start + 1, strips->start, strips->n_strips * sizeof (int));
+    strips->start[0] = 0;
+
+    return TRUE;
+}
+
+static void
+fini_trap_strips (trap_strips_t *strips)
+{
+    free (strips->start);
+    free (strips->traps);
+}
+
+static void
+set_strip_traps (strip_job_t *job, const trap_strips_t *strips, int s)
+{
+    job->traps = strips->traps + strips->start[s];
+    job->n_traps = strips->start[s + 1] - strips->start[s];
+}
+
+static void
+rasterize_strip (void *data, int i)
+{
+    strip_job_t *job = (strip_job_t *)data + i;
+
+    if (job->n_traps)
+    {
+	rasterize_trapezoids (job->image, job->x_off, job->y_off,
+			      job->n_traps, job->traps, job->exact);
+    }
+}
+
+static pixman_bool_t
+rasterize_in_parallel (int n_traps, int height)
+{
+    return _pixman_parallel_get_num_threads () > 1	&&
+	n_traps >= PARALLEL_MIN_TRAPS			&&
+	height >= 2 * STRIP_HEIGHT;
+}
+
+/* Extends [*x1, *x2) to include the trapezoids */
+static void
+get_trap_x_extents (int n_traps, const pixman_trapezoid_t *traps,
+		    int *x1, int *x2)
 {
     int i;
 
+    for (i = 0; i < n_traps; ++i)
+    {
+	const pixman_trapezoid_t *trap = &traps[i];
+	pixman_fixed_t l = MIN (trap->left.p1.x, trap->left.p2.x);
+	pixman_fixed_t r = MAX (trap->right.p1.x, trap->right.p2.x);
+
+	l = MIN (l, MIN (trap->right.p1.x, trap->right.p2.x));
+	r = MAX (r, MAX (trap->left.p1.x, trap->left.p2.x));
+
+	if (pixman_fixed_to_int (l) < *x1)
+	    *x1 = pixman_fixed_to_int (l);
+	if (pixman_fixed_to_int (pixman_fixed_ceil (r)) > *x2)
+	    *x2 = pixman_fixed_to_int (pixman_fixed_ceil (r));
+    }
+}
+
+/* Rasterizes the trapezoids into the rows of @image on several threads */
+static void
+rasterize_trapezoids_parallel (pixman_image_t *          image,
+			       int                       x_off,
+			       int                       y_off,
+			       int                       n_traps,
+			       const pixman_trapezoid_t *traps)
+{
+    uint32_t *bits = image->bits.bits;
+    int rowstride = image->bits.rowstride;
+    trap_strips_t strips;
+    strip_job_t *jobs;
+    int s, n_jobs;
+
+    if (!init_trap_strips (&strips, - y_off, image->bits.height - y_off,
+			   STRIP_HEIGHT, n_traps, traps))
+    {
+	rasterize_trapezoids (image, x_off, y_off, n_traps, traps, FALSE);
+	return;
+    }
+
+    jobs = pixman_malloc_ab (strips.n_strips, sizeof (strip_job_t));
+
+    for (n_jobs = 0; jobs && n_jobs < strips.n_strips; ++n_jobs)
+    {
+	strip_job_t *job = &jobs[n_jobs];
+	int y = n_jobs * STRIP_HEIGHT;
+
+	job->image = pixman_image_create_bits (
+	    image->bits.format, image->bits.width,
+	    MIN (STRIP_HEIGHT, image->bits.height - y),
+	    bits + y * rowstride, rowstride * 4);
+
+	if (!job->image)
+	    break;
+
+	job->x_off = x_off;
+	job->y_off = y_off - y;
+	job->exact = FALSE;
+	set_strip_traps (job, &strips, n_jobs);
+    }
+
+    if (jobs && n_jobs == strips.n_strips)
+	_pixman_parallel_run (n_jobs, rasterize_strip, jobs);
+    else
+	rasterize_trapezoids (image, x_off, y_off, n_traps, traps, FALSE);
+
+    for (s = 0; s < n_jobs; ++s)
+	pixman_image_unref (jobs[s].image);
+
+    free (jobs);
+    fini_trap_strips (&strips);
+}
+
+static void
+composite_trapezoid_strips (pixman_op_t			op,
+			    pixman_image_t *		src,
+			    pixman_image_t *		dst,
+			    pixman_format_code_t	mask_format,
+			    int				x_src,
+			    int				y_src,
+			    int				x_dst,
+			    int				y_dst,
+			    int				n_traps,
+			    const pixman_trapezoid_t *	traps,
+			    pixman_bool_t		exact)
+{
+    strip_job_t jobs[MAX_PARALLEL_STRIPS];
+    pixman_bool_t have_strips;
+    trap_strips_t strips;
+    pixman_image_t *tmp;
+    pixman_box32_t box;
+    int height, stride;
+    int n_strips, n_jobs;
+    int s, i;
+
+    if (!get_trap_extents (op, dst, traps, n_traps, &box))
+	return;
+
+    height = MIN (box.y2 - box.y1, STRIP_HEIGHT);
+    n_strips = (box.y2 - box.y1 + height - 1) / height;
+
+    /* If there is no memory to sort the trapezoids into strips, all of
+     * them are rasterized into every strip.
+     */
+    have_strips = init_trap_strips (&strips, box.y1, box.y2, height,
+				    n_traps, traps);
+
+    n_jobs = 1;
+    if (have_strips && rasterize_in_parallel (n_traps, box.y2 - box.y1))
+    {
+	n_jobs = _pixman_parallel_get_num_threads () * PARALLEL_STRIPS_PER_THREAD;
+	n_jobs = MIN (n_jobs, MAX_PARALLEL_STRIPS);
+	n_jobs = MIN (n_jobs, n_strips);
+    }
+
+    if (!(tmp = pixman_image_create_bits (
+	      mask_format, box.x2 - box.x1, height * n_jobs, NULL, -1)))
+	goto out;
+
+    stride = tmp->bits.rowstride;
+
+    for (i = 0; i < n_jobs; ++i)
+    {
+	jobs[i].image = tmp;
+	if (n_jobs > 1)
+	{
+	    jobs[i].image = pixman_image_create_bits (
+		mask_format, box.x2 - box.x1, height,
+		tmp->bits.bits + i * height * stride, stride * 4);
+	}
+
+	jobs[i].exact = exact;
+	jobs[i].n_traps = n_traps;
+	jobs[i].traps = traps;
+
+	if (!jobs[i].image)
+	{
+	    while (i--)
+		pixman_image_unref (jobs[i].image);
+	    goto out_tmp;
+	}
+    }
+
+    for (s = 0; s < n_strips; s += n_jobs)
+    {
+	int n = MIN (n_jobs, n_strips - s);
+
+	for (i = 0; i < n; ++i)
+	{
+	    jobs[i].x_off = - box.x1;
+	    jobs[i].y_off = - (box.y1 + (s + i) * height);
+
+	    if (have_strips)
+		set_strip_traps (&jobs[i], &strips, s + i);
+	}
+
+	_pixman_parallel_run (n, rasterize_strip, jobs);
+
+	for (i = 0; i < n; ++i)
+	{
+	    strip_job_t *job = &jobs[i];
+	    int y = - job->y_off;
+	    int h = MIN (box.y2 - y, height);
+	    int x1 = box.x1, x2 = box.x2;
+
+	    if (zero_src_has_no_effect[op] && have_strips)
+	    {
+		if (!job->n_traps)
+		    continue;
+
+		x1 = INT32_MAX;
+		x2 = INT32_MIN;
+		get_trap_x_extents (job->n_traps, job->traps, &x1, &x2);
+
+		x1 = MAX (x1, box.x1);
+		x2 = MIN (x2, box.x2);
+	    }
+
+	    pixman_image_composite (op, src, job->image, dst,
+				    x_src + x1, y_src + y,
+				    x1 - box.x1, 0,
+				    x_dst + x1, y_dst + y,
+				    x2 - x1, h);
+
+	    if (job->n_traps)
+	    {
+		memset (job->image->bits.bits, 0,
+			job->image->bits.rowstride * 4 * height);
+	    }
+	}
+    }
+
+    if (n_jobs > 1)
+    {
+	for (i = 0; i < n_jobs; ++i)
+	    pixman_image_unref (jobs[i].image);
+    }
+
+out_tmp:
+    pixman_image_unref (tmp);
+out:
+    if (have_strips)
+	fini_trap_strips (&strips);
+}
+
+static void
+composite_trapezoids (pixman_op_t		op,
+		      pixman_image_t *		src,
+		      pixman_image_t *		dst,
+		      pixman_format_code_t	mask_format,
+		      int			x_src,
+		      int			y_src,
+		      int			x_dst,
+		      int			y_dst,
+		      int			n_traps,
+		      const pixman_trapezoid_t *	traps,
+		      pixman_bool_t		exact)
+{
     return_if_fail (PIXMAN_FORMAT_TYPE (mask_format) == PIXMAN_TYPE_A);
     
     if (n_traps <= 0)
@@ -499,54 +965,77 @@ pixman_composite_trapezoids (pixman_op_t		op,
     _pixman_image_validate (src);
     _pixman_image_validate (dst);
 
+    exact = exact && mask_format == PIXMAN_a8;
+
     if (op == PIXMAN_OP_ADD &&
 	(src->common.flags & FAST_PATH_IS_OPAQUE)		&&
 	(mask_format == dst->common.extended_format_code)	&&
-	!(dst->common.have_clip_region))
+	!(dst->common.have_clip_region)				&&
+	!(exact && (dst->bits.read_func || dst->bits.write_func)))
     {
-	for (i = 0; i < n_traps; ++i)
+	/* Exact coverage is computed with floating point, which can
+	 * round differently when the rows are split up.
+	 */
+	if (!exact						&&
+	    !dst->bits.read_func && !dst->bits.write_func	&&
+	    rasterize_in_parallel (n_traps, dst->bits.height))
 	{
-	    const pixman_trapezoid_t *trap = &(traps[i]);
-	    
-	    if (!pixman_trapezoid_valid (trap))
-		continue;
-	    
-	    pixman_rasterize_trapezoid (dst, trap, x_dst, y_dst);
+	    rasterize_trapezoids_parallel (dst, x_dst, y_dst, n_traps, traps);
+	}
+	else
+	{
+	    rasterize_trapezoids (dst, x_dst, y_dst, n_traps, traps, exact);
 	}
     }
     else
     {
-	pixman_image_t *tmp;
-	pixman_box32_t box;
-	int i;
-
-	if (!get_trap_extents (op, dst, traps, n_traps, &box))
-	    return;
-	
-	if (!(tmp = pixman_image_create_bits (
-		  mask_format, box.x2 - box.x1, box.y2 - box.y1, NULL, -1)))
-	    return;
-	
-	for (i = 0; i < n_traps; ++i)
-	{
-	    const pixman_trapezoid_t *trap = &(traps[i]);
-	    
-	    if (!pixman_trapezoid_valid (trap))
-		continue;
-	    
-	    pixman_rasterize_trapezoid (tmp, trap, - box.x1, - box.y1);
-	}
-	
-	pixman_image_composite (op, src, tmp, dst,
-				x_src + box.x1, y_src + box.y1,
-				0, 0,
-				x_dst + box.x1, y_dst + box.y1,
-				box.x2 - box.x1, box.y2 - box.y1);
-	
-	pixman_image_unref (tmp);
+	composite_trapezoid_strips (op, src, dst, mask_format,
+				    x_src, y_src, x_dst, y_dst,
+				    n_traps, traps, exact);
     }
 }
 
+/*
+ * pixman_composite_trapezoids()
+ *
+ * All the trapezoids are conceptually rendered to an infinitely big image.
+ * The (0, 0) coordinates of this image are then aligned with the (x, y)
+ * coordinates of the source image, and then both images are aligned with
+ * the (x, y) coordinates of the destination. Then these three images are
+ * composited across the entire destination.
+ */
+PIXMAN_EXPORT void
+pixman_composite_trapezoids (pixman_op_t		op,
+			     pixman_image_t *		src,
+			     pixman_image_t *		dst,
+			     pixman_format_code_t	mask_format,
+			     int			x_src,
+			     int			y_src,
+			     int			x_dst,
+			     int			y_dst,
+			     int			n_traps,
+			     const pixman_trapezoid_t *	traps)
+{
+    composite_trapezoids (op, src, dst, mask_format,
+			  x_src, y_src, x_dst, y_dst, n_traps, traps, FALSE);
+}
+
+PIXMAN_EXPORT void
+pixman_composite_trapezoids_exact (pixman_op_t			op,
+				   pixman_image_t *		src,
+				   pixman_image_t *		dst,
+				   pixman_format_code_t		mask_format,
+				   int				x_src,
+				   int				y_src,
+				   int				x_dst,
+				   int				y_dst,
+				   int				n_traps,
+				   const pixman_trapezoid_t *	traps)
+{
+    composite_trapezoids (op, src, dst, mask_format,
+			  x_src, y_src, x_dst, y_dst, n_traps, traps, TRUE);
+}
+
 static int
 greater_y (const pixman_point_fixed_t *a, const pixman_point_fixed_t *b)
 {
@@ -692,6 +1181,30 @@ pixman_composite_triangles (pixman_op_t			op,
     }
 }
 
+PIXMAN_EXPORT void
+pixman_composite_triangles_exact (pixman_op_t			op,
+				  pixman_image_t *		src,
+				  pixman_image_t *		dst,
+				  pixman_format_code_t		mask_format,
+				  int				x_src,
+				  int				y_src,
+				  int				x_dst,
+				  int				y_dst,
+				  int				n_tris,
+				  const pixman_triangle_t *	tris)
+{
+    pixman_trapezoid_t *traps;
+
+    if ((traps = convert_triangles (n_tris, tris)))
+    {
+	pixman_composite_trapezoids_exact (op, src, dst, mask_format,
+					   x_src, y_src, x_dst, y_dst,
+					   n_tris * 2, traps);
+
+	free (traps);
+    }
+}
+
 PIXMAN_EXPORT void
 pixman_add_triangles (pixman_image_t          *image,
 		      int32_t	               x_off,
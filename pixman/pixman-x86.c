@@ -25,7 +25,8 @@
 
 #include "pixman-private.h"
 
-#if defined(USE_X86_MMX) || defined (USE_SSE2) || defined (USE_SSSE3)
+#if defined(USE_X86_MMX) || defined (USE_SSE2) || defined (USE_SSSE3) || \
+    defined (USE_AVX2) || defined (USE_AVX512)
 
 /* The CPU detection code needs to be in a file not compiled with
  * "-mmmx -msse", as gcc would generate CMOV instructions otherwise
@@ -40,7 +41,9 @@ typedef enum
     X86_SSE			= (1 << 2) | X86_MMX_EXTENSIONS,
     X86_SSE2			= (1 << 3),
     X86_CMOV			= (1 << 4),
-    X86_SSSE3			= (1 << 5)
+    X86_SSSE3			= (1 << 5),
+    X86_AVX2			= (1 << 6),
+    X86_AVX512BW		= (1 << 7)
 } cpu_features_t;
 
 #ifdef HAVE_GETISAX
@@ -51,22 +54,36 @@ static cpu_features_t
 detect_cpu_features (void)
 {
     cpu_features_t features = 0;
-    unsigned int result = 0;
+    unsigned int result[2] = { 0, 0 };
 
-    if (getisax (&result, 1))
+    if (getisax (result, 2))
     {
-	if (result & AV_386_CMOV)
+	if (result[0] & AV_386_CMOV)
 	    features |= X86_CMOV;
-	if (result & AV_386_MMX)
+	if (result[0] & AV_386_MMX)
 	    features |= X86_MMX;
-	if (result & AV_386_AMD_MMX)
+	if (result[0] & AV_386_AMD_MMX)
 	    features |= X86_MMX_EXTENSIONS;
-	if (result & AV_386_SSE)
+	if (result[0] & AV_386_SSE)
 	    features |= X86_SSE;
-	if (result & AV_386_SSE2)
+	if (result[0] & AV_386_SSE2)
 	    features |= X86_SSE2;
-	if (result & AV_386_SSSE3)
+	if (result[0] & AV_386_SSSE3)
 	    features |= X86_SSSE3;
+#ifdef AV_386_2_AVX2
+	/* The kernel only reports AVX2 if it saves the YMM state */
+	if (result[1] & AV_386_2_AVX2)
+	    features |= X86_AVX2;
+#endif
+#if defined (AV_386_2_AVX512F) && defined (AV_386_2_AVX512BW) && \
+    defined (AV_386_2_AVX512VL)
+	if ((result[1] & AV_386_2_AVX512F) &&
+	    (result[1] & AV_386_2_AVX512BW) &&
+	    (result[1] & AV_386_2_AVX512VL))
+	{
+	    features |= X86_AVX512BW;
+	}
+#endif
     }
 
     return features;
@@ -74,6 +91,10 @@ detect_cpu_features (void)
 
 #else
 
+#if defined (_MSC_VER)
+#include <intrin.h>
+#endif
+
 #define _PIXMAN_X86_64							\
     (defined(__amd64__) || defined(__x86_64__) || defined(_M_AMD64))
 
@@ -109,6 +130,9 @@ have_cpuid (void)
 #endif
 }
 
+/* Leaf 7 is split into sub-leaves selected by %ecx; we only ever
+ * need sub-leaf 0, so %ecx is always cleared.
+ */
 static void
 pixman_cpuid (uint32_t feature,
 	      uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d)
@@ -119,7 +143,7 @@ pixman_cpuid (uint32_t feature,
     __asm__ volatile (
         "cpuid"				"\n\t"
 	: "=a" (*a), "=b" (*b), "=c" (*c), "=d" (*d)
-	: "a" (feature));
+	: "a" (feature), "c" (0));
 #else
     /* On x86-32 we need to be careful about the handling of %ebx
      * and %esp. We can't declare either one as clobbered
@@ -134,13 +158,13 @@ pixman_cpuid (uint32_t feature,
 	"cpuid"				"\n\t"
 	"xchg %%ebx, %1"		"\n\t"
 	: "=a" (*a), "=r" (*b), "=c" (*c), "=d" (*d)
-	: "a" (feature));
+	: "a" (feature), "c" (0));
 #endif
 
 #elif defined (_MSC_VER)
     int info[4];
 
-    __cpuid (info, feature);
+    __cpuidex (info, feature, 0);
 
     *a = info[0];
     *b = info[1];
@@ -151,15 +175,41 @@ pixman_cpuid (uint32_t feature,
 #endif
 }
 
+static uint32_t
+pixman_xgetbv (void)
+{
+#if defined (__GNUC__)
+    uint32_t lo;
+
+    /* xgetbv with %ecx = 0, spelled out for old assemblers. Only
+     * the low half of XCR0 is interesting here.
+     */
+    __asm__ volatile (
+	".byte 0x0f, 0x01, 0xd0"	"\n\t"
+	: "=a" (lo)
+	: "c" (0)
+	: "%edx");
+
+    return lo;
+#elif defined (_MSC_VER)
+    return (uint32_t)_xgetbv (0);
+#else
+#error Unknown compiler
+#endif
+}
+
 static cpu_features_t
 detect_cpu_features (void)
 {
     uint32_t a, b, c, d;
+    uint32_t max_leaf;
     cpu_features_t features = 0;
 
     if (!have_cpuid())
 	return features;
 
+    pixman_cpuid (0x00, &max_leaf, &b, &c, &d);
+
     /* Get feature bits */
     pixman_cpuid (0x01, &a, &b, &c, &d);
     if (d & (1 << 15))
@@ -173,6 +223,30 @@ detect_cpu_features (void)
     if (c & (1 << 9))
 	features |= X86_SSSE3;
 
+    /* AVX2 can only be used if the OS saves the YMM registers on
+     * context switches, which it advertises through OSXSAVE and
+     * the SSE and AVX bits in XCR0.
+     */
+    if ((c & (1 << 27)) && (c & (1 << 28)) && max_leaf >= 7)
+    {
+	uint32_t xcr0 = pixman_xgetbv ();
+	uint32_t a7, b7, c7, d7;
+
+	pixman_cpuid (0x07, &a7, &b7, &c7, &d7);
+
+	if ((xcr0 & 0x6) == 0x6 && (b7 & (1 << 5)))
+	    features |= X86_AVX2;
+
+	/* AVX-512 additionally needs the opmask and both halves of
+	 * the ZMM state enabled. We want F, BW and VL.
+	 */
+	if ((xcr0 & 0xe6) == 0xe6 &&
+	    (b7 & (1 << 16)) && (b7 & (1 << 30)) && (b7 & (1u << 31)))
+	{
+	    features |= X86_AVX512BW;
+	}
+    }
+
     /* Check for AMD specific features */
     if ((features & X86_MMX) && !(features & X86_SSE))
     {
@@ -228,6 +302,8 @@ _pixman_x86_get_implementations (pixman_implementation_t *imp)
 #define MMX_BITS  (X86_MMX | X86_MMX_EXTENSIONS)
 #define SSE2_BITS (X86_MMX | X86_MMX_EXTENSIONS | X86_SSE | X86_SSE2)
 #define SSSE3_BITS (X86_SSE | X86_SSE2 | X86_SSSE3)
+#define AVX2_BITS (X86_SSE | X86_SSE2 | X86_SSSE3 | X86_AVX2)
+#define AVX512_BITS (AVX2_BITS | X86_AVX512BW)
 
 #ifdef USE_X86_MMX
     if (!_pixman_disabled ("mmx") && have_feature (MMX_BITS))
@@ -244,5 +320,15 @@ _pixman_x86_get_implementations (pixman_implementation_t *imp)
 	imp = _pixman_implementation_create_ssse3 (imp);
 #endif
 
+#ifdef USE_AVX2
+    if (!_pixman_disabled ("avx2") && have_feature (AVX2_BITS))
+	imp = _pixman_implementation_create_avx2 (imp);
+#endif
+
+#ifdef USE_AVX512
+    if (!_pixman_disabled ("avx512") && have_feature (AVX512_BITS))
+	imp = _pixman_implementation_create_avx512 (imp);
+#endif
+
     return imp;
 }
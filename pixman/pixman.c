@@ -540,69 +540,322 @@ analyze_extent (pixman_image_t       *image,
     return TRUE;
 }
 
-/*
- * Work around GCC bug causing crashes in Mozilla with SSE2
- *
- * When using -msse, gcc generates movdqa instructions assuming that
- * the stack is 16 byte aligned. Unfortunately some applications, such
- * as Mozilla and Mono, end up aligning the stack to 4 bytes, which
- * causes the movdqa instructions to fail.
- *
- * The __force_align_arg_pointer__ makes gcc generate a prologue that
- * realigns the stack pointer to 16 bytes.
- *
- * On x86-64 this is not necessary because the standard ABI already
- * calls for a 16 byte aligned stack.
- *
- * See https://bugs.freedesktop.org/show_bug.cgi?id=15693
+/* Boxes smaller than this are never split across threads, since
+ * handing them out would cost more than it could save.
  */
-#if defined (USE_SSE2) && defined(__GNUC__) && !defined(__x86_64__) && !defined(__amd64__)
-__attribute__((__force_align_arg_pointer__))
-#endif
-PIXMAN_EXPORT void
-pixman_image_composite32 (pixman_op_t      op,
-                          pixman_image_t * src,
-                          pixman_image_t * mask,
-                          pixman_image_t * dest,
-                          int32_t          src_x,
-                          int32_t          src_y,
-                          int32_t          mask_x,
-                          int32_t          mask_y,
-                          int32_t          dest_x,
-                          int32_t          dest_y,
-                          int32_t          width,
-                          int32_t          height)
+#define PARALLEL_MIN_PIXELS		(256 * 256)
+#define PARALLEL_MIN_BAND_HEIGHT	16
+/* More bands than threads, so that a thread that finishes early
+ * can pick up the slack of the others.
+ */
+#define PARALLEL_BANDS_PER_THREAD	4
+
+typedef struct
 {
-    pixman_format_code_t src_format, mask_format, dest_format;
-    pixman_region32_t region;
-    pixman_box32_t extents;
-    pixman_implementation_t *imp;
-    pixman_composite_func_t func;
-    pixman_composite_info_t info;
-    const pixman_box32_t *pbox;
-    int n;
+    pixman_implementation_t *	imp;
+    pixman_composite_func_t	func;
+    pixman_composite_info_t	info;
+    int				band_height;
+} composite_bands_t;
+
+static void
+composite_band (void *data, int band)
+{
+    composite_bands_t *bands = data;
+    pixman_composite_info_t info = bands->info;
+    int y = band * bands->band_height;
 
+    info.src_y += y;
+    info.mask_y += y;
+    info.dest_y += y;
+    info.height = MIN (bands->band_height, bands->info.height - y);
+
+    bands->func (bands->imp, &info);
+}
+
+static void
+composite_box_parallel (pixman_implementation_t       *imp,
+			pixman_composite_func_t        func,
+			const pixman_composite_info_t *info,
+			int                            n_threads)
+{
+    composite_bands_t bands;
+    int n_bands = n_threads * PARALLEL_BANDS_PER_THREAD;
+
+    bands.imp = imp;
+    bands.func = func;
+    bands.info = *info;
+    bands.band_height = (info->height + n_bands - 1) / n_bands;
+
+    if (bands.band_height < PARALLEL_MIN_BAND_HEIGHT)
+	bands.band_height = PARALLEL_MIN_BAND_HEIGHT;
+
+    n_bands = (info->height + bands.band_height - 1) / bands.band_height;
+
+    _pixman_parallel_run (n_bands, composite_band, &bands);
+}
+
+/* Bands can only be rendered concurrently if writing one of them can't
+ * affect what is read for another, and if there are no user supplied
+ * accessors, which may not be thread safe.
+ */
+static pixman_bool_t
+can_composite_in_parallel (pixman_image_t *src,
+			   pixman_image_t *mask,
+			   pixman_image_t *dest)
+{
+    if (!(src->common.flags & dest->common.flags & FAST_PATH_NO_ACCESSORS))
+	return FALSE;
+
+    if (mask && !(mask->common.flags & FAST_PATH_NO_ACCESSORS))
+	return FALSE;
+
+    if (src->type == BITS && src->bits.bits == dest->bits.bits)
+	return FALSE;
+
+    if (mask && mask->type == BITS && mask->bits.bits == dest->bits.bits)
+	return FALSE;
+
+    return TRUE;
+}
+
+/* The state that is the same for every rectangle composited with one
+ * combination of operator and images. It also remembers the result of
+ * the most recent fast path lookup, since consecutive rectangles almost
+ * always end up with the same flags.
+ */
+typedef struct
+{
+    pixman_op_t			op;
+    pixman_image_t *		src;
+    pixman_image_t *		mask;
+    pixman_image_t *		dest;
+    pixman_format_code_t	src_format;
+    pixman_format_code_t	mask_format;
+    pixman_format_code_t	dest_format;
+    uint32_t			src_flags;
+    uint32_t			mask_flags;
+    uint32_t			dest_flags;
+    int				n_threads;
+
+    pixman_format_code_t	lookup_src_format;
+    pixman_format_code_t	lookup_mask_format;
+    uint32_t			lookup_src_flags;
+    uint32_t			lookup_mask_flags;
+    pixman_op_t			lookup_op;
+    pixman_implementation_t *	imp;
+    pixman_composite_func_t	func;
+} composite_setup_t;
+
+static void
+composite_setup_init (composite_setup_t *setup,
+		      pixman_op_t        op,
+		      pixman_image_t *   src,
+		      pixman_image_t *   mask,
+		      pixman_image_t *   dest)
+{
     _pixman_image_validate (src);
     if (mask)
 	_pixman_image_validate (mask);
     _pixman_image_validate (dest);
 
-    src_format = src->common.extended_format_code;
-    info.src_flags = src->common.flags;
+    setup->op = op;
+    setup->src = src;
+    setup->mask = mask;
+    setup->dest = dest;
+
+    setup->src_format = src->common.extended_format_code;
+    setup->src_flags = src->common.flags;
 
     if (mask && !(mask->common.flags & FAST_PATH_IS_OPAQUE))
     {
-	mask_format = mask->common.extended_format_code;
-	info.mask_flags = mask->common.flags;
+	setup->mask_format = mask->common.extended_format_code;
+	setup->mask_flags = mask->common.flags;
     }
     else
     {
-	mask_format = PIXMAN_null;
-	info.mask_flags = FAST_PATH_IS_OPAQUE | FAST_PATH_NO_ALPHA_MAP;
+	setup->mask_format = PIXMAN_null;
+	setup->mask_flags = FAST_PATH_IS_OPAQUE | FAST_PATH_NO_ALPHA_MAP;
     }
 
-    dest_format = dest->common.extended_format_code;
-    info.dest_flags = dest->common.flags;
+    setup->dest_format = dest->common.extended_format_code;
+    setup->dest_flags = dest->common.flags;
+
+    setup->n_threads = _pixman_parallel_get_num_threads ();
+    if (setup->n_threads > 1 && !can_composite_in_parallel (src, mask, dest))
+	setup->n_threads = 1;
+
+    setup->func = NULL;
+}
+
+/* A plan records everything that composite_setup_rect() works out for
+ * one particular call, so that an identical call later on can skip
+ * straight to compositing. Plans are kept in a set associative
+ * table hanging off the destination image, which is only allocated once
+ * compositing to the image has missed the table a few times, so that
+ * short-lived destinations don't pay for it.
+ *
+ * Since image generations are unique, comparing generations is enough
+ * to know that the images are the same and that none of their
+ * properties have changed. Alpha maps are not covered by this, because
+ * their clip regions can change without the image they are attached to
+ * noticing, so plans are never used when one is involved.
+ *
+ * Hits are compared against misses every PLAN_WINDOW misses. When the
+ * plans of an image are hardly ever used, as when the coordinates keep
+ * changing, only one in PLAN_SPARSE_RATE new plans is stored until they
+ * are used again. The counts are not atomic, so they are approximate
+ * when several threads composite to the same image.
+ */
+#define N_PLAN_SETS 64
+#define N_PLAN_WAYS 4
+#define PLAN_ALLOC_THRESHOLD 16
+#define PLAN_WINDOW 64
+#define PLAN_SPARSE_RATE 16
+
+typedef enum
+{
+    PLAN_NOTHING,		/* Nothing to composite */
+    PLAN_ONE_BOX,		/* The composite region is plan->box */
+    PLAN_REGION			/* The region must be computed each time */
+} plan_kind_t;
+
+typedef struct
+{
+    uint64_t			src_generation;
+    uint64_t			mask_generation;
+    uint64_t			dest_generation;
+    pixman_op_t			op;
+    int32_t			src_x;
+    int32_t			src_y;
+    int32_t			mask_x;
+    int32_t			mask_y;
+    int32_t			dest_x;
+    int32_t			dest_y;
+    int32_t			width;
+    int32_t			height;
+} plan_key_t;
+
+typedef struct
+{
+    plan_key_t			key;
+
+    plan_kind_t			kind;
+    pixman_box32_t		box;
+    pixman_format_code_t	src_format;
+    pixman_format_code_t	mask_format;
+    uint32_t			src_flags;
+    uint32_t			mask_flags;
+    pixman_op_t			lookup_op;
+    pixman_implementation_t *	imp;
+    pixman_composite_func_t	func;
+} composite_plan_t;
+
+/* Readers don't take any lock. Instead, a writer makes seq odd while it
+ * is changing an entry, and readers check that seq was even and didn't
+ * change while they were looking at the plan.
+ */
+typedef struct
+{
+    volatile uint32_t		seq;
+    composite_plan_t		plan;
+} plan_entry_t;
+
+struct composite_plans
+{
+    plan_entry_t		sets[N_PLAN_SETS][N_PLAN_WAYS];
+};
+
+static void
+composite_boxes (composite_setup_t       *setup,
+		 pixman_composite_info_t *info,
+		 const pixman_box32_t    *pbox,
+		 int                      n,
+		 int32_t                  src_x,
+		 int32_t                  src_y,
+		 int32_t                  mask_x,
+		 int32_t                  mask_y,
+		 int32_t                  dest_x,
+		 int32_t                  dest_y)
+{
+    pixman_bool_t stats = _pixman_stats_enabled;
+    uint64_t start = 0;
+
+    info->src_image = setup->src;
+    info->mask_image = setup->mask;
+    info->dest_image = setup->dest;
+
+    if (_pixman_trace_fallbacks && n > 0 && !setup->imp->fallback)
+    {
+	_pixman_trace_fallback (get_implementation (), info->op,
+				setup->lookup_src_format, info->src_flags,
+				setup->lookup_mask_format, info->mask_flags,
+				setup->dest_format, info->dest_flags);
+    }
+
+    while (n--)
+    {
+	info->src_x = pbox->x1 + src_x - dest_x;
+	info->src_y = pbox->y1 + src_y - dest_y;
+	info->mask_x = pbox->x1 + mask_x - dest_x;
+	info->mask_y = pbox->y1 + mask_y - dest_y;
+	info->dest_x = pbox->x1;
+	info->dest_y = pbox->y1;
+	info->width = pbox->x2 - pbox->x1;
+	info->height = pbox->y2 - pbox->y1;
+
+	if (stats)
+	    start = _pixman_stats_timestamp ();
+
+	if (setup->n_threads > 1 &&
+	    (int64_t)info->width * info->height >= PARALLEL_MIN_PIXELS &&
+	    info->height >= 2 * PARALLEL_MIN_BAND_HEIGHT)
+	{
+	    composite_box_parallel (setup->imp, setup->func, info,
+				    setup->n_threads);
+	}
+	else
+	{
+	    setup->func (setup->imp, info);
+	}
+
+	if (stats)
+	    _pixman_stats_record (setup->imp, setup->func, info, start);
+
+	pbox++;
+    }
+}
+
+/* If @plan is not NULL, what was worked out is recorded in it */
+static void
+composite_setup_rect (composite_setup_t *setup,
+		      composite_plan_t * plan,
+		      int32_t            src_x,
+		      int32_t            src_y,
+		      int32_t            mask_x,
+		      int32_t            mask_y,
+		      int32_t            dest_x,
+		      int32_t            dest_y,
+		      int32_t            width,
+		      int32_t            height)
+{
+    pixman_image_t *src = setup->src;
+    pixman_image_t *mask = setup->mask;
+    pixman_image_t *dest = setup->dest;
+    pixman_format_code_t src_format = setup->src_format;
+    pixman_format_code_t mask_format = setup->mask_format;
+    pixman_region32_t region;
+    pixman_box32_t extents;
+    pixman_composite_info_t info;
+    const pixman_box32_t *pbox;
+    int n;
+
+    if (plan)
+	plan->kind = PLAN_NOTHING;
+
+    info.src_flags = setup->src_flags;
+    info.mask_flags = setup->mask_flags;
+    info.dest_flags = setup->dest_flags;
 
     /* Check for pixbufs */
     if ((mask_format == PIXMAN_a8r8g8b8 || mask_format == PIXMAN_a8b8g8r8) &&
@@ -666,46 +919,377 @@ pixman_image_composite32 (pixman_op_t      op,
 	info.mask_flags |= FAST_PATH_IS_OPAQUE;
     }
 
-    /*
-     * Check if we can replace our operator by a simpler one
-     * if the src or dest are opaque. The output operator should be
-     * mathematically equivalent to the source.
+    /* The operator and composite function only depend on the formats
+     * and flags, so they can be reused as long as these don't change.
      */
-    info.op = optimize_operator (op, info.src_flags, info.mask_flags, info.dest_flags);
-
-    _pixman_implementation_lookup_composite (
-	get_implementation (), info.op,
-	src_format, info.src_flags,
-	mask_format, info.mask_flags,
-	dest_format, info.dest_flags,
-	&imp, &func);
+    if (!setup->func					||
+	src_format != setup->lookup_src_format		||
+	mask_format != setup->lookup_mask_format	||
+	info.src_flags != setup->lookup_src_flags	||
+	info.mask_flags != setup->lookup_mask_flags)
+    {
+	/*
+	 * Check if we can replace our operator by a simpler one
+	 * if the src or dest are opaque. The output operator should be
+	 * mathematically equivalent to the source.
+	 */
+	setup->lookup_op = optimize_operator (
+	    setup->op, info.src_flags, info.mask_flags, info.dest_flags);
+
+	_pixman_implementation_lookup_composite (
+	    get_implementation (), setup->lookup_op,
+	    src_format, info.src_flags,
+	    mask_format, info.mask_flags,
+	    setup->dest_format, info.dest_flags,
+	    &setup->imp, &setup->func);
+
+	setup->lookup_src_format = src_format;
+	setup->lookup_mask_format = mask_format;
+	setup->lookup_src_flags = info.src_flags;
+	setup->lookup_mask_flags = info.mask_flags;
+    }
 
-    info.src_image = src;
-    info.mask_image = mask;
-    info.dest_image = dest;
+    info.op = setup->lookup_op;
 
     pbox = pixman_region32_rectangles (&region, &n);
 
-    while (n--)
+    if (plan)
     {
-	info.src_x = pbox->x1 + src_x - dest_x;
-	info.src_y = pbox->y1 + src_y - dest_y;
-	info.mask_x = pbox->x1 + mask_x - dest_x;
-	info.mask_y = pbox->y1 + mask_y - dest_y;
-	info.dest_x = pbox->x1;
-	info.dest_y = pbox->y1;
-	info.width = pbox->x2 - pbox->x1;
-	info.height = pbox->y2 - pbox->y1;
+	plan->kind = PLAN_REGION;
+	if (n == 1)
+	{
+	    plan->kind = PLAN_ONE_BOX;
+	    plan->box = pbox[0];
+	}
+	plan->src_format = src_format;
+	plan->mask_format = mask_format;
+	plan->src_flags = info.src_flags;
+	plan->mask_flags = info.mask_flags;
+	plan->lookup_op = setup->lookup_op;
+	plan->imp = setup->imp;
+	plan->func = setup->func;
+    }
 
-	func (imp, &info);
+    composite_boxes (setup, &info, pbox, n,
+		     src_x, src_y, mask_x, mask_y, dest_x, dest_y);
 
-	pbox++;
+out:
+    pixman_region32_fini (&region);
+}
+
+static pixman_bool_t
+can_use_plans (pixman_image_t *src,
+	       pixman_image_t *mask,
+	       pixman_image_t *dest)
+{
+    uint32_t flags = src->common.flags & dest->common.flags;
+
+    if (mask)
+	flags &= mask->common.flags;
+
+    return (flags & FAST_PATH_NO_ALPHA_MAP) == FAST_PATH_NO_ALPHA_MAP;
+}
+
+static force_inline pixman_bool_t
+plan_key_equal (const plan_key_t *a, const plan_key_t *b)
+{
+    return
+	a->src_generation == b->src_generation		&&
+	a->mask_generation == b->mask_generation	&&
+	a->dest_generation == b->dest_generation	&&
+	a->op == b->op					&&
+	a->src_x == b->src_x				&&
+	a->src_y == b->src_y				&&
+	a->mask_x == b->mask_x				&&
+	a->mask_y == b->mask_y				&&
+	a->dest_x == b->dest_x				&&
+	a->dest_y == b->dest_y				&&
+	a->width == b->width				&&
+	a->height == b->height;
+}
+
+static force_inline uint32_t
+plan_hash (const plan_key_t *key)
+{
+    uint64_t h;
+
+    h = key->src_generation * 0x9e3779b97f4a7c15ULL;
+    h ^= key->mask_generation * 0xc2b2ae3d27d4eb4fULL;
+    h ^= key->op;
+    h ^= (uint64_t)(uint32_t)(key->dest_x ^ (key->dest_y << 16)) << 24;
+    h ^= (uint64_t)(uint32_t)(key->src_x ^ (key->src_y << 16)) << 8;
+    h *= 0x9e3779b97f4a7c15ULL;
+
+    return (uint32_t)(h >> 32) & (N_PLAN_SETS - 1);
+}
+
+static pixman_bool_t
+find_plan (pixman_image_t *dest, composite_plan_t *plan)
+{
+    composite_plans_t *plans = dest->common.plans;
+    plan_entry_t *set;
+    composite_plan_t found;
+    uint32_t seq;
+    int i;
+
+    if (!plans)
+	return FALSE;
+
+    PIXMAN_READ_BARRIER ();
+
+    set = plans->sets[plan_hash (&plan->key)];
+
+    for (i = 0; i < N_PLAN_WAYS; ++i)
+    {
+	seq = set[i].seq;
+
+	PIXMAN_READ_BARRIER ();
+
+	if (!plan_key_equal (&set[i].plan.key, &plan->key))
+	    continue;
+
+	found = set[i].plan;
+
+	PIXMAN_READ_BARRIER ();
+
+	if (!(seq & 1) && set[i].seq == seq)
+	{
+	    if (dest->common.plan_hits < PLAN_WINDOW)
+		dest->common.plan_hits++;
+
+	    *plan = found;
+	    return TRUE;
+	}
     }
 
+    return FALSE;
+}
+
+static void
+write_plan_entry (plan_entry_t *entry, const composite_plan_t *plan)
+{
+    entry->seq++;
+    PIXMAN_WRITE_BARRIER ();
+
+    entry->plan = *plan;
+
+    PIXMAN_WRITE_BARRIER ();
+    entry->seq++;
+}
+
+/* Writers are serialized by a lock that is only ever tried. If another
+ * thread happens to be storing a plan for the same image, this one is
+ * simply dropped.
+ */
+static void
+store_plan (pixman_image_t *dest, const composite_plan_t *plan)
+{
+    image_common_t *common = &dest->common;
+    composite_plans_t *plans;
+    plan_entry_t *set;
+    int32_t misses = ++common->plan_misses;
+    int i;
+
+    if (!common->plans)
+    {
+	if (misses < PLAN_ALLOC_THRESHOLD)
+	    return;
+    }
+    else if (misses >= PLAN_WINDOW)
+    {
+	common->plans_sparse = common->plan_hits < PLAN_WINDOW / 16;
+	common->plan_hits = 0;
+	common->plan_misses = 0;
+    }
+    else if (common->plans_sparse && misses % PLAN_SPARSE_RATE)
+    {
+	return;
+    }
+
+    if (!PIXMAN_TRY_LOCK (&common->plans_lock))
+	return;
+
+    plans = common->plans;
+
+    if (!plans)
+    {
+	plans = calloc (1, sizeof (composite_plans_t));
+	if (!plans)
+	    goto out;
+
+	PIXMAN_WRITE_BARRIER ();
+	common->plans = plans;
+	common->plan_misses = 0;
+    }
+
+    /* The new plan goes first, pushing out the oldest one */
+    set = plans->sets[plan_hash (&plan->key)];
+
+    for (i = N_PLAN_WAYS - 1; i > 0; --i)
+	write_plan_entry (&set[i], &set[i - 1].plan);
+
+    write_plan_entry (&set[0], plan);
+
 out:
+    PIXMAN_UNLOCK (&common->plans_lock);
+}
+
+static void
+composite_plan_run (composite_setup_t      *setup,
+		    const composite_plan_t *plan)
+{
+    const plan_key_t *key = &plan->key;
+    pixman_composite_info_t info;
+    pixman_region32_t region;
+    const pixman_box32_t *pbox;
+    int n;
+
+    if (plan->kind == PLAN_NOTHING)
+	return;
+
+    setup->imp = plan->imp;
+    setup->func = plan->func;
+    setup->lookup_src_format = plan->src_format;
+    setup->lookup_mask_format = plan->mask_format;
+    setup->lookup_src_flags = plan->src_flags;
+    setup->lookup_mask_flags = plan->mask_flags;
+    setup->lookup_op = plan->lookup_op;
+
+    info.op = plan->lookup_op;
+    info.src_flags = plan->src_flags;
+    info.mask_flags = plan->mask_flags;
+    info.dest_flags = setup->dest_flags;
+
+    if (plan->kind == PLAN_ONE_BOX)
+    {
+	composite_boxes (setup, &info, &plan->box, 1,
+			 key->src_x, key->src_y, key->mask_x, key->mask_y,
+			 key->dest_x, key->dest_y);
+	return;
+    }
+
+    pixman_region32_init (&region);
+
+    if (_pixman_compute_composite_region32 (
+	    &region, setup->src, setup->mask, setup->dest,
+	    key->src_x, key->src_y, key->mask_x, key->mask_y,
+	    key->dest_x, key->dest_y, key->width, key->height))
+    {
+	pbox = pixman_region32_rectangles (&region, &n);
+
+	composite_boxes (setup, &info, pbox, n,
+			 key->src_x, key->src_y, key->mask_x, key->mask_y,
+			 key->dest_x, key->dest_y);
+    }
+
     pixman_region32_fini (&region);
 }
 
+/*
+ * Work around GCC bug causing crashes in Mozilla with SSE2
+ *
+ * When using -msse, gcc generates movdqa instructions assuming that
+ * the stack is 16 byte aligned. Unfortunately some applications, such
+ * as Mozilla and Mono, end up aligning the stack to 4 bytes, which
+ * causes the movdqa instructions to fail.
+ *
+ * The __force_align_arg_pointer__ makes gcc generate a prologue that
+ * realigns the stack pointer to 16 bytes.
+ *
+ * On x86-64 this is not necessary because the standard ABI already
+ * calls for a 16 byte aligned stack.
+ *
+ * See https://bugs.freedesktop.org/show_bug.cgi?id=15693
+ */
+#if defined (USE_SSE2) && defined(__GNUC__) && !defined(__x86_64__) && !defined(__amd64__)
+__attribute__((__force_align_arg_pointer__))
+#endif
+PIXMAN_EXPORT void
+pixman_image_composite32 (pixman_op_t      op,
+                          pixman_image_t * src,
+                          pixman_image_t * mask,
+                          pixman_image_t * dest,
+                          int32_t          src_x,
+                          int32_t          src_y,
+                          int32_t          mask_x,
+                          int32_t          mask_y,
+                          int32_t          dest_x,
+                          int32_t          dest_y,
+                          int32_t          width,
+                          int32_t          height)
+{
+    composite_setup_t setup;
+    composite_plan_t plan;
+    plan_key_t *key = &plan.key;
+
+    composite_setup_init (&setup, op, src, mask, dest);
+
+    if (!can_use_plans (src, mask, dest))
+    {
+	composite_setup_rect (&setup, NULL,
+			      src_x, src_y, mask_x, mask_y, dest_x, dest_y,
+			      width, height);
+	return;
+    }
+
+    key->src_generation = src->common.generation;
+    key->mask_generation = mask ? mask->common.generation : 0;
+    key->dest_generation = dest->common.generation;
+    key->op = op;
+    key->src_x = src_x;
+    key->src_y = src_y;
+    key->mask_x = mask_x;
+    key->mask_y = mask_y;
+    key->dest_x = dest_x;
+    key->dest_y = dest_y;
+    key->width = width;
+    key->height = height;
+
+    if (find_plan (dest, &plan))
+    {
+	composite_plan_run (&setup, &plan);
+    }
+    else
+    {
+	composite_setup_rect (&setup, &plan,
+			      src_x, src_y, mask_x, mask_y, dest_x, dest_y,
+			      width, height);
+
+	store_plan (dest, &plan);
+    }
+}
+
+#if defined (USE_SSE2) && defined(__GNUC__) && !defined(__x86_64__) && !defined(__amd64__)
+__attribute__((__force_align_arg_pointer__))
+#endif
+PIXMAN_EXPORT void
+pixman_image_composite_batch (pixman_op_t                      op,
+			      pixman_image_t *                 src,
+			      pixman_image_t *                 mask,
+			      pixman_image_t *                 dest,
+			      const pixman_composite_rect32_t *rects,
+			      int                              n_rects)
+{
+    composite_setup_t setup;
+    int i;
+
+    if (n_rects <= 0)
+	return;
+
+    composite_setup_init (&setup, op, src, mask, dest);
+
+    for (i = 0; i < n_rects; ++i)
+    {
+	const pixman_composite_rect32_t *r = &rects[i];
+
+	composite_setup_rect (&setup, NULL,
+			      r->src_x, r->src_y,
+			      r->mask_x, r->mask_y,
+			      r->dest_x, r->dest_y,
+			      r->width, r->height);
+    }
+}
+
 PIXMAN_EXPORT void
 pixman_image_composite (pixman_op_t      op,
                         pixman_image_t * src,
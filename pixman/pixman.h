@@ -441,6 +441,9 @@ void                    pixman_region_init_with_extents  (pixman_region16_t *reg
 							  pixman_box16_t    *extents);
 void                    pixman_region_init_from_image    (pixman_region16_t *region,
 							  pixman_image_t    *image);
+void                    pixman_region_init_from_image_threshold (pixman_region16_t *region,
+								 pixman_image_t    *image,
+								 uint8_t            threshold);
 void                    pixman_region_fini               (pixman_region16_t *region);
 
 
@@ -450,12 +453,17 @@ void                    pixman_region_translate          (pixman_region16_t *reg
 							  int                y);
 pixman_bool_t           pixman_region_copy               (pixman_region16_t *dest,
 							  pixman_region16_t *source);
+pixman_bool_t           pixman_region_copy_shared        (pixman_region16_t *dest,
+							  pixman_region16_t *source);
 pixman_bool_t           pixman_region_intersect          (pixman_region16_t *new_reg,
 							  pixman_region16_t *reg1,
 							  pixman_region16_t *reg2);
 pixman_bool_t           pixman_region_union              (pixman_region16_t *new_reg,
 							  pixman_region16_t *reg1,
 							  pixman_region16_t *reg2);
+pixman_bool_t           pixman_region_union_many         (pixman_region16_t  *dest,
+							  pixman_region16_t **regions,
+							  int                 n_regions);
 pixman_bool_t           pixman_region_union_rect         (pixman_region16_t *dest,
 							  pixman_region16_t *source,
 							  int                x,
@@ -536,6 +544,9 @@ void                    pixman_region32_init_with_extents  (pixman_region32_t *r
 							    pixman_box32_t    *extents);
 void                    pixman_region32_init_from_image    (pixman_region32_t *region,
 							    pixman_image_t    *image);
+void                    pixman_region32_init_from_image_threshold (pixman_region32_t *region,
+								   pixman_image_t    *image,
+								   uint8_t            threshold);
 void                    pixman_region32_fini               (pixman_region32_t *region);
 
 
@@ -545,12 +556,25 @@ void                    pixman_region32_translate          (pixman_region32_t *r
 							    int                y);
 pixman_bool_t           pixman_region32_copy               (pixman_region32_t *dest,
 							    pixman_region32_t *source);
+
+/* Like pixman_region32_copy(), except that the boxes of dest are put
+ * in memory that later copies of dest share instead of each having a
+ * copy, until they are changed. This includes copies made with
+ * pixman_region32_copy() and pixman_image_set_clip_region32(), so the
+ * boxes returned by pixman_region32_rectangles() for any of them may
+ * only be changed through pixman functions. source is not modified.
+ */
+pixman_bool_t           pixman_region32_copy_shared        (pixman_region32_t *dest,
+							    pixman_region32_t *source);
 pixman_bool_t           pixman_region32_intersect          (pixman_region32_t *new_reg,
 							    pixman_region32_t *reg1,
 							    pixman_region32_t *reg2);
 pixman_bool_t           pixman_region32_union              (pixman_region32_t *new_reg,
 							    pixman_region32_t *reg1,
 							    pixman_region32_t *reg2);
+pixman_bool_t           pixman_region32_union_many         (pixman_region32_t  *dest,
+							    pixman_region32_t **regions,
+							    int                 n_regions);
 pixman_bool_t		pixman_region32_intersect_rect     (pixman_region32_t *dest,
 							    pixman_region32_t *source,
 							    int                x,
@@ -907,6 +931,30 @@ void          pixman_image_composite32        (pixman_op_t        op,
 					       int32_t            width,
 					       int32_t            height);
 
+/* Compositing many rectangles with the same operator and images.
+ *
+ * This is equivalent to calling pixman_image_composite32() once for
+ * each rectangle, in order, but the images are only validated once and
+ * the composite function is only looked up again when the rectangles
+ * require different flags.
+ */
+typedef struct pixman_composite_rect32 pixman_composite_rect32_t;
+
+struct pixman_composite_rect32
+{
+    int32_t src_x, src_y;
+    int32_t mask_x, mask_y;
+    int32_t dest_x, dest_y;
+    int32_t width, height;
+};
+
+void          pixman_image_composite_batch    (pixman_op_t                      op,
+					       pixman_image_t                  *src,
+					       pixman_image_t                  *mask,
+					       pixman_image_t                  *dest,
+					       const pixman_composite_rect32_t *rects,
+					       int                              n_rects);
+
 /* Executive Summary: This function is a no-op that only exists
  * for historical reasons.
  *
@@ -927,6 +975,163 @@ void          pixman_image_composite32        (pixman_op_t        op,
  */
 void pixman_disable_out_of_bounds_workaround (void);
 
+/* Fast path dispatch statistics
+ *
+ * cache_hits and cache_misses count the lookups of composite functions
+ * that were and weren't answered by the per-thread cache of recently
+ * used fast paths. candidates is the number of fast paths that were
+ * compared against the operation on cache misses. Each thread adds its
+ * counts to the totals in batches, so the numbers may lag slightly
+ * behind for threads other than the calling one.
+ */
+typedef struct pixman_dispatch_stats pixman_dispatch_stats_t;
+
+struct pixman_dispatch_stats
+{
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint64_t candidates;
+};
+
+void pixman_get_dispatch_stats   (pixman_dispatch_stats_t *stats);
+void pixman_reset_dispatch_stats (void);
+
+/* Composite statistics
+ *
+ * When enabled, either with pixman_enable_stats() or by setting the
+ * PIXMAN_STATS environment variable to a value other than 0, pixman
+ * counts the calls, pixels and time spent in each composite function
+ * it dispatches to.
+ *
+ * pixman_get_stats() stores up to n_stats entries in stats and returns
+ * the number of entries available. There is first one entry of kind
+ * PIXMAN_STATS_IMPLEMENTATION for each implementation in use, from the
+ * most to the least specialized one, with the totals for that
+ * implementation. These are followed by one PIXMAN_STATS_COMPOSITE
+ * entry for each combination of operator and formats that has been
+ * composited since the last reset, along with the implementation
+ * that did it. fallback is set for the general implementation, which
+ * is used when there is no fast path for an operation.
+ *
+ * Glyphs that pixman_composite_glyphs() adds to its mask in batches are
+ * counted in PIXMAN_STATS_ADD_GLYPHS entries, one for each
+ * implementation and mask format. These have the mask format as both
+ * src_format and dest_format, and PIXMAN_OP_ADD as the operator. calls
+ * is the number of batches, and glyphs the number of glyphs in them.
+ * glyphs is 0 for composite entries.
+ *
+ * The operator is the one actually used, which may be simpler than the
+ * one requested. Formats that are not a pixman_format_code_t, such as
+ * those of solid fills, gradients and missing masks, are reported as 0.
+ * cycles are CPU timestamp counter ticks where available and 0
+ * elsewhere. Only a limited number of combinations is tracked; once
+ * that many have been seen, new ones are not counted. Resetting sets
+ * all counts back to zero.
+ */
+typedef enum
+{
+    PIXMAN_STATS_IMPLEMENTATION,
+    PIXMAN_STATS_COMPOSITE,
+    PIXMAN_STATS_ADD_GLYPHS
+} pixman_stats_kind_t;
+
+typedef struct pixman_composite_stats pixman_composite_stats_t;
+
+struct pixman_composite_stats
+{
+    pixman_stats_kind_t		kind;
+    const char *		implementation;
+    pixman_bool_t		fallback;
+    pixman_op_t			op;
+    pixman_format_code_t	src_format;
+    pixman_format_code_t	mask_format;
+    pixman_format_code_t	dest_format;
+    uint64_t			calls;
+    uint64_t			pixels;
+    uint64_t			cycles;
+    uint64_t			glyphs;
+};
+
+void pixman_enable_stats (pixman_bool_t            enable);
+int  pixman_get_stats    (pixman_composite_stats_t *stats,
+			  int                       n_stats);
+void pixman_reset_stats  (void);
+
+/* Fallback tracing
+ *
+ * Operations without a fast path are done by the general
+ * implementation, which is usually much slower. Most of the time that
+ * is because a fast path exists for the operator and formats, but
+ * some property of the images, such as the filter, repeat mode or a
+ * transformation that samples outside the image, rules it out.
+ *
+ * When enabled, either with pixman_enable_fallback_trace() or by
+ * setting the PIXMAN_TRACE_FALLBACKS environment variable to a value
+ * other than 0, every call to pixman_image_composite32() or rectangle
+ * passed to pixman_image_composite_batch() that ends up in the general
+ * implementation is counted. pixman_get_fallback_trace() stores up to
+ * n_traces entries and returns the number available, one for each
+ * distinct operator, formats and set of image properties seen.
+ *
+ * candidate is the name of the implementation of the fast path that
+ * came closest, that is, the one handling the operator and formats
+ * with the fewest missing flags, or NULL if there is no fast path for
+ * them at all. The missing_*_flags fields are the flags that fast path
+ * requires but the source, mask and destination didn't have, and
+ * pixman_fast_path_flag_name() returns the name of a single flag bit.
+ * Formats are reported as for pixman_get_stats().
+ */
+typedef struct pixman_fallback_trace pixman_fallback_trace_t;
+
+struct pixman_fallback_trace
+{
+    pixman_op_t			op;
+    pixman_format_code_t	src_format;
+    pixman_format_code_t	mask_format;
+    pixman_format_code_t	dest_format;
+    const char *		candidate;
+    uint32_t			missing_src_flags;
+    uint32_t			missing_mask_flags;
+    uint32_t			missing_dest_flags;
+    uint64_t			count;
+};
+
+void         pixman_enable_fallback_trace (pixman_bool_t            enable);
+int          pixman_get_fallback_trace    (pixman_fallback_trace_t *traces,
+					   int                      n_traces);
+void         pixman_reset_fallback_trace  (void);
+const char * pixman_fast_path_flag_name   (uint32_t                 flag);
+
+/* Threads
+ *
+ * pixman_set_num_threads() allows pixman to use up to n_threads threads,
+ * including the calling thread, for large composite operations. They
+ * are split into horizontal bands that are rendered by a pool of worker
+ * threads shared by the whole process. Many trapezoids or triangles
+ * passed to pixman_composite_trapezoids() or pixman_composite_triangles()
+ * are likewise rasterized in bands on several threads. Small operations
+ * always run on the calling thread. The default is 1, which disables the
+ * worker pool.
+ */
+void pixman_set_num_threads (int n_threads);
+int  pixman_get_num_threads (void);
+
+/* Scanline buffers
+ *
+ * Composite operations that can't be done directly take their scanline
+ * buffers from a per-thread arena that grows as needed and is freed when
+ * the thread exits. pixman_trim_scanline_arena() frees the arena of the
+ * calling thread right away.
+ */
+void pixman_trim_scanline_arena (void);
+
+/* pixman_set_cache_block_size() sets the amount of cache that these
+ * buffers should fit in. Wider operations are split into columns that
+ * are composited one after the other. The default of 0 uses half the
+ * L2 cache if its size is known, and a negative size disables this.
+ */
+void pixman_set_cache_block_size (int n_bytes);
+
 /*
  * Glyphs
  */
@@ -937,13 +1142,55 @@ typedef struct
     const void *glyph;
 } pixman_glyph_t;
 
+/* Caches made with pixman_glyph_cache_create() hold up to 16384 glyphs.
+ * pixman_glyph_cache_create_with_limits() sets the limits on the number
+ * of glyphs and on the bytes of glyph pixels instead, where 0 means no
+ * limit. When a cache is thawed while over a limit, the least recently
+ * used glyphs are evicted until it is down to half of it.
+ *
+ * A cache made with pixman_glyph_cache_create_shared() can be used by
+ * several threads at once. Each thread must have it frozen while it
+ * looks up, inserts or composites glyphs. Lookups don't block, and
+ * removed glyphs stay valid until no thread has the cache frozen, which
+ * is also the only time glyphs are evicted. Its hit and miss counts are
+ * approximate when many threads look up glyphs at the same time.
+ *
+ * pixman_glyph_cache_lookup_subpixel() returns the glyph shifted to the
+ * right by @phase / @n_phases pixel, where @n_phases is a power of two
+ * up to 16, and makes the shifted glyph from the cached one if needed.
+ * Such glyphs are one pixel wider, and are positioned at the integer
+ * part of the position like any other glyph. Only a8 and a8r8g8b8
+ * glyphs are shifted; for other formats the glyph itself is returned.
+ * NULL is returned if the glyph is not in the cache.
+ */
+typedef struct
+{
+    int		n_glyphs;
+    uint64_t	n_bytes;
+    uint64_t	hits;
+    uint64_t	misses;
+    uint64_t	insertions;
+    uint64_t	evictions;
+} pixman_glyph_cache_stats_t;
+
 pixman_glyph_cache_t *pixman_glyph_cache_create       (void);
+pixman_glyph_cache_t *pixman_glyph_cache_create_with_limits (int       max_glyphs,
+							     uint64_t  max_bytes);
+pixman_glyph_cache_t *pixman_glyph_cache_create_shared (int       max_glyphs,
+							uint64_t  max_bytes);
+void                  pixman_glyph_cache_get_stats    (pixman_glyph_cache_t       *cache,
+						       pixman_glyph_cache_stats_t *stats);
 void                  pixman_glyph_cache_destroy      (pixman_glyph_cache_t *cache);
 void                  pixman_glyph_cache_freeze       (pixman_glyph_cache_t *cache);
 void                  pixman_glyph_cache_thaw         (pixman_glyph_cache_t *cache);
 const void *          pixman_glyph_cache_lookup       (pixman_glyph_cache_t *cache,
 						       void                 *font_key,
 						       void                 *glyph_key);
+const void *          pixman_glyph_cache_lookup_subpixel (pixman_glyph_cache_t *cache,
+							  void                 *font_key,
+							  void                 *glyph_key,
+							  int                   phase,
+							  int                   n_phases);
 const void *          pixman_glyph_cache_insert       (pixman_glyph_cache_t *cache,
 						       void                 *font_key,
 						       void                 *glyph_key,
@@ -1106,6 +1353,37 @@ void	      pixman_add_triangles       (pixman_image_t              *image,
 					  int	                       n_tris,
 					  const pixman_triangle_t     *tris);
 
+/* Exact coverage
+ *
+ * These are the same as pixman_composite_trapezoids() and
+ * pixman_composite_triangles(), except that with a mask format of
+ * PIXMAN_a8, each pixel of the mask is the area of it that is covered,
+ * computed from the edges, rather than the number of covered points on
+ * a sample grid. Each mask pixel is written once, however many shapes
+ * cover it. Overlapping shapes add up, as they do when sampled. Other
+ * mask formats are sampled.
+ */
+void          pixman_composite_trapezoids_exact (pixman_op_t                 op,
+						 pixman_image_t *            src,
+						 pixman_image_t *            dst,
+						 pixman_format_code_t        mask_format,
+						 int                         x_src,
+						 int                         y_src,
+						 int                         x_dst,
+						 int                         y_dst,
+						 int                         n_traps,
+						 const pixman_trapezoid_t *  traps);
+void          pixman_composite_triangles_exact  (pixman_op_t                 op,
+						 pixman_image_t *            src,
+						 pixman_image_t *            dst,
+						 pixman_format_code_t        mask_format,
+						 int                         x_src,
+						 int                         y_src,
+						 int                         x_dst,
+						 int                         y_dst,
+						 int                         n_tris,
+						 const pixman_triangle_t *   tris);
+
 PIXMAN_END_DECLS
 
 #endif /* PIXMAN_H__ */
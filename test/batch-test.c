@@ -0,0 +1,144 @@
+/*
+ * Check that pixman_image_composite_batch() gives the same result as
+ * calling pixman_image_composite32() for each rectangle in turn.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+
+#define WIDTH 160
+#define HEIGHT 120
+#define N_ROUNDS 500
+#define MAX_RECTS 40
+
+static const pixman_op_t operators[] =
+{
+    PIXMAN_OP_SRC,
+    PIXMAN_OP_OVER,
+    PIXMAN_OP_ADD,
+    PIXMAN_OP_OUT_REVERSE,
+    PIXMAN_OP_DIFFERENCE,
+};
+
+static const pixman_format_code_t formats[] =
+{
+    PIXMAN_a8r8g8b8,
+    PIXMAN_x8r8g8b8,
+    PIXMAN_r5g6b5,
+    PIXMAN_a8,
+    PIXMAN_a4r4g4b4,
+};
+
+#define RAND_ELT(arr)							\
+    arr[prng_rand_n (ARRAY_LENGTH (arr))]
+
+static void
+destroy (pixman_image_t *image, void *data)
+{
+    free (data);
+}
+
+static pixman_image_t *
+make_image (pixman_format_code_t format, int width, int height)
+{
+    pixman_image_t *image;
+    uint32_t *bits;
+    int stride;
+
+    stride = width * PIXMAN_FORMAT_BPP (format) / 8;
+    stride = (stride + 3) & ~3;
+
+    bits = malloc (stride * height);
+    prng_randmemset (bits, stride * height, RANDMEMSET_MORE_00_AND_FF);
+
+    image = pixman_image_create_bits (format, width, height, bits, stride);
+    pixman_image_set_destroy_function (image, destroy, bits);
+
+    /* Mix of repeat modes, so that some rectangles sample outside
+     * the image and need different fast paths than others.
+     */
+    pixman_image_set_repeat (image, prng_rand_n (4));
+
+    return image;
+}
+
+int
+main (int argc, const char *argv[])
+{
+    pixman_composite_rect32_t rects[MAX_RECTS];
+    int i, j;
+
+    prng_srand (0);
+
+    for (i = 0; i < N_ROUNDS; ++i)
+    {
+	pixman_op_t op = RAND_ELT (operators);
+	pixman_image_t *src = make_image (RAND_ELT (formats), WIDTH, HEIGHT);
+	pixman_image_t *mask = NULL;
+	pixman_image_t *dest1 = make_image (RAND_ELT (formats), WIDTH, HEIGHT);
+	pixman_image_t *dest2;
+	int n_rects = prng_rand_n (MAX_RECTS + 1);
+	uint32_t crc1, crc2;
+
+	dest2 = pixman_image_create_bits (
+	    pixman_image_get_format (dest1), WIDTH, HEIGHT, NULL,
+	    pixman_image_get_stride (dest1));
+	memcpy (pixman_image_get_data (dest2), pixman_image_get_data (dest1),
+		pixman_image_get_stride (dest1) * HEIGHT);
+
+	if (prng_rand_n (2))
+	    mask = make_image (prng_rand_n (2)? PIXMAN_a8 : PIXMAN_a8r8g8b8,
+			       WIDTH, HEIGHT);
+
+	if (prng_rand_n (4) == 0)
+	{
+	    pixman_region32_t clip;
+
+	    pixman_region32_init_rect (&clip, 10, 5, WIDTH / 2, HEIGHT - 20);
+	    pixman_image_set_clip_region32 (dest1, &clip);
+	    pixman_image_set_clip_region32 (dest2, &clip);
+	    pixman_region32_fini (&clip);
+	}
+
+	for (j = 0; j < n_rects; ++j)
+	{
+	    pixman_composite_rect32_t *r = &rects[j];
+
+	    r->src_x = prng_rand_n (WIDTH) - WIDTH / 4;
+	    r->src_y = prng_rand_n (HEIGHT) - HEIGHT / 4;
+	    r->mask_x = prng_rand_n (2)? r->src_x : prng_rand_n (WIDTH);
+	    r->mask_y = prng_rand_n (2)? r->src_y : prng_rand_n (HEIGHT);
+	    r->dest_x = prng_rand_n (WIDTH) - 8;
+	    r->dest_y = prng_rand_n (HEIGHT) - 8;
+	    r->width = prng_rand_n (WIDTH / 2);
+	    r->height = prng_rand_n (HEIGHT / 2);
+
+	    pixman_image_composite32 (op, src, mask, dest1,
+				      r->src_x, r->src_y,
+				      r->mask_x, r->mask_y,
+				      r->dest_x, r->dest_y,
+				      r->width, r->height);
+	}
+
+	pixman_image_composite_batch (op, src, mask, dest2, rects, n_rects);
+
+	crc1 = compute_crc32_for_image (0, dest1);
+	crc2 = compute_crc32_for_image (0, dest2);
+
+	if (crc1 != crc2)
+	{
+	    printf ("Round %d: batch result differs (%08x != %08x)\n",
+		    i, crc1, crc2);
+	    return 1;
+	}
+
+	pixman_image_unref (src);
+	if (mask)
+	    pixman_image_unref (mask);
+	pixman_image_unref (dest1);
+	pixman_image_unref (dest2);
+    }
+
+    return 0;
+}
@@ -0,0 +1,218 @@
+/*
+ * Check that compositing wide rectangles in columns gives the same
+ * results as compositing them in one go, also when the source or the
+ * mask is the destination itself.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+
+#define MAX_WIDTH 700
+#define MAX_HEIGHT 12
+#define N_ROUNDS 3000
+
+static const pixman_op_t operators[] =
+{
+    PIXMAN_OP_SRC,
+    PIXMAN_OP_OVER,
+    PIXMAN_OP_ADD,
+    PIXMAN_OP_IN_REVERSE,
+    PIXMAN_OP_DISJOINT_OVER,
+    PIXMAN_OP_MULTIPLY,
+    PIXMAN_OP_HSL_SATURATION,
+};
+
+static const pixman_format_code_t formats[] =
+{
+    PIXMAN_a8r8g8b8,
+    PIXMAN_x8r8g8b8,
+    PIXMAN_r5g6b5,
+    PIXMAN_a2r10g10b10,
+    PIXMAN_a8,
+    PIXMAN_a4,
+    PIXMAN_a1,
+};
+
+static const pixman_filter_t filters[] =
+{
+    PIXMAN_FILTER_NEAREST,
+    PIXMAN_FILTER_BILINEAR,
+};
+
+#define RAND_ELT(arr)							\
+    arr[prng_rand_n (ARRAY_LENGTH (arr))]
+
+static void
+destroy (pixman_image_t *image, void *data)
+{
+    free (data);
+}
+
+static pixman_image_t *
+make_bits (pixman_format_code_t format, int width, int height)
+{
+    pixman_image_t *image;
+    uint32_t *bits;
+    int stride;
+
+    stride = (width * PIXMAN_FORMAT_BPP (format) + 31) / 32 * 4;
+
+    bits = malloc (stride * height);
+    prng_randmemset (bits, stride * height, 0);
+
+    image = pixman_image_create_bits (format, width, height, bits, stride);
+    pixman_image_set_destroy_function (image, destroy, bits);
+
+    return image;
+}
+
+static pixman_image_t *
+make_source (int width, int height)
+{
+    static const pixman_gradient_stop_t stops[] =
+    {
+	{ pixman_int_to_fixed (0), { 0xffff, 0x0000, 0x4000, 0xffff } },
+	{ pixman_double_to_fixed (0.4), { 0x1234, 0xffff, 0x0000, 0x8000 } },
+	{ pixman_int_to_fixed (1), { 0x0000, 0x2000, 0xffff, 0xffff } },
+    };
+    pixman_transform_t transform;
+    pixman_image_t *image;
+    pixman_point_fixed_t p1, p2;
+
+    switch (prng_rand_n (5))
+    {
+    case 0:
+	p1.x = pixman_int_to_fixed (prng_rand_n (width));
+	p1.y = 0;
+	p2.x = pixman_int_to_fixed (prng_rand_n (width));
+	p2.y = pixman_int_to_fixed (height);
+	image = pixman_image_create_linear_gradient (
+	    &p1, &p2, stops, ARRAY_LENGTH (stops));
+	break;
+
+    case 1:
+	p1.x = pixman_int_to_fixed (width / 2);
+	p1.y = pixman_int_to_fixed (height / 2);
+	p2.x = p1.x + pixman_int_to_fixed (3);
+	p2.y = p1.y;
+	image = pixman_image_create_radial_gradient (
+	    &p1, &p2, pixman_int_to_fixed (1), pixman_int_to_fixed (width / 3),
+	    stops, ARRAY_LENGTH (stops));
+	break;
+
+    case 2:
+	p1.x = pixman_int_to_fixed (prng_rand_n (width));
+	p1.y = pixman_int_to_fixed (prng_rand_n (height));
+	image = pixman_image_create_conical_gradient (
+	    &p1, pixman_double_to_fixed (prng_rand_n (360)),
+	    stops, ARRAY_LENGTH (stops));
+	break;
+
+    default:
+	image = make_bits (RAND_ELT (formats), width, height);
+	break;
+    }
+
+    pixman_image_set_repeat (image, prng_rand_n (4));
+
+    if (prng_rand_n (2))
+    {
+	pixman_transform_init_rotate (
+	    &transform,
+	    pixman_double_to_fixed (0.99), pixman_double_to_fixed (0.14));
+	pixman_transform_scale (
+	    &transform, NULL,
+	    pixman_double_to_fixed (0.7 + prng_rand_n (8) * 0.1),
+	    pixman_double_to_fixed (0.7 + prng_rand_n (8) * 0.1));
+	pixman_image_set_transform (image, &transform);
+	pixman_image_set_filter (image, RAND_ELT (filters), NULL, 0);
+    }
+
+    return image;
+}
+
+/* In place, the source or the mask is replaced by the destination */
+static uint32_t
+composite (int block_size, pixman_op_t op,
+	   pixman_image_t *src, pixman_image_t *mask, pixman_image_t *orig,
+	   int in_place, int src_x, int src_y, int dest_x, int width, int height)
+{
+    pixman_format_code_t format = pixman_image_get_format (orig);
+    int stride = pixman_image_get_stride (orig);
+    pixman_image_t *dest;
+    uint32_t crc;
+
+    dest = pixman_image_create_bits (
+	format, pixman_image_get_width (orig), pixman_image_get_height (orig),
+	NULL, stride);
+    memcpy (pixman_image_get_data (dest), pixman_image_get_data (orig),
+	    stride * pixman_image_get_height (orig));
+
+    if (in_place == 1)
+	src = dest;
+    else if (in_place == 2)
+	mask = dest;
+
+    pixman_set_cache_block_size (block_size);
+    pixman_image_composite32 (op, src, mask, dest,
+			      src_x, src_y, src_x, src_y, dest_x, 0,
+			      width, height);
+
+    crc = compute_crc32_for_image (0, dest);
+    pixman_image_unref (dest);
+
+    return crc;
+}
+
+int
+main (int argc, const char *argv[])
+{
+    int i;
+
+    prng_srand (0);
+
+    for (i = 0; i < N_ROUNDS; ++i)
+    {
+	int width = prng_rand_n (MAX_WIDTH) + 1;
+	int height = prng_rand_n (MAX_HEIGHT) + 1;
+	pixman_op_t op = RAND_ELT (operators);
+	pixman_image_t *src = make_source (width, height);
+	pixman_image_t *mask = NULL;
+	pixman_image_t *dest = make_bits (RAND_ELT (formats), width + 7, height);
+	int src_x = prng_rand_n (9) - 4;
+	int src_y = prng_rand_n (9) - 4;
+	int dest_x = prng_rand_n (8);
+	int in_place = prng_rand_n (4) ? 0 : prng_rand_n (2) + 1;
+	uint32_t crc1, crc2;
+
+	if (prng_rand_n (2))
+	{
+	    mask = make_bits (prng_rand_n (2)? PIXMAN_a8 : PIXMAN_a8r8g8b8,
+			      width, height);
+	    pixman_image_set_component_alpha (mask, prng_rand_n (2));
+	}
+
+	/* The smallest block size gives columns of 64 pixels or less */
+	crc1 = composite (-1, op, src, mask, dest, in_place,
+			  src_x, src_y, dest_x, width, height);
+	crc2 = composite (1, op, src, mask, dest, in_place,
+			  src_x, src_y, dest_x, width, height);
+
+	if (crc1 != crc2)
+	{
+	    printf ("Round %d: result%s differs (%08x != %08x)\n",
+		    i, in_place ? " in place" : "", crc1, crc2);
+	    return 1;
+	}
+
+	pixman_image_unref (src);
+	if (mask)
+	    pixman_image_unref (mask);
+	pixman_image_unref (dest);
+    }
+
+    pixman_set_cache_block_size (0);
+
+    return 0;
+}
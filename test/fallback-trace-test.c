@@ -0,0 +1,162 @@
+/*
+ * Check that composites ending up in the general implementation are
+ * traced, and that the nearest fast path and its missing flags are
+ * reported.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "utils.h"
+
+#define MAX_TRACES 64
+
+static pixman_fallback_trace_t traces[MAX_TRACES];
+
+static const pixman_fallback_trace_t *
+find_trace (int n, pixman_op_t op,
+	    pixman_format_code_t src_format,
+	    pixman_format_code_t mask_format,
+	    pixman_format_code_t dest_format)
+{
+    int i;
+
+    for (i = 0; i < n && i < MAX_TRACES; ++i)
+    {
+	if (traces[i].op == op				&&
+	    traces[i].src_format == src_format		&&
+	    traces[i].mask_format == mask_format	&&
+	    traces[i].dest_format == dest_format)
+	{
+	    return &traces[i];
+	}
+    }
+
+    return NULL;
+}
+
+static int
+check_flag_names (uint32_t flags)
+{
+    uint32_t flag;
+
+    for (flag = 1; flag; flag <<= 1)
+    {
+	if ((flags & flag) && !pixman_fast_path_flag_name (flag))
+	{
+	    printf ("No name for flag %08x\n", flag);
+	    return 0;
+	}
+    }
+
+    return 1;
+}
+
+/* A candidate must be missing something, or it would have been used */
+static int
+check_candidate (const pixman_fallback_trace_t *t)
+{
+    if (!t->candidate)
+	return 1;
+
+    if (!(t->missing_src_flags | t->missing_mask_flags | t->missing_dest_flags))
+    {
+	printf ("Candidate %s has no missing flags\n", t->candidate);
+	return 0;
+    }
+
+    return check_flag_names (t->missing_src_flags)	&&
+	   check_flag_names (t->missing_mask_flags)	&&
+	   check_flag_names (t->missing_dest_flags);
+}
+
+int
+main (int argc, const char *argv[])
+{
+    pixman_image_t *src, *mask, *dest;
+    const pixman_fallback_trace_t *t;
+    pixman_transform_t transform;
+    int n, i;
+
+    src = pixman_image_create_bits (PIXMAN_a8r8g8b8, 32, 32, NULL, 0);
+    mask = pixman_image_create_bits (PIXMAN_a8, 32, 32, NULL, 0);
+    dest = pixman_image_create_bits (PIXMAN_r5g6b5, 32, 32, NULL, 0);
+
+    pixman_enable_fallback_trace (TRUE);
+    pixman_reset_fallback_trace ();
+
+    /* No fast path implements this */
+    for (i = 0; i < 2; ++i)
+    {
+	pixman_image_composite32 (PIXMAN_OP_HSL_LUMINOSITY, src, mask, dest,
+				  0, 0, 0, 0, 0, 0, 7, 5);
+    }
+
+    n = pixman_get_fallback_trace (traces, MAX_TRACES);
+
+    t = find_trace (n, PIXMAN_OP_HSL_LUMINOSITY,
+		    PIXMAN_a8r8g8b8, PIXMAN_a8, PIXMAN_r5g6b5);
+    if (!t || t->count != 2)
+    {
+	printf ("HSL_LUMINOSITY fallback was not traced\n");
+	return 1;
+    }
+
+    if (!check_candidate (t))
+	return 1;
+
+    /* A scaled source that samples outside the image with a repeat
+     * mode no fast path handles in this combination.
+     */
+    pixman_transform_init_scale (&transform,
+				 pixman_double_to_fixed (1.5),
+				 pixman_double_to_fixed (1.5));
+    pixman_image_set_transform (src, &transform);
+    pixman_image_set_filter (src, PIXMAN_FILTER_NEAREST, NULL, 0);
+    pixman_image_set_repeat (src, PIXMAN_REPEAT_REFLECT);
+
+    pixman_image_composite32 (PIXMAN_OP_OVER, src, NULL, dest,
+			      0, 0, 0, 0, 0, 0, 32, 32);
+
+    n = pixman_get_fallback_trace (traces, MAX_TRACES);
+
+    t = find_trace (n, PIXMAN_OP_OVER, PIXMAN_a8r8g8b8, 0, PIXMAN_r5g6b5);
+    if (!t || t->count != 1)
+    {
+	printf ("Reflected OVER fallback was not traced\n");
+	return 1;
+    }
+
+    if (!check_candidate (t))
+	return 1;
+
+    if (pixman_fast_path_flag_name (0) || pixman_fast_path_flag_name (3))
+    {
+	printf ("Name returned for something that isn't a single flag\n");
+	return 1;
+    }
+
+    /* Nothing is traced while disabled */
+    pixman_enable_fallback_trace (FALSE);
+    pixman_image_composite32 (PIXMAN_OP_HSL_LUMINOSITY, src, mask, dest,
+			      0, 0, 0, 0, 0, 0, 7, 5);
+    n = pixman_get_fallback_trace (traces, MAX_TRACES);
+    t = find_trace (n, PIXMAN_OP_HSL_LUMINOSITY,
+		    PIXMAN_a8r8g8b8, PIXMAN_a8, PIXMAN_r5g6b5);
+    if (!t || t->count != 2)
+    {
+	printf ("Fallback traced while disabled\n");
+	return 1;
+    }
+
+    pixman_reset_fallback_trace ();
+    if (pixman_get_fallback_trace (traces, MAX_TRACES) != 0)
+    {
+	printf ("Trace not reset\n");
+	return 1;
+    }
+
+    pixman_image_unref (src);
+    pixman_image_unref (mask);
+    pixman_image_unref (dest);
+
+    return 0;
+}
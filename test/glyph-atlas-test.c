@@ -0,0 +1,209 @@
+/*
+ * Check that glyphs keep their contents while other glyphs come and go
+ * in the glyph cache, so that space shared between glyphs is reused
+ * correctly.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "utils.h"
+
+#define N_IMAGES 300
+#define N_INSERTS 40000
+#define BATCH 64
+
+static const pixman_format_code_t glyph_formats[] =
+{
+    PIXMAN_a8,
+    PIXMAN_a8,
+    PIXMAN_a8r8g8b8,
+    PIXMAN_a1,
+    PIXMAN_x8r8g8b8,
+};
+
+static void
+destroy (pixman_image_t *image, void *data)
+{
+    free (data);
+}
+
+static pixman_image_t *
+make_glyph_image (void)
+{
+    pixman_format_code_t format =
+	glyph_formats[prng_rand_n (ARRAY_LENGTH (glyph_formats))];
+    int width, height, stride;
+    pixman_image_t *image;
+    uint32_t *bits;
+
+    /* Mostly small glyphs, some too big to be shared */
+    width = prng_rand_n (prng_rand_n (8) ? 40 : 200) + 1;
+    height = prng_rand_n (prng_rand_n (8) ? 40 : 200) + 1;
+
+    stride = (width * PIXMAN_FORMAT_BPP (format) + 31) / 32 * 4;
+    bits = malloc (stride * height);
+    prng_randmemset (bits, stride * height, 0);
+
+    image = pixman_image_create_bits (format, width, height, bits, stride);
+    pixman_image_set_destroy_function (image, destroy, bits);
+
+    /* Parts of the glyph outside the clip are not copied */
+    if (prng_rand_n (4) == 0)
+    {
+	pixman_region32_t clip;
+
+	pixman_region32_init_rect (&clip, 0, 0, width / 2 + 1, height);
+	pixman_image_set_clip_region32 (image, &clip);
+	pixman_image_set_source_clipping (image, TRUE);
+	pixman_image_set_has_client_clip (image, TRUE);
+	pixman_region32_fini (&clip);
+    }
+
+    return image;
+}
+
+/* What the glyph cache should have stored for @image */
+static pixman_image_t *
+make_reference (pixman_image_t *image)
+{
+    pixman_format_code_t format = pixman_image_get_format (image);
+    int width = pixman_image_get_width (image);
+    int height = pixman_image_get_height (image);
+    pixman_image_t *copy;
+
+    copy = pixman_image_create_bits (format, width, height, NULL, -1);
+    pixman_image_composite32 (PIXMAN_OP_SRC, image, NULL, copy,
+			      0, 0, 0, 0, 0, 0, width, height);
+
+    if (PIXMAN_FORMAT_A (format) != 0 && PIXMAN_FORMAT_RGB (format) != 0)
+	pixman_image_set_component_alpha (copy, TRUE);
+
+    return copy;
+}
+
+static uint32_t
+render_glyph (pixman_glyph_cache_t *cache, pixman_image_t *white,
+	      const void *glyph, int width, int height)
+{
+    pixman_image_t *dest;
+    pixman_glyph_t g;
+    uint32_t crc;
+
+    dest = pixman_image_create_bits (PIXMAN_a8r8g8b8, width, height, NULL, -1);
+
+    g.x = 0;
+    g.y = 0;
+    g.glyph = glyph;
+
+    pixman_composite_glyphs_no_mask (PIXMAN_OP_ADD, white, dest,
+				     0, 0, 0, 0, cache, 1, &g);
+
+    crc = compute_crc32_for_image (0, dest);
+    pixman_image_unref (dest);
+
+    return crc;
+}
+
+static uint32_t
+render_reference (pixman_image_t *white, pixman_image_t *reference)
+{
+    int width = pixman_image_get_width (reference);
+    int height = pixman_image_get_height (reference);
+    pixman_image_t *dest;
+    uint32_t crc;
+
+    dest = pixman_image_create_bits (PIXMAN_a8r8g8b8, width, height, NULL, -1);
+
+    pixman_image_composite32 (PIXMAN_OP_ADD, white, reference, dest,
+			      0, 0, 0, 0, 0, 0, width, height);
+
+    crc = compute_crc32_for_image (0, dest);
+    pixman_image_unref (dest);
+
+    return crc;
+}
+
+#define FONT_KEY(n) ((void *)(uintptr_t)((n) / N_IMAGES + 1))
+#define GLYPH_KEY(n) ((void *)(uintptr_t)((n) % N_IMAGES + 1))
+
+int
+main (int argc, const char *argv[])
+{
+    static const pixman_color_t white_color = { 0xffff, 0xffff, 0xffff, 0xffff };
+    pixman_image_t *images[N_IMAGES], *references[N_IMAGES];
+    uint32_t crcs[N_IMAGES];
+    pixman_glyph_cache_t *cache;
+    pixman_image_t *white;
+    int n, i;
+
+    prng_srand (0);
+
+    white = pixman_image_create_solid_fill (&white_color);
+    cache = pixman_glyph_cache_create ();
+
+    for (i = 0; i < N_IMAGES; ++i)
+    {
+	images[i] = make_glyph_image ();
+	references[i] = make_reference (images[i]);
+	crcs[i] = render_reference (white, references[i]);
+    }
+
+    for (n = 0; n < N_INSERTS; n += BATCH)
+    {
+	pixman_glyph_cache_freeze (cache);
+
+	for (i = n; i < n + BATCH; ++i)
+	{
+	    pixman_image_t *image = images[i % N_IMAGES];
+
+	    if (!pixman_glyph_cache_insert (cache, FONT_KEY (i), GLYPH_KEY (i),
+					    0, 0, image))
+	    {
+		printf ("Insert %d failed\n", i);
+		return 1;
+	    }
+
+	    /* Remove some recent glyphs to leave holes */
+	    if (prng_rand_n (8) == 0)
+	    {
+		int j = i - prng_rand_n (BATCH);
+
+		if (j >= 0)
+		    pixman_glyph_cache_remove (cache, FONT_KEY (j), GLYPH_KEY (j));
+	    }
+	}
+
+	/* Check a few of the glyphs that are still there */
+	for (i = 0; i < 8; ++i)
+	{
+	    int j = prng_rand_n (n + BATCH);
+	    pixman_image_t *ref = references[j % N_IMAGES];
+	    const void *glyph;
+
+	    glyph = pixman_glyph_cache_lookup (cache, FONT_KEY (j), GLYPH_KEY (j));
+	    if (!glyph)
+		continue;
+
+	    if (render_glyph (cache, white, glyph,
+			      pixman_image_get_width (ref),
+			      pixman_image_get_height (ref)) != crcs[j % N_IMAGES])
+	    {
+		printf ("Glyph %d has the wrong contents after %d inserts\n",
+			j, n + BATCH);
+		return 1;
+	    }
+	}
+
+	pixman_glyph_cache_thaw (cache);
+    }
+
+    pixman_glyph_cache_destroy (cache);
+
+    for (i = 0; i < N_IMAGES; ++i)
+    {
+	pixman_image_unref (images[i]);
+	pixman_image_unref (references[i]);
+    }
+    pixman_image_unref (white);
+
+    return 0;
+}
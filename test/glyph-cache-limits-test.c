@@ -0,0 +1,213 @@
+/*
+ * Check the glyph cache statistics, that a cache which is over its
+ * limits evicts the least recently used glyphs when it is thawed, and
+ * that a cache without limits can hold many glyphs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "utils.h"
+
+#define N_MANY 40000
+
+static pixman_image_t *glyph_image;
+
+static int
+check_stats (pixman_glyph_cache_t *cache, const char *what,
+	     int n_glyphs, uint64_t n_bytes,
+	     uint64_t hits, uint64_t misses,
+	     uint64_t insertions, uint64_t evictions)
+{
+    pixman_glyph_cache_stats_t stats;
+
+    pixman_glyph_cache_get_stats (cache, &stats);
+
+    if (stats.n_glyphs != n_glyphs		||
+	stats.n_bytes != n_bytes		||
+	stats.hits != hits			||
+	stats.misses != misses			||
+	stats.insertions != insertions		||
+	stats.evictions != evictions)
+    {
+	printf ("%s: got %d glyphs, %llu bytes, %llu hits, %llu misses, "
+		"%llu insertions, %llu evictions\n", what,
+		stats.n_glyphs, (unsigned long long)stats.n_bytes,
+		(unsigned long long)stats.hits, (unsigned long long)stats.misses,
+		(unsigned long long)stats.insertions,
+		(unsigned long long)stats.evictions);
+	return 0;
+    }
+
+    return 1;
+}
+
+static const void *
+insert (pixman_glyph_cache_t *cache, uintptr_t key)
+{
+    return pixman_glyph_cache_insert (
+	cache, NULL, (void *)(key + 1), 0, 0, glyph_image);
+}
+
+static const void *
+lookup (pixman_glyph_cache_t *cache, uintptr_t key)
+{
+    return pixman_glyph_cache_lookup (cache, NULL, (void *)(key + 1));
+}
+
+static int
+test_counters (void)
+{
+    pixman_glyph_cache_t *cache = pixman_glyph_cache_create ();
+    int i;
+
+    pixman_glyph_cache_freeze (cache);
+
+    for (i = 0; i < 10; ++i)
+    {
+	if (!lookup (cache, i))
+	    insert (cache, i);
+    }
+
+    for (i = 0; i < 20; ++i)
+	lookup (cache, i);
+
+    pixman_glyph_cache_remove (cache, NULL, (void *)(uintptr_t)3);
+
+    pixman_glyph_cache_thaw (cache);
+
+    /* 8x10 a8 glyphs */
+    if (!check_stats (cache, "counters", 9, 9 * 80, 10, 20, 10, 0))
+	return 0;
+
+    pixman_glyph_cache_destroy (cache);
+
+    return 1;
+}
+
+static int
+test_limits (int max_glyphs, uint64_t max_bytes)
+{
+    pixman_glyph_cache_t *cache;
+    pixman_glyph_t glyphs[10];
+    pixman_image_t *dest;
+    int n, i;
+
+    dest = pixman_image_create_bits (PIXMAN_a8, 20, 10, NULL, 0);
+
+    cache = pixman_glyph_cache_create_with_limits (max_glyphs, max_bytes);
+
+    /* The limits don't apply while frozen */
+    n = 100;
+    pixman_glyph_cache_freeze (cache);
+    for (i = 0; i < n; ++i)
+	insert (cache, i);
+
+    /* Make the first glyphs the most recently used */
+    for (i = 0; i < 10; ++i)
+    {
+	glyphs[i].x = i;
+	glyphs[i].y = 0;
+	glyphs[i].glyph = lookup (cache, i);
+    }
+    pixman_composite_glyphs_no_mask (PIXMAN_OP_ADD, glyph_image, dest,
+				     0, 0, 0, 0, cache, 10, glyphs);
+
+    if (!check_stats (cache, "frozen", n, n * 80, 10, 0, n, 0))
+	return 0;
+
+    pixman_glyph_cache_thaw (cache);
+
+    /* Down to half of the limit */
+    if (max_glyphs)
+	n = max_glyphs / 2;
+    if (max_bytes && n * 80 > max_bytes / 2)
+	n = max_bytes / 2 / 80;
+
+    if (!check_stats (cache, "thawed", n, n * 80, 10, 0, 100, 100 - n))
+	return 0;
+
+    pixman_glyph_cache_freeze (cache);
+    for (i = 0; i < 100; ++i)
+    {
+	pixman_bool_t expected = (i < 10 || i >= 100 - (n - 10));
+
+	if (!!lookup (cache, i) != expected)
+	{
+	    printf ("Glyph %d was %s\n", i, expected ? "evicted" : "kept");
+	    return 0;
+	}
+    }
+    pixman_glyph_cache_thaw (cache);
+
+    pixman_glyph_cache_destroy (cache);
+    pixman_image_unref (dest);
+
+    return 1;
+}
+
+static int
+test_many (void)
+{
+    pixman_glyph_cache_t *cache;
+    int i;
+
+    cache = pixman_glyph_cache_create_with_limits (0, 0);
+
+    pixman_glyph_cache_freeze (cache);
+    for (i = 0; i < N_MANY; ++i)
+    {
+	if (!insert (cache, i))
+	{
+	    printf ("Failed to insert glyph %d\n", i);
+	    return 0;
+	}
+    }
+    pixman_glyph_cache_thaw (cache);
+
+    pixman_glyph_cache_freeze (cache);
+    for (i = 0; i < N_MANY; ++i)
+    {
+	if (i % 3)
+	    pixman_glyph_cache_remove (cache, NULL, (void *)(uintptr_t)(i + 1));
+    }
+    pixman_glyph_cache_thaw (cache);
+
+    pixman_glyph_cache_freeze (cache);
+    for (i = 0; i < N_MANY; ++i)
+    {
+	if (!!lookup (cache, i) != !(i % 3))
+	{
+	    printf ("Glyph %d is wrong after removing\n", i);
+	    return 0;
+	}
+    }
+    pixman_glyph_cache_thaw (cache);
+
+    pixman_glyph_cache_destroy (cache);
+
+    return 1;
+}
+
+int
+main (int argc, const char *argv[])
+{
+    int ret = 0;
+
+    glyph_image = pixman_image_create_bits (PIXMAN_a8, 8, 10, NULL, 0);
+
+    if (!test_counters ())
+	ret = 1;
+
+    if (!test_limits (40, 0)		||
+	!test_limits (0, 30 * 80)	||
+	!test_limits (60, 30 * 80))
+    {
+	ret = 1;
+    }
+
+    if (!test_many ())
+	ret = 1;
+
+    pixman_image_unref (glyph_image);
+
+    return ret;
+}
@@ -0,0 +1,228 @@
+/*
+ * Check that a shared glyph cache can be used by several threads at
+ * once, while glyphs are inserted, removed and evicted.
+ */
+#include "utils.h"
+
+#ifndef HAVE_PTHREADS
+
+int main ()
+{
+    printf ("Skipped glyph-cache-thread-test - pthreads not supported\n");
+    return 0;
+}
+
+#else
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define N_THREADS 8
+#define N_ROUNDS 400
+#define N_KEYS 600
+#define RUN_LENGTH 24
+#define MAX_GLYPHS 256
+
+static pixman_glyph_cache_t *cache;
+
+typedef struct
+{
+    int		thread_no;
+    int		failed;
+} info_t;
+
+static uint8_t
+glyph_pixel (uintptr_t key, int x, int y)
+{
+    return (key * 31 + x * 7 + y * 13) & 0xff;
+}
+
+static pixman_image_t *
+make_glyph_image (uintptr_t key)
+{
+    int width = 4 + key % 13;
+    int height = 3 + key % 7;
+    pixman_image_t *image;
+    uint8_t *bits;
+    int stride, x, y;
+
+    image = pixman_image_create_bits (PIXMAN_a8, width, height, NULL, 0);
+    bits = (uint8_t *)pixman_image_get_data (image);
+    stride = pixman_image_get_stride (image);
+
+    for (y = 0; y < height; ++y)
+    {
+	for (x = 0; x < width; ++x)
+	    bits[y * stride + x] = glyph_pixel (key, x, y);
+    }
+
+    return image;
+}
+
+static const void *
+get_glyph (uintptr_t key)
+{
+    const void *glyph;
+
+    if (!(glyph = pixman_glyph_cache_lookup (cache, NULL, (void *)key)))
+    {
+	pixman_image_t *image = make_glyph_image (key);
+
+	glyph = pixman_glyph_cache_insert (cache, NULL, (void *)key, 0, 0, image);
+
+	pixman_image_unref (image);
+    }
+
+    return glyph;
+}
+
+static int
+check_glyph (pixman_image_t *white, pixman_image_t *dest,
+	     uintptr_t key, const void *glyph)
+{
+    uint8_t *bits = (uint8_t *)pixman_image_get_data (dest);
+    int stride = pixman_image_get_stride (dest);
+    int width = 4 + key % 13;
+    int height = 3 + key % 7;
+    pixman_glyph_t g;
+    int x, y;
+
+    g.x = 0;
+    g.y = 0;
+    g.glyph = glyph;
+
+    memset (bits, 0, stride * pixman_image_get_height (dest));
+    pixman_composite_glyphs_no_mask (PIXMAN_OP_SRC, white, dest,
+				     0, 0, 0, 0, cache, 1, &g);
+
+    for (y = 0; y < height; ++y)
+    {
+	for (x = 0; x < width; ++x)
+	{
+	    if (bits[y * stride + x] != glyph_pixel (key, x, y))
+		return 0;
+	}
+    }
+
+    return 1;
+}
+
+static void *
+thread (void *data)
+{
+    static const pixman_color_t white_color = { 0xffff, 0xffff, 0xffff, 0xffff };
+    info_t *info = data;
+    pixman_image_t *white = pixman_image_create_solid_fill (&white_color);
+    pixman_image_t *dest = pixman_image_create_bits (PIXMAN_a8, 32, 32, NULL, 0);
+    uint32_t seed = info->thread_no * 2654435761u + 1;
+    const void *glyphs[RUN_LENGTH];
+    uintptr_t keys[RUN_LENGTH];
+    int i, j;
+
+    for (i = 0; i < N_ROUNDS && !info->failed; ++i)
+    {
+	pixman_glyph_cache_freeze (cache);
+
+	for (j = 0; j < RUN_LENGTH; ++j)
+	{
+	    seed = seed * 1103515245 + 12345;
+	    keys[j] = (seed >> 8) % N_KEYS + 1;
+
+	    if (!(glyphs[j] = get_glyph (keys[j])))
+	    {
+		printf ("Thread %d: insertion failed\n", info->thread_no);
+		info->failed = 1;
+		break;
+	    }
+	}
+
+	/* Glyphs stay valid while frozen, even when removed */
+	if ((seed >> 4) % 4 == 0)
+	    pixman_glyph_cache_remove (cache, NULL, (void *)keys[0]);
+
+	for (j = 0; j < RUN_LENGTH && !info->failed; ++j)
+	{
+	    if (!check_glyph (white, dest, keys[j], glyphs[j]))
+	    {
+		printf ("Thread %d: glyph %d is wrong\n",
+			info->thread_no, (int)keys[j]);
+		info->failed = 1;
+	    }
+	}
+
+	pixman_glyph_cache_thaw (cache);
+    }
+
+    pixman_image_unref (white);
+    pixman_image_unref (dest);
+
+    return NULL;
+}
+
+int
+main (void)
+{
+    pthread_t threads[N_THREADS];
+    info_t info[N_THREADS];
+    pixman_glyph_cache_stats_t stats;
+    pixman_image_t *image;
+    const void *g1, *g2;
+    int ret = 0;
+    int i;
+
+    cache = pixman_glyph_cache_create_shared (MAX_GLYPHS, 0);
+
+    /* Inserting a glyph that is already there gives the same glyph */
+    image = make_glyph_image (1);
+    pixman_glyph_cache_freeze (cache);
+    g1 = pixman_glyph_cache_insert (cache, NULL, (void *)1, 0, 0, image);
+    g2 = pixman_glyph_cache_insert (cache, NULL, (void *)1, 0, 0, image);
+    pixman_glyph_cache_thaw (cache);
+    pixman_image_unref (image);
+
+    if (!g1 || g1 != g2)
+    {
+	printf ("Inserting twice gave two glyphs\n");
+	ret = 1;
+    }
+
+    for (i = 0; i < N_THREADS; ++i)
+    {
+	info[i].thread_no = i;
+	info[i].failed = 0;
+
+	pthread_create (&threads[i], NULL, thread, &info[i]);
+    }
+
+    for (i = 0; i < N_THREADS; ++i)
+    {
+	pthread_join (threads[i], NULL);
+
+	if (info[i].failed)
+	    ret = 1;
+    }
+
+    /* Once nobody has it frozen, the cache is within its limit */
+    pixman_glyph_cache_freeze (cache);
+    pixman_glyph_cache_thaw (cache);
+
+    pixman_glyph_cache_get_stats (cache, &stats);
+    if (stats.n_glyphs > MAX_GLYPHS)
+    {
+	printf ("%d glyphs left over\n", stats.n_glyphs);
+	ret = 1;
+    }
+
+    if (stats.hits + stats.misses < (uint64_t)N_THREADS * N_ROUNDS * RUN_LENGTH)
+    {
+	printf ("Lookups were not all counted\n");
+	ret = 1;
+    }
+
+    pixman_glyph_cache_destroy (cache);
+
+    return ret;
+}
+
+#endif
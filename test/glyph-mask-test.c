@@ -0,0 +1,201 @@
+/*
+ * Check that pixman_composite_glyphs() gives the same result as adding
+ * the glyphs to a mask of the full size and compositing with that, also
+ * when it leaves out the mask or parts of it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+
+#define N_TESTS 3000
+#define MAX_GLYPHS 12
+#define WIDTH 96
+#define HEIGHT 48
+
+static const pixman_op_t operators[] =
+{
+    PIXMAN_OP_OVER,
+    PIXMAN_OP_ADD,
+    PIXMAN_OP_ATOP,
+    PIXMAN_OP_XOR,
+    PIXMAN_OP_OUT_REVERSE,
+    PIXMAN_OP_SRC,
+    PIXMAN_OP_IN,
+};
+
+static const pixman_format_code_t dest_formats[] =
+{
+    PIXMAN_a8r8g8b8,
+    PIXMAN_x8r8g8b8,
+    PIXMAN_r5g6b5,
+    PIXMAN_a8,
+};
+
+static const pixman_format_code_t glyph_formats[] =
+{
+    PIXMAN_a8,
+    PIXMAN_a8r8g8b8,
+    PIXMAN_a4,
+};
+
+static pixman_image_t *
+make_image (pixman_format_code_t format, int width, int height)
+{
+    pixman_image_t *image;
+
+    image = pixman_image_create_bits (format, width, height, NULL, 0);
+    prng_randmemset (pixman_image_get_data (image),
+		     pixman_image_get_stride (image) * height,
+		     RANDMEMSET_MORE_00_AND_FF);
+
+    return image;
+}
+
+static pixman_image_t *
+make_source (void)
+{
+    if (prng_rand_n (2))
+    {
+	pixman_color_t color;
+
+	color.red = prng_rand ();
+	color.green = prng_rand ();
+	color.blue = prng_rand ();
+	color.alpha = prng_rand_n (2) ? 0xffff : prng_rand ();
+
+	return pixman_image_create_solid_fill (&color);
+    }
+
+    return make_image (PIXMAN_a8r8g8b8, WIDTH, HEIGHT);
+}
+
+static void
+composite_reference (pixman_op_t op, pixman_image_t *src,
+		     pixman_image_t *dest, pixman_format_code_t mask_format,
+		     int src_x, int src_y, int mask_x, int mask_y,
+		     int dest_x, int dest_y, int width, int height,
+		     int n_glyphs, pixman_image_t **images,
+		     const pixman_glyph_t *glyphs)
+{
+    pixman_image_t *mask;
+    int i;
+
+    mask = pixman_image_create_bits (mask_format, width, height, NULL, 0);
+    if (PIXMAN_FORMAT_A (mask_format) != 0 && PIXMAN_FORMAT_RGB (mask_format) != 0)
+	pixman_image_set_component_alpha (mask, TRUE);
+
+    for (i = 0; i < n_glyphs; ++i)
+    {
+	pixman_image_composite32 (
+	    PIXMAN_OP_ADD, images[i], NULL, mask, 0, 0, 0, 0,
+	    glyphs[i].x - mask_x, glyphs[i].y - mask_y,
+	    pixman_image_get_width (images[i]),
+	    pixman_image_get_height (images[i]));
+    }
+
+    pixman_image_composite32 (op, src, mask, dest,
+			      src_x, src_y, 0, 0, dest_x, dest_y,
+			      width, height);
+
+    pixman_image_unref (mask);
+}
+
+static int
+test_glyphs (int testnum)
+{
+    pixman_glyph_cache_t *cache = pixman_glyph_cache_create ();
+    pixman_format_code_t format =
+	glyph_formats[prng_rand_n (ARRAY_LENGTH (glyph_formats))];
+    pixman_format_code_t dest_format =
+	dest_formats[prng_rand_n (ARRAY_LENGTH (dest_formats))];
+    pixman_op_t op = operators[prng_rand_n (ARRAY_LENGTH (operators))];
+    pixman_image_t *images[MAX_GLYPHS];
+    pixman_glyph_t glyphs[MAX_GLYPHS];
+    pixman_image_t *src, *dest1, *dest2;
+    int n_glyphs = prng_rand_n (MAX_GLYPHS) + 1;
+    int overlap = prng_rand_n (4) == 0;
+    int src_x, src_y, mask_x, mask_y, dest_x, dest_y, width, height;
+    int x = prng_rand_n (8) - 4;
+    int stride, i;
+    int ok;
+
+    src = make_source ();
+    dest1 = make_image (dest_format, WIDTH, HEIGHT);
+    stride = pixman_image_get_stride (dest1);
+    dest2 = pixman_image_create_bits (dest_format, WIDTH, HEIGHT, NULL, stride);
+    memcpy (pixman_image_get_data (dest2), pixman_image_get_data (dest1),
+	    stride * HEIGHT);
+
+    pixman_glyph_cache_freeze (cache);
+
+    for (i = 0; i < n_glyphs; ++i)
+    {
+	int w = prng_rand_n (12) + 1;
+	int h = prng_rand_n (16) + 1;
+
+	images[i] = make_image (format, w, h);
+	if (PIXMAN_FORMAT_RGB (format))
+	    pixman_image_set_component_alpha (images[i], TRUE);
+
+	/* Positions are where the top left corner of the glyph goes */
+	glyphs[i].glyph = pixman_glyph_cache_insert (
+	    cache, NULL, images[i], 0, 0, images[i]);
+	glyphs[i].x = x;
+	glyphs[i].y = prng_rand_n (HEIGHT / 2) - 4;
+
+	x += overlap ? w - prng_rand_n (3) : w + prng_rand_n (3);
+    }
+
+    src_x = prng_rand_n (16) - 8;
+    src_y = prng_rand_n (16) - 8;
+    mask_x = prng_rand_n (16) - 8;
+    mask_y = prng_rand_n (16) - 8;
+    dest_x = prng_rand_n (16) - 8;
+    dest_y = prng_rand_n (16) - 8;
+    width = prng_rand_n (WIDTH);
+    height = prng_rand_n (HEIGHT);
+
+    pixman_composite_glyphs (op, src, dest1, format,
+			     src_x, src_y, mask_x, mask_y, dest_x, dest_y,
+			     width, height, cache, n_glyphs, glyphs);
+
+    composite_reference (op, src, dest2, format,
+			 src_x, src_y, mask_x, mask_y, dest_x, dest_y,
+			 width, height, n_glyphs, images, glyphs);
+
+    ok = compute_crc32_for_image (0, dest1) == compute_crc32_for_image (0, dest2);
+    if (!ok)
+    {
+	printf ("Test %d: op %d, glyph format %08x, dest format %08x%s differs\n",
+		testnum, op, format, dest_format, overlap ? ", overlapping" : "");
+    }
+
+    pixman_glyph_cache_thaw (cache);
+
+    for (i = 0; i < n_glyphs; ++i)
+	pixman_image_unref (images[i]);
+
+    pixman_image_unref (src);
+    pixman_image_unref (dest1);
+    pixman_image_unref (dest2);
+    pixman_glyph_cache_destroy (cache);
+
+    return ok;
+}
+
+int
+main (int argc, const char *argv[])
+{
+    int i;
+
+    prng_srand (0);
+
+    for (i = 0; i < N_TESTS; ++i)
+    {
+	if (!test_glyphs (i))
+	    return 1;
+    }
+
+    return 0;
+}
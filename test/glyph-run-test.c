@@ -0,0 +1,116 @@
+/*
+ * Check that glyphs added to the mask by pixman_composite_glyphs() give
+ * the same mask as adding each glyph with pixman_image_composite32(),
+ * for overlapping glyphs of widths that end at every byte position.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+
+#define N_TESTS 2000
+#define MAX_GLYPHS 24
+#define WIDTH 160
+#define HEIGHT 40
+
+static pixman_image_t *
+make_image (pixman_format_code_t format, int width, int height)
+{
+    pixman_image_t *image;
+
+    image = pixman_image_create_bits (format, width, height, NULL, 0);
+    prng_randmemset (pixman_image_get_data (image),
+		     pixman_image_get_stride (image) * height,
+		     RANDMEMSET_MORE_00_AND_FF);
+
+    if (PIXMAN_FORMAT_RGB (format))
+	pixman_image_set_component_alpha (image, TRUE);
+
+    return image;
+}
+
+static int
+test_glyphs (int testnum)
+{
+    static const pixman_color_t white = { 0xffff, 0xffff, 0xffff, 0xffff };
+    pixman_format_code_t format =
+	prng_rand_n (2) ? PIXMAN_a8 : PIXMAN_a8r8g8b8;
+    pixman_glyph_cache_t *cache = pixman_glyph_cache_create ();
+    pixman_image_t *images[MAX_GLYPHS];
+    pixman_glyph_t glyphs[MAX_GLYPHS];
+    pixman_image_t *src, *dest, *mask;
+    int n_glyphs = prng_rand_n (MAX_GLYPHS) + 1;
+    int max_width = format == PIXMAN_a8 ? 80 : 20;
+    int i, ok;
+
+    src = pixman_image_create_solid_fill (&white);
+    dest = pixman_image_create_bits (format, WIDTH, HEIGHT, NULL, 0);
+    mask = pixman_image_create_bits (format, WIDTH, HEIGHT, NULL, 0);
+
+    pixman_glyph_cache_freeze (cache);
+
+    for (i = 0; i < n_glyphs; ++i)
+    {
+	pixman_format_code_t glyph_format = format;
+	int w = prng_rand_n (max_width) + 1;
+	int h = prng_rand_n (HEIGHT / 2) + 1;
+
+	/* Some glyphs that can't be blitted in between the others. Only
+	 * for a8, since a4 glyphs are added to an a8r8g8b8 mask as white.
+	 */
+	if (format == PIXMAN_a8 && prng_rand_n (8) == 0)
+	    glyph_format = PIXMAN_a4;
+
+	images[i] = make_image (glyph_format, w, h);
+	glyphs[i].glyph = pixman_glyph_cache_insert (
+	    cache, NULL, images[i], 0, 0, images[i]);
+	glyphs[i].x = prng_rand_n (WIDTH + 16) - 16;
+	glyphs[i].y = prng_rand_n (HEIGHT + 8) - 8;
+
+	pixman_image_composite32 (
+	    PIXMAN_OP_ADD, images[i], NULL, mask, 0, 0, 0, 0,
+	    glyphs[i].x, glyphs[i].y, w, h);
+    }
+
+    /* SRC always uses a mask, and with a white source the result is
+     * the mask itself.
+     */
+    pixman_composite_glyphs (PIXMAN_OP_SRC, src, dest, format,
+			     0, 0, 0, 0, 0, 0, WIDTH, HEIGHT,
+			     cache, n_glyphs, glyphs);
+
+    ok = compute_crc32_for_image (0, dest) == compute_crc32_for_image (0, mask);
+    if (!ok)
+    {
+	printf ("Test %d: %d glyphs of format %08x differ\n",
+		testnum, n_glyphs, format);
+    }
+
+    pixman_glyph_cache_thaw (cache);
+
+    for (i = 0; i < n_glyphs; ++i)
+	pixman_image_unref (images[i]);
+
+    pixman_image_unref (src);
+    pixman_image_unref (dest);
+    pixman_image_unref (mask);
+    pixman_glyph_cache_destroy (cache);
+
+    return ok;
+}
+
+int
+main (int argc, const char *argv[])
+{
+    int i;
+
+    prng_srand (0);
+
+    for (i = 0; i < N_TESTS; ++i)
+    {
+	if (!test_glyphs (i))
+	    return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,204 @@
+/*
+ * Check that the glyph cache makes glyphs shifted by a fraction of a
+ * pixel correctly, and that they are reused and freed with the glyph.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+
+#define N_GLYPHS 40
+
+static pixman_image_t *white;
+
+static pixman_image_t *
+make_glyph_image (pixman_format_code_t format)
+{
+    int width = prng_rand_n (prng_rand_n (4) ? 20 : 150) + 1;
+    int height = prng_rand_n (20) + 1;
+    pixman_image_t *image;
+
+    image = pixman_image_create_bits (format, width, height, NULL, 0);
+    prng_randmemset (pixman_image_get_data (image),
+		     pixman_image_get_stride (image) * height,
+		     RANDMEMSET_MORE_00_AND_FF);
+
+    if (PIXMAN_FORMAT_RGB (format))
+	pixman_image_set_component_alpha (image, TRUE);
+
+    return image;
+}
+
+/* The value of byte @i in row @y of @image, or 0 outside of it */
+static int
+get_byte (pixman_image_t *image, int i, int y)
+{
+    int Bpp = PIXMAN_FORMAT_BPP (pixman_image_get_format (image)) / 8;
+    uint8_t *row = (uint8_t *)pixman_image_get_data (image) +
+	y * pixman_image_get_stride (image);
+
+    if (i < 0 || i >= pixman_image_get_width (image) * Bpp)
+	return 0;
+
+    return row[i];
+}
+
+/* Checks the shifted glyph by compositing it into a destination of the
+ * same format with the glyph as the mask.
+ */
+static int
+check_variant (pixman_glyph_cache_t *cache, pixman_image_t *image,
+	       const void *variant, int phase, int n_phases)
+{
+    pixman_format_code_t format = pixman_image_get_format (image);
+    int Bpp = PIXMAN_FORMAT_BPP (format) / 8;
+    int width = pixman_image_get_width (image);
+    int height = pixman_image_get_height (image);
+    int w = phase * 256 / n_phases;
+    pixman_image_t *dest;
+    pixman_glyph_t g;
+    int i, y;
+    int ok = 1;
+
+    dest = pixman_image_create_bits (format, width + 2, height, NULL, 0);
+
+    g.x = 0;
+    g.y = 0;
+    g.glyph = variant;
+
+    pixman_composite_glyphs_no_mask (PIXMAN_OP_SRC, white, dest,
+				     0, 0, 0, 0, cache, 1, &g);
+
+    for (y = 0; y < height && ok; ++y)
+    {
+	for (i = 0; i < (width + 2) * Bpp; ++i)
+	{
+	    int expected = (get_byte (image, i, y) * (256 - w) +
+			    get_byte (image, i - Bpp, y) * w + 128) >> 8;
+
+	    if (get_byte (dest, i, y) != expected)
+	    {
+		printf ("Phase %d/%d, format %08x: byte %d of row %d is %d, not %d\n",
+			phase, n_phases, format, i, y, get_byte (dest, i, y), expected);
+		ok = 0;
+		break;
+	    }
+	}
+    }
+
+    pixman_image_unref (dest);
+
+    return ok;
+}
+
+static int
+test_cache (pixman_glyph_cache_t *cache)
+{
+    static const pixman_format_code_t formats[] =
+    {
+	PIXMAN_a8, PIXMAN_a8r8g8b8, PIXMAN_a4,
+    };
+    pixman_image_t *images[N_GLYPHS];
+    pixman_glyph_cache_stats_t stats;
+    int i, n, phase;
+
+    pixman_glyph_cache_freeze (cache);
+
+    if (pixman_glyph_cache_lookup_subpixel (cache, NULL, (void *)1, 1, 4))
+    {
+	printf ("Found a variant of a glyph that is not in the cache\n");
+	return 0;
+    }
+
+    for (i = 0; i < N_GLYPHS; ++i)
+    {
+	images[i] = make_glyph_image (formats[i % ARRAY_LENGTH (formats)]);
+	pixman_glyph_cache_insert (cache, NULL, images[i], 0, 0, images[i]);
+    }
+
+    for (i = 0; i < N_GLYPHS; ++i)
+    {
+	const void *glyph = pixman_glyph_cache_lookup (cache, NULL, images[i]);
+	pixman_format_code_t format = pixman_image_get_format (images[i]);
+
+	for (n = 1; n <= 16; n *= 2)
+	{
+	    for (phase = 0; phase < n; ++phase)
+	    {
+		const void *v1, *v2;
+
+		v1 = pixman_glyph_cache_lookup_subpixel (
+		    cache, NULL, images[i], phase, n);
+		v2 = pixman_glyph_cache_lookup_subpixel (
+		    cache, NULL, images[i], phase * 2, n * 2 > 16 ? 16 : n * 2);
+
+		if (n <= 8 && v1 != v2)
+		{
+		    printf ("Phase %d/%d and %d/%d are different glyphs\n",
+			    phase, n, phase * 2, n * 2);
+		    return 0;
+		}
+
+		if (format == PIXMAN_a4 || phase == 0)
+		{
+		    if (v1 != glyph)
+		    {
+			printf ("Glyph was shifted by %d/%d\n", phase, n);
+			return 0;
+		    }
+		}
+		else if (!check_variant (cache, images[i], v1, phase, n))
+		{
+		    return 0;
+		}
+	    }
+	}
+    }
+
+    pixman_glyph_cache_thaw (cache);
+
+    for (i = 0; i < N_GLYPHS; ++i)
+    {
+	pixman_glyph_cache_remove (cache, NULL, images[i]);
+	pixman_image_unref (images[i]);
+    }
+
+    pixman_glyph_cache_freeze (cache);
+    pixman_glyph_cache_thaw (cache);
+
+    pixman_glyph_cache_get_stats (cache, &stats);
+    if (stats.n_glyphs != 0 || stats.n_bytes != 0)
+    {
+	printf ("%d glyphs and %llu bytes left\n",
+		stats.n_glyphs, (unsigned long long)stats.n_bytes);
+	return 0;
+    }
+
+    return 1;
+}
+
+int
+main (int argc, const char *argv[])
+{
+    static const pixman_color_t color = { 0xffff, 0xffff, 0xffff, 0xffff };
+    pixman_glyph_cache_t *cache;
+    int ret = 0;
+
+    prng_srand (0);
+
+    white = pixman_image_create_solid_fill (&color);
+
+    cache = pixman_glyph_cache_create ();
+    if (!test_cache (cache))
+	ret = 1;
+    pixman_glyph_cache_destroy (cache);
+
+    cache = pixman_glyph_cache_create_shared (0, 0);
+    if (!test_cache (cache))
+	ret = 1;
+    pixman_glyph_cache_destroy (cache);
+
+    pixman_image_unref (white);
+
+    return ret;
+}
@@ -0,0 +1,162 @@
+/*
+ * Check that compositing with worker threads produces exactly the
+ * same results as compositing on the calling thread only.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+
+#define WIDTH 517
+#define HEIGHT 391
+#define N_ROUNDS 100
+
+static const pixman_op_t operators[] =
+{
+    PIXMAN_OP_SRC,
+    PIXMAN_OP_OVER,
+    PIXMAN_OP_ADD,
+    PIXMAN_OP_IN,
+    PIXMAN_OP_ATOP,
+    PIXMAN_OP_MULTIPLY,
+};
+
+static const pixman_format_code_t formats[] =
+{
+    PIXMAN_a8r8g8b8,
+    PIXMAN_x8r8g8b8,
+    PIXMAN_r5g6b5,
+    PIXMAN_a8,
+};
+
+#define RAND_ELT(arr)							\
+    arr[prng_rand_n (ARRAY_LENGTH (arr))]
+
+static void
+destroy (pixman_image_t *image, void *data)
+{
+    free (data);
+}
+
+static pixman_image_t *
+make_bits_image (pixman_format_code_t format, int width, int height)
+{
+    pixman_image_t *image;
+    uint32_t *bits;
+    int stride;
+
+    stride = width * PIXMAN_FORMAT_BPP (format) / 8;
+    stride = (stride + 3) & ~3;
+
+    bits = malloc (stride * height);
+    prng_randmemset (bits, stride * height, RANDMEMSET_MORE_00_AND_FF);
+
+    image = pixman_image_create_bits (format, width, height, bits, stride);
+    pixman_image_set_destroy_function (image, destroy, bits);
+
+    return image;
+}
+
+static pixman_image_t *
+make_source (void)
+{
+    static const pixman_gradient_stop_t stops[] =
+    {
+	{ pixman_int_to_fixed (0), { 0xffff, 0x0000, 0x0000, 0xffff } },
+	{ pixman_double_to_fixed (0.4), { 0x0000, 0xffff, 0x8000, 0x8000 } },
+	{ pixman_int_to_fixed (1), { 0x2000, 0x4000, 0xffff, 0x0000 } },
+    };
+    pixman_point_fixed_t p1 = { pixman_int_to_fixed (10), pixman_int_to_fixed (20) };
+    pixman_point_fixed_t p2 = { pixman_int_to_fixed (300), pixman_int_to_fixed (350) };
+    pixman_image_t *image;
+    pixman_transform_t transform;
+
+    switch (prng_rand_n (4))
+    {
+    case 0:
+	return pixman_image_create_linear_gradient (
+	    &p1, &p2, stops, ARRAY_LENGTH (stops));
+
+    case 1:
+	return pixman_image_create_radial_gradient (
+	    &p1, &p2, pixman_int_to_fixed (30), pixman_int_to_fixed (250),
+	    stops, ARRAY_LENGTH (stops));
+
+    case 2:
+	image = make_bits_image (RAND_ELT (formats), 200, 150);
+
+	pixman_transform_init_rotate (
+	    &transform, pixman_double_to_fixed (0.8), pixman_double_to_fixed (0.6));
+	pixman_transform_scale (
+	    &transform, NULL, pixman_double_to_fixed (0.5), pixman_double_to_fixed (0.7));
+	pixman_image_set_transform (image, &transform);
+	pixman_image_set_filter (image, PIXMAN_FILTER_BILINEAR, NULL, 0);
+	pixman_image_set_repeat (image, prng_rand_n (4));
+	return image;
+
+    default:
+	return make_bits_image (RAND_ELT (formats), WIDTH, HEIGHT);
+    }
+}
+
+static uint32_t
+composite (pixman_op_t op, pixman_image_t *src, pixman_image_t *mask,
+	   pixman_image_t *dest, const uint32_t *dest_bits, int dest_size,
+	   int x, int y, int w, int h, int n_threads)
+{
+    memcpy (pixman_image_get_data (dest), dest_bits, dest_size);
+
+    pixman_set_num_threads (n_threads);
+    pixman_image_composite32 (op, src, mask, dest,
+			      x / 2, y / 3, x, y, x, y, w, h);
+    pixman_set_num_threads (1);
+
+    return compute_crc32_for_image (0, dest);
+}
+
+int
+main (int argc, const char *argv[])
+{
+    int i;
+
+    prng_srand (0);
+
+    for (i = 0; i < N_ROUNDS; ++i)
+    {
+	pixman_op_t op = RAND_ELT (operators);
+	pixman_image_t *src = make_source ();
+	pixman_image_t *mask = NULL;
+	pixman_image_t *dest = make_bits_image (RAND_ELT (formats), WIDTH, HEIGHT);
+	int dest_size = pixman_image_get_stride (dest) * HEIGHT;
+	uint32_t *dest_bits = malloc (dest_size);
+	int x = prng_rand_n (WIDTH / 4);
+	int y = prng_rand_n (HEIGHT / 4);
+	int w = prng_rand_n (WIDTH);
+	int h = prng_rand_n (HEIGHT);
+	uint32_t crc1, crc2;
+
+	if (prng_rand_n (2))
+	    mask = make_bits_image (PIXMAN_a8, WIDTH, HEIGHT);
+
+	memcpy (dest_bits, pixman_image_get_data (dest), dest_size);
+
+	crc1 = composite (op, src, mask, dest, dest_bits, dest_size, x, y, w, h, 1);
+	crc2 = composite (op, src, mask, dest, dest_bits, dest_size, x, y, w, h,
+			  2 + prng_rand_n (7));
+
+	if (crc1 != crc2)
+	{
+	    printf ("Round %d: threaded result differs (%08x != %08x)\n",
+		    i, crc1, crc2);
+	    return 1;
+	}
+
+	pixman_image_unref (src);
+	if (mask)
+	    pixman_image_unref (mask);
+	pixman_image_unref (dest);
+	free (dest_bits);
+    }
+
+    return 0;
+}
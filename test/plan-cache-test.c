@@ -0,0 +1,243 @@
+/*
+ * Check that compositing with the same arguments over and over gives the
+ * same results as compositing into a fresh destination, also when image
+ * properties are changed between the calls, and after calls with
+ * arguments that are never repeated have made pixman store fewer plans.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+
+#define WIDTH 96
+#define HEIGHT 80
+#define N_ROUNDS 300
+#define N_STEPS 60
+#define N_CALLS 4
+#define N_UNIQUE_CALLS 400
+
+static const pixman_op_t operators[] =
+{
+    PIXMAN_OP_SRC,
+    PIXMAN_OP_OVER,
+    PIXMAN_OP_ADD,
+    PIXMAN_OP_IN_REVERSE,
+};
+
+static const pixman_format_code_t formats[] =
+{
+    PIXMAN_a8r8g8b8,
+    PIXMAN_x8r8g8b8,
+    PIXMAN_r5g6b5,
+    PIXMAN_a8,
+};
+
+#define RAND_ELT(arr)							\
+    arr[prng_rand_n (ARRAY_LENGTH (arr))]
+
+typedef struct
+{
+    int src_x, src_y, mask_x, mask_y, dest_x, dest_y, width, height;
+} call_t;
+
+static void
+destroy (pixman_image_t *image, void *data)
+{
+    free (data);
+}
+
+static pixman_image_t *
+make_image (pixman_format_code_t format, int width, int height)
+{
+    pixman_image_t *image;
+    uint32_t *bits;
+    int stride;
+
+    stride = width * PIXMAN_FORMAT_BPP (format) / 8;
+    stride = (stride + 3) & ~3;
+
+    bits = malloc (stride * height);
+    prng_randmemset (bits, stride * height, RANDMEMSET_MORE_00_AND_FF);
+
+    image = pixman_image_create_bits (format, width, height, bits, stride);
+    pixman_image_set_destroy_function (image, destroy, bits);
+
+    return image;
+}
+
+static void
+change_property (pixman_image_t *image, pixman_region32_t *clip)
+{
+    pixman_transform_t transform;
+
+    switch (prng_rand_n (7))
+    {
+    case 0:
+	pixman_image_set_repeat (image, prng_rand_n (4));
+	break;
+
+    case 1:
+	pixman_transform_init_translate (
+	    &transform,
+	    pixman_int_to_fixed (prng_rand_n (9) - 4),
+	    pixman_int_to_fixed (prng_rand_n (9) - 4));
+	pixman_image_set_transform (image, &transform);
+	break;
+
+    case 2:
+	pixman_image_set_transform (image, NULL);
+	break;
+
+    case 3:
+	pixman_image_set_filter (
+	    image, prng_rand_n (2)? PIXMAN_FILTER_BILINEAR : PIXMAN_FILTER_NEAREST,
+	    NULL, 0);
+	break;
+
+    case 4:
+	pixman_region32_fini (clip);
+	pixman_region32_init_rect (clip,
+				   prng_rand_n (WIDTH / 2), prng_rand_n (HEIGHT / 2),
+				   prng_rand_n (WIDTH), prng_rand_n (HEIGHT));
+	if (prng_rand_n (2))
+	{
+	    pixman_region32_t other;
+
+	    pixman_region32_init_rect (&other, 0, HEIGHT / 2, WIDTH / 3, HEIGHT);
+	    pixman_region32_union (clip, clip, &other);
+	    pixman_region32_fini (&other);
+	}
+	pixman_image_set_clip_region32 (image, clip);
+	break;
+
+    case 5:
+	pixman_image_set_has_client_clip (image, prng_rand_n (2));
+	break;
+
+    case 6:
+	pixman_image_set_source_clipping (image, prng_rand_n (2));
+	break;
+    }
+}
+
+int
+main (int argc, const char *argv[])
+{
+    pixman_region32_t src_clip, mask_clip, dest_clip;
+    call_t calls[N_CALLS];
+    int i, j;
+
+    prng_srand (0);
+
+    pixman_region32_init (&src_clip);
+    pixman_region32_init (&mask_clip);
+    pixman_region32_init (&dest_clip);
+
+    for (i = 0; i < N_ROUNDS; ++i)
+    {
+	pixman_op_t op = RAND_ELT (operators);
+	pixman_image_t *src = make_image (RAND_ELT (formats), WIDTH, HEIGHT);
+	pixman_image_t *mask = NULL;
+	pixman_image_t *dest = make_image (RAND_ELT (formats), WIDTH, HEIGHT);
+	pixman_bool_t dest_clipped = FALSE;
+	int stride = pixman_image_get_stride (dest);
+
+	if (prng_rand_n (2))
+	    mask = make_image (PIXMAN_a8, WIDTH, HEIGHT);
+
+	pixman_image_set_source_clipping (src, TRUE);
+
+	for (j = 0; j < N_CALLS; ++j)
+	{
+	    call_t *c = &calls[j];
+
+	    c->src_x = prng_rand_n (WIDTH) - WIDTH / 4;
+	    c->src_y = prng_rand_n (HEIGHT) - HEIGHT / 4;
+	    c->mask_x = prng_rand_n (2)? c->src_x : prng_rand_n (WIDTH);
+	    c->mask_y = prng_rand_n (2)? c->src_y : prng_rand_n (HEIGHT);
+	    c->dest_x = prng_rand_n (WIDTH) - 8;
+	    c->dest_y = prng_rand_n (HEIGHT) - 8;
+	    c->width = prng_rand_n (WIDTH);
+	    c->height = prng_rand_n (HEIGHT);
+	}
+
+	if (prng_rand_n (4) == 0)
+	{
+	    for (j = 0; j < N_UNIQUE_CALLS; ++j)
+	    {
+		pixman_image_composite32 (op, src, mask, dest,
+					  j % WIDTH, j / WIDTH, 0, 0,
+					  j % WIDTH, j / WIDTH, 3, 2);
+	    }
+	}
+
+	for (j = 0; j < N_STEPS; ++j)
+	{
+	    const call_t *c = &calls[prng_rand_n (N_CALLS)];
+	    pixman_image_t *fresh;
+	    uint32_t crc1, crc2;
+
+	    switch (prng_rand_n (6))
+	    {
+	    case 0:
+		change_property (src, &src_clip);
+		break;
+
+	    case 1:
+		if (mask)
+		    change_property (mask, &mask_clip);
+		break;
+
+	    case 2:
+		pixman_region32_fini (&dest_clip);
+		pixman_region32_init_rect (&dest_clip,
+					   prng_rand_n (WIDTH / 2),
+					   prng_rand_n (HEIGHT / 2),
+					   WIDTH / 2, HEIGHT / 2);
+		pixman_image_set_clip_region32 (dest, &dest_clip);
+		dest_clipped = TRUE;
+		break;
+
+	    default:
+		break;
+	    }
+
+	    fresh = pixman_image_create_bits (
+		pixman_image_get_format (dest), WIDTH, HEIGHT, NULL, stride);
+	    memcpy (pixman_image_get_data (fresh), pixman_image_get_data (dest),
+		    stride * HEIGHT);
+	    if (dest_clipped)
+		pixman_image_set_clip_region32 (fresh, &dest_clip);
+
+	    pixman_image_composite32 (op, src, mask, dest,
+				      c->src_x, c->src_y, c->mask_x, c->mask_y,
+				      c->dest_x, c->dest_y, c->width, c->height);
+	    pixman_image_composite32 (op, src, mask, fresh,
+				      c->src_x, c->src_y, c->mask_x, c->mask_y,
+				      c->dest_x, c->dest_y, c->width, c->height);
+
+	    crc1 = compute_crc32_for_image (0, dest);
+	    crc2 = compute_crc32_for_image (0, fresh);
+
+	    pixman_image_unref (fresh);
+
+	    if (crc1 != crc2)
+	    {
+		printf ("Round %d, step %d: result differs (%08x != %08x)\n",
+			i, j, crc1, crc2);
+		return 1;
+	    }
+	}
+
+	pixman_image_unref (src);
+	if (mask)
+	    pixman_image_unref (mask);
+	pixman_image_unref (dest);
+    }
+
+    pixman_region32_fini (&src_clip);
+    pixman_region32_fini (&mask_clip);
+    pixman_region32_fini (&dest_clip);
+
+    return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * Check pixman_region32_contains_point() and
+ * pixman_region32_contains_rectangle() against a bitmap, for regions made
+ * from a1 masks with many boxes in each band, and the same for 16 bit
+ * regions.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+
+#define N_IMAGES 60
+#define N_QUERIES 2000
+#define WIDTH 1000
+#define HEIGHT 24
+
+static uint8_t bitmap[HEIGHT + 2][WIDTH + 2];
+
+/* Runs of set and clear pixels, with rows that are often the same */
+static pixman_image_t *
+random_mask (void)
+{
+    pixman_image_t *image = pixman_image_create_bits (
+	PIXMAN_a1, WIDTH, HEIGHT, NULL, 0);
+    uint32_t *bits = pixman_image_get_data (image);
+    int stride = pixman_image_get_stride (image) / 4;
+    int max_run = prng_rand_n (2) ? 3 : 40;
+    int x, y;
+
+    memset (bitmap, 0, sizeof (bitmap));
+
+    for (y = 0; y < HEIGHT; ++y)
+    {
+	if (y > 0 && prng_rand_n (2))
+	{
+	    memcpy (bitmap[y + 1], bitmap[y], sizeof (bitmap[0]));
+	}
+	else
+	{
+	    int set = prng_rand_n (2);
+
+	    x = 0;
+	    while (x < WIDTH)
+	    {
+		int run = prng_rand_n (max_run) + 1;
+
+		while (run-- && x < WIDTH)
+		    bitmap[y + 1][1 + x++] = set;
+
+		set = !set;
+	    }
+	}
+
+	for (x = 0; x < WIDTH; ++x)
+	{
+	    if (bitmap[y + 1][x + 1])
+		bits[y * stride + x / 32] |= 1U << (is_little_endian () ? x % 32 : 31 - x % 32);
+	}
+    }
+
+    return image;
+}
+
+/* The bitmap has a clear border, one pixel wide */
+static int
+is_set (int x, int y)
+{
+    if (x < -1 || x > WIDTH || y < -1 || y > HEIGHT)
+	return 0;
+
+    return bitmap[y + 1][x + 1];
+}
+
+static pixman_region_overlap_t
+expected_overlap (pixman_box32_t *rect)
+{
+    int n_in = 0, n_out = 0;
+    int x, y;
+
+    for (y = rect->y1; y < rect->y2; ++y)
+    {
+	for (x = rect->x1; x < rect->x2; ++x)
+	{
+	    if (is_set (x, y))
+		n_in++;
+	    else
+		n_out++;
+	}
+    }
+
+    if (!n_in)
+	return PIXMAN_REGION_OUT;
+
+    return n_out ? PIXMAN_REGION_PART : PIXMAN_REGION_IN;
+}
+
+static int
+check_point (pixman_region32_t *region, pixman_region16_t *region16, int x, int y)
+{
+    pixman_box32_t box = { 0, 0, 0, 0 };
+    pixman_box16_t box16 = { 0, 0, 0, 0 };
+    int expected = is_set (x, y);
+    int in, in16;
+
+    in = pixman_region32_contains_point (region, x, y, &box);
+    in16 = pixman_region_contains_point (region16, x, y, &box16);
+
+    if (in != expected || in16 != expected)
+    {
+	printf ("point %d, %d is %d/%d, expected %d\n", x, y, in, in16, expected);
+	return FALSE;
+    }
+
+    if (in && (x < box.x1 || x >= box.x2 || y < box.y1 || y >= box.y2 ||
+	       box.x1 != box16.x1 || box.y1 != box16.y1 ||
+	       box.x2 != box16.x2 || box.y2 != box16.y2))
+    {
+	printf ("point %d, %d is not in the box it was found in\n", x, y);
+	return FALSE;
+    }
+
+    return TRUE;
+}
+
+static int
+check_rectangle (pixman_region32_t *region, pixman_region16_t *region16,
+		 pixman_box32_t *rect)
+{
+    pixman_box16_t rect16;
+    pixman_region_overlap_t expected = expected_overlap (rect);
+    pixman_region_overlap_t overlap, overlap16;
+
+    rect16.x1 = rect->x1;
+    rect16.y1 = rect->y1;
+    rect16.x2 = rect->x2;
+    rect16.y2 = rect->y2;
+
+    overlap = pixman_region32_contains_rectangle (region, rect);
+    overlap16 = pixman_region_contains_rectangle (region16, &rect16);
+
+    if (overlap != expected || overlap16 != expected)
+    {
+	printf ("rectangle %d, %d, %d, %d is %d/%d, expected %d\n",
+		rect->x1, rect->y1, rect->x2, rect->y2,
+		overlap, overlap16, expected);
+	return FALSE;
+    }
+
+    return TRUE;
+}
+
+int
+main (int argc, const char *argv[])
+{
+    int i, j;
+
+    prng_srand (0);
+
+    for (i = 0; i < N_IMAGES; ++i)
+    {
+	pixman_image_t *mask = random_mask ();
+	pixman_region32_t region;
+	pixman_region16_t region16;
+	int ok = TRUE;
+
+	pixman_region32_init_from_image (&region, mask);
+	pixman_region_init_from_image (&region16, mask);
+
+	for (j = 0; j < N_QUERIES && ok; ++j)
+	{
+	    pixman_box32_t rect;
+
+	    rect.x1 = prng_rand_n (WIDTH + 2) - 1;
+	    rect.y1 = prng_rand_n (HEIGHT + 2) - 1;
+
+	    ok = check_point (&region, &region16, rect.x1, rect.y1);
+
+	    /* Mostly small rectangles, some as wide as a band */
+	    if (prng_rand_n (4))
+	    {
+		rect.x2 = rect.x1 + prng_rand_n (8) + 1;
+		rect.y2 = rect.y1 + prng_rand_n (4) + 1;
+	    }
+	    else
+	    {
+		rect.x1 = prng_rand_n (20) - 10;
+		rect.x2 = WIDTH - prng_rand_n (20) + 10;
+		rect.y2 = rect.y1 + prng_rand_n (HEIGHT) + 1;
+	    }
+
+	    ok = ok && check_rectangle (&region, &region16, &rect);
+	}
+
+	pixman_region32_fini (&region);
+	pixman_region_fini (&region16);
+	pixman_image_unref (mask);
+
+	if (!ok)
+	{
+	    printf ("Image %d failed\n", i);
+	    return 1;
+	}
+    }
+
+    return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * Check pixman_region32_init_from_image() and
+ * pixman_region32_init_from_image_threshold() against the runs of a
+ * bitmap, for a1 masks with garbage after the end of each line and for
+ * a8 masks with random thresholds, with widths that are not multiples
+ * of 32 and rows that are often the same as the previous one, and the
+ * same for 16 bit regions.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+
+#define N_TESTS 2000
+#define MAX_WIDTH 300
+#define MAX_HEIGHT 40
+
+static uint8_t bitmap[MAX_HEIGHT][MAX_WIDTH];
+
+/* Runs of set and clear pixels, often with long runs and repeated rows */
+static void
+random_bitmap (int width, int height)
+{
+    int max_run = prng_rand_n (2) ? 3 : 80;
+    int x, y;
+
+    for (y = 0; y < height; ++y)
+    {
+	if (y > 0 && prng_rand_n (2))
+	{
+	    memcpy (bitmap[y], bitmap[y - 1], width);
+	}
+	else if (prng_rand_n (8) == 0)
+	{
+	    memset (bitmap[y], prng_rand_n (2), width);
+	}
+	else
+	{
+	    int set = prng_rand_n (2);
+
+	    x = 0;
+	    while (x < width)
+	    {
+		int run = prng_rand_n (max_run) + 1;
+
+		while (run-- && x < width)
+		    bitmap[y][x++] = set;
+
+		set = !set;
+	    }
+	}
+    }
+}
+
+/* The set pixels of the bitmap are set in the a1 image, and the bits
+ * after the end of each line are random.
+ */
+static pixman_image_t *
+a1_from_bitmap (int width, int height)
+{
+    pixman_image_t *image = pixman_image_create_bits (
+	PIXMAN_a1, width, height, NULL, 0);
+    uint32_t *bits = pixman_image_get_data (image);
+    int stride = pixman_image_get_stride (image) / 4;
+    int x, y;
+
+    for (y = 0; y < height; ++y)
+    {
+	for (x = 0; x < stride * 32; ++x)
+	{
+	    if (x < width ? bitmap[y][x] : prng_rand_n (2))
+		bits[y * stride + x / 32] |= 1U << (is_little_endian () ? x % 32 : 31 - x % 32);
+	}
+    }
+
+    return image;
+}
+
+/* Set pixels are above the threshold, clear ones are not */
+static pixman_image_t *
+a8_from_bitmap (int width, int height, uint8_t threshold)
+{
+    pixman_image_t *image = pixman_image_create_bits (
+	PIXMAN_a8, width, height, NULL, 0);
+    uint8_t *bits = (uint8_t *)pixman_image_get_data (image);
+    int stride = pixman_image_get_stride (image);
+    int x, y;
+
+    for (y = 0; y < height; ++y)
+    {
+	for (x = 0; x < width; ++x)
+	{
+	    if (bitmap[y][x])
+		bits[y * stride + x] = threshold + 1 + prng_rand_n (255 - threshold);
+	    else
+		bits[y * stride + x] = prng_rand_n (threshold + 1);
+	}
+    }
+
+    return image;
+}
+
+/* One box per run, which init_rects() puts into the canonical form */
+static void
+expected_region (pixman_region32_t *region, int width, int height)
+{
+    static pixman_box32_t boxes[MAX_HEIGHT * MAX_WIDTH];
+    int n = 0, x, y;
+
+    for (y = 0; y < height; ++y)
+    {
+	for (x = 0; x < width; ++x)
+	{
+	    if (bitmap[y][x] && (x == 0 || !bitmap[y][x - 1]))
+	    {
+		boxes[n].x1 = x;
+		boxes[n].y1 = y;
+		boxes[n].y2 = y + 1;
+		n++;
+	    }
+
+	    if (bitmap[y][x] && (x == width - 1 || !bitmap[y][x + 1]))
+		boxes[n - 1].x2 = x + 1;
+	}
+    }
+
+    pixman_region32_init_rects (region, boxes, n);
+}
+
+static int
+same_region (pixman_region32_t *region, pixman_region16_t *region16,
+	     pixman_region32_t *expected)
+{
+    pixman_box32_t *boxes, *e;
+    pixman_box16_t *boxes16;
+    int n, n16, n_expected, i;
+
+    boxes = pixman_region32_rectangles (region, &n);
+    boxes16 = pixman_region_rectangles (region16, &n16);
+    e = pixman_region32_rectangles (expected, &n_expected);
+
+    if (n != n_expected || n16 != n_expected ||
+	!pixman_region32_selfcheck (region) ||
+	!pixman_region_selfcheck (region16))
+    {
+	return FALSE;
+    }
+
+    for (i = 0; i < n; ++i)
+    {
+	if (boxes[i].x1 != e[i].x1 || boxes[i].y1 != e[i].y1 ||
+	    boxes[i].x2 != e[i].x2 || boxes[i].y2 != e[i].y2 ||
+	    boxes16[i].x1 != e[i].x1 || boxes16[i].y1 != e[i].y1 ||
+	    boxes16[i].x2 != e[i].x2 || boxes16[i].y2 != e[i].y2)
+	{
+	    return FALSE;
+	}
+    }
+
+    return pixman_region32_equal (region, expected);
+}
+
+static int
+test_from_image (int testnum)
+{
+    int width = prng_rand_n (4) ? prng_rand_n (MAX_WIDTH) + 1 : (prng_rand_n (8) + 1) * 32;
+    int height = prng_rand_n (MAX_HEIGHT) + 1;
+    int a8 = prng_rand_n (2);
+    uint8_t threshold = prng_rand_n (2) ? 0 : prng_rand_n (255);
+    pixman_region32_t region, expected;
+    pixman_region16_t region16;
+    pixman_image_t *image;
+    int ok;
+
+    random_bitmap (width, height);
+
+    if (a8)
+    {
+	image = a8_from_bitmap (width, height, threshold);
+	pixman_region32_init_from_image_threshold (&region, image, threshold);
+	pixman_region_init_from_image_threshold (&region16, image, threshold);
+    }
+    else
+    {
+	image = a1_from_bitmap (width, height);
+	pixman_region32_init_from_image (&region, image);
+	pixman_region_init_from_image (&region16, image);
+    }
+
+    expected_region (&expected, width, height);
+
+    ok = same_region (&region, &region16, &expected);
+    if (!ok)
+    {
+	printf ("Test %d: %s image of %d x %d with threshold %d differs\n",
+		testnum, a8 ? "a8" : "a1", width, height, threshold);
+    }
+
+    pixman_region32_fini (&region);
+    pixman_region32_fini (&expected);
+    pixman_region_fini (&region16);
+    pixman_image_unref (image);
+
+    return ok;
+}
+
+int
+main (int argc, const char *argv[])
+{
+    int i;
+
+    prng_srand (0);
+
+    for (i = 0; i < N_TESTS; ++i)
+    {
+	if (!test_from_image (i))
+	    return 1;
+    }
+
+    return 0;
+}
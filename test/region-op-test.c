@@ -0,0 +1,331 @@
+/*
+ * Check union, intersection and subtraction of random regions against
+ * a bitmap, that the results are well formed and fully coalesced, and
+ * that 16 bit regions give the same results.
+ * The regions are made of comb-like bands with many boxes, often with
+ * the same teeth in several bands, and are often apart or touching in y.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+
+#define N_TESTS 3000
+#define SIZE 160
+#define MAX_RECTS 200
+
+typedef uint8_t bitmap_t[SIZE][SIZE];
+
+/* There are few different combs, so that bands in different regions
+ * often have the same teeth.
+ */
+static void
+random_comb (pixman_box32_t *boxes, int *n, int y1, int y2)
+{
+    static const int n_teeth[] = { 1, 5, 9, 30 };
+    int teeth = n_teeth[prng_rand_n (ARRAY_LENGTH (n_teeth))];
+    int width = prng_rand_n (2) + 1;
+    int gap = prng_rand_n (2) + 1;
+    int x = prng_rand_n (2);
+    int i;
+
+    for (i = 0; i < teeth && x + width <= SIZE && *n < MAX_RECTS; ++i)
+    {
+	boxes[*n].x1 = x;
+	boxes[*n].x2 = x + width;
+	boxes[*n].y1 = y1;
+	boxes[*n].y2 = y2;
+	(*n)++;
+
+	x += width + gap;
+    }
+}
+
+static void
+random_region (pixman_region32_t *region, bitmap_t bitmap, int y1, int y2)
+{
+    pixman_box32_t boxes[MAX_RECTS];
+    int n = 0, i, x, y;
+
+    while (y1 < y2 && n < MAX_RECTS)
+    {
+	int h = prng_rand_n (6) + 1;
+	int k, repeat = prng_rand_n (3) + 1;
+
+	/* The same comb several times, so that bands can be coalesced,
+	 * or other boxes
+	 */
+	if (prng_rand_n (4))
+	{
+	    int first = n, n_teeth;
+
+	    random_comb (boxes, &n, y1, MIN (y1 + h, y2));
+	    n_teeth = n - first;
+	    y1 += h;
+
+	    for (k = 1; k < repeat && y1 < y2 && n + n_teeth <= MAX_RECTS; ++k)
+	    {
+		for (i = 0; i < n_teeth; ++i)
+		{
+		    boxes[n] = boxes[first + i];
+		    boxes[n].y1 = y1;
+		    boxes[n].y2 = MIN (y1 + h, y2);
+		    n++;
+		}
+		y1 += h;
+	    }
+	}
+	else
+	{
+	    boxes[n].x1 = prng_rand_n (SIZE);
+	    boxes[n].x2 = boxes[n].x1 + prng_rand_n (SIZE - boxes[n].x1) + 1;
+	    boxes[n].y1 = y1;
+	    boxes[n].y2 = MIN (y1 + h, y2);
+	    n++;
+	    y1 += h;
+	}
+
+	if (prng_rand_n (4) == 0)
+	    y1 += prng_rand_n (10);
+    }
+
+    pixman_region32_init_rects (region, boxes, n);
+
+    memset (bitmap, 0, sizeof (bitmap_t));
+    for (i = 0; i < n; ++i)
+    {
+	for (y = boxes[i].y1; y < boxes[i].y2; ++y)
+	{
+	    for (x = boxes[i].x1; x < boxes[i].x2; ++x)
+		bitmap[y][x] = 1;
+	}
+    }
+}
+
+/* Checks that the boxes are in bands that are sorted, don't overlap,
+ * and can't be coalesced, and that they cover exactly the bitmap.
+ */
+static int
+check_region (pixman_region32_t *region, bitmap_t expected)
+{
+    static bitmap_t bitmap;
+    pixman_box32_t *boxes, *band = NULL, *prev_band = NULL;
+    int n_prev = 0, n_band = 0;
+    int n, i, x, y;
+
+    boxes = pixman_region32_rectangles (region, &n);
+
+    memset (bitmap, 0, sizeof (bitmap));
+
+    for (i = 0; i <= n; ++i)
+    {
+	const pixman_box32_t *b = &boxes[i];
+
+	if (i == n || !band || b->y1 != band->y1)
+	{
+	    /* A band ended */
+	    if (band && prev_band && prev_band->y2 == band->y1 &&
+		n_prev == n_band)
+	    {
+		int k;
+
+		for (k = 0; k < n_band; ++k)
+		{
+		    if (prev_band[k].x1 != band[k].x1 ||
+			prev_band[k].x2 != band[k].x2)
+		    {
+			break;
+		    }
+		}
+
+		if (k == n_band)
+		{
+		    printf ("bands at %d and %d are not coalesced\n",
+			    prev_band->y1, band->y1);
+		    return FALSE;
+		}
+	    }
+
+	    if (i == n)
+		break;
+
+	    if (band && b->y1 < band->y2)
+	    {
+		printf ("band at %d is not below the previous one\n", b->y1);
+		return FALSE;
+	    }
+
+	    prev_band = band;
+	    n_prev = n_band;
+	    band = &boxes[i];
+	    n_band = 0;
+	}
+	else if (b->y2 != band->y2 || b->x1 <= (b - 1)->x2)
+	{
+	    printf ("box %d is not part of its band\n", i);
+	    return FALSE;
+	}
+
+	if (b->x1 >= b->x2 || b->y1 >= b->y2)
+	{
+	    printf ("box %d is empty\n", i);
+	    return FALSE;
+	}
+
+	n_band++;
+
+	for (y = b->y1; y < b->y2; ++y)
+	{
+	    for (x = b->x1; x < b->x2; ++x)
+		bitmap[y][x] = 1;
+	}
+    }
+
+    if (memcmp (bitmap, expected, sizeof (bitmap)) != 0)
+    {
+	printf ("region covers the wrong pixels\n");
+	return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void
+region16_from_region32 (pixman_region16_t *region16, pixman_region32_t *region32)
+{
+    pixman_box16_t boxes16[MAX_RECTS];
+    pixman_box32_t *boxes;
+    int n, i;
+
+    boxes = pixman_region32_rectangles (region32, &n);
+    for (i = 0; i < n; ++i)
+    {
+	boxes16[i].x1 = boxes[i].x1;
+	boxes16[i].y1 = boxes[i].y1;
+	boxes16[i].x2 = boxes[i].x2;
+	boxes16[i].y2 = boxes[i].y2;
+    }
+
+    pixman_region_init_rects (region16, boxes16, n);
+}
+
+/* The 16 bit regions must give the same boxes */
+static int
+check_region16 (pixman_region16_t *region16, pixman_region32_t *region32)
+{
+    pixman_box32_t *boxes;
+    pixman_box16_t *boxes16;
+    int n, n16, i;
+
+    boxes = pixman_region32_rectangles (region32, &n);
+    boxes16 = pixman_region_rectangles (region16, &n16);
+
+    if (n != n16)
+    {
+	printf ("16 bit region has %d boxes instead of %d\n", n16, n);
+	return FALSE;
+    }
+
+    for (i = 0; i < n; ++i)
+    {
+	if (boxes[i].x1 != boxes16[i].x1 || boxes[i].y1 != boxes16[i].y1 ||
+	    boxes[i].x2 != boxes16[i].x2 || boxes[i].y2 != boxes16[i].y2)
+	{
+	    printf ("16 bit region differs in box %d\n", i);
+	    return FALSE;
+	}
+    }
+
+    return TRUE;
+}
+
+static int
+test_op (int testnum)
+{
+    static bitmap_t bitmap1, bitmap2, expected;
+    pixman_region32_t r1, r2, result;
+    pixman_region16_t r1_16, r2_16, result16;
+    int op = prng_rand_n (3);
+    int ok, x, y;
+
+    /* Regions that are apart in y, that touch, or that overlap */
+    switch (prng_rand_n (3))
+    {
+    case 0:
+	y = prng_rand_n (SIZE);
+	random_region (&r1, bitmap1, 0, y);
+	random_region (&r2, bitmap2, y + prng_rand_n (3), SIZE);
+	break;
+
+    case 1:
+	y = prng_rand_n (SIZE);
+	random_region (&r1, bitmap1, y, SIZE);
+	random_region (&r2, bitmap2, 0, y);
+	break;
+
+    default:
+	random_region (&r1, bitmap1, prng_rand_n (SIZE / 2), SIZE);
+	random_region (&r2, bitmap2, prng_rand_n (SIZE / 2), SIZE);
+	break;
+    }
+
+    pixman_region32_init (&result);
+    pixman_region_init (&result16);
+    region16_from_region32 (&r1_16, &r1);
+    region16_from_region32 (&r2_16, &r2);
+
+    switch (op)
+    {
+    case 0:
+	pixman_region32_union (&result, &r1, &r2);
+	pixman_region_union (&result16, &r1_16, &r2_16);
+	break;
+    case 1:
+	pixman_region32_intersect (&result, &r1, &r2);
+	pixman_region_intersect (&result16, &r1_16, &r2_16);
+	break;
+    default:
+	pixman_region32_subtract (&result, &r1, &r2);
+	pixman_region_subtract (&result16, &r1_16, &r2_16);
+	break;
+    }
+
+    for (y = 0; y < SIZE; ++y)
+    {
+	for (x = 0; x < SIZE; ++x)
+	{
+	    int a = bitmap1[y][x], b = bitmap2[y][x];
+
+	    expected[y][x] = op == 0 ? a | b : op == 1 ? a & b : a & !b;
+	}
+    }
+
+    ok = check_region (&result, expected) && check_region16 (&result16, &result);
+    if (!ok)
+	printf ("Test %d: operation %d failed\n", testnum, op);
+
+    pixman_region32_fini (&r1);
+    pixman_region32_fini (&r2);
+    pixman_region32_fini (&result);
+    pixman_region_fini (&r1_16);
+    pixman_region_fini (&r2_16);
+    pixman_region_fini (&result16);
+
+    return ok;
+}
+
+int
+main (int argc, const char *argv[])
+{
+    int i;
+
+    prng_srand (0);
+
+    for (i = 0; i < N_TESTS; ++i)
+    {
+	if (!test_op (i))
+	    return 1;
+    }
+
+    return 0;
+}
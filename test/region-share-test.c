@@ -0,0 +1,344 @@
+/*
+ * Check that shared copies of 32 bit regions put their boxes in memory
+ * that later copies share, that copies of other regions don't share,
+ * that the source of a copy is never modified, and that modifying one
+ * of the regions leaves the others alone. Random operations are applied
+ * to a set of 32 bit regions that are often shared copies of each other
+ * or clip regions of an image, and to the same set of 16 bit regions,
+ * which are never shared, and all of the regions are compared after
+ * each operation. Then a region with data that was allocated by the
+ * caller goes through the same operations, and the boxes of a region
+ * are read after it was copied and set as a clip region.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+
+#define N_REGIONS 8
+#define N_OPS 20000
+#define MAX_RECTS 20
+
+static pixman_region32_t regions[N_REGIONS];
+static pixman_region16_t regions16[N_REGIONS];
+static pixman_image_t *image;
+
+static void
+random_boxes (pixman_box32_t *boxes, pixman_box16_t *boxes16, int n)
+{
+    int i;
+
+    for (i = 0; i < n; ++i)
+    {
+	boxes[i].x1 = prng_rand_n (100);
+	boxes[i].y1 = prng_rand_n (100);
+	boxes[i].x2 = boxes[i].x1 + prng_rand_n (30) + 1;
+	boxes[i].y2 = boxes[i].y1 + prng_rand_n (30) + 1;
+
+	boxes16[i].x1 = boxes[i].x1;
+	boxes16[i].y1 = boxes[i].y1;
+	boxes16[i].x2 = boxes[i].x2;
+	boxes16[i].y2 = boxes[i].y2;
+    }
+}
+
+static void
+init_random (int i)
+{
+    pixman_box32_t boxes[MAX_RECTS];
+    pixman_box16_t boxes16[MAX_RECTS];
+    int n = prng_rand_n (MAX_RECTS) + 1;
+
+    random_boxes (boxes, boxes16, n);
+
+    pixman_region32_init_rects (&regions[i], boxes, n);
+    pixman_region_init_rects (&regions16[i], boxes16, n);
+}
+
+static int
+same_region (int i)
+{
+    pixman_box32_t *boxes;
+    pixman_box16_t *boxes16;
+    int n, n16, j;
+
+    boxes = pixman_region32_rectangles (&regions[i], &n);
+    boxes16 = pixman_region_rectangles (&regions16[i], &n16);
+
+    if (n != n16 || !pixman_region32_selfcheck (&regions[i]))
+	return FALSE;
+
+    for (j = 0; j < n; ++j)
+    {
+	if (boxes[j].x1 != boxes16[j].x1 || boxes[j].y1 != boxes16[j].y1 ||
+	    boxes[j].x2 != boxes16[j].x2 || boxes[j].y2 != boxes16[j].y2)
+	{
+	    return FALSE;
+	}
+    }
+
+    return TRUE;
+}
+
+static int
+shares_boxes (int i, int j)
+{
+    int n;
+
+    return pixman_region32_rectangles (&regions[i], &n) ==
+	pixman_region32_rectangles (&regions[j], &n);
+}
+
+/* Whether the boxes of the region are in memory that copies share */
+static int
+is_shared (int i)
+{
+    pixman_region32_data_t *data = regions[i].data;
+
+    return data && !data->size && data->numRects;
+}
+
+static int
+run_op (int testnum)
+{
+    int i = prng_rand_n (N_REGIONS);
+    int j = prng_rand_n (N_REGIONS);
+    int k = prng_rand_n (N_REGIONS);
+    int op = prng_rand_n (14);
+    pixman_region32_data_t *data = regions[j].data;
+    int shared = is_shared (j);
+    pixman_box32_t box;
+    pixman_box16_t box16;
+    int x, y;
+
+    switch (op)
+    {
+    case 0:
+    case 1:
+    case 2:
+	pixman_region32_copy_shared (&regions[i], &regions[j]);
+	pixman_region_copy (&regions16[i], &regions16[j]);
+
+	if (pixman_region32_n_rects (&regions[i]) > 1 && !is_shared (i))
+	{
+	    printf ("Op %d: shared copy of region %d isn't shared\n",
+		    testnum, j);
+	    return FALSE;
+	}
+	break;
+
+    case 10:
+	pixman_region32_copy (&regions[i], &regions[j]);
+	pixman_region_copy (&regions16[i], &regions16[j]);
+
+	if (i != j && pixman_region32_n_rects (&regions[i]) > 1 &&
+	    shares_boxes (i, j) != shared)
+	{
+	    printf ("Op %d: plain copy of region %d %s its boxes\n",
+		    testnum, j, shared ? "doesn't share" : "shares");
+	    return FALSE;
+	}
+	break;
+
+    case 11:
+	pixman_image_set_clip_region32 (image, &regions[j]);
+	break;
+
+    case 12:
+	box.x1 = box16.x1 = prng_rand_n (50);
+	box.y1 = box16.y1 = prng_rand_n (50);
+	box.x2 = box16.x2 = box.x1 + prng_rand_n (100) + 1;
+	box.y2 = box16.y2 = box.y1 + prng_rand_n (100) + 1;
+	pixman_region32_inverse (&regions[i], &regions[j], &box);
+	pixman_region_inverse (&regions16[i], &regions16[j], &box16);
+	break;
+
+    case 13:
+	pixman_region32_subtract (&regions[j], &regions[j], &regions[k]);
+	pixman_region_subtract (&regions16[j], &regions16[j], &regions16[k]);
+	break;
+
+    case 3:
+	x = prng_rand_n (20) - 10;
+	y = prng_rand_n (20) - 10;
+	pixman_region32_translate (&regions[i], x, y);
+	pixman_region_translate (&regions16[i], x, y);
+	break;
+
+    case 4:
+	pixman_region32_union (&regions[i], &regions[j], &regions[k]);
+	pixman_region_union (&regions16[i], &regions16[j], &regions16[k]);
+	break;
+
+    case 5:
+	pixman_region32_intersect (&regions[i], &regions[j], &regions[k]);
+	pixman_region_intersect (&regions16[i], &regions16[j], &regions16[k]);
+	break;
+
+    case 6:
+	pixman_region32_subtract (&regions[i], &regions[j], &regions[k]);
+	pixman_region_subtract (&regions16[i], &regions16[j], &regions16[k]);
+	break;
+
+    case 7:
+	x = prng_rand_n (100);
+	y = prng_rand_n (100);
+	pixman_region32_union_rect (&regions[i], &regions[j], x, y, 7, 5);
+	pixman_region_union_rect (&regions16[i], &regions16[j], x, y, 7, 5);
+	break;
+
+    case 8:
+	{
+	    pixman_region32_t *ptrs[2] = { &regions[j], &regions[k] };
+	    pixman_region16_t *ptrs16[2] = { &regions16[j], &regions16[k] };
+
+	    pixman_region32_union_many (&regions[i], ptrs, 2);
+	    pixman_region_union_many (&regions16[i], ptrs16, 2);
+	}
+	break;
+
+    default:
+	pixman_region32_fini (&regions[i]);
+	pixman_region_fini (&regions16[i]);
+	init_random (i);
+	break;
+    }
+
+    if ((op <= 2 || op == 10 || op == 11) && (op == 11 || i != j) &&
+	(regions[j].data != data || is_shared (j) != shared))
+    {
+	printf ("Op %d: copying region %d modified it\n", testnum, j);
+	return FALSE;
+    }
+
+    for (i = 0; i < N_REGIONS; ++i)
+    {
+	if (!same_region (i))
+	{
+	    printf ("Op %d: operation %d changed region %d\n", testnum, op, i);
+	    return FALSE;
+	}
+    }
+
+    return TRUE;
+}
+
+/* pixman must not assume anything about data it didn't allocate */
+static int
+test_caller_data (void)
+{
+    pixman_region32_t region, copy, shared;
+    pixman_region32_data_t *data;
+    pixman_box32_t *boxes;
+    int n;
+
+    boxes = pixman_region32_rectangles (&regions[0], &n);
+    if (n < 2)
+	return TRUE;
+
+    data = malloc (sizeof (pixman_region32_data_t) + (n + 3) * sizeof (pixman_box32_t));
+    data->size = n + 3;
+    data->numRects = n;
+    memcpy (data + 1, boxes, n * sizeof (pixman_box32_t));
+
+    region.extents = *pixman_region32_extents (&regions[0]);
+    region.data = data;
+
+    pixman_region32_init (&copy);
+    pixman_region32_init (&shared);
+
+    pixman_region32_copy (&copy, &region);
+    if (!pixman_region32_equal (&copy, &regions[0]) ||
+	pixman_region32_rectangles (&copy, NULL) == pixman_region32_rectangles (&region, NULL))
+    {
+	printf ("Copy of caller allocated data is wrong\n");
+	return FALSE;
+    }
+
+    pixman_region32_translate (&region, 3, 4);
+    pixman_region32_translate (&region, -3, -4);
+    pixman_region32_union (&region, &region, &regions[1]);
+    pixman_region32_union (&copy, &copy, &regions[1]);
+
+    pixman_region32_copy_shared (&shared, &region);
+    pixman_image_set_clip_region32 (image, &shared);
+
+    if (!pixman_region32_equal (&region, &copy) ||
+	!pixman_region32_equal (&shared, &copy))
+    {
+	printf ("Operations on caller allocated data are wrong\n");
+	return FALSE;
+    }
+
+    pixman_region32_fini (&region);
+    pixman_region32_fini (&copy);
+    pixman_region32_fini (&shared);
+
+    return TRUE;
+}
+
+/* Boxes that the caller got from a region stay valid when the region is
+ * copied or set as a clip region.
+ */
+static int
+test_boxes_after_copy (void)
+{
+    static const pixman_box32_t rects[2] = {
+	{ 0, 0, 10, 10 }, { 20, 20, 30, 30 }
+    };
+    pixman_region32_t region, shared;
+    pixman_box32_t *boxes;
+    int ok;
+
+    pixman_region32_init_rects (&region, rects, 2);
+    pixman_region32_init (&shared);
+
+    boxes = pixman_region32_rectangles (&region, NULL);
+
+    pixman_image_set_clip_region32 (image, &region);
+    pixman_region32_copy_shared (&shared, &region);
+    pixman_image_set_clip_region32 (image, &shared);
+    pixman_region32_copy (&shared, &region);
+    pixman_region32_fini (&shared);
+
+    ok = pixman_region32_rectangles (&region, NULL) == boxes &&
+	memcmp (boxes, rects, sizeof (rects)) == 0;
+    if (!ok)
+	printf ("Copying a region changed its boxes\n");
+
+    pixman_region32_fini (&region);
+
+    return ok;
+}
+
+int
+main (int argc, const char *argv[])
+{
+    int i;
+
+    prng_srand (0);
+
+    image = pixman_image_create_bits (PIXMAN_a8r8g8b8, 100, 100, NULL, 0);
+
+    for (i = 0; i < N_REGIONS; ++i)
+	init_random (i);
+
+    for (i = 0; i < N_OPS; ++i)
+    {
+	if (!run_op (i))
+	    return 1;
+    }
+
+    if (!test_caller_data () || !test_boxes_after_copy ())
+	return 1;
+
+    pixman_image_unref (image);
+
+    for (i = 0; i < N_REGIONS; ++i)
+    {
+	pixman_region32_fini (&regions[i]);
+	pixman_region_fini (&regions16[i]);
+    }
+
+    return 0;
+}
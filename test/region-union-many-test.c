@@ -0,0 +1,202 @@
+/*
+ * Check that the union of many regions at once has exactly the same
+ * boxes as adding the regions one at a time with pixman_region32_union(),
+ * including when the destination is one of the regions, for 16 bit
+ * regions, and for enough regions to be merged in several groups.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "utils.h"
+
+#define N_TESTS 2000
+#define MAX_REGIONS 300
+#define MAX_RECTS 30
+#define SIZE 200
+
+static void
+random_region (pixman_region32_t *region)
+{
+    pixman_box32_t boxes[MAX_RECTS];
+    int n, i;
+
+    /* Some empty regions and single boxes */
+    switch (prng_rand_n (8))
+    {
+    case 0:
+	pixman_region32_init (region);
+	return;
+
+    case 1:
+	n = 1;
+	break;
+
+    default:
+	n = prng_rand_n (MAX_RECTS) + 1;
+	break;
+    }
+
+    for (i = 0; i < n; ++i)
+    {
+	/* Coordinates on a coarse grid, so that bands often start and
+	 * end at the same y and boxes often touch.
+	 */
+	int grid = prng_rand_n (2) ? 10 : 1;
+	int x = prng_rand_n (SIZE / grid) * grid;
+	int y = prng_rand_n (SIZE / grid) * grid;
+
+	boxes[i].x1 = x;
+	boxes[i].y1 = y;
+	boxes[i].x2 = x + (prng_rand_n (SIZE / (2 * grid)) + 1) * grid;
+	boxes[i].y2 = y + (prng_rand_n (SIZE / (2 * grid)) + 1) * grid;
+    }
+
+    pixman_region32_init_rects (region, boxes, n);
+}
+
+static void
+region16_from_region32 (pixman_region16_t *region16, pixman_region32_t *region32)
+{
+    static pixman_box16_t boxes16[4 * MAX_RECTS * MAX_RECTS];
+    pixman_box32_t *boxes;
+    int n, i;
+
+    boxes = pixman_region32_rectangles (region32, &n);
+    for (i = 0; i < n; ++i)
+    {
+	boxes16[i].x1 = boxes[i].x1;
+	boxes16[i].y1 = boxes[i].y1;
+	boxes16[i].x2 = boxes[i].x2;
+	boxes16[i].y2 = boxes[i].y2;
+    }
+
+    pixman_region_init_rects (region16, boxes16, n);
+}
+
+static int
+same_boxes (pixman_region32_t *region, pixman_region32_t *expected)
+{
+    pixman_box32_t *boxes, *e;
+    int n, n_expected, i;
+
+    boxes = pixman_region32_rectangles (region, &n);
+    e = pixman_region32_rectangles (expected, &n_expected);
+
+    if (n != n_expected)
+	return FALSE;
+
+    for (i = 0; i < n; ++i)
+    {
+	if (boxes[i].x1 != e[i].x1 || boxes[i].y1 != e[i].y1 ||
+	    boxes[i].x2 != e[i].x2 || boxes[i].y2 != e[i].y2)
+	{
+	    return FALSE;
+	}
+    }
+
+    return pixman_region32_equal (region, expected);
+}
+
+static int
+same_boxes16 (pixman_region16_t *region16, pixman_region32_t *expected)
+{
+    pixman_box16_t *boxes16;
+    pixman_box32_t *e;
+    int n16, n_expected, i;
+
+    boxes16 = pixman_region_rectangles (region16, &n16);
+    e = pixman_region32_rectangles (expected, &n_expected);
+
+    if (n16 != n_expected)
+	return FALSE;
+
+    for (i = 0; i < n16; ++i)
+    {
+	if (boxes16[i].x1 != e[i].x1 || boxes16[i].y1 != e[i].y1 ||
+	    boxes16[i].x2 != e[i].x2 || boxes16[i].y2 != e[i].y2)
+	{
+	    return FALSE;
+	}
+    }
+
+    return TRUE;
+}
+
+static int
+test_union_many (int testnum)
+{
+    pixman_region32_t regions[MAX_REGIONS], expected, result;
+    pixman_region32_t *ptrs[MAX_REGIONS];
+    pixman_region16_t regions16[MAX_REGIONS], result16;
+    pixman_region16_t *ptrs16[MAX_REGIONS];
+    int n = prng_rand_n (8) ? prng_rand_n (40) : prng_rand_n (MAX_REGIONS + 1);
+    int in_place = n && prng_rand_n (2);
+    int i, ok;
+
+    pixman_region32_init (&expected);
+
+    for (i = 0; i < n; ++i)
+    {
+	random_region (&regions[i]);
+	region16_from_region32 (&regions16[i], &regions[i]);
+
+	ptrs[i] = &regions[i];
+	ptrs16[i] = &regions16[i];
+
+	pixman_region32_union (&expected, &expected, &regions[i]);
+    }
+
+    /* In place, the destination is one of the regions */
+    if (in_place)
+    {
+	pixman_region32_t *dest = ptrs[prng_rand_n (n)];
+
+	ok = pixman_region32_union_many (dest, ptrs, n) &&
+	    same_boxes (dest, &expected);
+    }
+    else
+    {
+	pixman_region32_init_rect (&result, 1, 2, 3, 4);
+
+	ok = pixman_region32_union_many (&result, ptrs, n) &&
+	    same_boxes (&result, &expected);
+
+	pixman_region32_fini (&result);
+    }
+
+    pixman_region_init (&result16);
+    ok = ok && pixman_region_union_many (&result16, ptrs16, n) &&
+	same_boxes16 (&result16, &expected);
+
+    if (!ok)
+    {
+	printf ("Test %d: union of %d regions%s differs\n",
+		testnum, n, in_place ? " in place" : "");
+    }
+
+    for (i = 0; i < n; ++i)
+    {
+	pixman_region32_fini (&regions[i]);
+	pixman_region_fini (&regions16[i]);
+    }
+
+    pixman_region32_fini (&expected);
+    pixman_region_fini (&result16);
+
+    return ok;
+}
+
+int
+main (int argc, const char *argv[])
+{
+    int i;
+
+    prng_srand (0);
+
+    for (i = 0; i < N_TESTS; ++i)
+    {
+	if (!test_union_many (i))
+	    return 1;
+    }
+
+    return 0;
+}
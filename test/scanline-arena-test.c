@@ -0,0 +1,181 @@
+/*
+ * Check that reusing the per-thread scanline buffers doesn't change the
+ * results: every composite is done once right after other, unrelated
+ * composites have left their data in the buffers, and once after the
+ * buffers were freed, and the two results are compared.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+
+#define MAX_WIDTH 1500
+#define HEIGHT 6
+#define N_ROUNDS 400
+
+static const pixman_op_t operators[] =
+{
+    PIXMAN_OP_OVER,
+    PIXMAN_OP_ADD,
+    PIXMAN_OP_SATURATE,
+    PIXMAN_OP_DISJOINT_OVER,
+    PIXMAN_OP_CONJOINT_ATOP,
+    PIXMAN_OP_COLOR_DODGE,
+    PIXMAN_OP_HSL_HUE,
+};
+
+static const pixman_format_code_t formats[] =
+{
+    PIXMAN_a8r8g8b8,
+    PIXMAN_x8r8g8b8,
+    PIXMAN_r5g6b5,
+    PIXMAN_a2r10g10b10,
+    PIXMAN_a8,
+};
+
+#define RAND_ELT(arr)							\
+    arr[prng_rand_n (ARRAY_LENGTH (arr))]
+
+typedef struct
+{
+    pixman_op_t			op;
+    pixman_image_t *		src;
+    pixman_image_t *		mask;
+    pixman_format_code_t	dest_format;
+    pixman_bool_t		dest_alpha_map;
+    int				width;
+    uint32_t			seed;
+} test_t;
+
+static void
+destroy (pixman_image_t *image, void *data)
+{
+    free (data);
+}
+
+static pixman_image_t *
+make_image (pixman_format_code_t format, int width, int height)
+{
+    pixman_image_t *image;
+    uint32_t *bits;
+    int stride;
+
+    stride = width * PIXMAN_FORMAT_BPP (format) / 8;
+    stride = (stride + 3) & ~3;
+
+    bits = malloc (stride * height);
+    prng_randmemset (bits, stride * height, RANDMEMSET_MORE_FF);
+
+    image = pixman_image_create_bits (format, width, height, bits, stride);
+    pixman_image_set_destroy_function (image, destroy, bits);
+
+    return image;
+}
+
+static void
+make_test (test_t *t)
+{
+    pixman_transform_t transform;
+
+    t->op = RAND_ELT (operators);
+    t->width = prng_rand_n (MAX_WIDTH) + 1;
+    t->dest_format = RAND_ELT (formats);
+    t->dest_alpha_map = prng_rand_n (4) == 0;
+    t->seed = prng_rand ();
+
+    t->src = make_image (RAND_ELT (formats), MAX_WIDTH, HEIGHT);
+    if (prng_rand_n (3) == 0)
+    {
+	pixman_transform_init_scale (&transform,
+				     pixman_double_to_fixed (0.5),
+				     pixman_double_to_fixed (0.5));
+	pixman_image_set_transform (t->src, &transform);
+	pixman_image_set_filter (t->src, PIXMAN_FILTER_BILINEAR, NULL, 0);
+    }
+
+    t->mask = NULL;
+    if (prng_rand_n (2))
+    {
+	t->mask = make_image (PIXMAN_a8r8g8b8, MAX_WIDTH, HEIGHT);
+	pixman_image_set_component_alpha (t->mask, prng_rand_n (2));
+    }
+}
+
+static void
+free_test (test_t *t)
+{
+    pixman_image_unref (t->src);
+    if (t->mask)
+	pixman_image_unref (t->mask);
+}
+
+static uint32_t
+run_test (const test_t *t)
+{
+    pixman_image_t *dest, *alpha = NULL;
+    uint32_t crc;
+
+    prng_srand (t->seed);
+
+    dest = make_image (t->dest_format, t->width, HEIGHT);
+    if (t->dest_alpha_map)
+    {
+	alpha = make_image (PIXMAN_a8, t->width, HEIGHT);
+	pixman_image_set_alpha_map (dest, alpha, 0, 0);
+    }
+
+    pixman_image_composite32 (t->op, t->src, t->mask, dest,
+			      0, 0, 0, 0, 0, 0, t->width, HEIGHT);
+
+    if (alpha)
+    {
+	pixman_image_set_alpha_map (dest, NULL, 0, 0);
+	crc = compute_crc32_for_image (0, alpha);
+	pixman_image_unref (alpha);
+    }
+    else
+    {
+	crc = 0;
+    }
+
+    crc = compute_crc32_for_image (crc, dest);
+    pixman_image_unref (dest);
+
+    return crc;
+}
+
+int
+main (int argc, const char *argv[])
+{
+    test_t t, other;
+    uint32_t crc1, crc2;
+    int i;
+
+    prng_srand (0);
+
+    for (i = 0; i < N_ROUNDS; ++i)
+    {
+	make_test (&t);
+	make_test (&other);
+
+	run_test (&other);
+	crc1 = run_test (&t);
+
+	pixman_trim_scanline_arena ();
+	crc2 = run_test (&t);
+
+	if (crc1 != crc2)
+	{
+	    printf ("Round %d: result differs (%08x != %08x)\n", i, crc1, crc2);
+	    return 1;
+	}
+
+	free_test (&t);
+	free_test (&other);
+
+	/* run_test() reseeds the generator */
+	prng_srand (i + 1);
+    }
+
+    return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * Check that the composite statistics count what was composited,
+ * including the glyphs added to a glyph mask in batches, and that the
+ * totals per implementation match the individual entries.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "utils.h"
+
+#define MAX_STATS 256
+#define N_GLYPHS 40
+
+static pixman_composite_stats_t stats[MAX_STATS];
+
+static const pixman_composite_stats_t *
+find_composite (int n, pixman_op_t op,
+		pixman_format_code_t src_format,
+		pixman_format_code_t mask_format,
+		pixman_format_code_t dest_format)
+{
+    int i;
+
+    for (i = 0; i < n; ++i)
+    {
+	if (stats[i].kind == PIXMAN_STATS_COMPOSITE	&&
+	    stats[i].op == op				&&
+	    stats[i].src_format == src_format		&&
+	    stats[i].mask_format == mask_format		&&
+	    stats[i].dest_format == dest_format)
+	{
+	    return &stats[i];
+	}
+    }
+
+    return NULL;
+}
+
+static const pixman_composite_stats_t *
+find_add_glyphs (int n, pixman_format_code_t format)
+{
+    int i;
+
+    for (i = 0; i < n; ++i)
+    {
+	if (stats[i].kind == PIXMAN_STATS_ADD_GLYPHS	&&
+	    stats[i].src_format == format		&&
+	    stats[i].dest_format == format)
+	{
+	    return &stats[i];
+	}
+    }
+
+    return NULL;
+}
+
+static int
+check_totals (int n)
+{
+    uint64_t impl_calls = 0, impl_pixels = 0;
+    uint64_t calls = 0, pixels = 0;
+    int i;
+
+    for (i = 0; i < n; ++i)
+    {
+	if (stats[i].kind == PIXMAN_STATS_IMPLEMENTATION)
+	{
+	    if (!stats[i].implementation)
+	    {
+		printf ("Implementation %d has no name\n", i);
+		return 0;
+	    }
+
+	    impl_calls += stats[i].calls;
+	    impl_pixels += stats[i].pixels;
+	}
+	else
+	{
+	    calls += stats[i].calls;
+	    pixels += stats[i].pixels;
+	}
+    }
+
+    if (impl_calls != calls || impl_pixels != pixels)
+    {
+	printf ("Implementation totals don't match (%llu/%llu calls, %llu/%llu pixels)\n",
+		(unsigned long long)impl_calls, (unsigned long long)calls,
+		(unsigned long long)impl_pixels, (unsigned long long)pixels);
+	return 0;
+    }
+
+    return 1;
+}
+
+int
+main (int argc, const char *argv[])
+{
+    pixman_image_t *src, *mask, *dest, *glyph_img;
+    pixman_glyph_cache_t *cache;
+    pixman_glyph_t glyphs[N_GLYPHS];
+    const void *glyph;
+    const pixman_composite_stats_t *s;
+    int n, i;
+
+    src = pixman_image_create_bits (PIXMAN_a8r8g8b8, 64, 64, NULL, 0);
+    mask = pixman_image_create_bits (PIXMAN_a8, 64, 64, NULL, 0);
+    dest = pixman_image_create_bits (PIXMAN_r5g6b5, 64, 64, NULL, 0);
+
+    pixman_enable_stats (TRUE);
+    pixman_reset_stats ();
+
+    for (i = 0; i < 3; ++i)
+    {
+	pixman_image_composite32 (PIXMAN_OP_OVER, src, mask, dest,
+				  0, 0, 0, 0, 0, 0, 10, 20);
+    }
+
+    /* No fast path implements this */
+    pixman_image_composite32 (PIXMAN_OP_HSL_LUMINOSITY, src, mask, dest,
+			      0, 0, 0, 0, 0, 0, 7, 5);
+
+    /* SRC needs a mask for the whole rectangle, to which the glyphs are
+     * added in two batches.
+     */
+    cache = pixman_glyph_cache_create ();
+    glyph_img = pixman_image_create_bits (PIXMAN_a8, 4, 5, NULL, 0);
+
+    pixman_glyph_cache_freeze (cache);
+    glyph = pixman_glyph_cache_insert (cache, cache, glyph_img, 0, 0, glyph_img);
+    pixman_glyph_cache_thaw (cache);
+
+    for (i = 0; i < N_GLYPHS; ++i)
+    {
+	glyphs[i].x = (i % 16) * 4;
+	glyphs[i].y = (i / 16) * 5;
+	glyphs[i].glyph = glyph;
+    }
+
+    pixman_composite_glyphs (PIXMAN_OP_SRC, src, dest, PIXMAN_a8,
+			     0, 0, 0, 0, 0, 0, 64, 64,
+			     cache, N_GLYPHS, glyphs);
+
+    n = pixman_get_stats (stats, MAX_STATS);
+    if (n > MAX_STATS)
+    {
+	printf ("Too many entries (%d)\n", n);
+	return 1;
+    }
+
+    s = find_composite (n, PIXMAN_OP_OVER,
+			PIXMAN_a8r8g8b8, PIXMAN_a8, PIXMAN_r5g6b5);
+    if (!s || s->calls != 3 || s->pixels != 3 * 10 * 20)
+    {
+	printf ("OVER was not counted correctly\n");
+	return 1;
+    }
+
+    s = find_composite (n, PIXMAN_OP_HSL_LUMINOSITY,
+			PIXMAN_a8r8g8b8, PIXMAN_a8, PIXMAN_r5g6b5);
+    if (!s || s->calls != 1 || s->pixels != 7 * 5 || !s->fallback)
+    {
+	printf ("HSL_LUMINOSITY was not counted as a fallback\n");
+	return 1;
+    }
+
+    s = find_add_glyphs (n, PIXMAN_a8);
+    if (!s || s->calls != 2 || s->glyphs != N_GLYPHS ||
+	s->pixels != N_GLYPHS * 4 * 5 || s->op != PIXMAN_OP_ADD)
+    {
+	printf ("Glyph batches were not counted correctly\n");
+	return 1;
+    }
+
+    if (!check_totals (n))
+	return 1;
+
+    /* Nothing is counted while disabled */
+    pixman_enable_stats (FALSE);
+    pixman_image_composite32 (PIXMAN_OP_OVER, src, mask, dest,
+			      0, 0, 0, 0, 0, 0, 10, 20);
+    n = pixman_get_stats (stats, MAX_STATS);
+    s = find_composite (n, PIXMAN_OP_OVER,
+			PIXMAN_a8r8g8b8, PIXMAN_a8, PIXMAN_r5g6b5);
+    if (!s || s->calls != 3)
+    {
+	printf ("Composite counted while disabled\n");
+	return 1;
+    }
+
+    pixman_reset_stats ();
+    n = pixman_get_stats (stats, MAX_STATS);
+
+    for (i = 0; i < n && i < MAX_STATS; ++i)
+    {
+	if (stats[i].calls || stats[i].pixels || stats[i].cycles ||
+	    stats[i].glyphs)
+	{
+	    printf ("Entry %d not reset\n", i);
+	    return 1;
+	}
+    }
+
+    pixman_image_unref (src);
+    pixman_image_unref (mask);
+    pixman_image_unref (dest);
+    pixman_image_unref (glyph_img);
+    pixman_glyph_cache_destroy (cache);
+
+    return 0;
+}
@@ -0,0 +1,293 @@
+/*
+ * Check that the exact coverage of triangles and trapezoids is the area
+ * of each pixel that they cover, computed here by clipping the shapes to
+ * the pixel, and that other mask formats are rasterized as usual.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "utils.h"
+
+#define N_TESTS 400
+#define MAX_SHAPES 12
+#define MAX_SIZE 40
+
+typedef struct
+{
+    double x, y;
+} point_t;
+
+/* Keeps the part of the polygon in @in where a * x + b * y <= c */
+static int
+clip_polygon (const point_t *in, int n, point_t *out,
+	      double a, double b, double c)
+{
+    int i, n_out = 0;
+
+    for (i = 0; i < n; ++i)
+    {
+	const point_t *p = &in[i];
+	const point_t *q = &in[(i + 1) % n];
+	double vp = a * p->x + b * p->y - c;
+	double vq = a * q->x + b * q->y - c;
+
+	if (vp <= 0)
+	    out[n_out++] = *p;
+
+	if ((vp < 0 && vq > 0) || (vp > 0 && vq < 0))
+	{
+	    double t = vp / (vp - vq);
+
+	    out[n_out].x = p->x + (q->x - p->x) * t;
+	    out[n_out].y = p->y + (q->y - p->y) * t;
+	    n_out++;
+	}
+    }
+
+    return n_out;
+}
+
+static double
+polygon_pixel_area (const point_t *polygon, int n, int px, int py)
+{
+    point_t a[32], b[32];
+    double area = 0;
+    int i;
+
+    n = clip_polygon (polygon, n, a, -1, 0, -px);
+    n = clip_polygon (a, n, b, 1, 0, px + 1);
+    n = clip_polygon (b, n, a, 0, -1, -py);
+    n = clip_polygon (a, n, b, 0, 1, py + 1);
+
+    for (i = 0; i < n; ++i)
+    {
+	const point_t *p = &b[i];
+	const point_t *q = &b[(i + 1) % n];
+
+	area += p->x * q->y - q->x * p->y;
+    }
+
+    return fabs (area) / 2;
+}
+
+static int
+triangle_polygon (const pixman_triangle_t *tri, point_t *polygon)
+{
+    polygon[0].x = pixman_fixed_to_double (tri->p1.x);
+    polygon[0].y = pixman_fixed_to_double (tri->p1.y);
+    polygon[1].x = pixman_fixed_to_double (tri->p2.x);
+    polygon[1].y = pixman_fixed_to_double (tri->p2.y);
+    polygon[2].x = pixman_fixed_to_double (tri->p3.x);
+    polygon[2].y = pixman_fixed_to_double (tri->p3.y);
+
+    return 3;
+}
+
+/* The part of a trapezoid between the top and bottom where the left
+ * edge is to the left of the right one
+ */
+static int
+trapezoid_polygon (const pixman_trapezoid_t *trap, point_t *polygon)
+{
+    const pixman_line_fixed_t *l = &trap->left, *r = &trap->right;
+    double kl = (double)(l->p2.x - l->p1.x) / (l->p2.y - l->p1.y);
+    double kr = (double)(r->p2.x - r->p1.x) / (r->p2.y - r->p1.y);
+    point_t tmp[32];
+    int n;
+
+    polygon[0].x = -1000;
+    polygon[0].y = -1000;
+    polygon[1].x = 1000;
+    polygon[1].y = -1000;
+    polygon[2].x = 1000;
+    polygon[2].y = 1000;
+    polygon[3].x = -1000;
+    polygon[3].y = 1000;
+
+    n = clip_polygon (polygon, 4, tmp, 0, -1,
+		      -pixman_fixed_to_double (trap->top));
+    n = clip_polygon (tmp, n, polygon, 0, 1,
+		      pixman_fixed_to_double (trap->bottom));
+    n = clip_polygon (polygon, n, tmp, -1, kl,
+		      kl * pixman_fixed_to_double (l->p1.y) -
+		      pixman_fixed_to_double (l->p1.x));
+    n = clip_polygon (tmp, n, polygon, 1, -kr,
+		      pixman_fixed_to_double (r->p1.x) -
+		      kr * pixman_fixed_to_double (r->p1.y));
+
+    return n;
+}
+
+static pixman_fixed_t
+random_coord (int size)
+{
+    return prng_rand_n (pixman_int_to_fixed (size + 8)) - pixman_int_to_fixed (4);
+}
+
+static int
+check_exact (int testnum, int width, int height,
+	     int n_shapes, const pixman_triangle_t *tris,
+	     const pixman_trapezoid_t *traps)
+{
+    static const pixman_color_t white = { 0xffff, 0xffff, 0xffff, 0xffff };
+    pixman_image_t *src = pixman_image_create_solid_fill (&white);
+    pixman_image_t *mask = pixman_image_create_bits (
+	PIXMAN_a8, width, height, NULL, 0);
+    pixman_image_t *dest = pixman_image_create_bits (
+	PIXMAN_a8r8g8b8, width, height, NULL, 0);
+    uint8_t *mbits = (uint8_t *)pixman_image_get_data (mask);
+    uint32_t *dbits = pixman_image_get_data (dest);
+    int mstride = pixman_image_get_stride (mask);
+    int dstride = pixman_image_get_stride (dest) / 4;
+    point_t polygons[MAX_SHAPES][32];
+    int n_points[MAX_SHAPES];
+    int ok = 1;
+    int x, y, i;
+
+    /* Straight into the destination, and through a temporary mask */
+    if (tris)
+    {
+	pixman_composite_triangles_exact (PIXMAN_OP_ADD, src, mask, PIXMAN_a8,
+					  0, 0, 0, 0, n_shapes, tris);
+	pixman_composite_triangles_exact (PIXMAN_OP_OVER, src, dest, PIXMAN_a8,
+					  0, 0, 0, 0, n_shapes, tris);
+
+	for (i = 0; i < n_shapes; ++i)
+	    n_points[i] = triangle_polygon (&tris[i], polygons[i]);
+    }
+    else
+    {
+	pixman_composite_trapezoids_exact (PIXMAN_OP_ADD, src, mask, PIXMAN_a8,
+					   0, 0, 0, 0, n_shapes, traps);
+	pixman_composite_trapezoids_exact (PIXMAN_OP_OVER, src, dest, PIXMAN_a8,
+					   0, 0, 0, 0, n_shapes, traps);
+
+	for (i = 0; i < n_shapes; ++i)
+	    n_points[i] = trapezoid_polygon (&traps[i], polygons[i]);
+    }
+
+    for (y = 0; y < height && ok; ++y)
+    {
+	for (x = 0; x < width && ok; ++x)
+	{
+	    double area = 0;
+	    int expected, m, d;
+
+	    for (i = 0; i < n_shapes; ++i)
+		area += polygon_pixel_area (polygons[i], n_points[i], x, y);
+
+	    expected = (int)((area > 1 ? 1 : area) * 255 + 0.5);
+	    m = mbits[y * mstride + x];
+	    d = dbits[y * dstride + x] >> 24;
+
+	    if (abs (m - expected) > 1 || abs (d - expected) > 1)
+	    {
+		printf ("Test %d: %s, pixel %d, %d is %d/%d, expected %d\n",
+			testnum, tris ? "triangles" : "trapezoids",
+			x, y, m, d, expected);
+		ok = 0;
+	    }
+	}
+    }
+
+    pixman_image_unref (src);
+    pixman_image_unref (mask);
+    pixman_image_unref (dest);
+
+    return ok;
+}
+
+static int
+check_sampled (int testnum, pixman_format_code_t format,
+	       int width, int height, int n_tris, const pixman_triangle_t *tris)
+{
+    static const pixman_color_t white = { 0xffff, 0xffff, 0xffff, 0xffff };
+    pixman_image_t *src = pixman_image_create_solid_fill (&white);
+    pixman_image_t *dest1 = pixman_image_create_bits (
+	PIXMAN_a8r8g8b8, width, height, NULL, 0);
+    pixman_image_t *dest2 = pixman_image_create_bits (
+	PIXMAN_a8r8g8b8, width, height, NULL, 0);
+    int ok;
+
+    pixman_composite_triangles_exact (PIXMAN_OP_OVER, src, dest1, format,
+				      0, 0, 2, 1, n_tris, tris);
+    pixman_composite_triangles (PIXMAN_OP_OVER, src, dest2, format,
+				0, 0, 2, 1, n_tris, tris);
+
+    ok = compute_crc32_for_image (0, dest1) == compute_crc32_for_image (0, dest2);
+    if (!ok)
+	printf ("Test %d: format %08x is not sampled\n", testnum, format);
+
+    pixman_image_unref (src);
+    pixman_image_unref (dest1);
+    pixman_image_unref (dest2);
+
+    return ok;
+}
+
+int
+main (int argc, const char *argv[])
+{
+    pixman_triangle_t tris[MAX_SHAPES];
+    pixman_trapezoid_t traps[MAX_SHAPES];
+    int i, j;
+
+    prng_srand (0);
+
+    for (i = 0; i < N_TESTS; ++i)
+    {
+	int width = prng_rand_n (MAX_SIZE) + 1;
+	int height = prng_rand_n (MAX_SIZE) + 1;
+	int n = prng_rand_n (MAX_SHAPES) + 1;
+
+	for (j = 0; j < n; ++j)
+	{
+	    tris[j].p1.x = random_coord (width);
+	    tris[j].p1.y = random_coord (height);
+	    tris[j].p2.x = random_coord (width);
+	    tris[j].p2.y = random_coord (height);
+	    tris[j].p3.x = random_coord (width);
+	    tris[j].p3.y = random_coord (height);
+
+	    /* Some horizontal and vertical edges */
+	    if (prng_rand_n (4) == 0)
+		tris[j].p2.y = tris[j].p1.y;
+	    if (prng_rand_n (4) == 0)
+		tris[j].p3.x = tris[j].p1.x;
+	}
+
+	if (!check_exact (i, width, height, n, tris, NULL))
+	    return 1;
+
+	if (!check_sampled (i, prng_rand_n (2) ? PIXMAN_a4 : PIXMAN_a1,
+			    width, height, n, tris))
+	{
+	    return 1;
+	}
+
+	/* Trapezoids whose edges may cross. The lines span the trapezoids,
+	 * since the extents of the temporary mask are taken from them.
+	 */
+	for (j = 0; j < n; ++j)
+	{
+	    pixman_trapezoid_t *trap = &traps[j];
+
+	    trap->top = random_coord (height);
+	    trap->bottom = trap->top + prng_rand_n (pixman_int_to_fixed (height)) + 1;
+	    trap->left.p1.x = random_coord (width);
+	    trap->left.p1.y = trap->top;
+	    trap->left.p2.x = random_coord (width);
+	    trap->left.p2.y = trap->bottom;
+	    trap->right.p1.x = random_coord (width);
+	    trap->right.p1.y = trap->top;
+	    trap->right.p2.x = random_coord (width);
+	    trap->right.p2.y = trap->bottom;
+	}
+
+	if (!check_exact (i, width, height, n, NULL, traps))
+	    return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,174 @@
+/*
+ * Check that compositing trapezoids and triangles with worker threads
+ * produces exactly the same results as on the calling thread only, both
+ * through a temporary mask and when rasterizing straight into the
+ * destination.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+
+#define WIDTH 301
+#define HEIGHT 457
+#define N_ROUNDS 60
+#define MAX_SHAPES 600
+
+static const pixman_op_t operators[] =
+{
+    PIXMAN_OP_OVER,
+    PIXMAN_OP_ADD,
+    PIXMAN_OP_SRC,
+    PIXMAN_OP_IN,
+};
+
+static const pixman_format_code_t mask_formats[] =
+{
+    PIXMAN_a8,
+    PIXMAN_a4,
+    PIXMAN_a1,
+};
+
+#define RAND_ELT(arr)							\
+    arr[prng_rand_n (ARRAY_LENGTH (arr))]
+
+static pixman_fixed_t
+random_coord (int size)
+{
+    return prng_rand_n (pixman_int_to_fixed (size + 20)) - pixman_int_to_fixed (10);
+}
+
+static void
+random_triangle (pixman_triangle_t *tri)
+{
+    /* Mostly small triangles as from a tessellated mesh */
+    int x = prng_rand_n (WIDTH), y = prng_rand_n (HEIGHT);
+    int size = prng_rand_n (8) ? 20 : HEIGHT;
+
+    tri->p1.x = pixman_int_to_fixed (x) + random_coord (size);
+    tri->p1.y = pixman_int_to_fixed (y) + random_coord (size);
+    tri->p2.x = pixman_int_to_fixed (x) + random_coord (size);
+    tri->p2.y = pixman_int_to_fixed (y) + random_coord (size);
+    tri->p3.x = pixman_int_to_fixed (x) + random_coord (size);
+    tri->p3.y = pixman_int_to_fixed (y) + random_coord (size);
+}
+
+static void
+random_trapezoid (pixman_trapezoid_t *trap)
+{
+    trap->top = random_coord (HEIGHT);
+    trap->bottom = trap->top + prng_rand_n (pixman_int_to_fixed (HEIGHT / 4));
+    trap->left.p1.x = random_coord (WIDTH);
+    trap->left.p1.y = trap->top;
+    trap->left.p2.x = random_coord (WIDTH);
+    trap->left.p2.y = trap->bottom + 1;
+    trap->right.p1.x = trap->left.p1.x + prng_rand_n (pixman_int_to_fixed (WIDTH / 2));
+    trap->right.p1.y = trap->top;
+    trap->right.p2.x = trap->left.p2.x + prng_rand_n (pixman_int_to_fixed (WIDTH / 2));
+    trap->right.p2.y = trap->bottom + 1;
+}
+
+static pixman_image_t *
+make_image (pixman_format_code_t format)
+{
+    pixman_image_t *image = pixman_image_create_bits (format, WIDTH, HEIGHT, NULL, 0);
+
+    prng_randmemset (pixman_image_get_data (image),
+		     pixman_image_get_stride (image) * HEIGHT, 0);
+
+    return image;
+}
+
+int
+main (int argc, const char *argv[])
+{
+    static const pixman_color_t color = { 0x8000, 0xc000, 0x4000, 0xffff };
+    pixman_trapezoid_t traps[MAX_SHAPES];
+    pixman_triangle_t tris[MAX_SHAPES];
+    int i, j;
+
+    prng_srand (0);
+
+    for (i = 0; i < N_ROUNDS; ++i)
+    {
+	pixman_format_code_t mask_format = RAND_ELT (mask_formats);
+	pixman_op_t op = RAND_ELT (operators);
+	int n = prng_rand_n (MAX_SHAPES) + 1;
+	int exact = prng_rand_n (2);
+	int triangles = prng_rand_n (2);
+	int x = prng_rand_n (20) - 10;
+	int y = prng_rand_n (20) - 10;
+	pixman_image_t *src, *dest[2];
+	uint32_t crc[2];
+
+	/* An opaque source and a destination in the mask format make
+	 * pixman rasterize straight into the destination.
+	 */
+	if (op == PIXMAN_OP_ADD && prng_rand_n (2))
+	{
+	    src = pixman_image_create_solid_fill (&color);
+	    dest[0] = make_image (mask_format);
+	}
+	else
+	{
+	    src = make_image (PIXMAN_a8r8g8b8);
+	    dest[0] = make_image (PIXMAN_a8r8g8b8);
+	}
+
+	dest[1] = pixman_image_create_bits (
+	    pixman_image_get_format (dest[0]), WIDTH, HEIGHT, NULL, 0);
+	memcpy (pixman_image_get_data (dest[1]), pixman_image_get_data (dest[0]),
+		pixman_image_get_stride (dest[0]) * HEIGHT);
+
+	for (j = 0; j < n; ++j)
+	{
+	    if (triangles)
+		random_triangle (&tris[j]);
+	    else
+		random_trapezoid (&traps[j]);
+	}
+
+	for (j = 0; j < 2; ++j)
+	{
+	    pixman_set_num_threads (j ? 2 + prng_rand_n (7) : 1);
+
+	    if (triangles && exact)
+	    {
+		pixman_composite_triangles_exact (
+		    op, src, dest[j], mask_format, x, y, x, y, n, tris);
+	    }
+	    else if (triangles)
+	    {
+		pixman_composite_triangles (
+		    op, src, dest[j], mask_format, x, y, x, y, n, tris);
+	    }
+	    else if (exact)
+	    {
+		pixman_composite_trapezoids_exact (
+		    op, src, dest[j], mask_format, x, y, x, y, n, traps);
+	    }
+	    else
+	    {
+		pixman_composite_trapezoids (
+		    op, src, dest[j], mask_format, x, y, x, y, n, traps);
+	    }
+
+	    pixman_set_num_threads (1);
+
+	    crc[j] = compute_crc32_for_image (0, dest[j]);
+	}
+
+	if (crc[0] != crc[1])
+	{
+	    printf ("Round %d: threaded result differs (%08x != %08x)\n",
+		    i, crc[0], crc[1]);
+	    return 1;
+	}
+
+	pixman_image_unref (src);
+	pixman_image_unref (dest[0]);
+	pixman_image_unref (dest[1]);
+    }
+
+    return 0;
+}
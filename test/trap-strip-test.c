@@ -0,0 +1,157 @@
+/*
+ * Check that pixman_composite_trapezoids() gives the same result as
+ * rasterizing the trapezoids into a mask the size of the destination
+ * and compositing that, for destinations taller than one strip.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+
+#define N_TESTS 600
+#define MAX_TRAPS 40
+#define MAX_WIDTH 64
+#define MAX_HEIGHT 300
+
+static const pixman_format_code_t dest_formats[] =
+{
+    PIXMAN_a8r8g8b8, PIXMAN_r5g6b5, PIXMAN_a8,
+};
+
+static const pixman_format_code_t mask_formats[] =
+{
+    PIXMAN_a1, PIXMAN_a4, PIXMAN_a8,
+};
+
+static const pixman_op_t operators[] =
+{
+    PIXMAN_OP_OVER, PIXMAN_OP_ADD, PIXMAN_OP_SRC, PIXMAN_OP_IN,
+    PIXMAN_OP_OUT_REVERSE,
+};
+
+static pixman_fixed_t
+random_coord (int size)
+{
+    return prng_rand_n (pixman_int_to_fixed (size + 16)) - pixman_int_to_fixed (8);
+}
+
+static void
+random_trapezoid (pixman_trapezoid_t *trap, int width, int height)
+{
+    trap->top = random_coord (height);
+    trap->bottom = trap->top + prng_rand_n (pixman_int_to_fixed (height / 2 + 1));
+    trap->left.p1.x = random_coord (width);
+    trap->left.p1.y = trap->top;
+    trap->left.p2.x = random_coord (width);
+    trap->left.p2.y = trap->bottom + 1;
+    trap->right.p1.x = trap->left.p1.x + prng_rand_n (pixman_int_to_fixed (width));
+    trap->right.p1.y = trap->top;
+    trap->right.p2.x = trap->left.p2.x + prng_rand_n (pixman_int_to_fixed (width));
+    trap->right.p2.y = trap->bottom + 1;
+}
+
+static pixman_image_t *
+make_image (pixman_format_code_t format, int width, int height)
+{
+    pixman_image_t *image = pixman_image_create_bits (format, width, height, NULL, 0);
+
+    prng_randmemset (pixman_image_get_data (image),
+		     pixman_image_get_stride (image) * height, 0);
+
+    return image;
+}
+
+static pixman_image_t *
+copy_image (pixman_image_t *image)
+{
+    int stride = pixman_image_get_stride (image);
+    int height = pixman_image_get_height (image);
+    pixman_image_t *copy = pixman_image_create_bits (
+	pixman_image_get_format (image), pixman_image_get_width (image),
+	height, NULL, stride);
+
+    memcpy (pixman_image_get_data (copy), pixman_image_get_data (image),
+	    stride * height);
+
+    return copy;
+}
+
+static int
+test_strips (int testnum)
+{
+    pixman_format_code_t dest_format = dest_formats[prng_rand_n (ARRAY_LENGTH (dest_formats))];
+    pixman_format_code_t mask_format = mask_formats[prng_rand_n (ARRAY_LENGTH (mask_formats))];
+    pixman_op_t op = operators[prng_rand_n (ARRAY_LENGTH (operators))];
+    int width = prng_rand_n (MAX_WIDTH) + 1;
+    int height = prng_rand_n (MAX_HEIGHT) + 1;
+    int n = prng_rand_n (MAX_TRAPS) + 1;
+    int x_src = prng_rand_n (10) - 5;
+    int y_src = prng_rand_n (10) - 5;
+    int x_dst = prng_rand_n (10) - 5;
+    int y_dst = prng_rand_n (10) - 5;
+    pixman_trapezoid_t traps[MAX_TRAPS];
+    pixman_image_t *src, *dest1, *dest2, *mask;
+    int i, ok;
+
+    src = make_image (PIXMAN_a8r8g8b8, 13, 7);
+    pixman_image_set_repeat (src, PIXMAN_REPEAT_NORMAL);
+
+    dest1 = make_image (dest_format, width, height);
+    dest2 = copy_image (dest1);
+
+    for (i = 0; i < n; ++i)
+	random_trapezoid (&traps[i], width, height);
+
+    pixman_composite_trapezoids (op, src, dest1, mask_format,
+				 x_src, y_src, x_dst, y_dst, n, traps);
+
+    /* Operators for which a zero mask has an effect are composited
+     * across a destination-sized box in trapezoid space; for the others
+     * that is the same as compositing across the whole destination.
+     */
+    mask = pixman_image_create_bits (mask_format, width, height, NULL, 0);
+    if (op == PIXMAN_OP_SRC || op == PIXMAN_OP_IN)
+    {
+	pixman_add_trapezoids (mask, 0, 0, n, traps);
+	pixman_image_composite (op, src, mask, dest2,
+				x_src, y_src, 0, 0, x_dst, y_dst,
+				width, height);
+    }
+    else
+    {
+	pixman_add_trapezoids (mask, x_dst, y_dst, n, traps);
+	pixman_image_composite (op, src, mask, dest2,
+				x_src - x_dst, y_src - y_dst, 0, 0, 0, 0,
+				width, height);
+    }
+
+    ok = compute_crc32_for_image (0, dest1) == compute_crc32_for_image (0, dest2);
+    if (!ok)
+    {
+	printf ("Test %d: %d trapezoids in %dx%d %08x with %08x mask, op %d differ\n",
+		testnum, n, width, height, dest_format, mask_format, op);
+    }
+
+    pixman_image_unref (src);
+    pixman_image_unref (dest1);
+    pixman_image_unref (dest2);
+    pixman_image_unref (mask);
+
+    return ok;
+}
+
+int
+main (int argc, const char *argv[])
+{
+    int i;
+
+    prng_srand (0);
+
+    for (i = 0; i < N_TESTS; ++i)
+    {
+	if (!test_strips (i))
+	    return 1;
+    }
+
+    return 0;
+}
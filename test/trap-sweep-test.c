@@ -0,0 +1,194 @@
+/*
+ * Check that adding many trapezoids, traps or triangles at once gives
+ * the same mask as rasterizing them one by one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+
+#define N_TESTS 1500
+#define MAX_TRAPS 64
+#define MAX_SIZE 100
+
+static const pixman_format_code_t formats[] =
+{
+    PIXMAN_a8,
+    PIXMAN_a4,
+    PIXMAN_a1,
+};
+
+static pixman_fixed_t
+random_coord (int size)
+{
+    /* Mostly within the image, sometimes well outside it */
+    if (prng_rand_n (8) == 0)
+	return pixman_int_to_fixed (prng_rand_n (3 * size) - size) + prng_rand_n (65536);
+
+    return prng_rand_n (pixman_int_to_fixed (size + 4)) - pixman_int_to_fixed (2);
+}
+
+static void
+random_trapezoid (pixman_trapezoid_t *trap, int width, int height)
+{
+    trap->top = random_coord (height);
+    trap->bottom = random_coord (height);
+    if (trap->top > trap->bottom)
+    {
+	pixman_fixed_t t = trap->top;
+
+	trap->top = trap->bottom;
+	trap->bottom = t;
+    }
+
+    /* Thin slivers as from tessellated polygons */
+    if (prng_rand_n (2))
+	trap->bottom = trap->top + prng_rand_n (pixman_int_to_fixed (3));
+
+    trap->left.p1.x = random_coord (width);
+    trap->left.p1.y = random_coord (height);
+    trap->left.p2.x = random_coord (width);
+    trap->left.p2.y = trap->left.p1.y + prng_rand_n (pixman_int_to_fixed (height)) + 1;
+    trap->right.p1.x = random_coord (width);
+    trap->right.p1.y = random_coord (height);
+    trap->right.p2.x = random_coord (width);
+    trap->right.p2.y = trap->right.p1.y + prng_rand_n (pixman_int_to_fixed (height)) + 1;
+}
+
+static void
+random_trap (pixman_trap_t *trap, int width, int height)
+{
+    trap->top.y = random_coord (height);
+    trap->bot.y = trap->top.y + prng_rand_n (pixman_int_to_fixed (height / 2 + 1));
+    trap->top.l = random_coord (width);
+    trap->top.r = trap->top.l + prng_rand_n (pixman_int_to_fixed (width / 2 + 1));
+    trap->bot.l = random_coord (width);
+    trap->bot.r = trap->bot.l + prng_rand_n (pixman_int_to_fixed (width / 2 + 1));
+}
+
+static pixman_image_t *
+make_mask (pixman_format_code_t format, int width, int height)
+{
+    pixman_image_t *image = pixman_image_create_bits (format, width, height, NULL, 0);
+
+    if (prng_rand_n (2))
+    {
+	prng_randmemset (pixman_image_get_data (image),
+			 pixman_image_get_stride (image) * height, 0);
+    }
+
+    return image;
+}
+
+static pixman_image_t *
+copy_mask (pixman_image_t *image)
+{
+    int stride = pixman_image_get_stride (image);
+    int height = pixman_image_get_height (image);
+    pixman_image_t *copy = pixman_image_create_bits (
+	pixman_image_get_format (image), pixman_image_get_width (image),
+	height, NULL, stride);
+
+    memcpy (pixman_image_get_data (copy), pixman_image_get_data (image),
+	    stride * height);
+
+    return copy;
+}
+
+static int
+test_traps (int testnum)
+{
+    pixman_format_code_t format = formats[prng_rand_n (ARRAY_LENGTH (formats))];
+    int width = prng_rand_n (MAX_SIZE) + 1;
+    int height = prng_rand_n (MAX_SIZE) + 1;
+    int n = prng_rand_n (MAX_TRAPS) + 1;
+    int x_off = prng_rand_n (20) - 10;
+    int y_off = prng_rand_n (20) - 10;
+    pixman_image_t *mask1 = make_mask (format, width, height);
+    pixman_image_t *mask2 = copy_mask (mask1);
+    const char *kind;
+    int i, ok;
+
+    switch (prng_rand_n (3))
+    {
+    case 0:
+	{
+	    pixman_trapezoid_t traps[MAX_TRAPS];
+
+	    kind = "trapezoids";
+	    for (i = 0; i < n; ++i)
+		random_trapezoid (&traps[i], width, height);
+
+	    pixman_add_trapezoids (mask1, x_off, y_off, n, traps);
+	    for (i = 0; i < n; ++i)
+	    {
+		if (pixman_trapezoid_valid (&traps[i]))
+		    pixman_rasterize_trapezoid (mask2, &traps[i], x_off, y_off);
+	    }
+	}
+	break;
+
+    case 1:
+	{
+	    pixman_trap_t traps[MAX_TRAPS];
+
+	    kind = "traps";
+	    for (i = 0; i < n; ++i)
+		random_trap (&traps[i], width, height);
+
+	    pixman_add_traps (mask1, x_off, y_off, n, traps);
+	    for (i = 0; i < n; ++i)
+		pixman_add_traps (mask2, x_off, y_off, 1, &traps[i]);
+	}
+	break;
+
+    default:
+	{
+	    pixman_triangle_t tris[MAX_TRAPS];
+
+	    kind = "triangles";
+	    for (i = 0; i < n; ++i)
+	    {
+		tris[i].p1.x = random_coord (width);
+		tris[i].p1.y = random_coord (height);
+		tris[i].p2.x = random_coord (width);
+		tris[i].p2.y = random_coord (height);
+		tris[i].p3.x = random_coord (width);
+		tris[i].p3.y = random_coord (height);
+	    }
+
+	    pixman_add_triangles (mask1, x_off, y_off, n, tris);
+	    for (i = 0; i < n; ++i)
+		pixman_add_triangles (mask2, x_off, y_off, 1, &tris[i]);
+	}
+	break;
+    }
+
+    ok = compute_crc32_for_image (0, mask1) == compute_crc32_for_image (0, mask2);
+    if (!ok)
+    {
+	printf ("Test %d: %d %s in %dx%d %08x mask differ\n",
+		testnum, n, kind, width, height, format);
+    }
+
+    pixman_image_unref (mask1);
+    pixman_image_unref (mask2);
+
+    return ok;
+}
+
+int
+main (int argc, const char *argv[])
+{
+    int i;
+
+    prng_srand (0);
+
+    for (i = 0; i < N_TESTS; ++i)
+    {
+	if (!test_traps (i))
+	    return 1;
+    }
+
+    return 0;
+}